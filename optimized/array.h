@@ -1,3 +1,7 @@
+#pragma once
+
+#include "memory.h"
+
 #define declare_array(T)                                         \
 typedef struct {                                                 \
     T*  data;                                                    \
@@ -28,8 +32,10 @@ typedef struct {                                                    \
     T*  data;                                                       \
     u32 count;                                                      \
     u32 capacity;                                                   \
+    Arena* arena;  /* Heap allocated if NULL. */                    \
 } DynArray_##T;                                                     \
 DynArray_##T make_dynarray_##T();                                   \
+DynArray_##T make_arena_dynarray_##T(Arena* arena);                 \
 T* dynarray_##T##_get(DynArray_##T* array, u32 index);              \
 void dynarray_##T##_set(DynArray_##T* array, u32 index, T value);   \
 u32 dynarray_##T##_append(DynArray_##T* array, T value);
@@ -37,7 +43,10 @@ u32 dynarray_##T##_append(DynArray_##T* array, T value);
 
 #define define_dynarray(T)                                       \
 DynArray_##T make_dynarray_##T() {                               \
-    return (DynArray_##T) { .data=0, .count=0 };                 \
+    return (DynArray_##T) { .data=0, .count=0, .arena=NULL };    \
+}                                                                \
+DynArray_##T make_arena_dynarray_##T(Arena* arena) {             \
+    return (DynArray_##T) { .data=0, .count=0, .arena=arena };   \
 }                                                                \
 T* dynarray_##T##_get(DynArray_##T* array, u32 index) {          \
     nax_assert(index < array->count);                              \
@@ -51,7 +60,7 @@ u32 dynarray_##T##_append(DynArray_##T* array, T value) {       \
     if (array->count + 1 > array->capacity) {                    \
         u32 old_capacity = array->capacity;                      \
         array->capacity  = GROW_CAPACITY(old_capacity);          \
-        array->data      = RESIZE_ARRAY(T, array->data, old_capacity, array->capacity);  \
+        array->data      = ARENA_RESIZE_ARRAY(array->arena, T, array->data, old_capacity, array->capacity);  \
     }                                                            \
     array->data[array->count] = value;                           \
     return array->count++;                                       \
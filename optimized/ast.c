@@ -92,6 +92,25 @@ Location ast_location(Ast ast) {
     return location;
 }
 
+u32 ast_node_size(AstType type) {
+    switch (type) {
+        case AST_IDENTIFIER:  return sizeof(Ast_Identifier) / sizeof(Ast);
+        case AST_LITERAL:     return sizeof(Ast_Literal)    / sizeof(Ast);
+        case AST_BIN_OP:      return sizeof(Ast_BinOp)      / sizeof(Ast);
+        case AST_FUNC_CALL:   return sizeof(Ast_FuncCall)   / sizeof(Ast);
+        case AST_VAR_ASSIGN:  return sizeof(Ast_VarAssign)  / sizeof(Ast);
+        case AST_VAR_DECL:    return sizeof(Ast_VarDecl)    / sizeof(Ast);
+        case AST_FUNC_DECL:   return sizeof(Ast_FuncDecl)   / sizeof(Ast);
+        case AST_RETURN_STMT: return sizeof(Ast_ReturnStmt) / sizeof(Ast);
+        case AST_IF_STMT:     return sizeof(Ast_IfStmt)     / sizeof(Ast);
+        case AST_WHILE_STMT:  return sizeof(Ast_WhileStmt)  / sizeof(Ast);
+        case AST_BLOCK:       return sizeof(Ast_Block)      / sizeof(Ast);
+        case AST_MODULE:      return sizeof(Ast_Module)     / sizeof(Ast);
+        case AST_IMPORT:      return sizeof(Ast_Import)     / sizeof(Ast);
+        default: unreachable();
+    }
+}
+
 Ast_Identifier  make_identifier(Location location, u16 absolute_offset, u16 scope_local_offset, u16 scope_depth) {
     return (Ast_Identifier) {
         .ast=make_ast(AST_IDENTIFIER, location),
@@ -148,6 +167,11 @@ Ast_Block make_block(Location location, u32 stmt_count, u32 end) {
 }
 
 
+Ast_Import make_import(Location location, u32 path) {
+    return (Ast_Import) { .ast=make_ast(AST_IMPORT, location), .path=path };
+}
+
+
 Ast_Module make_module(Location location, const char* name, u32 stmt_count, u32 end) {
     return (Ast_Module) { .ast=make_ast(AST_MODULE, location), .name=name, .stmt_count=stmt_count, .end=end };
 }
@@ -101,6 +101,7 @@ typedef enum {
     AST_WHILE_STMT,
     AST_BLOCK,
     AST_MODULE,
+    AST_IMPORT,
 
     AST_INVALID = 0b11111110,
     AST_COUNT,
@@ -118,6 +119,8 @@ typedef struct {
 static_assert(sizeof(Ast) == 8 && sizeof(Ast) == sizeof(Location), "ast_and_location_must_be_the_same");
 Ast make_ast(AstType type, Location location);
 Location ast_location(Ast ast);
+// Size in Ast units of the node itself, excluding its children.
+u32 ast_node_size(AstType type);
 
 
 /* An expression with a named value. */
@@ -249,6 +252,16 @@ typedef struct {
 Ast_Block make_block(Location location, u32 stmt_count, u32 end);
 
 
+typedef struct {
+    Ast ast;
+    // An index in parser->strings to the (quoted) path.
+    u32 path;
+    u32 _pad1;
+} Ast_Import;
+static_assert(sizeof(Ast_Import) == 2*sizeof(Ast), "waste");
+Ast_Import make_import(Location location, u32 path);
+
+
 typedef struct {
     Ast ast;
     const char* name;
@@ -1,306 +1,877 @@
-#include <stdio.h>
-#include <errno.h>
+#include "c_target.h"
+#include "memory.h"
+
+#include <stdarg.h>
 #include <stdlib.h>
-#include <string.h>  // memcpy
-#define panic(...)     (fprintf(stderr, "[PANIC]: %s:%d\: ", __FILE__, __LINE__), fprintf(stderr, __VA_ARGS__), exit(errno))
-#define assert(x, ...) (x) ? (void*)0 : (fprintf(stderr, "[ASSERT]: %s:%d: ", __FILE__, __LINE__), fprintf(stderr, __VA_ARGS__), exit(errno), (void*)0)
-
-
-#include <stdbool.h>
-#include <stddef.h>
-#include <stdint.h>
-
-
-// ---- Types ----
-typedef uint8_t   u8;
-typedef uint16_t  u16;
-typedef uint32_t  u32;
-typedef uint64_t  u64;
-
-typedef int8_t    i8;
-typedef int16_t   i16;
-typedef int32_t   i32;
-typedef int64_t   i64;
-
-typedef float     f32;
-typedef double    f64;
-
-typedef size_t    usize;
-typedef ptrdiff_t isize;
-
-typedef u32       rune;   // Unicode code point.
-typedef char      utf8;   // Unicode byte.
-
-
-//// ---- Optional ----
-//typedef i32 optional_type;
-//struct c_optional_type_optional {
-//    optional_type value; // where value != 10
-//};
-//static inline bool c_optional_type_is_valid(struct c_optional_type_optional optional) {
-//    return optional.value != 10;
-//}
-//static inline optional_type c_optional_type_get_or(struct c_optional_type_optional optional, optional_type value) {
-//    return c_optional_type_is_valid(optional) ? optional.value : value;
-//}
-//static inline optional_type c_optional_type_unsafe_get(struct c_optional_type_optional optional) {
-//    assert(c_optional_type_is_valid(optional), "Unsafe get of '%s' with value '%d'", "c_optional_type_optional", optional.value);
-//    return optional.value;
-//}
-//static inline struct c_optional_type_optional c_optional_type_make(optional_type value) {
-//    return (struct c_optional_type_optional) { value };
-//}
-//
-//
-//// ---- Allocator ----
-//// @NOTE: Pushing global allocators must be known at compile-time. We'll
-////  calculate the minimum required size and allocate a static array to
-////  contain all global allocator data. The global allocators must be
-////  thread-safe. Pushing and popping is only allowed in the main thread,
-////  as that'll allow us to use a stack.
-////      Example:
-////          @with_global_allocator(my_allocator) {
-////              // Will use the thread-safe global allocator.
-////              thread.make(my_function)
-////              // A thread that is started within a global allocator block
-////              // must be terminated within the block!
-////              thread.join();
-////          }
-////
-//// @NOTE: You can't nest the push of global allocators, as its effect is
-////  global. The reason for pushing allocators is to get fallback
-////  alternatives.
-////
-//// @NOTE: You can also push allocators to the thread-local temporary
-////  storage.
-////      Example:
-////          @with_allocator(my_allocator) {
-////              // Will use the thread-local allocator.
-////              my_function();
-////          }
-////          // Will send the thread-local allocator to a
-////          // new thread. NOTE! It's not allowed to access
-////          // the allocator in the current thread after it
-////          // has been sent to another thread.
-////          thread.make(my_function, my_allocator);
-////
-//// @NOTE: Pushing thread-local allocators can be nested.
-////
-//// @NOTE: If the program doesn't push any global allocators, then a
-////  non thread-safe allocator will be automatically pushed on the
-////  global stack.
-////
-//// @NOTE: Each allocator is aligned to the 64 byte boundary. This
-////  simplifies stack indexing and avoids false-sharing of shared
-////  allocators (even if that is expected to be very minimal).
-////
-//typedef struct allocator_t {
-//    u8 data[64];
-//} allocator_t;
-//
-//#define ALLOCATOR_FREED_VALUE 0xCC
-//
-//bool allocator_is_freed(allocator_t* allocator) {
-//    for (usize i = 0; i < sizeof(*allocator); ++i) {
-//        if (allocator->data[i] != ALLOCATOR_FREED_VALUE) {
-//            return false;
-//        }
-//    }
-//    return true;
-//}
-//
-//
-//#define GLOBAL_ALLOCATOR_STACK_CAPACITY 8
-//static allocator_t global_allocator_stack[GLOBAL_ALLOCATOR_STACK_CAPACITY]  = { 0 };
-//static isize global_allocator_stack_current = -1;
-//
-//// @NOTE: Is thread-safe as only the main thread can create global allocators.
-//static void global_allocator_stack_push(allocator_t* custom_allocator) {
-//    assert(global_allocator_stack_current + 1 <= GLOBAL_ALLOCATOR_STACK_CAPACITY, "Global stack allocator capacity exceeded!");
-//
-//    global_allocator_stack_current += 1;
-//    allocator_t* allocator = &global_allocator_stack[global_allocator_stack_current];
-//
-//    assert(allocator_is_freed(allocator), "Previous allocator wasn't freed!");
-//    memcpy(allocator, custom_allocator, sizeof(allocator_t));
-//
-//    // @NOTE: The allocator is consumed.
-//    memset(custom_allocator, ALLOCATOR_FREED_VALUE, sizeof(*custom_allocator));
-//}
-//
-//// @TODO: Lock!
-//// @NOTE: This function is shared between all threads.
-//static void* global_allocator_stack_allocate(usize size) {
-//    for (isize i = global_allocator_stack_current; i > -1; --i) {
-//        void* memory = allocate(&global_allocator_stack[i], size);
-//        if (memory)
-//            return memory;
-//    }
-//    return malloc(size);
-//}
-//
-//// @NOTE: Is thread-safe as only the main thread can remove global allocators.
-//static void global_allocator_stack_remove() {
-//    assert(global_allocator_stack_current >= 0, "Can't remove the system allocator.");
-//    allocator_t* allocator = &global_allocator_stack[global_allocator_stack_current];
-//
-//    assert(!allocator_is_freed(allocator), "Allocator has already been freed!");
-//    memset(allocator, ALLOCATOR_FREED_VALUE, sizeof(allocator_t));
-//}
-//
-//
-//// @NOTE: Lazily and dynamically allocated per thread.
-//__thread allocator_t* thread_local_allocator_stack   =  0;
-//__thread isize thread_local_allocator_stack_current  = -1;
-//__thread isize thread_local_allocator_stack_capacity =  0;
-//
-//// @NOTE: Is thread-safe as each thread will have its own allocator stack.
-//static void thread_local_allocator_push(allocator_t* custom_allocator) {
-//    if (thread_local_allocator_stack_current + 1 >= thread_local_allocator_stack_capacity) {
-//        isize grow_count = (thread_local_allocator_stack_current == 0) ? 8 : 2 * thread_local_allocator_stack_current;
-//        thread_local_allocator_stack = (allocator_t*) global_allocator_stack_allocate(grow_count * sizeof(allocator_t));
-//        assert(thread_local_allocator_stack != NULL, "Could not allocate more memory for thread allocator.");
-//    }
-//
-//    thread_local_allocator_stack_current += 1;
-//    allocator_t* allocator = &thread_local_allocator_stack[thread_local_allocator_stack_current];
-//
-//    assert(allocator_is_freed(allocator), "Previous allocator wasn't freed!");
-//    memcpy(allocator, custom_allocator, sizeof(allocator_t));
-//
-//    // @NOTE: The allocator is consumed.
-//    memset(custom_allocator, ALLOCATOR_FREED_VALUE, sizeof(*custom_allocator));
-//}
-//
-//// @NOTE: Is thread-safe as each thread will have its own allocator stack.
-//static void* thread_local_allocator_allocate(usize size) {
-//    for (isize i = thread_local_allocator_stack_current; i > -1; --i) {
-//        void* memory = allocate(&thread_local_allocator_stack[i], size);
-//        if (memory)
-//            return memory;
-//    }
-//    return global_allocator_stack_allocate(size);
-//}
-//
-//// @NOTE: Is thread-safe as each thread will have its own allocator stack.
-//static void thread_local_allocator_remove() {
-//    assert(thread_local_allocator_stack_current >= 0, "No allocator to remove!");
-//    allocator_t* allocator = &thread_local_allocator_stack[thread_local_allocator_stack_current--];
-//
-//    assert(!allocator_is_freed(allocator), "Allocator has already been freed!");
-//    memset(allocator, ALLOCATOR_FREED_VALUE, sizeof(allocator_t));
-//}
-//
-typedef struct {
-    void* d;
-} array;
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 
+/* Global variables are named `g<module>_<name>`, functions
+ * `f<module>_<name>` and locals `v_<name>`, so nothing collides with
+ * the prelude or C keywords, and C's block scoping matches ours. */
 
 typedef struct {
-    u64 id;
-    i64 join;  // > 0 == AND, < 0 == OR, abs(join) == index.
-} ir_constraint;
+    Ast_FuncDecl* node;
+    Slice         name;
+    // PrimitiveType_inferred until a return with a known type is found,
+    // and PrimitiveType_null if the function never returns a value.
+    PrimitiveType return_type;
+    bool          is_called;
+} CFunction;
 
 typedef struct {
-    u64 id;
-    ir_constraint* constraints;
-} ir_type;
+    const char*   name;
+    const char*   function;
+    PrimitiveType result;
+    u32           arity;
+    // Called as `function` followed by the type name of the argument.
+    bool          is_generic;
+} CNative;
+
+static const CNative C_NATIVES[] = {
+    { "print", "chain_print_", PrimitiveType_null, 1, true  },
+    { "clock", "chain_clock",  PrimitiveType_f64,  0, false },
+};
+
 
 typedef struct {
-    ir_type type;
-    char*   name;
+    // Nothing is written while the types are inferred.
+    FILE*   out;
+    Parser* parser;
+    u8*     base;
+    u32     module;
+
+    // Indexed by the declarations, which are the offsets of the var
+    // declarations and parameters in the module. Parameters of different
+    // functions may share the same identifier, so it's not used.
+    Ast*           ast;
+    PrimitiveType* types;
+    bool*          is_global;
+    u32*           names;
+    u32            declaration_count;
+    // Set when a type was inferred, until nothing more can be inferred.
+    bool           changed;
+
+    CFunction* functions;
+    u32        function_count;
+    // NULL for the top-level code of the module.
+    CFunction* function;
+
+    // Declared variables in scope, innermost last.
+    DynArray_u32 scope;
+    DynArray_u32 globals;
+    u32          depth;
+    int          indent;
+
+    Error errors[C_TARGET_MAX_ERRORS];
+    int   error_count;
+} CTarget;
+
+
+static const char* PRELUDE =
+    "#include <inttypes.h>\n"
+    "#include <math.h>\n"
+    "#include <stdbool.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <time.h>\n"
+    "\n"
+    "typedef int64_t  i64;\n"
+    "typedef uint64_t u64;\n"
+    "typedef double   f64;\n"
+    "\n"
+    "static void chain_print_i64(i64 x)            { printf(\"%\" PRId64 \"\\n\", x); }\n"
+    "static void chain_print_u64(u64 x)            { printf(\"%\" PRIu64 \"\\n\", x); }\n"
+    "static void chain_print_f64(f64 x)            { printf(\"%g\\n\", x); }\n"
+    "static void chain_print_bool(bool x)          { printf(\"%s\\n\", x ? \"true\" : \"false\"); }\n"
+    "static void chain_print_string(const char* x) { printf(\"%s\\n\", x); }\n"
+    "static f64  chain_clock(void)                 { return (f64) clock() / CLOCKS_PER_SEC; }\n"
+    "\n"
+    "__attribute__((noreturn)) static void chain_runtime_error(const char* message) {\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"[Runtime error]: %s.\\n\", message);\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "static i64 chain_div_i64(i64 a, i64 b) {\n"
+    "    if (b == 0) chain_runtime_error(\"Division by zero\");\n"
+    "    return (b == -1) ? (i64) (0 - (u64) a) : a / b;\n"
+    "}\n"
+    "static i64 chain_mod_i64(i64 a, i64 b) {\n"
+    "    if (b == 0) chain_runtime_error(\"Division by zero\");\n"
+    "    return (b == -1) ? 0 : a % b;\n"
+    "}\n"
+    "\n";
+
+
+static void put(CTarget* self, const char* format, ...) {
+    if (!self->out)
+        return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(self->out, format, args);
+    va_end(args);
+}
+
+static void put_indent(CTarget* self) {
+    put(self, "%*s", 4 * self->indent, "");
+}
+
+static void put_variable(CTarget* self, u32 declaration) {
+    Slice name = self->parser->variables.data[self->names[declaration]];
+    if (self->is_global[declaration])
+        put(self, "g%u_%.*s", self->module, name.count, name.source);
+    else
+        put(self, "v_%.*s", name.count, name.source);
+}
+
+static void put_function(CTarget* self, CFunction* function) {
+    put(self, "f%u_%.*s", self->module, function->name.count, function->name.source);
+}
+
+
+/* Errors are only reported once the types are known, when writing. */
+static void c_target_error(CTarget* self, Ast* node, ErrorCode code, Slice arg) {
+    if (!self->out || self->error_count >= C_TARGET_MAX_ERRORS)
+        return;
+
+    self->errors[self->error_count++] = (Error) {
+        .code     = code,
+        .start    = ast_location(*node),
+        .count    = 1,
+        .arg      = arg,
+        .path     = self->parser->path,
+        .source   = self->parser->source,
+        .function = self->function ? self->function->name : SLICE("script"),
+    };
+}
+
+static Slice type_name(PrimitiveType type) {
+    return PrimitiveType_TYPE_NAMES[type];
+}
+
+static const char* c_type(PrimitiveType type) {
+    switch (type) {
+        case PrimitiveType_i64:    return "i64";
+        case PrimitiveType_u64:    return "u64";
+        case PrimitiveType_f64:    return "f64";
+        case PrimitiveType_bool:   return "bool";
+        case PrimitiveType_string: return "const char*";
+        case PrimitiveType_null:   return "void";
+        default:                   return NULL;
+    }
+}
+
+static void infer(CTarget* self, PrimitiveType* type, PrimitiveType inferred) {
+    if (*type == PrimitiveType_inferred && inferred != PrimitiveType_inferred) {
+        *type = inferred;
+        self->changed = true;
+    }
+}
+
+static void check_type(CTarget* self, Ast* node, PrimitiveType expected, PrimitiveType actual) {
+    if (expected != PrimitiveType_inferred && actual != PrimitiveType_inferred && expected != actual)
+        c_target_error(self, node, COMPILE_ERROR_MISMATCHED_TYPES, type_name(expected));
+}
+
+
+static u32 declaration_of(CTarget* self, Ast* node) {
+    return (u32) (node - self->ast);
+}
+
+static void declare(CTarget* self, u32 declaration, u32 variable) {
+    self->names[declaration] = variable;
+    dynarray_u32_append(&self->scope, declaration);
+}
+
+/* Identifiers with the same name in different depths have different
+ * ids, so they're matched by name through the scope, as in the IR. */
+static bool resolve(CTarget* self, u32 variable, u32* declaration) {
+    Slice name = self->parser->variables.data[variable];
+    for (u32 i = self->scope.count; i > 0; --i) {
+        u32 candidate = self->scope.data[i-1];
+        if (self->names[candidate] == variable || slice_equals(self->parser->variables.data[self->names[candidate]], name)) {
+            *declaration = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static CFunction* find_function(CTarget* self, Slice name) {
+    for (u32 i = 0; i < self->function_count; ++i) {
+        if (slice_equals(self->functions[i].name, name))
+            return &self->functions[i];
+    }
+    return NULL;
+}
+
+static const CNative* find_native(Slice name) {
+    for (u32 i = 0; i < sizeof(C_NATIVES) / sizeof(*C_NATIVES); ++i) {
+        if (slice_equals(slice_make(C_NATIVES[i].name, (int) strlen(C_NATIVES[i].name)), name))
+            return &C_NATIVES[i];
+    }
+    return NULL;
+}
+
+
+/* ---- Expressions ---- */
+
+static PrimitiveType emit_expression(CTarget* self, Ast* node, Ast** next);
+
+// The type of an expression, without writing it.
+static PrimitiveType type_of(CTarget* self, Ast* node) {
+    FILE* out = self->out;
+    self->out = NULL;
+    Ast* next;
+    PrimitiveType type = emit_expression(self, node, &next);
+    self->out = out;
+    return type;
+}
+
+static PrimitiveType emit_identifier(CTarget* self, Ast_Identifier* node) {
+    u32 variable;
+    if (!resolve(self, node->absolute_offset, &variable)) {
+        c_target_error(self, (Ast*) node, COMPILE_ERROR_UNDEFINED_VARIABLE, self->parser->variables.data[node->absolute_offset]);
+        return PrimitiveType_inferred;
+    }
+    put_variable(self, variable);
+    return self->types[variable];
+}
+
+static PrimitiveType emit_literal(CTarget* self, Ast_Literal* node) {
+    switch (node->type) {
+        case PrimitiveType_i64: {
+            // @NOTE: INT64_MIN can't be written as a literal.
+            if (node->value.int_ == INT64_MIN)
+                put(self, "INT64_MIN");
+            else
+                put(self, "INT64_C(%lld)", (long long) node->value.int_);
+            return PrimitiveType_i64;
+        }
+        case PrimitiveType_u64: {
+            put(self, "UINT64_C(%llu)", (unsigned long long) node->value.uint_);
+            return PrimitiveType_u64;
+        }
+        case PrimitiveType_f64: {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.17g", node->value.float_);
+            put(self, "%s%s", buffer, strpbrk(buffer, ".en") ? "" : ".0");
+            return PrimitiveType_f64;
+        }
+        case PrimitiveType_string: {
+            // The view includes the quotes.
+            Slice view = self->parser->strings.data[(u32) node->value.string];
+            put(self, "\"");
+            for (int i = 1; i < view.count - 1; ++i) {
+                char c = view.source[i];
+                if (c == '\\' || c == '"') put(self, "\\%c", c);
+                else if (c == '\n')        put(self, "\\n");
+                else                       put(self, "%c", c);
+            }
+            put(self, "\"");
+            return PrimitiveType_string;
+        }
+        default: {
+            c_target_error(self, (Ast*) node, COMPILE_ERROR_UNSUPPORTED_OPERATION, type_name(node->type));
+            return PrimitiveType_inferred;
+        }
+    }
+}
+
+static PrimitiveType emit_bin_op(CTarget* self, Ast_BinOp* node, Ast** next) {
+    Ast* left  = bin_op_left(node);
+    Ast* right = bin_op_right(node);
+
+    // While inferring, the operands are only walked once.
+    PrimitiveType left_type  = self->out ? type_of(self, left)  : emit_expression(self, left,  next);
+    PrimitiveType right_type = self->out ? type_of(self, right) : emit_expression(self, right, next);
+    PrimitiveType type       = (left_type != PrimitiveType_inferred) ? left_type : right_type;
+    check_type(self, (Ast*) node, left_type, right_type);
+
+    bool is_integer = type == PrimitiveType_i64 || type == PrimitiveType_u64;
+    bool is_number  = is_integer || type == PrimitiveType_f64;
+
+    // Written as `prefix left infix right suffix`.
+    const char* prefix = "(";
+    const char* infix  = NULL;
+    const char* suffix = ")";
+    PrimitiveType result = type;
+    switch (node->op) {
+        case Add:
+        case Sub:
+        case Mul: {
+            const char* op = (node->op == Add) ? " + " : (node->op == Sub) ? " - " : " * ";
+            if (type == PrimitiveType_i64) {
+                // @NOTE: Overflow wraps around, as in the VM.
+                prefix = "(i64) ((u64) ";
+                infix  = (node->op == Add) ? " + (u64) " : (node->op == Sub) ? " - (u64) " : " * (u64) ";
+            } else if (is_number) {
+                infix = op;
+            }
+            break;
+        }
+        case Div: {
+            if (type == PrimitiveType_i64) {
+                prefix = "chain_div_i64(";
+                infix  = ", ";
+            } else if (is_number) {
+                infix = " / ";
+            }
+            break;
+        }
+        case Mod: {
+            if (type == PrimitiveType_i64) {
+                prefix = "chain_mod_i64(";
+                infix  = ", ";
+            } else if (type == PrimitiveType_u64) {
+                infix = " % ";
+            } else if (type == PrimitiveType_f64) {
+                prefix = "fmod(";
+                infix  = ", ";
+            }
+            break;
+        }
+        case Lt: case Le: case Ge: case Gt: {
+            result = PrimitiveType_bool;
+            if (is_number) {
+                infix = (node->op == Lt) ? " < " : (node->op == Le) ? " <= " : (node->op == Ge) ? " >= " : " > ";
+            }
+            break;
+        }
+        case Eq: case Ne: {
+            result = PrimitiveType_bool;
+            if (type == PrimitiveType_string) {
+                prefix = "(strcmp(";
+                infix  = ", ";
+                suffix = (node->op == Eq) ? ") == 0)" : ") != 0)";
+            } else if (is_number || type == PrimitiveType_bool) {
+                infix = (node->op == Eq) ? " == " : " != ";
+            }
+            break;
+        }
+        case And: case Or: {
+            // @NOTE: Only on bools, as C has no value for the left
+            //  operand of another type to fall back on.
+            if (type == PrimitiveType_bool)
+                infix = (node->op == And) ? " && " : " || ";
+            break;
+        }
+        default: unreachable();
+    }
+
+    if (!infix && type != PrimitiveType_inferred)
+        c_target_error(self, (Ast*) node, COMPILE_ERROR_UNSUPPORTED_OPERATION, type_name(type));
+
+    if (self->out) {
+        put(self, "%s", prefix);
+        emit_expression(self, left, next);
+        put(self, "%s", infix ? infix : " ? ");
+        emit_expression(self, right, next);
+        put(self, "%s", suffix);
+    }
+    return result;
+}
+
+static PrimitiveType emit_func_call(CTarget* self, Ast_FuncCall* node, Ast** next) {
+    Slice      name     = self->parser->variables.data[node->name];
+    CFunction* function = find_function(self, name);
+    const CNative* native = function ? NULL : find_native(name);
+
+    Ast* argument = (Ast*) (node + 1);
+    if (!function && !native) {
+        c_target_error(self, (Ast*) node, COMPILE_ERROR_UNDEFINED_FUNCTION, name);
+        for (u32 i = 0; i < node->arg_count; ++i)
+            emit_expression(self, argument, &argument);
+        *next = argument;
+        return PrimitiveType_inferred;
+    }
+
+    u32 arity = function ? function->node->param_count : native->arity;
+    if (node->arg_count != arity)
+        c_target_error(self, (Ast*) node, COMPILE_ERROR_WRONG_ARGUMENT_COUNT, name);
+
+    if (function) {
+        function->is_called = true;
+        put_function(self, function);
+    } else if (native->is_generic && node->arg_count > 0) {
+        PrimitiveType type = type_of(self, argument);
+        bool is_printable = type != PrimitiveType_inferred && type != PrimitiveType_null;
+        if (!is_printable && type != PrimitiveType_inferred)
+            c_target_error(self, argument, COMPILE_ERROR_UNSUPPORTED_OPERATION, type_name(type));
+        put(self, "%s%.*s", native->function, type_name(type).count, type_name(type).source);
+    } else {
+        put(self, "%s", native->function);
+    }
+
+    put(self, "(");
+    Ast_Identifier* params = function ? (Ast_Identifier*) (function->node + 1) : NULL;
+    for (u32 i = 0; i < node->arg_count; ++i) {
+        if (i > 0)
+            put(self, ", ");
+        Ast* start = argument;
+        PrimitiveType type = emit_expression(self, argument, &argument);
+        if (params && i < arity) {
+            PrimitiveType* param = &self->types[declaration_of(self, (Ast*) &params[i])];
+            check_type(self, start, *param, type);
+            infer(self, param, type);
+        }
+    }
+    put(self, ")");
+
+    *next = argument;
+    if (function)
+        return function->return_type;
+    return native->result;
+}
+
+static PrimitiveType emit_expression(CTarget* self, Ast* node, Ast** next) {
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            *next = (Ast*) (((Ast_Identifier*) node) + 1);
+            return emit_identifier(self, (Ast_Identifier*) node);
+        }
+        case AST_LITERAL: {
+            *next = (Ast*) (((Ast_Literal*) node) + 1);
+            return emit_literal(self, (Ast_Literal*) node);
+        }
+        case AST_BIN_OP:    return emit_bin_op(self,    (Ast_BinOp*) node,    next);
+        case AST_FUNC_CALL: return emit_func_call(self, (Ast_FuncCall*) node, next);
+        default: {
+            PANIC("Not an expression");
+            return PrimitiveType_inferred;
+        }
+    }
+}
+
+
+/* ---- Statements ---- */
+
+static Ast* emit_statement(CTarget* self, Ast* node);
+
+static Ast* emit_var_decl(CTarget* self, Ast_VarDecl* node) {
+    Ast* expression = (Ast*) (node + 1);
+    PrimitiveType type = type_of(self, expression);
+
+    u32  declaration = declaration_of(self, (Ast*) node);
+    bool is_global   = self->function == NULL && self->depth == 0;
+    self->names[declaration] = node->name;
+    if (is_global) {
+        self->is_global[declaration] = true;
+        dynarray_u32_append(&self->globals, declaration);
+    }
+
+    PrimitiveType* variable = &self->types[declaration];
+    check_type(self, (Ast*) node, *variable, type);
+    infer(self, variable, type);
+
+    const char* declared = c_type(*variable);
+    if (!declared || *variable == PrimitiveType_null) {
+        Slice name = self->parser->variables.data[node->name];
+        c_target_error(self, (Ast*) node, COMPILE_ERROR_CANT_INFER_TYPE, name);
+    }
+
+    // @NOTE: Declared after the initializer is written, so it can't
+    //  refer to itself.
+    put_indent(self);
+    if (!is_global)
+        put(self, "%s ", declared ? declared : "void");
+    put_variable(self, declaration);
+    put(self, " = ");
+    Ast* next;
+    emit_expression(self, expression, &next);
+    put(self, ";\n");
+
+    declare(self, declaration, node->name);
+    return next;
+}
+
+static Ast* emit_var_assign(CTarget* self, Ast_VarAssign* node) {
+    Ast* expression = (Ast*) (node + 1);
+    Ast* next;
 
-    bool is_mutable;
-    bool is_reference;
-} ir_param;
+    u32 variable;
+    if (!resolve(self, node->name, &variable)) {
+        c_target_error(self, (Ast*) node, COMPILE_ERROR_UNDEFINED_VARIABLE, self->parser->variables.data[node->name]);
+        emit_expression(self, expression, &next);
+        return next;
+    }
+
+    PrimitiveType type = type_of(self, expression);
+    check_type(self, (Ast*) node, self->types[variable], type);
+    infer(self, &self->types[variable], type);
 
+    put_indent(self);
+    put_variable(self, variable);
+    put(self, " = ");
+    emit_expression(self, expression, &next);
+    put(self, ";\n");
+    return next;
+}
+
+static Ast* emit_return_stmt(CTarget* self, Ast_ReturnStmt* node) {
+    Ast* expression = (Ast*) (node + 1);
+    PrimitiveType type = type_of(self, expression);
+
+    PrimitiveType* return_type = &self->function->return_type;
+    check_type(self, (Ast*) node, *return_type, type);
+    infer(self, return_type, type);
+
+    Ast* next;
+    put_indent(self);
+    if (*return_type == PrimitiveType_null || *return_type == PrimitiveType_inferred) {
+        // Returns the result of a function that never returns a value.
+        put(self, "{ ");
+        emit_expression(self, expression, &next);
+        put(self, "; return; }\n");
+    } else {
+        put(self, "return ");
+        emit_expression(self, expression, &next);
+        put(self, ";\n");
+    }
+    return next;
+}
 
-void check_function_def(const char* function_name, array params) {
-    // Store name in lookup table.
-    // Store types and constraints for each parameter.
-    // Evaluate default values and type match.
-    // Evaluate statements.
-    // Evaluate return value.
-    //
+static void emit_condition(CTarget* self, Ast* condition, Ast** next) {
+    check_type(self, condition, PrimitiveType_bool, type_of(self, condition));
+    emit_expression(self, condition, next);
 }
 
+static Ast* emit_block_statements(CTarget* self, Ast_Block* node) {
+    u32 scope_count = self->scope.count;
+    self->depth  += 1;
+    self->indent += 1;
+
+    Ast* statement = (Ast*) (node + 1);
+    for (u32 i = 0; i < node->stmt_count; ++i) {
+        statement = emit_statement(self, statement);
+    }
+
+    self->indent -= 1;
+    self->depth  -= 1;
+    self->scope.count = scope_count;
+    return (Ast*) node + node->end;
+}
 
-void check_function_call(const char* function_name, array args) {
-    // Fetch function definition
-    // Check parity
-    // Evaluate argument expression types.
-    // Type match parameters and arguments.
-    //
+// Writes the braces without a trailing newline.
+static Ast* emit_block(CTarget* self, Ast_Block* node) {
+    put(self, "{\n");
+    Ast* next = emit_block_statements(self, node);
+    put_indent(self);
+    put(self, "}");
+    return next;
 }
 
+static Ast* emit_if_stmt(CTarget* self, Ast_IfStmt* node) {
+    Ast* body;
+    put(self, "if (");
+    emit_condition(self, (Ast*) (node + 1), &body);
+    put(self, ") ");
+    emit_block(self, (Ast_Block*) body);
+
+    // An else-node is followed directly by its block, while an
+    // else-if is a nested if-statement with a condition.
+    if (node->next != node->end) {
+        Ast_IfStmt* else_ = (Ast_IfStmt*) (self->base + node->next);
+        Ast* after_else = (Ast*) (else_ + 1);
+        put(self, " else ");
+        if (after_else->type == AST_BLOCK)
+            emit_block(self, (Ast_Block*) after_else);
+        else
+            emit_if_stmt(self, else_);
+    }
+    return (Ast*) (self->base + node->end);
+}
+
+static Ast* emit_while_stmt(CTarget* self, Ast_WhileStmt* node) {
+    Ast* body;
+    put_indent(self);
+    put(self, "while (");
+    emit_condition(self, (Ast*) (node + 1), &body);
+    put(self, ") ");
+    emit_block(self, (Ast_Block*) body);
+    put(self, "\n");
+    return (Ast*) (self->base + node->end);
+}
+
+static Ast* emit_statement(CTarget* self, Ast* node) {
+    switch (node->type) {
+        case AST_VAR_DECL:    return emit_var_decl(self,    (Ast_VarDecl*) node);
+        case AST_VAR_ASSIGN:  return emit_var_assign(self,  (Ast_VarAssign*) node);
+        case AST_RETURN_STMT: return emit_return_stmt(self, (Ast_ReturnStmt*) node);
+        case AST_WHILE_STMT:  return emit_while_stmt(self,  (Ast_WhileStmt*) node);
+        case AST_FUNC_DECL: {
+            // @NOTE: Written on their own, as C has no nested functions.
+            Ast_FuncDecl* function = (Ast_FuncDecl*) node;
+            Ast_Block*    body     = (Ast_Block*) ((Ast*) function + function->next);
+            return (Ast*) body + body->end;
+        }
+        case AST_IF_STMT: {
+            put_indent(self);
+            Ast* next = emit_if_stmt(self, (Ast_IfStmt*) node);
+            put(self, "\n");
+            return next;
+        }
+        case AST_BLOCK: {
+            put_indent(self);
+            Ast* next = emit_block(self, (Ast_Block*) node);
+            put(self, "\n");
+            return next;
+        }
+        case AST_IMPORT: {
+            return (Ast*) (((Ast_Import*) node) + 1);
+        }
+        default: {
+            Ast* next;
+            put_indent(self);
+            emit_expression(self, node, &next);
+            put(self, ";\n");
+            return next;
+        }
+    }
+}
 
 
+/* ---- Functions and modules ---- */
 
+static bool is_emitted(CFunction* function) {
+    // Functions that are never called may not have known parameter types.
+    return function->is_called;
+}
 
+static PrimitiveType return_type(CFunction* function) {
+    return (function->return_type == PrimitiveType_inferred) ? PrimitiveType_null : function->return_type;
+}
 
+static void emit_signature(CTarget* self, CFunction* function) {
+    put(self, "static %s ", c_type(return_type(function)));
+    put_function(self, function);
+    put(self, "(");
+
+    Ast_Identifier* params = (Ast_Identifier*) (function->node + 1);
+    for (u32 i = 0; i < function->node->param_count; ++i) {
+        u32 param = declaration_of(self, (Ast*) &params[i]);
+        const char* type = c_type(self->types[param]);
+        if (!type || self->types[param] == PrimitiveType_null) {
+            c_target_error(self, (Ast*) &params[i], COMPILE_ERROR_CANT_INFER_TYPE, self->parser->variables.data[params[i].absolute_offset]);
+            type = "void";
+        }
+        put(self, "%s%s ", (i > 0) ? ", " : "", type);
+        put_variable(self, param);
+    }
+    put(self, "%s)", (function->node->param_count == 0) ? "void" : "");
+}
 
-#include <pthread.h>
-#include <stdio.h>
+static void emit_function(CTarget* self, CFunction* function) {
+    self->function    = function;
+    self->depth       = 0;
+    self->scope.count = 0;
+    for (u32 i = 0; i < self->globals.count; ++i)
+        dynarray_u32_append(&self->scope, self->globals.data[i]);
+
+    Ast_Identifier* params = (Ast_Identifier*) (function->node + 1);
+    for (u32 i = 0; i < function->node->param_count; ++i)
+        declare(self, declaration_of(self, (Ast*) &params[i]), params[i].absolute_offset);
+
+    if (self->out)
+        emit_signature(self, function);
+    put(self, " {\n");
+    emit_block_statements(self, (Ast_Block*) ((Ast*) function->node + function->node->next));
+
+    // @NOTE: The VM returns null when falling off the end of a function,
+    //  but C has no such value for the other types.
+    if (return_type(function) != PrimitiveType_null)
+        put(self, "    chain_runtime_error(\"Function ended without returning a value\");\n");
+    put(self, "}\n\n");
+    self->function = NULL;
+}
 
+static void emit_module_body(CTarget* self, Ast_Module* module) {
+    self->function      = NULL;
+    self->depth         = 0;
+    self->scope.count   = 0;
+    self->globals.count = 0;
 
-void write_color(f64 r /* where 0 <= r <= 1 */, f64 g /* where 0 <= g <= 1 */, f64 b /* where 0 <= b <= 1 */, FILE* fd) {
-    int ir = (int) (255.999 * r);
-    int ig = (int) (255.999 * g);
-    int ib = (int) (255.999 * b);
-    fprintf(fd, "%d %d %d\n", ir, ig, ib);
+    Ast* statement = (Ast*) (module + 1);
+    for (u32 i = 0; i < module->stmt_count; ++i) {
+        statement = emit_statement(self, statement);
+    }
 }
 
-void render(int image_width /* where image_width > 1 */, int image_height /* where image_width > 1 */, FILE* fd) {
-    fprintf(fd, "P3\n%d %d\n255\n", image_width, image_height);
 
-    for (int j = image_height-1; j >= 0; --j) {
-        printf("Progress: %.2f%%\r", (f64) (image_height-j) / (f64) image_height);
-        for (int i = 0; i < image_width; ++i) {
-            f64 r = (f64) (i) / (f64) (image_width  - 1);
-            f64 g = (f64) (j) / (f64) (image_height - 1);
-            f64 b = 0.25;
+static CTarget c_target_make(Module* module, u32 index) {
+    Parser* parser = &module->parser;
+    CTarget self = (CTarget) {
+        .out               = NULL,
+        .parser            = parser,
+        .base              = parser->buffer.data,
+        .module            = index,
+        .ast               = (Ast*) module->ast,
+        .declaration_count = module->ast->end + 1,
+        .scope             = make_dynarray_u32(),
+        .globals           = make_dynarray_u32(),
+        .indent            = 0,
+        .error_count       = 0,
+    };
+
+    self.types     = ALLOCATE_ARRAY(PrimitiveType, self.declaration_count);
+    self.is_global = ALLOCATE_ARRAY(bool,          self.declaration_count);
+    self.names     = ALLOCATE_ARRAY(u32,           self.declaration_count);
+    for (u32 i = 0; i < self.declaration_count; ++i) {
+        self.types[i]     = PrimitiveType_inferred;
+        self.is_global[i] = false;
+        self.names[i]     = 0;
+    }
 
-            if (i % j == 12)
-                r *= 1.2;
+    // As the nodes are laid out contiguously in pre-order, all functions
+    // (also the nested ones) are found in a single scan.
+    Ast* node = (Ast*) (module->ast + 1);
+    Ast* end  = (Ast*) module->ast + module->ast->end;
+    for (Ast* it = node; it < end; it += ast_node_size(it->type)) {
+        if (it->type == AST_FUNC_DECL)
+            self.function_count += 1;
+    }
+    self.functions = ALLOCATE_ARRAY(CFunction, self.function_count + 1);
+    u32 count = 0;
+    for (Ast* it = node; it < end; it += ast_node_size(it->type)) {
+        if (it->type == AST_FUNC_DECL) {
+            Ast_FuncDecl* function = (Ast_FuncDecl*) it;
+            self.functions[count++] = (CFunction) {
+                .node        = function,
+                .name        = parser->variables.data[function->name],
+                .return_type = PrimitiveType_inferred,
+                .is_called   = false,
+            };
+        }
+    }
+    return self;
+}
+
+static void c_target_free(CTarget* self) {
+    FREE_ARRAY(PrimitiveType, self->types,     self->declaration_count);
+    FREE_ARRAY(bool,          self->is_global, self->declaration_count);
+    FREE_ARRAY(u32,           self->names,     self->declaration_count);
+    FREE_ARRAY(CFunction,     self->functions, self->function_count + 1);
+    FREE_ARRAY(u32, self->scope.data,   self->scope.capacity);
+    FREE_ARRAY(u32, self->globals.data, self->globals.capacity);
+}
 
-            // @NOTE: It's probably too difficult to do static analysis on the input values
-            //  for `write_color` (which expects all values to be between 0 and 1). Probably
-            //  better to warn about it and auto-generate tests. However, since this is
-            //  an internal variable only dependent on the input, we still manage to
-            //  avoid having to return an error (if it's sufficiently tested) due to user
-            //  error.
-            write_color(r, g, b, fd);
 
-            // It is possible to solve this if we only have ONE mutable variable in the
-            // expression. If we have multiple we could find the global min and max values,
-            // but they might be larger/smaller than the expression will ever reach. For
-            // example f(x, y) = x/y where -1 <= x <= 1 and 1 <= y <= 2 gives min(f(x, y))
-            // = -2 and max(f(x, y)) = 2, but the expression:
-            //      for x in range(-1, 1) for y in range(2, 1): z = x/y
-            // will only give -0.5 <= z <= 1.
-            //
+/* Walks the module without writing anything until no more types can be
+ * inferred. Types only go from unknown to known, so it terminates. */
+static void infer_types(CTarget* self, Ast_Module* module) {
+    do {
+        self->changed = false;
+        emit_module_body(self, module);
+        for (u32 i = 0; i < self->function_count; ++i)
+            emit_function(self, &self->functions[i]);
+    } while (self->changed);
+}
 
-            // https://github.com/Z3Prover/z3/blob/master/examples/c/test_capi.c
-            // Using z3, it's possible to verify whether statements might fail by AND'ing
-            // wanted result with the negation of the input.
-            // Example:
-            //      Wanted: z == x/y and 0 <= z  when 5 <= x < 22 and y < 0
-            //      Check:  Solve(z == x/y, 0 <= z, Not(And(5 <= x, x < 22, y < 0)))
-            // If a solution is found, then the expression has a potential bug.
+static bool emit_module(CTarget* self, Ast_Module* module, FILE* out) {
+    infer_types(self, module);
+    self->out = out;
+
+    put(self, "// ---- %s ----\n", self->parser->path);
+    for (u32 i = 0; i < self->globals.count; ++i) {
+        u32 global = self->globals.data[i];
+        const char* type = c_type(self->types[global]);
+        if (type && self->types[global] != PrimitiveType_null) {
+            put(self, "static %s ", type);
+            put_variable(self, global);
+            put(self, ";\n");
+        }
+    }
+    put(self, "\n");
+
+    // @NOTE: Errors in the signatures are reported with the definitions.
+    int error_count = self->error_count;
+    for (u32 i = 0; i < self->function_count; ++i) {
+        if (is_emitted(&self->functions[i])) {
+            emit_signature(self, &self->functions[i]);
+            put(self, ";\n");
         }
     }
-    printf("\nDone!\n");
+    self->error_count = error_count;
+    put(self, "\n");
+
+    for (u32 i = 0; i < self->function_count; ++i) {
+        if (is_emitted(&self->functions[i]))
+            emit_function(self, &self->functions[i]);
+    }
+
+    put(self, "static void module_%u(void) {\n", self->module);
+    self->indent = 1;
+    emit_module_body(self, module);
+    self->indent = 0;
+    put(self, "}\n\n");
+
+    for (int i = 0; i < self->error_count; ++i)
+        print_error(self->errors[i]);
+    return self->error_count == 0;
 }
 
 
-int main() {
-    const int image_width  = 256;
-    const int image_height = 256;
+bool c_target_emit(ModuleGraph* graph, const char* c_path) {
+    FILE* out = fopen(c_path, "w");
+    if (!out) {
+        fprintf(stderr, "[C TARGET] Error: Couldn't open '%s' for writing.\n", c_path);
+        return false;
+    }
+
+    fprintf(out, "// Generated by chain. Don't edit.\n");
+    fprintf(out, "%s", PRELUDE);
+
+    bool success = true;
+    for (u32 i = 0; i < graph->order.count; ++i) {
+        u32     index  = graph->order.data[i];
+        Module* module = &graph->modules.data[index];
+
+        CTarget target = c_target_make(module, index);
+        if (!emit_module(&target, module->ast, out))
+            success = false;
+        c_target_free(&target);
+    }
 
-    FILE* fd = fopen("image.ppm", "w");
-    assert(fd != NULL, "Couldn't open file");
-    render(image_width, image_height, fd);
-    fclose(fd);
+    // Modules run in import order, as in the VM.
+    fprintf(out, "int main(void) {\n");
+    for (u32 i = 0; i < graph->order.count; ++i)
+        fprintf(out, "    module_%u();\n", graph->order.data[i]);
+    fprintf(out, "    return 0;\n}\n");
+
+    fclose(out);
+    if (!success)
+        remove(c_path);
+    return success;
+}
+
+
+bool c_target_build(ModuleGraph* graph, const char* output_path) {
+    int   length = (int) strlen(output_path);
+    char* c_path = ALLOCATE_ARRAY(char, length + 3);
+    memcpy(c_path, output_path, length);
+    memcpy(c_path + length, ".c", 3);
+
+    bool success = c_target_emit(graph, c_path);
+    if (success) {
+        const char* arguments[] = { C_TARGET_COMPILER, "-O2", "-o", output_path, c_path, "-lm", NULL };
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            execvp(arguments[0], (char* const*) arguments);
+            fprintf(stderr, "[C TARGET] Error: Couldn't run '%s'.\n", arguments[0]);
+            _exit(EXIT_FAILURE);
+        }
+
+        int status = 0;
+        success = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!success)
+            fprintf(stderr, "[C TARGET] Error: '%s' failed to compile '%s'.\n", arguments[0], c_path);
+    }
 
-    system("open image.ppm");
+    FREE_ARRAY(char, c_path, length + 3);
+    return success;
 }
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "c-preamble/nax_preamble.h"
+#include "loader.h"
+
+
+/* An ahead-of-time backend that translates the flat AST of every module
+ * in a graph into a single C translation unit, which is then compiled by
+ * the system C compiler.
+ *
+ * The language doesn't have type annotations yet, so the types of all
+ * variables, parameters and return values are inferred from literals,
+ * operators and call sites. Everything must get a single static type,
+ * otherwise the module can't be translated. Natives are plain C
+ * functions in the prelude of the translation unit.
+ */
+
+#define C_TARGET_MAX_ERRORS 32
+#define C_TARGET_COMPILER "cc"
+
+
+// Writes the translation unit to `c_path`. Returns false and prints the
+// errors if any module couldn't be translated.
+bool c_target_emit(ModuleGraph* graph, const char* c_path);
+
+// Writes `output_path`.c and compiles it with `cc -O2` into an
+// executable at `output_path`.
+bool c_target_build(ModuleGraph* graph, const char* output_path);
@@ -81,8 +81,6 @@ int chunk_instruction_disassemble(Chunk* chunk, int offset) {
         case OP_EQ:            return instruction_simple("OP_EQ",       offset);
         case OP_GT:            return instruction_simple("OP_GT",       offset);
         case OP_LT:            return instruction_simple("OP_LT",       offset);
-        case OP_AND:           return instruction_simple("OP_AND",      offset);
-        case OP_OR:            return instruction_simple("OP_OR",       offset);
         case OP_ADD:           return instruction_simple("OP_ADD",      offset);
         case OP_SUB:           return instruction_simple("OP_SUB",      offset);
         case OP_MUL:           return instruction_simple("OP_MUL",      offset);
@@ -97,6 +95,7 @@ int chunk_instruction_disassemble(Chunk* chunk, int offset) {
         case OP_SET_LOCAL:     return instruction_byte("OP_SET_LOCAL", chunk, offset);
         case OP_CALL:          return instruction_byte("OP_CALL",      chunk, offset);
         case OP_JUMP_IF_FALSE: return instruction_jump("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_JUMP_IF_TRUE:  return instruction_jump("OP_JUMP_IF_TRUE",  1, chunk, offset);
         case OP_JUMP:          return instruction_jump("OP_JUMP",  1, chunk, offset);
         case OP_LOOP:          return instruction_jump("OP_LOOP", -1, chunk, offset);
         default:
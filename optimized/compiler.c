@@ -15,6 +15,10 @@ Compiler compiler_make(Parser* parser) {
         .current_location=make_location(0, 1, 1),
         .scope_depth=0,
         .variables=make_dynarray_Variable(),
+        .scope=make_dynarray_u32(),
+        .variable_info=NULL,
+        .variable_info_count=0,
+        .error_count=0,
         .had_error=0,
         .in_panic_mode=0,
     };
@@ -29,6 +33,38 @@ static void synchronize(Compiler* compiler) {
 
 }
 
+static void compiler_error(Compiler* compiler, Ast* node, ErrorCode code) {
+    compiler->had_error = true;
+    if (compiler->error_count >= COMPILER_MAX_ERRORS)
+        return;
+
+    compiler->errors[compiler->error_count++] = (Error) {
+            .code=code,
+            .start=ast_location(*node),
+            .count=1,
+            .arg=slice_make_empty(),
+            .source=compiler->parser->source,
+            .path=compiler->parser->path,
+    };
+}
+
+
+static void declare(Compiler* compiler, u32 variable) {
+    dynarray_u32_append(&compiler->scope, variable);
+}
+
+/* Returns the declared identifier with the same name, or the identifier
+ * itself if it's not declared in any enclosing scope. */
+static u32 resolve(Compiler* compiler, u32 variable) {
+    Slice name = compiler->parser->variables.data[variable];
+    for (u32 i = compiler->scope.count; i > 0; --i) {
+        u32 declared = compiler->scope.data[i-1];
+        if (declared == variable || slice_equals(compiler->parser->variables.data[declared], name))
+            return declared;
+    }
+    return variable;
+}
+
 
 CompilerReturn type_check_identifier(Compiler* compiler, Ast_Identifier* node);
 CompilerReturn type_check_literal(Compiler* compiler, Ast_Literal* node);
@@ -108,6 +144,27 @@ static void emit_bytes(Compiler* self, u8 byte1, u8 byte2) {
     emit_byte(self, byte2);
 }
 
+static int emit_jump(Compiler* self, u8 instruction) {
+    emit_byte(self, instruction);
+    emit_byte(self, 0xff);  // Placeholders.
+    emit_byte(self, 0xff);  // Placeholders.
+    return (int) current_chunk(self)->code.count - 2;
+}
+
+static void patch_jump(Compiler* self, Ast* node, int offset) {
+    Chunk* chunk = current_chunk(self);
+
+    // -2 to adjust for the bytecode for the jump offset itself.
+    int jump = (int) chunk->code.count - offset - 2;
+    if (jump > UINT16_MAX) {
+        compiler_error(self, node, COMPILE_ERROR_TOO_LARGE_JUMP);
+        return;
+    }
+
+    chunk->code.data[offset]     = (jump >> 8) & 0xff;
+    chunk->code.data[offset + 1] = jump & 0xff;
+}
+
 
 
 CompilerReturn emit_identifier(Compiler* compiler, Ast_Identifier* node);
@@ -127,7 +184,29 @@ CompilerReturn emit_block(Compiler* compiler, Ast_Block* node);
 CompilerReturn emit_statement(Compiler* compiler, Ast* node);
 
 
+/* Removes everything emitted after `code_count` and `constant_count`. */
+static void rewind_chunk(Compiler* compiler, u32 code_count, u32 constant_count) {
+    Chunk* chunk = current_chunk(compiler);
+    chunk->code.count      = code_count;
+    chunk->locations.count = code_count;
+    chunk->constants.count = constant_count;
+}
+
+static CompilerReturn emit_constant(Compiler* compiler, Ast* node, Value value) {
+    int id = add_constant(compiler, value);
+    emit_bytes(compiler, OP_CONSTANT, (u8) id);
+
+    bool is_foldable = IS_I64(value) || IS_F64(value) || IS_BOOL(value);
+    return (CompilerReturn) { .next=node, .type=value.type, .is_constant=is_foldable, .value=value };
+}
+
+
 CompilerReturn emit_identifier(Compiler* compiler, Ast_Identifier* node) {
+    // Variables that are never reassigned are replaced by their value.
+    VariableInfo* info = &compiler->variable_info[resolve(compiler, node->absolute_offset)];
+    if (info->is_constant)
+        return emit_constant(compiler, (Ast*)(node+1), info->value);
+
     emit_bytes(compiler, OP_CONSTANT, (u8) node->scope_local_offset);
     return (CompilerReturn) { .next=(Ast*)(node+1), .type=make_primitive_type(PrimitiveType_i64) };
 }
@@ -174,12 +253,93 @@ CompilerReturn emit_literal(Compiler* compiler, Ast_Literal* node) {
         static_assert(PrimitiveTypeCount == 26, "Exhaustive");
     }
 
-    int id = add_constant(compiler, value);
-    emit_bytes(compiler, OP_CONSTANT, (u8) id);
-    return (CompilerReturn) { .next=(Ast*)(node+1), .type=value.type };
+    return emit_constant(compiler, (Ast*)(node+1), value);
+}
+
+
+/* Evaluates `a op b` the same way as vm_run would. Returns false if
+ * it should be left to run-time. */
+static bool fold_bin_op(Compiler* compiler, Ast_BinOp* node, Value a, Value b, Value* result) {
+    if (!is_type(a.type, b.type))
+        return false;
+
+    if (IS_I64(a)) {
+        // @NOTE: Overflow wraps around, as on the machine.
+        u64 x = (u64) AS_I64(a);
+        u64 y = (u64) AS_I64(b);
+        switch (node->op) {
+            case Add: *result = MAKE_I64((i64) (x + y)); return true;
+            case Sub: *result = MAKE_I64((i64) (x - y)); return true;
+            case Mul: *result = MAKE_I64((i64) (x * y)); return true;
+            case Div: {
+                if (AS_I64(b) == 0) {
+                    compiler_error(compiler, (Ast*) node, COMPILE_ERROR_DIVISION_BY_ZERO);
+                    return false;
+                }
+                if (AS_I64(a) == INT64_MIN && AS_I64(b) == -1)
+                    return false;
+                *result = MAKE_I64(AS_I64(a) / AS_I64(b));
+                return true;
+            }
+            case Lt: *result = MAKE_BOOL(AS_I64(a) < AS_I64(b));   return true;
+            case Gt: *result = MAKE_BOOL(AS_I64(a) > AS_I64(b));   return true;
+            case Eq: *result = MAKE_BOOL(value_equals(a, b));      return true;
+            default: return false;
+        }
+    } else if (IS_F64(a)) {
+        switch (node->op) {
+            case Add: *result = MAKE_F64(AS_F64(a) + AS_F64(b));   return true;
+            case Sub: *result = MAKE_F64(AS_F64(a) - AS_F64(b));   return true;
+            case Mul: *result = MAKE_F64(AS_F64(a) * AS_F64(b));   return true;
+            case Div: *result = MAKE_F64(AS_F64(a) / AS_F64(b));   return true;
+            case Lt:  *result = MAKE_BOOL(AS_F64(a) < AS_F64(b));  return true;
+            case Gt:  *result = MAKE_BOOL(AS_F64(a) > AS_F64(b));  return true;
+            case Eq:  *result = MAKE_BOOL(value_equals(a, b));     return true;
+            default: return false;
+        }
+    } else if (IS_BOOL(a)) {
+        switch (node->op) {
+            case And: *result = MAKE_BOOL(AS_BOOL(a) && AS_BOOL(b)); return true;
+            case Or:  *result = MAKE_BOOL(AS_BOOL(a) || AS_BOOL(b)); return true;
+            case Eq:  *result = MAKE_BOOL(value_equals(a, b));       return true;
+            default: return false;
+        }
+    }
+    return false;
+}
+
+/* The left operand is left on the stack if it decides the result,
+ * and the right operand is then never evaluated. */
+static CompilerReturn emit_logical_op(Compiler* compiler, Ast_BinOp* node) {
+    Chunk* chunk = current_chunk(compiler);
+    u32 code_count     = chunk->code.count;
+    u32 constant_count = chunk->constants.count;
+
+    CompilerReturn left_type = emit_expression(compiler, bin_op_left(node));
+    int end_jump = emit_jump(compiler, node->op == And ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE);
+    emit_byte(compiler, OP_POP);
+    CompilerReturn right_type = emit_expression(compiler, bin_op_right(node));
+    patch_jump(compiler, (Ast*) node, end_jump);
+
+    if (!is_type(left_type.type, right_type.type))
+        PANIC("Type error!");
+
+    Value folded;
+    if (left_type.is_constant && right_type.is_constant && fold_bin_op(compiler, node, left_type.value, right_type.value, &folded)) {
+        rewind_chunk(compiler, code_count, constant_count);
+        return emit_constant(compiler, right_type.next, folded);
+    }
+    return (CompilerReturn) { .next=right_type.next, .type=left_type.type };
 }
 
 CompilerReturn emit_bin_op(Compiler* compiler, Ast_BinOp* node) {
+    if (node->op == And || node->op == Or)
+        return emit_logical_op(compiler, node);
+
+    Chunk* chunk = current_chunk(compiler);
+    u32 code_count     = chunk->code.count;
+    u32 constant_count = chunk->constants.count;
+
     Ast* left  = bin_op_left(node);
     Ast* right = bin_op_right(node);
     CompilerReturn left_type  = emit_expression(compiler, left);
@@ -188,6 +348,13 @@ CompilerReturn emit_bin_op(Compiler* compiler, Ast_BinOp* node) {
     if (!is_type(left_type.type, right_type.type))
         PANIC("Type error!");
 
+    // Both operands are single constants, so replace them with the result.
+    Value folded;
+    if (left_type.is_constant && right_type.is_constant && fold_bin_op(compiler, node, left_type.value, right_type.value, &folded)) {
+        rewind_chunk(compiler, code_count, constant_count);
+        return emit_constant(compiler, right_type.next, folded);
+    }
+
     switch (node->op) {
         case Add: emit_byte(compiler, OP_ADD); break;
         case Sub: emit_byte(compiler, OP_SUB); break;
@@ -200,8 +367,6 @@ CompilerReturn emit_bin_op(Compiler* compiler, Ast_BinOp* node) {
 //        case Ne:  emit_byte(compiler, OP_);  break;
 //        case Ge:  emit_byte(compiler, OP_);  break;
         case Gt:  emit_byte(compiler, OP_GT);  break;
-        case And: emit_byte(compiler, OP_AND); break;
-        case Or:  emit_byte(compiler, OP_OR);  break;
         default: unreachable();
         static_assert(PrimitiveTypeCount == 26, "Exhaustive");
     }
@@ -235,14 +400,23 @@ CompilerReturn emit_expression(Compiler* compiler, Ast* node) {
 }
 
 CompilerReturn emit_var_assign(Compiler* compiler, Ast_VarAssign* node) {
-    emit_bytes(compiler, OP_GET_GLOBAL, (u8) node->name);
+    u32 variable = resolve(compiler, node->name);
+    emit_bytes(compiler, OP_GET_GLOBAL, (u8) variable);
     CompilerReturn result = emit_expression(compiler, (Ast*) (node+1));
-    emit_bytes(compiler, OP_SET_GLOBAL, (u8) node->name);
+    emit_bytes(compiler, OP_SET_GLOBAL, (u8) variable);
     return (CompilerReturn) { .next=result.next, .type=make_primitive_type(PrimitiveType_null) };
 }
 
 CompilerReturn emit_var_decl(Compiler* compiler, Ast_VarDecl* node) {
     CompilerReturn result = emit_expression(compiler, (Ast*) (node+1));
+
+    VariableInfo* info = &compiler->variable_info[node->name];
+    if (result.is_constant && info->writes == 1) {
+        info->is_constant = true;
+        info->value       = result.value;
+    }
+    declare(compiler, node->name);
+
     emit_bytes(compiler, OP_DEFINE_GLOBAL, (u8) node->name);
     return (CompilerReturn) { .next=result.next, .type=make_primitive_type(PrimitiveType_null) };
 }
@@ -266,12 +440,14 @@ CompilerReturn emit_while_stmt(Compiler* compiler, Ast_WhileStmt* node) {
 }
 
 CompilerReturn emit_block(Compiler* self, Ast_Block* node) {
+    u32 scope_count = self->scope.count;
     Ast* statement = (Ast*) (node + 1);
     CompilerReturn result = { 0 };
     for (u32 i = 0; i < node->stmt_count; ++i) {
         result = emit_statement(self, statement);
         statement = result.next;
     }
+    self->scope.count = scope_count;
     return (CompilerReturn) { .next=result.next, .type=make_primitive_type(PrimitiveType_null) };
 }
 
@@ -307,6 +483,11 @@ CompilerReturn emit_statement(Compiler* compiler, Ast* node) {
             result = emit_block(compiler, (Ast_Block*) node);
             break;
         }
+        case AST_IMPORT: {
+            // @NOTE: Resolved by the module loader before compilation.
+            result = (CompilerReturn) { .next=(Ast*) (((Ast_Import*) node) + 1), .type=make_primitive_type(PrimitiveType_null) };
+            break;
+        }
         default: {
             result = emit_expression(compiler, node);
             break;
@@ -329,7 +510,73 @@ void emit_module(Compiler* compiler, Ast_Module* module) {
 }
 
 
+/* Counts the writes to each variable. As the nodes are laid out
+ * contiguously in pre-order, it's a single scan over the buffer, where
+ * the scopes are closed at the end offsets of their blocks. */
+static void count_variable_writes(Compiler* compiler, Ast_Module* module) {
+    compiler->variable_info_count = compiler->parser->variables.count;
+    compiler->variable_info = ALLOCATE_ARRAY(VariableInfo, compiler->variable_info_count);
+    memset(compiler->variable_info, 0, sizeof(VariableInfo) * compiler->variable_info_count);
+
+    // Where each open scope ends, and the size of `scope` before it.
+    DynArray_u32 ends   = make_dynarray_u32();
+    DynArray_u32 counts = make_dynarray_u32();
+
+    Ast* node = (Ast*) (module + 1);
+    Ast* end  = (Ast*) module + module->end;
+    while (node < end) {
+        u32 offset = (u32) (node - (Ast*) module);
+        while (ends.count > 0 && ends.data[ends.count-1] <= offset) {
+            ends.count   -= 1;
+            counts.count -= 1;
+            compiler->scope.count = counts.data[counts.count];
+        }
+
+        switch (node->type) {
+            case AST_VAR_DECL: {
+                u32 variable = ((Ast_VarDecl*) node)->name;
+                compiler->variable_info[variable].writes += 1;
+                declare(compiler, variable);
+            } break;
+            case AST_VAR_ASSIGN: {
+                compiler->variable_info[resolve(compiler, ((Ast_VarAssign*) node)->name)].writes += 1;
+            } break;
+            case AST_BLOCK: {
+                dynarray_u32_append(&ends,   offset + ((Ast_Block*) node)->end);
+                dynarray_u32_append(&counts, compiler->scope.count);
+            } break;
+            case AST_FUNC_DECL: {
+                // Parameters are in the scope of the body.
+                Ast_FuncDecl* decl = (Ast_FuncDecl*) node;
+                Ast_Block*    body = (Ast_Block*) (node + decl->next);
+                dynarray_u32_append(&ends,   offset + decl->next + body->end);
+                dynarray_u32_append(&counts, compiler->scope.count);
+
+                Ast_Identifier* params = (Ast_Identifier*) (decl + 1);
+                for (u32 i = 0; i < decl->param_count; ++i) {
+                    declare(compiler, params[i].absolute_offset);
+                }
+            } break;
+            default:
+                break;
+        }
+        node += ast_node_size(node->type);
+    }
+
+    compiler->scope.count = 0;
+    FREE_ARRAY(u32, ends.data,   ends.capacity);
+    FREE_ARRAY(u32, counts.data, counts.capacity);
+}
+
+
 void compile(Compiler* compiler, Ast_Module* node) {
+    count_variable_writes(compiler, node);
     emit_module(compiler, node);
     emit_byte(compiler, OP_EXIT);
+
+    FREE_ARRAY(VariableInfo, compiler->variable_info, compiler->variable_info_count);
+    compiler->variable_info       = NULL;
+    compiler->variable_info_count = 0;
+    FREE_ARRAY(u32, compiler->scope.data, compiler->scope.capacity);
+    compiler->scope = make_dynarray_u32();
 }
@@ -7,15 +7,28 @@
 
 declare_dynarray(OpCode)
 
-#define COMPILER_MAX_ERRORS
+#define COMPILER_MAX_ERRORS 32
 
 
 typedef struct {
     Ast* next;
     Type type;
+    // Set if the expression was emitted as a single constant
+    // that can be folded further.
+    bool  is_constant;
+    Value value;
 } CompilerReturn;
 
 
+/* What's known about a variable at compile time. */
+typedef struct {
+    // Number of declarations and assignments to the variable.
+    u32   writes;
+    bool  is_constant;
+    Value value;
+} VariableInfo;
+
+
 typedef struct {
     Token name;
     int   depth;
@@ -32,8 +45,8 @@ typedef struct {
 
     Location current_location;
 
-//    Error errors[COMPILER_MAX_ERRORS];
-//    int error_count;
+    Error errors[COMPILER_MAX_ERRORS];
+    int   error_count;
 
     int scope_depth;
 
@@ -44,6 +57,14 @@ typedef struct {
      * */
     DynArray_Variable variables;
 
+    // Declared identifiers, innermost last. A name used in a deeper
+    // scope has its own identifier until it's resolved against these.
+    DynArray_u32 scope;
+
+    // Indexed by the unique identifiers in parser->variables.
+    VariableInfo* variable_info;
+    u32           variable_info_count;
+
     bool had_error;
     bool in_panic_mode;
 } Compiler;
@@ -3,6 +3,7 @@
 #include "compiler.h"
 #include "chunk.h"
 #include "object.h"
+#include "memory.h"
 
 #include <time.h>
 #include <stdlib.h>
@@ -10,111 +11,130 @@
 
 #define STRING_TO_SLICE(x) ((Slice) { .source=x->data, .count=x->size })
 
-VM vm = { 0 };
-
-void vm_init() {
-    memset(vm.stack,  0, VM_STACK_MAX  * sizeof(Value));
-
-    vm.stack_top = vm.stack;
-    vm.objects   = NULL;
-    vm.ip = 0;
-    vm.slots = malloc(1024);
+VM* vm_create(const VMConfig* config) {
+    VMConfig defaults = VM_CONFIG_DEFAULT;
+    if (config == NULL)
+        config = &defaults;
+
+    VM* vm = ALLOCATE(VM);
+    vm->stack          = ALLOCATE_ARRAY(Value, config->stack_size);
+    vm->stack_capacity = config->stack_size;
+    memset(vm->stack, 0, config->stack_size * sizeof(Value));
+
+    vm->stack_top = vm->stack;
+    vm->objects   = NULL;
+    vm->ip = 0;
+    vm->slots = ALLOCATE_ARRAY(Value, VM_SLOTS_MAX);
+    return vm;
 }
 
-void vm_free() {
-    Obj* object = vm.objects;
+void vm_destroy(VM* vm) {
+    Obj* object = vm->objects;
     while (object != NULL) {
         Obj* next = object->next;
         object_free(object);
         object = next;
     }
+    FREE_ARRAY(Value, vm->slots, VM_SLOTS_MAX);
+    FREE_ARRAY(Value, vm->stack, vm->stack_capacity);
+    FREE(VM, vm);
 }
 
-void vm_push(Value value) {
-    *vm.stack_top = value;
-    vm.stack_top++;
+void vm_push(VM* vm, Value value) {
+    *vm->stack_top = value;
+    vm->stack_top++;
 }
 
-Value vm_pop() {
-    vm.stack_top--;
-    Value value = *vm.stack_top;
-    *vm.stack_top = MAKE_INVALID();
+Value vm_pop(VM* vm) {
+    vm->stack_top--;
+    Value value = *vm->stack_top;
+    *vm->stack_top = MAKE_INVALID();
     return value;
 }
 
-Value vm_peek(int x) {
-    return *(vm.stack_top-1-x);
+Value vm_peek(VM* vm, int x) {
+    return *(vm->stack_top-1-x);
 }
 
-void vm_interpret(const char* path, const char* source, bool quiet) {
+void vm_interpret(VM* vm, const char* path, const char* source, bool quiet) {
+
+}
 
+/* Makes room for `count` values above the top of the stack, moving it
+ * to a larger one if needed. */
+static void reserve_stack(VM* vm, int count) {
+    int used = (int) (vm->stack_top - vm->stack);
+    if (used + count <= vm->stack_capacity)
+        return;
+
+    int capacity = vm->stack_capacity;
+    while (capacity < used + count)
+        capacity = GROW_CAPACITY(capacity);
+    vm->stack          = RESIZE_ARRAY(Value, vm->stack, vm->stack_capacity, capacity);
+    vm->stack_top      = vm->stack + used;
+    vm->stack_capacity = capacity;
 }
 
-void vm_run(Chunk chunk) {
-    vm.ip = chunk.code.data;
+void vm_run(VM* vm, Chunk chunk) {
+    // @NOTE: Each instruction pushes at most one value, so the chunk can't
+    //  fill more of the stack than it has bytes of code. This is the only
+    //  check, the pushes don't check.
+    reserve_stack(vm, (int) chunk.code.count);
+    vm->ip = chunk.code.data;
 
-#define READ_BYTE()     (*vm.ip++)
-#define READ_SHORT()    (vm.ip += 2, (uint16_t)((vm.ip[-2] << 8) | vm.ip[-1]))
+#define READ_BYTE()     (*vm->ip++)
+#define READ_SHORT()    (vm->ip += 2, (uint16_t)((vm->ip[-2] << 8) | vm->ip[-1]))
 #define READ_CONSTANT() (chunk.constants.data[READ_BYTE()])
 #define READ_STRING()   AS_STRING(AS_OBJ(READ_CONSTANT()))
-#define IS_SAME(type)   (IS_## type(vm_peek(0)) && IS_ ## type(vm_peek(1)))
+#define IS_SAME(type)   (IS_## type(vm_peek(vm, 0)) && IS_ ## type(vm_peek(vm, 1)))
 #define BINARY_OP(op, type) \
     do { \
-      Value b = vm_pop(); \
-      Value a = vm_pop(); \
-      vm_push(MAKE_##type(AS_##type(a) op AS_##type(b))); \
+      Value b = vm_pop(vm); \
+      Value a = vm_pop(vm); \
+      vm_push(vm, MAKE_##type(AS_##type(a) op AS_##type(b))); \
     } while (false)
 
 #define BINARY_RELATION(op, type) \
     do { \
-      Value b = vm_pop(); \
-      Value a = vm_pop(); \
-      vm_push(MAKE_BOOL(AS_ ## type(a) op AS_ ## type(b))); \
+      Value b = vm_pop(vm); \
+      Value a = vm_pop(vm); \
+      vm_push(vm, MAKE_BOOL(AS_ ## type(a) op AS_ ## type(b))); \
     } while (false)
 
 #define BINARY_EQUALS() \
     do { \
-      Value b = vm_pop(); \
-      Value a = vm_pop(); \
-      vm_push(MAKE_BOOL(value_equals(a, b))); \
+      Value b = vm_pop(vm); \
+      Value a = vm_pop(vm); \
+      vm_push(vm, MAKE_BOOL(value_equals(a, b))); \
     } while (false)
 
 
     while (1) {
         printf(">>         ");
-        if (vm.stack >= vm.stack_top)
+        if (vm->stack >= vm->stack_top)
             printf("[ ]");
         else
-            for (Value* slot = vm.stack; slot < vm.stack_top; slot++) {
+            for (Value* slot = vm->stack; slot < vm->stack_top; slot++) {
                 printf("[ ");
                 print_value(*slot);
                 printf(" ]");
             }
         printf("\n>> ");
-        chunk_instruction_disassemble(&chunk, (int)(vm.ip - chunk.code.data));
+        chunk_instruction_disassemble(&chunk, (int)(vm->ip - chunk.code.data));
 
         u8 instruction;
         switch (instruction = READ_BYTE()) {
-            case OP_POP:      vm_pop();                   break;
-            case OP_CONSTANT: vm_push(READ_CONSTANT());   break;
-            case OP_TRUE:     vm_push(MAKE_BOOL(true));   break;
-            case OP_FALSE:    vm_push(MAKE_BOOL(false));  break;
+            case OP_POP:      vm_pop(vm);                   break;
+            case OP_CONSTANT: vm_push(vm, READ_CONSTANT());   break;
+            case OP_TRUE:     vm_push(vm, MAKE_BOOL(true));   break;
+            case OP_FALSE:    vm_push(vm, MAKE_BOOL(false));  break;
             case OP_NEGATE:   {
-                if      (IS_F64(vm_peek(0))) { vm_push(MAKE_F64(-AS_F64(vm_pop()))); }
-                else if (IS_I64(vm_peek(0))) { vm_push(MAKE_I64(-AS_I64(vm_pop()))); }
+                if      (IS_F64(vm_peek(vm, 0))) { vm_push(vm, MAKE_F64(-AS_F64(vm_pop(vm)))); }
+                else if (IS_I64(vm_peek(vm, 0))) { vm_push(vm, MAKE_I64(-AS_I64(vm_pop(vm)))); }
                 break;
             }
             case OP_NOT: {
-                if (IS_BOOL(vm_peek(0))) vm_push(MAKE_BOOL(!AS_BOOL(vm_pop())));
-                break;
-            }
-            // @TODO: AND and OR should short-circuit.
-            case OP_AND: {
-                if   (IS_SAME(BOOL)) { BINARY_OP(&&, BOOL); }
-                break;
-            }
-            case OP_OR: {
-                if   (IS_SAME(BOOL)) { BINARY_OP(||, BOOL); }
+                if (IS_BOOL(vm_peek(vm, 0))) vm_push(vm, MAKE_BOOL(!AS_BOOL(vm_pop(vm))));
                 break;
             }
             case OP_EQ: {
@@ -154,38 +174,44 @@ void vm_run(Chunk chunk) {
             case OP_EXIT:
                 return;
             case OP_PRINT: {
-                print_value(vm_pop());
+                print_value(vm_pop(vm));
                 printf("\n");
                 break;
             }
             case OP_GET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                vm_push(vm.slots[slot]);
+                vm_push(vm, vm->slots[slot]);
                 break;
             }
             case OP_SET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                vm.slots[slot] = vm_peek(0);
+                vm->slots[slot] = vm_peek(vm, 0);
                 break;
             }
             case OP_JUMP_IF_FALSE: {
                 uint16_t offset = READ_SHORT();
-                if (value_is_falsy(vm_peek(0)))
-                    vm.ip += offset;
+                if (value_is_falsy(vm_peek(vm, 0)))
+                    vm->ip += offset;
+                break;
+            }
+            case OP_JUMP_IF_TRUE: {
+                uint16_t offset = READ_SHORT();
+                if (!value_is_falsy(vm_peek(vm, 0)))
+                    vm->ip += offset;
                 break;
             }
             case OP_JUMP: {
                 uint16_t offset = READ_SHORT();
-                vm.ip += offset;
+                vm->ip += offset;
                 break;
             }
             case OP_LOOP: {
                 uint16_t offset = READ_SHORT();
-                vm.ip -= offset;
+                vm->ip -= offset;
                 break;
             }
             case OP_NULL: {
-                vm_push(MAKE_NULL());
+                vm_push(vm, MAKE_NULL());
                 break;
             }
             default: {
@@ -7,24 +7,32 @@
 
 
 #define VM_STACK_MAX  1024
+// Slots are indexed by a byte.
+#define VM_SLOTS_MAX  256
+
+
+typedef struct {
+    int stack_size;
+} VMConfig;
+
+#define VM_CONFIG_DEFAULT ((VMConfig) { .stack_size=VM_STACK_MAX })
 
 
 typedef struct {
-    Chunk    chunk;
     uint8_t* ip;
     Value*   slots;
 
-    Value  stack[VM_STACK_MAX];
+    Value* stack;
     Value* stack_top;
+    int    stack_capacity;
     Obj*   objects;
 } VM;
 
-extern VM vm;
-
-void vm_init();
-void  vm_free();
-void  vm_push(Value value);
-Value vm_pop();
-Value vm_peek(int x);
-void  vm_interpret(const char* path, const char* source, bool quiet);
-void vm_run(Chunk chunk);
+// `config` is NULL for the defaults.
+VM*   vm_create(const VMConfig* config);
+void  vm_destroy(VM* vm);
+void  vm_push(VM* vm, Value value);
+Value vm_pop(VM* vm);
+Value vm_peek(VM* vm, int x);
+void  vm_interpret(VM* vm, const char* path, const char* source, bool quiet);
+void  vm_run(VM* vm, Chunk chunk);
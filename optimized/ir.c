@@ -0,0 +1,1269 @@
+#include "ir.h"
+#include "memory.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+#define X(name, side_effects) [IR_##name] = #name,
+const char* IR_OP_NAMES[IR_OP_COUNT] = {
+    ALL_IR_OPS(X)
+};
+#undef X
+
+#define X(name, side_effects) [IR_##name] = side_effects,
+const bool IR_OP_HAS_SIDE_EFFECTS[IR_OP_COUNT] = {
+    ALL_IR_OPS(X)
+};
+#undef X
+
+
+
+/* ---- Construction ---- */
+
+/* Maps (block, variable) to the value the variable has at the end of
+ * the block. Open addressing, where a zero key is empty. */
+typedef struct {
+    u64*   keys;
+    IrRef* values;
+    u32    count;
+    u32    capacity;
+} IrDefinitions;
+
+static inline u64 definition_key(u32 block, u32 variable) {
+    return (((u64) block << 32) | variable) + 1;
+}
+
+static inline u32 definition_hash(u64 key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (u32) key;
+}
+
+static void definitions_set(IrDefinitions* definitions, u64 key, IrRef value);
+
+static void definitions_grow(IrDefinitions* definitions) {
+    IrDefinitions old = *definitions;
+    definitions->capacity = GROW_CAPACITY(old.capacity);
+    definitions->count    = 0;
+    definitions->keys     = ALLOCATE_ARRAY(u64,   definitions->capacity);
+    definitions->values   = ALLOCATE_ARRAY(IrRef, definitions->capacity);
+    memset(definitions->keys, 0, sizeof(u64) * definitions->capacity);
+
+    for (u32 i = 0; i < old.capacity; ++i) {
+        if (old.keys[i] != 0)
+            definitions_set(definitions, old.keys[i], old.values[i]);
+    }
+    FREE_ARRAY(u64,   old.keys,   old.capacity);
+    FREE_ARRAY(IrRef, old.values, old.capacity);
+}
+
+static void definitions_set(IrDefinitions* definitions, u64 key, IrRef value) {
+    if (definitions->count + 1 > definitions->capacity * 3 / 4)
+        definitions_grow(definitions);
+
+    u32 index = definition_hash(key) & (definitions->capacity - 1);
+    while (definitions->keys[index] != 0 && definitions->keys[index] != key)
+        index = (index + 1) & (definitions->capacity - 1);
+
+    if (definitions->keys[index] == 0)
+        definitions->count += 1;
+    definitions->keys[index]   = key;
+    definitions->values[index] = value;
+}
+
+static IrRef definitions_get(IrDefinitions* definitions, u64 key) {
+    if (definitions->count == 0)
+        return IR_NONE;
+
+    u32 index = definition_hash(key) & (definitions->capacity - 1);
+    while (definitions->keys[index] != 0) {
+        if (definitions->keys[index] == key)
+            return definitions->values[index];
+        index = (index + 1) & (definitions->capacity - 1);
+    }
+    return IR_NONE;
+}
+
+static void definitions_free(IrDefinitions* definitions) {
+    FREE_ARRAY(u64,   definitions->keys,   definitions->capacity);
+    FREE_ARRAY(IrRef, definitions->values, definitions->capacity);
+    *definitions = (IrDefinitions) { 0 };
+}
+
+
+typedef struct {
+    Parser*   parser;
+    IrModule* module;
+    // Start of the AST buffer, which the offsets of if- and while-nodes
+    // are relative to.
+    u8* base;
+
+    u32 function;
+    u32 current;
+    u32 depth;
+
+    // @NOTE: The parser gives a name a new identifier when it's used in
+    //  a deeper scope than where it was declared, so names are resolved
+    //  here. Declared identifiers, innermost last.
+    DynArray_u32 scope;
+    // Indexed by the unique identifiers in parser->variables.
+    bool* is_global;
+    u32   variable_count;
+
+    IrDefinitions definitions;
+
+    // Byte offsets of function declarations that are yet to be built.
+    DynArray_u32 pending_functions;
+} IrBuilder;
+
+
+static inline IrFunction* current_function(IrBuilder* builder) {
+    return &builder->module->functions.data[builder->function];
+}
+
+static inline IrBlock* get_block(IrFunction* function, u32 block) {
+    return &function->blocks.data[block];
+}
+
+static inline IrInstruction* get_instruction(IrFunction* function, IrRef ref) {
+    return &function->instructions.data[ref];
+}
+
+
+static u32 new_block(IrBuilder* builder) {
+    IrBlock block = (IrBlock) {
+        .instructions    = make_dynarray_u32(),
+        .predecessors    = make_dynarray_u32(),
+        .incomplete_phis = make_dynarray_u32(),
+        .sealed          = false,
+    };
+    return dynarray_IrBlock_append(&current_function(builder)->blocks, block);
+}
+
+static bool is_terminated(IrFunction* function, u32 block) {
+    IrBlock* b = get_block(function, block);
+    if (b->instructions.count == 0)
+        return false;
+    return ir_is_terminator(get_instruction(function, b->instructions.data[b->instructions.count-1])->op);
+}
+
+static IrInstruction make_instruction(IrOp op, Location location) {
+    return (IrInstruction) {
+        .op            = op,
+        .block         = IR_NONE,
+        .first_operand = 0,
+        .operand_count = 0,
+        .immediate     = IR_NONE,
+        .targets       = { IR_NONE, IR_NONE },
+        .replacement   = IR_NONE,
+        .use_count     = 0,
+        .inlined_call  = IR_NONE,
+        .constant      = MAKE_NULL(),
+        .location      = location,
+    };
+}
+
+/* Adds the instruction to `block`, at `position` in its instruction list. */
+static IrRef insert_instruction(IrBuilder* builder, u32 block, u32 position, IrInstruction instruction, const IrRef* operands, u32 operand_count) {
+    IrFunction* function = current_function(builder);
+
+    instruction.block         = block;
+    instruction.first_operand = function->operands.count;
+    instruction.operand_count = operand_count;
+    for (u32 i = 0; i < operand_count; ++i)
+        dynarray_u32_append(&function->operands, operands[i]);
+
+    IrRef ref = dynarray_IrInstruction_append(&function->instructions, instruction);
+
+    DynArray_u32* list = &get_block(function, block)->instructions;
+    dynarray_u32_append(list, ref);
+    memmove(list->data + position + 1, list->data + position, sizeof(u32) * (list->count - 1 - position));
+    list->data[position] = ref;
+    return ref;
+}
+
+/* Starts a new block, without predecessors, if the current one already
+ * has been terminated. Code placed in it is unreachable. */
+static void ensure_open_block(IrBuilder* builder) {
+    if (is_terminated(current_function(builder), builder->current)) {
+        builder->current = new_block(builder);
+        get_block(current_function(builder), builder->current)->sealed = true;
+    }
+}
+
+static IrRef emit(IrBuilder* builder, IrInstruction instruction, const IrRef* operands, u32 operand_count) {
+    ensure_open_block(builder);
+    u32 position = get_block(current_function(builder), builder->current)->instructions.count;
+    return insert_instruction(builder, builder->current, position, instruction, operands, operand_count);
+}
+
+static void emit_jump(IrBuilder* builder, u32 target, Location location) {
+    IrFunction* function = current_function(builder);
+    if (is_terminated(function, builder->current))
+        return;
+
+    IrInstruction instruction = make_instruction(IR_JUMP, location);
+    instruction.targets[0] = target;
+    emit(builder, instruction, NULL, 0);
+    dynarray_u32_append(&get_block(function, target)->predecessors, builder->current);
+}
+
+static void emit_branch(IrBuilder* builder, IrRef condition, u32 then_block, u32 else_block, Location location) {
+    IrInstruction instruction = make_instruction(IR_BRANCH, location);
+    instruction.targets[0] = then_block;
+    instruction.targets[1] = else_block;
+    emit(builder, instruction, &condition, 1);
+
+    IrFunction* function = current_function(builder);
+    dynarray_u32_append(&get_block(function, then_block)->predecessors, builder->current);
+    dynarray_u32_append(&get_block(function, else_block)->predecessors, builder->current);
+}
+
+
+/* Phis are placed after the other phis at the start of the block, with
+ * their operands added once all predecessors are known. */
+static IrRef new_phi(IrBuilder* builder, u32 block, u32 variable) {
+    IrFunction* function = current_function(builder);
+    DynArray_u32* list = &get_block(function, block)->instructions;
+
+    u32 position = 0;
+    while (position < list->count && get_instruction(function, list->data[position])->op == IR_PHI)
+        ++position;
+
+    IrInstruction instruction = make_instruction(IR_PHI, make_location(0, 0, 0));
+    instruction.immediate = variable;
+    return insert_instruction(builder, block, position, instruction, NULL, 0);
+}
+
+static IrRef new_undef(IrBuilder* builder, u32 block) {
+    IrInstruction instruction = make_instruction(IR_UNDEF, make_location(0, 0, 0));
+    return insert_instruction(builder, block, 0, instruction, NULL, 0);
+}
+
+
+static void  write_variable(IrBuilder* builder, u32 variable, u32 block, IrRef value);
+static IrRef read_variable(IrBuilder* builder, u32 variable, u32 block);
+
+static void add_phi_operands(IrBuilder* builder, IrRef phi) {
+    IrFunction* function = current_function(builder);
+    u32 block    = get_instruction(function, phi)->block;
+    u32 variable = get_instruction(function, phi)->immediate;
+    u32 count    = get_block(function, block)->predecessors.count;
+
+    // @NOTE: Reading the operands may create new instructions and
+    //  operands, so they're collected first to keep them contiguous.
+    IrRef* operands = ALLOCATE_ARRAY(IrRef, count);
+    for (u32 i = 0; i < count; ++i) {
+        u32 predecessor = current_function(builder)->blocks.data[block].predecessors.data[i];
+        operands[i] = read_variable(builder, variable, predecessor);
+    }
+
+    function = current_function(builder);
+    IrInstruction* instruction = get_instruction(function, phi);
+    instruction->first_operand = function->operands.count;
+    instruction->operand_count = count;
+    for (u32 i = 0; i < count; ++i)
+        dynarray_u32_append(&function->operands, operands[i]);
+
+    FREE_ARRAY(IrRef, operands, count);
+}
+
+static void seal_block(IrBuilder* builder, u32 block) {
+    IrFunction* function = current_function(builder);
+    for (u32 i = 0; i < get_block(function, block)->incomplete_phis.count; ++i) {
+        add_phi_operands(builder, get_block(current_function(builder), block)->incomplete_phis.data[i]);
+    }
+    get_block(current_function(builder), block)->incomplete_phis.count = 0;
+    get_block(current_function(builder), block)->sealed = true;
+}
+
+static void write_variable(IrBuilder* builder, u32 variable, u32 block, IrRef value) {
+    definitions_set(&builder->definitions, definition_key(block, variable), value);
+}
+
+static IrRef read_variable(IrBuilder* builder, u32 variable, u32 block) {
+    IrRef value = definitions_get(&builder->definitions, definition_key(block, variable));
+    if (value != IR_NONE)
+        return value;
+
+    IrBlock* b = get_block(current_function(builder), block);
+    if (!b->sealed) {
+        value = new_phi(builder, block, variable);
+        dynarray_u32_append(&get_block(current_function(builder), block)->incomplete_phis, value);
+    } else if (b->predecessors.count == 0) {
+        // Read before being written on some path.
+        value = new_undef(builder, block);
+    } else if (b->predecessors.count == 1) {
+        value = read_variable(builder, variable, b->predecessors.data[0]);
+    } else {
+        // Break cycles by defining the variable before the operands are read.
+        value = new_phi(builder, block, variable);
+        write_variable(builder, variable, block, value);
+        add_phi_operands(builder, value);
+    }
+    write_variable(builder, variable, block, value);
+    return value;
+}
+
+
+static IrRef build_expression(IrBuilder* builder, Ast* node, Ast** next);
+static Ast*  build_statement(IrBuilder* builder, Ast* node);
+
+
+static void declare(IrBuilder* builder, u32 variable) {
+    dynarray_u32_append(&builder->scope, variable);
+}
+
+/* Returns the declared identifier with the same name, or the identifier
+ * itself if it's not declared in any enclosing scope. */
+static u32 resolve(IrBuilder* builder, u32 variable) {
+    Slice name = builder->parser->variables.data[variable];
+    for (u32 i = builder->scope.count; i > 0; --i) {
+        u32 declared = builder->scope.data[i-1];
+        if (declared == variable || slice_equals(builder->parser->variables.data[declared], name))
+            return declared;
+    }
+    return variable;
+}
+
+static bool is_local(IrBuilder* builder, u32 variable) {
+    if (builder->is_global[variable])
+        return false;
+    for (u32 i = builder->scope.count; i > 0; --i) {
+        if (builder->scope.data[i-1] == variable)
+            return true;
+    }
+    return false;
+}
+
+
+static IrRef build_identifier(IrBuilder* builder, Ast_Identifier* node) {
+    u32 variable = resolve(builder, node->absolute_offset);
+    if (is_local(builder, variable)) {
+        ensure_open_block(builder);
+        return read_variable(builder, variable, builder->current);
+    }
+
+    IrInstruction instruction = make_instruction(IR_LOAD_GLOBAL, ast_location(node->ast));
+    instruction.immediate = variable;
+    return emit(builder, instruction, NULL, 0);
+}
+
+static IrRef build_literal(IrBuilder* builder, Ast_Literal* node) {
+    IrInstruction instruction = make_instruction(IR_CONST, ast_location(node->ast));
+    switch (node->type) {
+        case PrimitiveType_inferred:
+        case PrimitiveType_number:
+        case PrimitiveType_u8:
+        case PrimitiveType_u16:
+        case PrimitiveType_u32:
+        case PrimitiveType_rune:
+        case PrimitiveType_u64:
+        case PrimitiveType_u128:
+        case PrimitiveType_int:
+        case PrimitiveType_bool:
+        case PrimitiveType_i8:
+        case PrimitiveType_i16:
+        case PrimitiveType_i32:
+        case PrimitiveType_i64:
+        case PrimitiveType_i128:
+            instruction.constant = MAKE_I64(node->value.int_);
+            break;
+
+        case PrimitiveType_float:
+        case PrimitiveType_f16:
+        case PrimitiveType_f32:
+        case PrimitiveType_f64:
+        case PrimitiveType_f128:
+            instruction.constant = MAKE_F64(node->value.float_);
+            break;
+
+        case PrimitiveType_string:
+            instruction.op        = IR_STRING;
+            instruction.immediate = (u32) node->value.string;
+            break;
+
+        default: unreachable();
+    }
+    return emit(builder, instruction, NULL, 0);
+}
+
+/* `and` and `or` only evaluate the right operand if the left one
+ * doesn't decide the result, and then join the two with a phi. */
+static IrRef build_logical_op(IrBuilder* builder, Ast_BinOp* node, Ast** next) {
+    Location location = ast_location(node->ast);
+
+    IrRef left = build_expression(builder, bin_op_left(node), next);
+    ensure_open_block(builder);
+
+    u32 right_block = new_block(builder);
+    u32 join_block  = new_block(builder);
+    if (node->op == And)
+        emit_branch(builder, left, right_block, join_block, location);
+    else
+        emit_branch(builder, left, join_block, right_block, location);
+    seal_block(builder, right_block);
+
+    builder->current = right_block;
+    IrRef right = build_expression(builder, bin_op_right(node), next);
+    emit_jump(builder, join_block, location);
+    seal_block(builder, join_block);
+
+    builder->current = join_block;
+    IrBlock* join = get_block(current_function(builder), join_block);
+    ASSERT(join->predecessors.count == 2);
+
+    IrRef operands[2] = { left, right };
+    IrInstruction phi = make_instruction(IR_PHI, location);
+    return insert_instruction(builder, join_block, 0, phi, operands, 2);
+}
+
+static IrRef build_bin_op(IrBuilder* builder, Ast_BinOp* node, Ast** next) {
+    if (node->op == And || node->op == Or)
+        return build_logical_op(builder, node, next);
+
+    IrRef operands[2];
+    operands[0] = build_expression(builder, bin_op_left(node), next);
+    operands[1] = build_expression(builder, bin_op_right(node), next);
+
+    IrOp op;
+    switch (node->op) {
+        case Add: op = IR_ADD; break;
+        case Sub: op = IR_SUB; break;
+        case Mul: op = IR_MUL; break;
+        case Div: op = IR_DIV; break;
+        case Mod: op = IR_MOD; break;
+        case Lt:  op = IR_LT;  break;
+        case Le:  op = IR_LE;  break;
+        case Eq:  op = IR_EQ;  break;
+        case Ne:  op = IR_NE;  break;
+        case Ge:  op = IR_GE;  break;
+        case Gt:  op = IR_GT;  break;
+        default: unreachable();
+    }
+    return emit(builder, make_instruction(op, ast_location(node->ast)), operands, 2);
+}
+
+static IrRef build_func_call(IrBuilder* builder, Ast_FuncCall* node, Ast** next) {
+    IrRef* arguments = ALLOCATE_ARRAY(IrRef, node->arg_count);
+
+    Ast* argument = (Ast*) (node + 1);
+    for (u32 i = 0; i < node->arg_count; ++i) {
+        arguments[i] = build_expression(builder, argument, &argument);
+    }
+    *next = argument;
+
+    IrInstruction instruction = make_instruction(IR_CALL, ast_location(node->ast));
+    instruction.immediate = resolve(builder, node->name);
+    IrRef result = emit(builder, instruction, arguments, node->arg_count);
+
+    FREE_ARRAY(IrRef, arguments, node->arg_count);
+    return result;
+}
+
+static IrRef build_expression(IrBuilder* builder, Ast* node, Ast** next) {
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            *next = (Ast*) (((Ast_Identifier*) node) + 1);
+            return build_identifier(builder, (Ast_Identifier*) node);
+        }
+        case AST_LITERAL: {
+            *next = (Ast*) (((Ast_Literal*) node) + 1);
+            return build_literal(builder, (Ast_Literal*) node);
+        }
+        case AST_BIN_OP:    return build_bin_op(builder,    (Ast_BinOp*) node,    next);
+        case AST_FUNC_CALL: return build_func_call(builder, (Ast_FuncCall*) node, next);
+        default: {
+            PANIC("Not an expression");
+            return IR_NONE;
+        }
+    }
+}
+
+
+static void build_store(IrBuilder* builder, u32 variable, IrRef value, Location location) {
+    IrInstruction instruction = make_instruction(IR_STORE_GLOBAL, location);
+    instruction.immediate = variable;
+    emit(builder, instruction, &value, 1);
+}
+
+static Ast* build_var_decl(IrBuilder* builder, Ast_VarDecl* node) {
+    Ast* next;
+    IrRef value = build_expression(builder, (Ast*) (node+1), &next);
+
+    declare(builder, node->name);
+    bool is_top_level = builder->function == 0 && builder->depth == 0;
+    if (is_top_level) {
+        builder->is_global[node->name] = true;
+        build_store(builder, node->name, value, ast_location(node->ast));
+    } else {
+        ensure_open_block(builder);
+        write_variable(builder, node->name, builder->current, value);
+    }
+    return next;
+}
+
+static Ast* build_var_assign(IrBuilder* builder, Ast_VarAssign* node) {
+    Ast* next;
+    IrRef value = build_expression(builder, (Ast*) (node+1), &next);
+
+    u32 variable = resolve(builder, node->name);
+    if (is_local(builder, variable)) {
+        ensure_open_block(builder);
+        write_variable(builder, variable, builder->current, value);
+    } else {
+        build_store(builder, variable, value, ast_location(node->ast));
+    }
+    return next;
+}
+
+static Ast* build_func_decl(IrBuilder* builder, Ast_FuncDecl* node) {
+    // @NOTE: Built once the enclosing code is done, so all globals are known.
+    builder->is_global[node->name] = true;
+    declare(builder, node->name);
+    dynarray_u32_append(&builder->pending_functions, (u32) ((u8*) node - builder->base));
+
+    Ast_Block* body = (Ast_Block*) ((Ast*) node + node->next);
+    return (Ast*) body + body->end;
+}
+
+static Ast* build_return_stmt(IrBuilder* builder, Ast_ReturnStmt* node) {
+    Ast* next;
+    IrRef value = build_expression(builder, (Ast*) (node+1), &next);
+    emit(builder, make_instruction(IR_RETURN, ast_location(node->ast)), &value, 1);
+    return next;
+}
+
+static Ast* build_if_stmt(IrBuilder* builder, Ast_IfStmt* node) {
+    Location location = ast_location(node->ast);
+
+    Ast*  body;
+    IrRef condition = build_expression(builder, (Ast*) (node+1), &body);
+    ensure_open_block(builder);
+
+    bool has_else = node->next != node->end;
+    u32 then_block = new_block(builder);
+    u32 join_block = new_block(builder);
+    u32 else_block = has_else ? new_block(builder) : join_block;
+
+    emit_branch(builder, condition, then_block, else_block, location);
+    seal_block(builder, then_block);
+
+    builder->current = then_block;
+    build_statement(builder, body);
+    emit_jump(builder, join_block, location);
+
+    if (has_else) {
+        seal_block(builder, else_block);
+        builder->current = else_block;
+
+        // An else-node is followed directly by its block, while an
+        // else-if is a nested if-statement with a condition.
+        Ast_IfStmt* else_ = (Ast_IfStmt*) (builder->base + node->next);
+        Ast* after_else = (Ast*) (else_ + 1);
+        if (after_else->type == AST_BLOCK)
+            build_statement(builder, after_else);
+        else
+            build_if_stmt(builder, else_);
+        emit_jump(builder, join_block, location);
+    }
+
+    seal_block(builder, join_block);
+    builder->current = join_block;
+    return (Ast*) (builder->base + node->end);
+}
+
+static Ast* build_while_stmt(IrBuilder* builder, Ast_WhileStmt* node) {
+    Location location = ast_location(node->ast);
+
+    // The header isn't sealed until the back edge from the body is known.
+    u32 header_block = new_block(builder);
+    emit_jump(builder, header_block, location);
+    builder->current = header_block;
+
+    Ast*  body;
+    IrRef condition = build_expression(builder, (Ast*) (node+1), &body);
+    ensure_open_block(builder);
+
+    u32 body_block = new_block(builder);
+    u32 exit_block = new_block(builder);
+    emit_branch(builder, condition, body_block, exit_block, location);
+    seal_block(builder, body_block);
+    seal_block(builder, exit_block);
+
+    builder->current = body_block;
+    build_statement(builder, body);
+    emit_jump(builder, header_block, location);
+    seal_block(builder, header_block);
+
+    builder->current = exit_block;
+    return (Ast*) (builder->base + node->end);
+}
+
+static Ast* build_block(IrBuilder* builder, Ast_Block* node) {
+    u32 scope_count = builder->scope.count;
+    builder->depth += 1;
+    Ast* statement = (Ast*) (node + 1);
+    for (u32 i = 0; i < node->stmt_count; ++i) {
+        statement = build_statement(builder, statement);
+    }
+    builder->depth -= 1;
+    builder->scope.count = scope_count;
+    return (Ast*) node + node->end;
+}
+
+static Ast* build_statement(IrBuilder* builder, Ast* node) {
+    ensure_open_block(builder);
+    switch (node->type) {
+        case AST_VAR_ASSIGN:  return build_var_assign(builder,  (Ast_VarAssign*) node);
+        case AST_VAR_DECL:    return build_var_decl(builder,    (Ast_VarDecl*) node);
+        case AST_FUNC_DECL:   return build_func_decl(builder,   (Ast_FuncDecl*) node);
+        case AST_RETURN_STMT: return build_return_stmt(builder, (Ast_ReturnStmt*) node);
+        case AST_IF_STMT:     return build_if_stmt(builder,     (Ast_IfStmt*) node);
+        case AST_WHILE_STMT:  return build_while_stmt(builder,  (Ast_WhileStmt*) node);
+        case AST_BLOCK:       return build_block(builder,       (Ast_Block*) node);
+        case AST_IMPORT:      return (Ast*) (((Ast_Import*) node) + 1);
+        default: {
+            Ast* next;
+            build_expression(builder, node, &next);
+            return next;
+        }
+    }
+}
+
+
+static u32 begin_function(IrBuilder* builder, u32 name, Location location) {
+    IrFunction function = (IrFunction) {
+        .name         = name,
+        .param_count  = 0,
+        .location     = location,
+        .instructions = make_dynarray_IrInstruction(),
+        .blocks       = make_dynarray_IrBlock(),
+        .operands     = make_dynarray_u32(),
+    };
+    builder->function = dynarray_IrFunction_append(&builder->module->functions, function);
+    builder->depth    = 0;
+
+    builder->current = new_block(builder);
+    seal_block(builder, builder->current);
+    return builder->function;
+}
+
+static void end_function(IrBuilder* builder) {
+    if (!is_terminated(current_function(builder), builder->current))
+        emit(builder, make_instruction(IR_RETURN, current_function(builder)->location), NULL, 0);
+    definitions_free(&builder->definitions);
+}
+
+static void build_function(IrBuilder* builder, Ast_FuncDecl* node) {
+    u32 scope_count = builder->scope.count;
+    begin_function(builder, node->name, ast_location(node->ast));
+
+    Ast_Identifier* params = (Ast_Identifier*) (node + 1);
+    for (u32 i = 0; i < node->param_count; ++i) {
+        IrInstruction instruction = make_instruction(IR_PARAM, ast_location(params[i].ast));
+        instruction.immediate = i;
+        IrRef value = emit(builder, instruction, NULL, 0);
+
+        declare(builder, params[i].absolute_offset);
+        write_variable(builder, params[i].absolute_offset, builder->current, value);
+    }
+    current_function(builder)->param_count = node->param_count;
+
+    // Parameters are at the same depth as the body.
+    builder->depth = 1;
+    build_block(builder, (Ast_Block*) ((Ast*) node + node->next));
+    end_function(builder);
+    builder->scope.count = scope_count;
+}
+
+
+IrModule ir_build_module(Parser* parser, Ast_Module* module) {
+    IrModule result = (IrModule) {
+        .parser    = parser,
+        .functions = make_dynarray_IrFunction(),
+    };
+
+    IrBuilder builder = (IrBuilder) {
+        .parser            = parser,
+        .module            = &result,
+        .base              = parser->buffer.data,
+        .variable_count    = parser->variables.count,
+        .definitions       = { 0 },
+        .scope             = make_dynarray_u32(),
+        .pending_functions = make_dynarray_u32(),
+    };
+    builder.is_global = ALLOCATE_ARRAY(bool, builder.variable_count + 1);
+    memset(builder.is_global, 0, sizeof(bool) * builder.variable_count);
+
+    begin_function(&builder, IR_NONE, ast_location(module->ast));
+    Ast* statement = (Ast*) (module + 1);
+    for (u32 i = 0; i < module->stmt_count; ++i) {
+        statement = build_statement(&builder, statement);
+    }
+    end_function(&builder);
+
+    // @NOTE: Functions may declare new functions, which are appended.
+    for (u32 i = 0; i < builder.pending_functions.count; ++i) {
+        build_function(&builder, (Ast_FuncDecl*) (builder.base + builder.pending_functions.data[i]));
+    }
+
+    FREE_ARRAY(bool, builder.is_global, builder.variable_count + 1);
+    FREE_ARRAY(u32,  builder.scope.data, builder.scope.capacity);
+    FREE_ARRAY(u32,  builder.pending_functions.data, builder.pending_functions.capacity);
+
+    for (u32 i = 0; i < result.functions.count; ++i) {
+        ir_count_uses(&result.functions.data[i]);
+    }
+    return result;
+}
+
+
+void ir_free_module(IrModule* module) {
+    for (u32 i = 0; i < module->functions.count; ++i) {
+        IrFunction* function = &module->functions.data[i];
+        for (u32 j = 0; j < function->blocks.count; ++j) {
+            IrBlock* block = &function->blocks.data[j];
+            FREE_ARRAY(u32, block->instructions.data,    block->instructions.capacity);
+            FREE_ARRAY(u32, block->predecessors.data,    block->predecessors.capacity);
+            FREE_ARRAY(u32, block->incomplete_phis.data, block->incomplete_phis.capacity);
+        }
+        FREE_ARRAY(IrBlock,       function->blocks.data,       function->blocks.capacity);
+        FREE_ARRAY(IrInstruction, function->instructions.data, function->instructions.capacity);
+        FREE_ARRAY(u32,           function->operands.data,     function->operands.capacity);
+    }
+    FREE_ARRAY(IrFunction, module->functions.data, module->functions.capacity);
+    *module = (IrModule) { 0 };
+}
+
+
+
+/* ---- Queries ---- */
+
+IrRef ir_resolve(IrFunction* function, IrRef ref) {
+    while (ref != IR_NONE && function->instructions.data[ref].replacement != IR_NONE)
+        ref = function->instructions.data[ref].replacement;
+    return ref;
+}
+
+IrRef* ir_operands(IrFunction* function, IrInstruction* instruction) {
+    return function->operands.data + instruction->first_operand;
+}
+
+void ir_count_uses(IrFunction* function) {
+    for (u32 i = 0; i < function->instructions.count; ++i)
+        function->instructions.data[i].use_count = 0;
+
+    for (u32 i = 0; i < function->blocks.count; ++i) {
+        IrBlock* block = &function->blocks.data[i];
+        for (u32 j = 0; j < block->instructions.count; ++j) {
+            IrInstruction* instruction = get_instruction(function, block->instructions.data[j]);
+            IrRef* operands = ir_operands(function, instruction);
+            for (u32 k = 0; k < instruction->operand_count; ++k) {
+                operands[k] = ir_resolve(function, operands[k]);
+                function->instructions.data[operands[k]].use_count += 1;
+            }
+        }
+    }
+}
+
+
+/* Removes instructions that have been turned into NOP from the blocks. */
+static void compact_blocks(IrFunction* function) {
+    for (u32 i = 0; i < function->blocks.count; ++i) {
+        DynArray_u32* list = &function->blocks.data[i].instructions;
+        u32 count = 0;
+        for (u32 j = 0; j < list->count; ++j) {
+            if (get_instruction(function, list->data[j])->op != IR_NOP)
+                list->data[count++] = list->data[j];
+        }
+        list->count = count;
+    }
+}
+
+
+
+/* ---- Verification ---- */
+
+#define VERIFY(condition, ...)                                                      \
+    do {                                                                            \
+        if (!(condition)) {                                                         \
+            fprintf(stderr, "[IR] Verification failed in block %u: ", i);           \
+            fprintf(stderr, __VA_ARGS__);                                           \
+            fprintf(stderr, "\n");                                                  \
+            valid = false;                                                          \
+        }                                                                           \
+    } while (0)
+
+bool ir_verify(IrModule* module, IrFunction* function) {
+    bool valid = true;
+
+    for (u32 i = 0; i < function->blocks.count; ++i) {
+        IrBlock* block = &function->blocks.data[i];
+        VERIFY(block->sealed, "block isn't sealed");
+        VERIFY(block->instructions.count > 0, "block is empty");
+
+        bool in_phis = true;
+        for (u32 j = 0; j < block->instructions.count; ++j) {
+            IrRef ref = block->instructions.data[j];
+            IrInstruction* instruction = get_instruction(function, ref);
+            bool is_last = j + 1 == block->instructions.count;
+
+            VERIFY(instruction->op != IR_NOP, "%%%u is removed but still in the block", ref);
+            VERIFY(instruction->block == i, "%%%u belongs to block %u", ref, instruction->block);
+            VERIFY(ir_is_terminator(instruction->op) == is_last, "%%%u: blocks must end with exactly one terminator", ref);
+
+            if (instruction->op == IR_PHI) {
+                VERIFY(in_phis, "phi %%%u after other instructions", ref);
+                VERIFY(instruction->operand_count == block->predecessors.count, "phi %%%u has %u operands but the block has %u predecessors", ref, instruction->operand_count, block->predecessors.count);
+            } else if (instruction->op != IR_UNDEF) {
+                in_phis = false;
+            }
+
+            IrRef* operands = ir_operands(function, instruction);
+            for (u32 k = 0; k < instruction->operand_count; ++k) {
+                IrRef operand = ir_resolve(function, operands[k]);
+                VERIFY(operand < function->instructions.count, "%%%u has an invalid operand", ref);
+                if (operand < function->instructions.count)
+                    VERIFY(get_instruction(function, operand)->op != IR_NOP, "%%%u uses removed %%%u", ref, operand);
+            }
+
+            int target_count = instruction->op == IR_BRANCH ? 2 : instruction->op == IR_JUMP ? 1 : 0;
+            for (int k = 0; k < target_count; ++k) {
+                u32 target = instruction->targets[k];
+                VERIFY(target < function->blocks.count, "%%%u jumps to an invalid block", ref);
+                if (target >= function->blocks.count)
+                    continue;
+
+                bool found = false;
+                IrBlock* successor = &function->blocks.data[target];
+                for (u32 p = 0; p < successor->predecessors.count; ++p)
+                    found |= successor->predecessors.data[p] == i;
+                VERIFY(found, "block %u is missing as predecessor of block %u", i, target);
+            }
+        }
+    }
+    return valid;
+}
+
+#undef VERIFY
+
+
+
+/* ---- Printing ---- */
+
+static void print_variable(IrModule* module, u32 variable) {
+    if (variable == IR_NONE) {
+        printf("<script>");
+    } else {
+        Slice name = module->parser->variables.data[variable];
+        printf("%.*s", name.count, name.source);
+    }
+}
+
+void ir_print_function(IrModule* module, IrFunction* function) {
+    printf("function ");
+    print_variable(module, function->name);
+    printf(" (%u params)\n", function->param_count);
+
+    for (u32 i = 0; i < function->blocks.count; ++i) {
+        IrBlock* block = &function->blocks.data[i];
+        printf("  block%u:", i);
+        if (block->predecessors.count > 0) {
+            printf("  ; preds:");
+            for (u32 j = 0; j < block->predecessors.count; ++j)
+                printf(" block%u", block->predecessors.data[j]);
+        }
+        printf("\n");
+
+        for (u32 j = 0; j < block->instructions.count; ++j) {
+            IrRef ref = block->instructions.data[j];
+            IrInstruction* instruction = get_instruction(function, ref);
+
+            if (IR_OP_HAS_SIDE_EFFECTS[instruction->op] && instruction->op != IR_CALL && instruction->op != IR_DIV && instruction->op != IR_MOD)
+                printf("    ");
+            else
+                printf("    %%%-3u = ", ref);
+            printf("%s", IR_OP_NAMES[instruction->op]);
+
+            switch (instruction->op) {
+                case IR_CONST:  printf(" "); print_value(instruction->constant); break;
+                case IR_STRING: {
+                    Slice string = module->parser->strings.data[instruction->immediate];
+                    printf(" %.*s", string.count, string.source);
+                    break;
+                }
+                case IR_PARAM:  printf(" %u", instruction->immediate); break;
+                case IR_PHI:
+                case IR_LOAD_GLOBAL:
+                case IR_STORE_GLOBAL:
+                case IR_CALL: {
+                    if (instruction->immediate != IR_NONE) {
+                        printf(" ");
+                        print_variable(module, instruction->immediate);
+                    }
+                    break;
+                }
+                default: break;
+            }
+
+            IrRef* operands = ir_operands(function, instruction);
+            for (u32 k = 0; k < instruction->operand_count; ++k) {
+                printf("%s%%%u", k == 0 ? " " : ", ", ir_resolve(function, operands[k]));
+                if (instruction->op == IR_PHI)
+                    printf(" [block%u]", block->predecessors.data[k]);
+            }
+
+            if (instruction->op == IR_JUMP)
+                printf(" block%u", instruction->targets[0]);
+            else if (instruction->op == IR_BRANCH)
+                printf(", block%u, block%u", instruction->targets[0], instruction->targets[1]);
+            printf("\n");
+        }
+    }
+}
+
+void ir_print_module(IrModule* module) {
+    for (u32 i = 0; i < module->functions.count; ++i) {
+        ir_print_function(module, &module->functions.data[i]);
+    }
+}
+
+
+
+/* ---- Passes ---- */
+
+static IrFunction* find_function(IrModule* module, u32 name) {
+    for (u32 i = 0; i < module->functions.count; ++i) {
+        if (module->functions.data[i].name == name)
+            return &module->functions.data[i];
+    }
+    return NULL;
+}
+
+static u32 function_size(IrFunction* function) {
+    u32 size = 0;
+    for (u32 i = 0; i < function->blocks.count; ++i)
+        size += function->blocks.data[i].instructions.count;
+    return size;
+}
+
+/* A function can be inlined if it's small, doesn't call itself, and is
+ * only ever called by its name; never loaded as a value or reassigned. */
+static bool is_inlinable(IrModule* module, IrFunction* callee) {
+    if (function_size(callee) > IR_INLINE_MAX_CALLEE_SIZE)
+        return false;
+    if (get_block(callee, 0)->predecessors.count > 0)
+        return false;
+
+    for (u32 i = 0; i < module->functions.count; ++i) {
+        IrFunction* function = &module->functions.data[i];
+        for (u32 j = 0; j < function->blocks.count; ++j) {
+            IrBlock* block = &function->blocks.data[j];
+            for (u32 k = 0; k < block->instructions.count; ++k) {
+                IrInstruction* instruction = get_instruction(function, block->instructions.data[k]);
+                if (instruction->immediate != callee->name)
+                    continue;
+                if (instruction->op == IR_LOAD_GLOBAL || instruction->op == IR_STORE_GLOBAL)
+                    return false;
+                if (instruction->op == IR_CALL && function == callee)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+static IrRef append_instruction(IrFunction* function, IrInstruction instruction, const IrRef* operands, u32 operand_count) {
+    instruction.first_operand = function->operands.count;
+    instruction.operand_count = operand_count;
+    for (u32 i = 0; i < operand_count; ++i)
+        dynarray_u32_append(&function->operands, operands[i]);
+    return dynarray_IrInstruction_append(&function->instructions, instruction);
+}
+
+static u32 append_block(IrFunction* function) {
+    IrBlock block = (IrBlock) {
+        .instructions    = make_dynarray_u32(),
+        .predecessors    = make_dynarray_u32(),
+        .incomplete_phis = make_dynarray_u32(),
+        .sealed          = true,
+    };
+    return dynarray_IrBlock_append(&function->blocks, block);
+}
+
+/* Replaces `call` by a copy of the callee's blocks. The block of the
+ * call is split in two; the first half jumps to the copied entry and
+ * every return jumps to the second half, where a phi joins the returned
+ * values. Parameters are replaced by the arguments. */
+static void inline_call(IrFunction* caller, IrRef call, IrFunction* callee) {
+    IrInstruction* instruction = get_instruction(caller, call);
+    u32      call_block = instruction->block;
+    Location location   = instruction->location;
+
+    // @NOTE: The operands are reallocated while copying.
+    u32    argument_count = instruction->operand_count;
+    IrRef* arguments      = ALLOCATE_ARRAY(IrRef, argument_count);
+    memcpy(arguments, ir_operands(caller, instruction), sizeof(IrRef) * argument_count);
+
+    // Move everything after the call into a new block.
+    u32 continuation = append_block(caller);
+    {
+        DynArray_u32* list = &get_block(caller, call_block)->instructions;
+        u32 position = 0;
+        while (list->data[position] != call)
+            ++position;
+
+        for (u32 i = position + 1; i < list->count; ++i) {
+            dynarray_u32_append(&get_block(caller, continuation)->instructions, list->data[i]);
+            get_instruction(caller, list->data[i])->block = continuation;
+        }
+        get_block(caller, call_block)->instructions.count = position;
+
+        DynArray_u32* moved = &get_block(caller, continuation)->instructions;
+        IrInstruction* terminator = get_instruction(caller, moved->data[moved->count - 1]);
+        int target_count = terminator->op == IR_BRANCH ? 2 : terminator->op == IR_JUMP ? 1 : 0;
+        for (int k = 0; k < target_count; ++k) {
+            DynArray_u32* predecessors = &get_block(caller, terminator->targets[k])->predecessors;
+            for (u32 p = 0; p < predecessors->count; ++p) {
+                if (predecessors->data[p] == call_block)
+                    predecessors->data[p] = continuation;
+            }
+        }
+    }
+
+    u32 instruction_base = caller->instructions.count;
+    u32 block_base       = caller->blocks.count;
+
+    for (u32 i = 0; i < callee->instructions.count; ++i) {
+        IrInstruction copy = callee->instructions.data[i];
+        IrRef* operands = ir_operands(callee, &copy);
+
+        copy.block = copy.block == IR_NONE ? IR_NONE : block_base + copy.block;
+        if (copy.replacement != IR_NONE)
+            copy.replacement = instruction_base + copy.replacement;
+        copy.inlined_call = copy.inlined_call == IR_NONE ? call : instruction_base + copy.inlined_call;
+        if (copy.op == IR_JUMP || copy.op == IR_BRANCH) {
+            copy.targets[0] = block_base + copy.targets[0];
+            if (copy.op == IR_BRANCH)
+                copy.targets[1] = block_base + copy.targets[1];
+        }
+
+        IrRef ref = append_instruction(caller, copy, NULL, 0);
+        get_instruction(caller, ref)->first_operand = caller->operands.count;
+        get_instruction(caller, ref)->operand_count = copy.operand_count;
+        for (u32 k = 0; k < copy.operand_count; ++k)
+            dynarray_u32_append(&caller->operands, instruction_base + operands[k]);
+
+        if (copy.op == IR_PARAM) {
+            IrInstruction* param = get_instruction(caller, ref);
+            param->op            = IR_NOP;
+            param->operand_count = 0;
+            param->replacement   = arguments[copy.immediate];
+        }
+    }
+
+    DynArray_u32 returned = make_dynarray_u32();
+    for (u32 i = 0; i < callee->blocks.count; ++i) {
+        u32 block = append_block(caller);
+        IrBlock* original = get_block(callee, i);
+        for (u32 j = 0; j < original->predecessors.count; ++j)
+            dynarray_u32_append(&get_block(caller, block)->predecessors, block_base + original->predecessors.data[j]);
+        for (u32 j = 0; j < original->instructions.count; ++j) {
+            if (get_instruction(caller, instruction_base + original->instructions.data[j])->op != IR_NOP)
+                dynarray_u32_append(&get_block(caller, block)->instructions, instruction_base + original->instructions.data[j]);
+        }
+
+        DynArray_u32*  list       = &get_block(caller, block)->instructions;
+        IrRef          last       = list->data[list->count - 1];
+        IrInstruction* terminator = get_instruction(caller, last);
+        if (terminator->op != IR_RETURN)
+            continue;
+
+        IrRef value;
+        if (terminator->operand_count == 1) {
+            value = ir_operands(caller, terminator)[0];
+        } else {
+            IrInstruction null = make_instruction(IR_CONST, terminator->location);
+            null.block        = block;
+            null.inlined_call = terminator->inlined_call;
+            value = append_instruction(caller, null, NULL, 0);
+            list->data[list->count - 1] = value;
+            dynarray_u32_append(list, last);
+        }
+        dynarray_u32_append(&returned, value);
+
+        terminator = get_instruction(caller, last);
+        terminator->op            = IR_JUMP;
+        terminator->operand_count = 0;
+        terminator->targets[0]    = continuation;
+        dynarray_u32_append(&get_block(caller, continuation)->predecessors, block);
+    }
+
+    IrInstruction jump = make_instruction(IR_JUMP, location);
+    jump.block      = call_block;
+    jump.targets[0] = block_base;
+    dynarray_u32_append(&get_block(caller, call_block)->instructions, append_instruction(caller, jump, NULL, 0));
+    dynarray_u32_append(&get_block(caller, block_base)->predecessors, call_block);
+
+    // The returned values are joined in the same order as the predecessors.
+    IrRef result;
+    if (returned.count == 1) {
+        result = returned.data[0];
+    } else {
+        IrInstruction join = make_instruction(returned.count == 0 ? IR_UNDEF : IR_PHI, location);
+        join.block = continuation;
+        result = append_instruction(caller, join, returned.data, returned.count);
+
+        DynArray_u32* list = &get_block(caller, continuation)->instructions;
+        dynarray_u32_append(list, result);
+        memmove(list->data + 1, list->data, sizeof(u32) * (list->count - 1));
+        list->data[0] = result;
+    }
+
+    instruction = get_instruction(caller, call);
+    instruction->op          = IR_NOP;
+    instruction->replacement = result;
+
+    FREE_ARRAY(u32,   returned.data, returned.capacity);
+    FREE_ARRAY(IrRef, arguments, argument_count);
+}
+
+/* Inlines calls to small functions whose arity matches the call. Calls
+ * with the wrong number of arguments are left to fail at run-time. */
+bool ir_pass_inline_calls(IrModule* module, IrFunction* function) {
+    bool changed = false;
+    for (u32 i = 0; i < function->instructions.count && function->instructions.count < IR_INLINE_MAX_CALLER_SIZE; ++i) {
+        IrInstruction* instruction = get_instruction(function, i);
+        if (instruction->op != IR_CALL)
+            continue;
+
+        IrFunction* callee = find_function(module, instruction->immediate);
+        if (callee == NULL || callee == function || callee->param_count != instruction->operand_count)
+            continue;
+        if (!is_inlinable(module, callee))
+            continue;
+
+        inline_call(function, i, callee);
+        changed = true;
+    }
+
+    if (changed)
+        ir_count_uses(function);
+    return changed;
+}
+
+/* A phi is trivial if all of its operands are either the same value or
+ * the phi itself, in which case it's replaced by that value. Removing
+ * one may make others trivial, so it's repeated until nothing changes. */
+bool ir_pass_remove_trivial_phis(IrModule* module, IrFunction* function) {
+    bool changed_any = false;
+    bool changed     = true;
+    while (changed) {
+        changed = false;
+        for (u32 i = 0; i < function->instructions.count; ++i) {
+            IrInstruction* phi = get_instruction(function, i);
+            if (phi->op != IR_PHI)
+                continue;
+
+            IrRef  same     = IR_NONE;
+            bool   trivial  = true;
+            IrRef* operands = ir_operands(function, phi);
+            for (u32 k = 0; k < phi->operand_count; ++k) {
+                IrRef operand = ir_resolve(function, operands[k]);
+                if (operand == same || operand == i)
+                    continue;
+                if (same != IR_NONE) {
+                    trivial = false;
+                    break;
+                }
+                same = operand;
+            }
+            if (!trivial)
+                continue;
+
+            if (same == IR_NONE) {
+                // Only references itself, so it's unreachable or undefined.
+                phi->op = IR_UNDEF;
+                phi->operand_count = 0;
+            } else {
+                phi->op          = IR_NOP;
+                phi->replacement = same;
+            }
+            changed = changed_any = true;
+        }
+    }
+
+    if (changed_any) {
+        compact_blocks(function);
+        ir_count_uses(function);
+    }
+    return changed_any;
+}
+
+/* Removes values without side effects that are never used. */
+bool ir_pass_remove_dead_values(IrModule* module, IrFunction* function) {
+    ir_count_uses(function);
+
+    DynArray_u32 worklist = make_dynarray_u32();
+    for (u32 i = 0; i < function->instructions.count; ++i) {
+        IrInstruction* instruction = get_instruction(function, i);
+        if (instruction->op != IR_NOP && instruction->use_count == 0 && !IR_OP_HAS_SIDE_EFFECTS[instruction->op])
+            dynarray_u32_append(&worklist, i);
+    }
+
+    bool changed = worklist.count > 0;
+    while (worklist.count > 0) {
+        IrInstruction* instruction = get_instruction(function, worklist.data[--worklist.count]);
+        if (instruction->op == IR_NOP)
+            continue;
+        instruction->op = IR_NOP;
+
+        IrRef* operands = ir_operands(function, instruction);
+        for (u32 k = 0; k < instruction->operand_count; ++k) {
+            IrInstruction* operand = get_instruction(function, operands[k]);
+            operand->use_count -= 1;
+            if (operand->use_count == 0 && operand->op != IR_NOP && !IR_OP_HAS_SIDE_EFFECTS[operand->op])
+                dynarray_u32_append(&worklist, operands[k]);
+        }
+    }
+    FREE_ARRAY(u32, worklist.data, worklist.capacity);
+
+    if (changed)
+        compact_blocks(function);
+    return changed;
+}
+
+
+const IrPass IR_DEFAULT_PASSES[] = {
+    { "inline-calls",        ir_pass_inline_calls        },
+    { "remove-trivial-phis", ir_pass_remove_trivial_phis },
+    { "remove-dead-values",  ir_pass_remove_dead_values  },
+};
+const int IR_DEFAULT_PASS_COUNT = sizeof(IR_DEFAULT_PASSES) / sizeof(IR_DEFAULT_PASSES[0]);
+
+
+#define IR_MAX_PASS_ITERATIONS 8
+
+void ir_run_passes(IrModule* module, const IrPass* passes, int count) {
+    for (u32 i = 0; i < module->functions.count; ++i) {
+        IrFunction* function = &module->functions.data[i];
+
+        bool changed   = true;
+        int  iteration = 0;
+        while (changed && iteration++ < IR_MAX_PASS_ITERATIONS) {
+            changed = false;
+            for (int j = 0; j < count; ++j) {
+                changed |= passes[j].run(module, function);
+#ifdef DEBUG
+                if (!ir_verify(module, function)) {
+                    ir_print_function(module, function);
+                    PANIC("IR is invalid after pass '%s'", passes[j].name);
+                }
+#endif
+            }
+        }
+    }
+}
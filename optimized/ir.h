@@ -0,0 +1,168 @@
+#pragma once
+
+#include "c-preamble/nax_preamble.h"
+#include "array.h"
+#include "ast.h"
+#include "value.h"
+#include "parser.h"
+
+
+/* A mid-level IR in SSA form, built from the flat AST. Every function
+ * is a graph of basic blocks, where each block starts with its phis and
+ * ends with exactly one terminator (JUMP, BRANCH or RETURN).
+ *
+ * Construction follows "Simple and Efficient Construction of Static
+ * Single Assignment Form" (Braun et al. 2013), so it doesn't need a
+ * dominator tree. Variables declared at the top-level of a module are
+ * globals and are accessed with LOAD_GLOBAL/STORE_GLOBAL; all other
+ * variables become SSA values.
+ */
+
+
+#define IR_NONE UINT32_MAX
+
+// X(name, has_side_effects)
+#define ALL_IR_OPS(X)           \
+    X(NOP,           false)     \
+    X(UNDEF,         false)     \
+    X(CONST,         false)     \
+    X(STRING,        false)     \
+    X(PARAM,         false)     \
+    X(PHI,           false)     \
+    X(ADD,           false)     \
+    X(SUB,           false)     \
+    X(MUL,           false)     \
+    X(DIV,           true)      \
+    X(MOD,           true)      \
+    X(LT,            false)     \
+    X(LE,            false)     \
+    X(EQ,            false)     \
+    X(NE,            false)     \
+    X(GE,            false)     \
+    X(GT,            false)     \
+    X(LOAD_GLOBAL,   false)     \
+    X(STORE_GLOBAL,  true)      \
+    X(CALL,          true)      \
+    X(JUMP,          true)      \
+    X(BRANCH,        true)      \
+    X(RETURN,        true)      \
+
+#define X(name, side_effects) IR_##name,
+typedef enum {
+    ALL_IR_OPS(X)
+    IR_OP_COUNT
+} IrOp;
+#undef X
+
+extern const char* IR_OP_NAMES[IR_OP_COUNT];
+extern const bool  IR_OP_HAS_SIDE_EFFECTS[IR_OP_COUNT];
+
+static inline bool ir_is_terminator(IrOp op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+
+// Index of an instruction in its function.
+typedef u32 IrRef;
+
+typedef struct {
+    IrOp op;
+    u32  block;
+
+    // Operands are stored in IrFunction.operands. For phis they're
+    // in the same order as the predecessors of the block.
+    u32 first_operand;
+    u32 operand_count;
+
+    // The variable of a PHI, the global of LOAD/STORE_GLOBAL, the callee
+    // of CALL, the index of a PARAM and the string index of STRING.
+    u32 immediate;
+    // Successor blocks of JUMP and BRANCH (then, else).
+    u32 targets[2];
+
+    // Set when the instruction has been replaced by another value.
+    IrRef replacement;
+    u32   use_count;
+    // The call that the instruction has been inlined from, whose own
+    // location (and call) continues the stack trace. IR_NONE if it
+    // hasn't been inlined.
+    IrRef inlined_call;
+
+    Value    constant;
+    Location location;
+} IrInstruction;
+
+declare_dynarray(IrInstruction)
+
+
+typedef struct {
+    // Phis first and the terminator last.
+    DynArray_u32 instructions;
+    DynArray_u32 predecessors;
+    // Phis created before all predecessors were known.
+    DynArray_u32 incomplete_phis;
+    bool sealed;
+} IrBlock;
+
+declare_dynarray(IrBlock)
+
+
+typedef struct {
+    // IR_NONE for the top-level code of a module.
+    u32 name;
+    u32 param_count;
+    Location location;
+
+    DynArray_IrInstruction instructions;
+    // The first block is the entry.
+    DynArray_IrBlock       blocks;
+    DynArray_u32           operands;
+} IrFunction;
+
+declare_dynarray(IrFunction)
+
+
+typedef struct {
+    Parser* parser;
+    // The first function is the top-level code of the module.
+    DynArray_IrFunction functions;
+} IrModule;
+
+
+IrModule ir_build_module(Parser* parser, Ast_Module* module);
+void     ir_free_module(IrModule* module);
+
+IrRef  ir_resolve(IrFunction* function, IrRef ref);
+IrRef* ir_operands(IrFunction* function, IrInstruction* instruction);
+void   ir_count_uses(IrFunction* function);
+
+bool ir_verify(IrModule* module, IrFunction* function);
+void ir_print_function(IrModule* module, IrFunction* function);
+void ir_print_module(IrModule* module);
+
+
+/* ---- Passes ---- */
+
+// Returns true if the function was changed.
+typedef bool (*IrPassFunction)(IrModule* module, IrFunction* function);
+
+typedef struct {
+    const char*    name;
+    IrPassFunction run;
+} IrPass;
+
+// Callees with more instructions than this are never inlined, and no
+// more are inlined into a caller once it's grown past the second limit.
+#define IR_INLINE_MAX_CALLEE_SIZE 32
+#define IR_INLINE_MAX_CALLER_SIZE 2048
+
+bool ir_pass_inline_calls(IrModule* module, IrFunction* function);
+bool ir_pass_remove_trivial_phis(IrModule* module, IrFunction* function);
+bool ir_pass_remove_dead_values(IrModule* module, IrFunction* function);
+
+extern const IrPass IR_DEFAULT_PASSES[];
+extern const int    IR_DEFAULT_PASS_COUNT;
+
+// Runs the passes in order over every function until none of them make
+// any more changes. The IR is verified after each pass in debug builds.
+void ir_run_passes(IrModule* module, const IrPass* passes, int count);
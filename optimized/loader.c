@@ -0,0 +1,322 @@
+#include "loader.h"
+#include "tokenizer.h"
+#include "allocators/allocator.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+Slice load_file(const char* file_path) {
+    FILE* file = fopen(file_path, "r");
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        char* buffer = nax_alloc(char, (word_t)length+1);
+        if (buffer) {
+            fread(buffer, 1, length, file);
+            buffer[length] = '\0';
+            fclose(file);
+            return (Slice) { .source=buffer, .count=(int)length };
+        } else {
+            fclose(file);
+            fprintf(stderr, "Couldn't read file '%s'", file_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fprintf(stderr, "Couldn't open file '%s'", file_path);
+    exit(EXIT_FAILURE);
+}
+
+
+
+/* ---- Dependency graph ---- */
+
+/* Returns a copy of `path` without '.', '..' and symbolic links, so a
+ * module imported under different paths is only loaded once. A path that
+ * can't be resolved is kept as it is, and fails when it's read. */
+static char* canonical_path(const char* path) {
+    char resolved[PATH_MAX];
+    const char* result = realpath(path, resolved) ? resolved : path;
+
+    int length = (int) strlen(result);
+    char* copy = ALLOCATE_ARRAY(char, length + 1);
+    memcpy(copy, result, length + 1);
+    return copy;
+}
+
+/* Imports are relative to the directory of the importing module. */
+static char* resolve_import(const char* importer, Slice import) {
+    int directory = 0;
+    if (import.source[0] != '/') {
+        const char* slash = strrchr(importer, '/');
+        directory = slash ? (int) (slash - importer) + 1 : 0;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%.*s%.*s", directory, importer, import.count, import.source);
+    return canonical_path(path);
+}
+
+static u32 add_module(ModuleGraph* graph, Table_u32* indices, const char* path) {
+    Slice key = (Slice) { .source=path, .count=(int) strlen(path) };
+    u32 index;
+    if (table_u32_get(indices, key, &index))
+        return index;
+
+    Module module = (Module) {
+        .path            = path,
+        .source          = (Slice) { 0 },
+        .import_count    = 0,
+        .dependents      = make_dynarray_u32(),
+        .pending_imports = 0,
+        .arena           = make_arena(),
+        .ast             = NULL,
+        .failed          = false,
+    };
+    index = dynarray_Module_append(&graph->modules, module);
+    ASSERT(table_u32_add(indices, key, index));
+    return index;
+}
+
+
+/* Reads every module reachable from `paths`, but only tokenizes the
+ * import header of each, and orders them so imports come first. */
+ModuleGraph load_module_graph(const char* const* paths, int count) {
+    ModuleGraph graph = (ModuleGraph) {
+        .modules = make_dynarray_Module(),
+        .order   = make_dynarray_u32(),
+    };
+    Table_u32 indices = table_u32_make();
+
+    for (int i = 0; i < count; ++i) {
+        add_module(&graph, &indices, canonical_path(paths[i]));
+    }
+
+    // @NOTE: The array grows as new imports are discovered.
+    for (u32 i = 0; i < graph.modules.count; ++i) {
+        Slice source = load_file(graph.modules.data[i].path);
+
+        // @NOTE: One more than fits, so a module with too many imports is
+        //  reported instead of losing the rest of them.
+        Slice imports[MODULE_MAX_IMPORTS + 1];
+        int import_count = tokenize_imports(source.source, imports, MODULE_MAX_IMPORTS + 1);
+        if (import_count > MODULE_MAX_IMPORTS) {
+            fprintf(stderr, "[LOADER] Error: '%s' has more than %d imports.\n", graph.modules.data[i].path, MODULE_MAX_IMPORTS);
+            exit(EXIT_FAILURE);
+        }
+
+        for (int j = 0; j < import_count; ++j) {
+            char* path  = resolve_import(graph.modules.data[i].path, imports[j]);
+            u32   index = add_module(&graph, &indices, path);
+
+            Module* module = &graph.modules.data[i];
+            module->imports[module->import_count++] = index;
+        }
+
+        Module* module = &graph.modules.data[i];
+        module->source          = source;
+        module->pending_imports = module->import_count;
+    }
+
+    for (u32 i = 0; i < graph.modules.count; ++i) {
+        Module* module = &graph.modules.data[i];
+        for (u32 j = 0; j < module->import_count; ++j) {
+            dynarray_u32_append(&graph.modules.data[module->imports[j]].dependents, i);
+        }
+    }
+
+    // Kahn's algorithm, only to find a valid order and to reject cycles.
+    u32* remaining = ALLOCATE_ARRAY(u32, graph.modules.count);
+    for (u32 i = 0; i < graph.modules.count; ++i) {
+        remaining[i] = graph.modules.data[i].import_count;
+        if (remaining[i] == 0)
+            dynarray_u32_append(&graph.order, i);
+    }
+    for (u32 i = 0; i < graph.order.count; ++i) {
+        Module* module = &graph.modules.data[graph.order.data[i]];
+        for (u32 j = 0; j < module->dependents.count; ++j) {
+            u32 dependent = module->dependents.data[j];
+            if (--remaining[dependent] == 0)
+                dynarray_u32_append(&graph.order, dependent);
+        }
+    }
+
+    if (graph.order.count != graph.modules.count) {
+        for (u32 i = 0; i < graph.modules.count; ++i) {
+            if (remaining[i] != 0) {
+                fprintf(stderr, "[LOADER] Error: '%s' is part of an import cycle.\n", graph.modules.data[i].path);
+                break;
+            }
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    FREE_ARRAY(u32, remaining, graph.modules.count);
+    table_u32_free(&indices);
+    return graph;
+}
+
+
+
+/* ---- Parallel compilation ---- */
+
+typedef struct {
+    ModuleGraph* graph;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+
+    // Modules whose imports all have been compiled.
+    DynArray_u32 ready;
+    u32 ready_it;
+    // Modules that haven't finished compiling yet.
+    u32 remaining;
+} Loader;
+
+typedef struct {
+    Loader*        loader;
+    StackAllocator allocator;
+    pthread_t      thread;
+} Worker;
+
+
+static void compile_module(Module* self, StackAllocator* allocator) {
+    TokenStream stream = make_token_stream(self->source.source, self->path);
+    self->parser = make_streaming_parser(self->source.source, self->path, &stream, split_stack(*allocator));
+    parser_use_arena(&self->parser, &self->arena);
+    self->ast    = module(&self->parser, self->path);
+
+    // @NOTE: Keep the AST alive after the module, as the next one
+    //  compiled by this worker is placed after it.
+    allocator->ptr += self->parser.buffer.ptr;
+    self->parser.stream = NULL;
+
+    if (self->parser.error_count > 0 || self->ast == NULL) {
+        self->failed = true;
+        return;
+    }
+
+#ifdef LOADER_BUILD_IR
+    // @NOTE: Nothing is lowered from the IR yet, so it's only built to
+    //  inspect the passes.
+    self->ir = ir_build_module(&self->parser, self->ast);
+    ir_run_passes(&self->ir, IR_DEFAULT_PASSES, IR_DEFAULT_PASS_COUNT);
+#endif
+
+    Compiler compiler = compiler_make(&self->parser);
+    compile(&compiler, self->ast);
+    self->chunk = *compiler.chunks.data;
+
+    // @NOTE: Reported together with the parser's errors.
+    for (int i = 0; i < compiler.error_count && self->parser.error_count < PARSER_MAX_ERRORS; ++i) {
+        self->parser.errors[self->parser.error_count++] = compiler.errors[i];
+    }
+    if (compiler.error_count > 0)
+        self->failed = true;
+}
+
+
+static void* worker_main(void* argument) {
+    Worker* worker = argument;
+    Loader* loader = worker->loader;
+
+    while (true) {
+        pthread_mutex_lock(&loader->lock);
+        while (loader->ready_it == loader->ready.count && loader->remaining > 0)
+            pthread_cond_wait(&loader->changed, &loader->lock);
+
+        if (loader->remaining == 0) {
+            pthread_mutex_unlock(&loader->lock);
+            return NULL;
+        }
+        u32 index = loader->ready.data[loader->ready_it++];
+        pthread_mutex_unlock(&loader->lock);
+
+        // @NOTE: The module array doesn't grow after it's been loaded, so
+        //  the pointer stays valid without holding the lock.
+        Module* module = &loader->graph->modules.data[index];
+        compile_module(module, &worker->allocator);
+
+        pthread_mutex_lock(&loader->lock);
+        loader->remaining -= 1;
+        for (u32 i = 0; i < module->dependents.count; ++i) {
+            Module* dependent = &loader->graph->modules.data[module->dependents.data[i]];
+            if (--dependent->pending_imports == 0)
+                dynarray_u32_append(&loader->ready, module->dependents.data[i]);
+        }
+        pthread_cond_broadcast(&loader->changed);
+        pthread_mutex_unlock(&loader->lock);
+    }
+}
+
+
+/* Compiles all modules of the graph on `worker_count` threads. A module
+ * is started first when all of its imports have been compiled. Each
+ * worker gets an equally large part of `allocator` for its ASTs.
+ * Returns false if any module failed to parse. */
+bool compile_module_graph(ModuleGraph* graph, StackAllocator* allocator, int worker_count) {
+    if (worker_count > LOADER_MAX_WORKERS)       worker_count = LOADER_MAX_WORKERS;
+    if (worker_count > (int) graph->modules.count) worker_count = (int) graph->modules.count;
+    if (worker_count < 1)                        worker_count = 1;
+
+    Loader loader = (Loader) {
+        .graph     = graph,
+        .ready     = make_dynarray_u32(),
+        .ready_it  = 0,
+        .remaining = graph->modules.count,
+    };
+    pthread_mutex_init(&loader.lock, NULL);
+    pthread_cond_init(&loader.changed, NULL);
+
+    for (u32 i = 0; i < graph->modules.count; ++i) {
+        if (graph->modules.data[i].pending_imports == 0)
+            dynarray_u32_append(&loader.ready, i);
+    }
+
+    int share = (allocator->capacity - allocator->ptr) / worker_count;
+    share -= share % (int) sizeof(Ast);
+
+    Worker workers[LOADER_MAX_WORKERS];
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i] = (Worker) { .loader=&loader, .allocator=split_stack_by(allocator, share) };
+    }
+
+    // @NOTE: The calling thread is the first worker.
+    for (int i = 1; i < worker_count; ++i) {
+        int result = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        ASSERTF(result == 0, "Couldn't create worker thread");
+    }
+    worker_main(&workers[0]);
+    for (int i = 1; i < worker_count; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&loader.changed);
+    pthread_mutex_destroy(&loader.lock);
+    FREE_ARRAY(u32, loader.ready.data, loader.ready.capacity);
+
+    bool success = true;
+    for (u32 i = 0; i < graph->modules.count; ++i) {
+        if (graph->modules.data[i].failed)
+            success = false;
+    }
+    return success;
+}
+
+
+void free_module_graph(ModuleGraph* graph) {
+    for (u32 i = 0; i < graph->modules.count; ++i) {
+        Module* module = &graph->modules.data[i];
+#ifdef LOADER_BUILD_IR
+        ir_free_module(&module->ir);
+#endif
+        arena_free(&module->arena);
+        FREE_ARRAY(u32, module->dependents.data, module->dependents.capacity);
+    }
+    FREE_ARRAY(Module, graph->modules.data, graph->modules.capacity);
+    FREE_ARRAY(u32, graph->order.data, graph->order.capacity);
+    *graph = (ModuleGraph) { 0 };
+}
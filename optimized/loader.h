@@ -0,0 +1,51 @@
+#pragma once
+
+#include "c-preamble/nax_preamble.h"
+#include "slice.h"
+#include "memory.h"
+#include "parser.h"
+#include "compiler.h"
+#include "ir.h"
+
+
+#define MODULE_MAX_IMPORTS 32
+#define LOADER_MAX_WORKERS 16
+
+
+typedef struct {
+    const char* path;
+    Slice       source;
+
+    // Indices of the modules this module imports.
+    u32 imports[MODULE_MAX_IMPORTS];
+    u32 import_count;
+
+    // Indices of the modules that imports this module.
+    DynArray_u32 dependents;
+    // Number of imports that haven't been compiled yet.
+    u32 pending_imports;
+
+    // Owns the parser's tables, so they're released in one go.
+    Arena       arena;
+    Parser      parser;
+    Ast_Module* ast;
+    IrModule    ir;
+    Chunk       chunk;
+    bool        failed;
+} Module;
+
+declare_dynarray(Module)
+
+
+typedef struct {
+    DynArray_Module modules;
+    // Module indices where every module comes after all of its imports.
+    DynArray_u32    order;
+} ModuleGraph;
+
+
+Slice load_file(const char* file_path);
+
+ModuleGraph load_module_graph(const char* const* paths, int count);
+bool compile_module_graph(ModuleGraph* graph, StackAllocator* allocator, int worker_count);
+void free_module_graph(ModuleGraph* graph);
@@ -20,9 +20,13 @@
 #include "opcodes.h"
 #include "compiler.h"
 #include "interpreter.h"
+#include "loader.h"
+#include "c_target.h"
 
 #include <sys/mman.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "slice.h"
 
 
@@ -60,32 +64,14 @@ define_dynarray(u8)
 define_dynarray(Variable)
 define_dynarray(Slice)
 define_dynarray(Ast_Identifier)
+define_dynarray(u32)
+define_dynarray(Module)
+define_dynarray(IrInstruction)
+define_dynarray(IrBlock)
+define_dynarray(IrFunction)
 
 
 
-Slice load_file(const char* file_path) {
-    FILE* file = fopen(file_path, "r");
-    if (file) {
-        fseek(file, 0, SEEK_END);
-        long length = ftell(file);
-        fseek(file, 0, SEEK_SET);
-        char* buffer = nax_alloc(char, (word_t)length+1);
-        if (buffer) {
-            fread(buffer, 1, length, file);
-            buffer[length] = '\0';
-            fclose(file);
-            return (Slice) { .source=buffer, .count=(int)length };
-        } else {
-            fclose(file);
-            fprintf(stderr, "Couldn't read file '%s'", file_path);
-            exit(EXIT_FAILURE);
-        }
-    }
-    fprintf(stderr, "Couldn't open file '%s'", file_path);
-    exit(EXIT_FAILURE);
-}
-
-
 int main(int argc, const char* const argv[]) {
     int capacity = 64*64*64*64;
     void* memory = mmap(NULL, capacity, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
@@ -103,32 +89,91 @@ int main(int argc, const char* const argv[]) {
         "../../examples/single_expression.chain",
     };
 
-    for (int i = 0; i < (int) (sizeof(paths) / sizeof(*paths)); ++i) {
-        printf("\n---- %s ----\n", paths[i]);
+    const char* const* entries = paths;
+    int entry_count = (int) (sizeof(paths) / sizeof(*paths));
+    if (argc > 1) {
+        entries     = argv + 1;
+        entry_count = argc - 1;
+    }
 
-        StackAllocator allocator = make_stack(memory, capacity);
-        Slice source = load_file(paths[i]);
+    // chain com --target=c [-o output] <file>...
+    // c_target [-o output] <file>...
+#ifdef C_TARGET_STANDALONE
+    const char* usage = "[-o output] <file>...";
+    int first_option  = 1;
+#else
+    const char* usage = "com --target=c [-o output] <file>...";
+    int first_option  = (argc > 1 && strcmp(argv[1], "com") == 0) ? 2 : -1;
+#endif
+    bool        is_compiling = false;
+    const char* output       = NULL;
+    if (first_option != -1) {
+        is_compiling = true;
+        int i = first_option;
+        for (; i < argc && argv[i][0] == '-'; ++i) {
+            if (strcmp(argv[i], "--target=c") == 0) {
+                continue;
+            } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                output = argv[++i];
+            } else {
+                fprintf(stderr, "Unknown option '%s'. Usage: %s %s\n", argv[i], argv[0], usage);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (i == argc) {
+            fprintf(stderr, "No input files. Usage: %s %s\n", argv[0], usage);
+            exit(EXIT_FAILURE);
+        }
+        entries     = argv + i;
+        entry_count = argc - i;
+    }
+
+    StackAllocator allocator = make_stack(memory, capacity);
 
-        Array_Token all_tokens = tokenize(source.source, paths[i], &allocator);
-        Parser parser = make_parser(source.source, paths[i], all_tokens, split_stack(allocator));
+    ModuleGraph graph = load_module_graph(entries, entry_count);
+    bool success = compile_module_graph(&graph, &allocator, (int) sysconf(_SC_NPROCESSORS_ONLN));
 
-        Ast_Module* node = module(&parser, paths[i]);
-        if (parser.error_count > 0) {
-            for (int j = 0; j < parser.error_count; ++j) {
-                print_error(parser.errors[j]);
+    if (!success) {
+        for (u32 i = 0; i < graph.modules.count; ++i) {
+            Module* module = &graph.modules.data[i];
+            for (int j = 0; j < module->parser.error_count; ++j) {
+                print_error(module->parser.errors[j]);
             }
-            exit(EXIT_FAILURE);
         }
-        visit((Ast*) node, &parser, 0);
+        exit(EXIT_FAILURE);
+    }
 
-        Compiler compiler = compiler_make(&parser);
-        compile(&compiler, node);
+    if (is_compiling) {
+        // The executable is named after the first file, without '.chain'.
+        char default_output[1024];
+        if (!output) {
+            const char* path   = entries[0];
+            int         length = (int) strlen(path);
+            if (length > 6 && strcmp(path + length - 6, ".chain") == 0)
+                length -= 6;
+            snprintf(default_output, sizeof(default_output), "%.*s", length, path);
+            output = default_output;
+        }
+        bool built = c_target_build(&graph, output);
+        free_module_graph(&graph);
+        return built ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        Chunk chunk = *compiler.chunks.data;
+    for (u32 i = 0; i < graph.order.count; ++i) {
+        Module* module = &graph.modules.data[graph.order.data[i]];
+        printf("\n---- %s ----\n", module->path);
 
-        chunk_disassemble(&chunk, "<script>");
+        visit((Ast*) module->ast, &module->parser, 0);
+#ifdef LOADER_BUILD_IR
+        ir_print_module(&module->ir);
+#endif
 
-        vm_init();
-        vm_run(chunk);
+        chunk_disassemble(&module->chunk, "<script>");
+
+        VM* vm = vm_create(NULL);
+        vm_run(vm, module->chunk);
+        vm_destroy(vm);
     }
+
+    free_module_graph(&graph);
 }
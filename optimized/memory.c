@@ -29,6 +29,79 @@ void* to_nearest_power_of_two(const void* const data, uintptr_t alignment) {
 }
 
 
+Arena make_arena(void) {
+    return (Arena) { .first=NULL, .current=NULL };
+}
+
+void* arena_allocate(Arena* arena, size_t size, size_t alignment) {
+    ArenaBlock* block = arena->current;
+    while (block != NULL) {
+        u8* data = to_nearest_power_of_two(block->data + block->used, alignment);
+        if (data + size <= block->data + block->capacity) {
+            block->used = (size_t) (data + size - block->data);
+            arena->current = block;
+            return data;
+        }
+
+        // @NOTE: Blocks after the current one are left over from before
+        //  a reset, and are reused before new ones are allocated.
+        block = block->next;
+        if (block != NULL)
+            block->used = 0;
+    }
+
+    size_t capacity = ARENA_BLOCK_SIZE;
+    if (capacity < size + alignment)
+        capacity = size + alignment;
+
+    block = ALLOCATE_RAW(ArenaBlock, sizeof(ArenaBlock) + capacity);
+    block->next     = NULL;
+    block->used     = 0;
+    block->capacity = capacity;
+
+    if (arena->current == NULL) {
+        block->next  = arena->first;
+        arena->first = block;
+    } else {
+        ArenaBlock* last = arena->current;
+        while (last->next != NULL)
+            last = last->next;
+        last->next = block;
+    }
+    arena->current = block;
+
+    return arena_allocate(arena, size, alignment);
+}
+
+void arena_reset(Arena* arena) {
+    arena->current = arena->first;
+    if (arena->current != NULL)
+        arena->current->used = 0;
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->first;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        FREE_RAW(block, sizeof(ArenaBlock) + block->capacity);
+        block = next;
+    }
+    *arena = make_arena();
+}
+
+void* arena_reallocate(Arena* arena, void* pointer, size_t old_size, size_t new_size) {
+    if (arena == NULL)
+        return reallocate(pointer, old_size, new_size);
+    if (new_size == 0)
+        return NULL;
+
+    void* result = arena_allocate(arena, new_size, 16);
+    if (pointer != NULL)
+        memcpy(result, pointer, old_size < new_size ? old_size : new_size);
+    return result;
+}
+
+
 StackAllocator make_stack(void* data, int capacity) {
     return (StackAllocator) {
             .data=data,
@@ -45,6 +118,16 @@ StackAllocator split_stack(StackAllocator allocator) {
     };
 }
 
+/* Takes `capacity` bytes from the top of the allocator and returns them
+ * as an independent allocator, e.g. for handing to another thread. */
+StackAllocator split_stack_by(StackAllocator* allocator, int capacity) {
+    ASSERT(allocator->ptr + capacity <= allocator->capacity);
+    StackAllocator result = split_stack(*allocator);
+    result.capacity = capacity;
+    allocator->ptr += capacity;
+    return result;
+}
+
 void* allocate_raw(StackAllocator* allocator, int size, int alignment) {
     u8* data = to_nearest_power_of_two(allocator->data + allocator->ptr, alignment);
     int to_align = (int) (data - (allocator->data + allocator->ptr));
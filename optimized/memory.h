@@ -32,9 +32,37 @@ typedef struct {
 
 StackAllocator make_stack(void* data, int capacity);
 StackAllocator split_stack(StackAllocator allocator);
+StackAllocator split_stack_by(StackAllocator* allocator, int capacity);
 void* allocate_raw(StackAllocator* allocator, int size, int alignment);
 void* allocator_push_raw(StackAllocator* allocator, int size, int alignment, void* value);
 
+// Allocates in blocks that are never freed individually. Resetting
+// makes all blocks available again without returning them to the heap.
+#define ARENA_BLOCK_SIZE (64*1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    u8     data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* first;
+    ArenaBlock* current;
+} Arena;
+
+Arena make_arena(void);
+void* arena_allocate(Arena* arena, size_t size, size_t alignment);
+void  arena_reset(Arena* arena);
+void  arena_free(Arena* arena);
+
+// Resizes from the arena if there is one, otherwise from the heap. Memory
+// in an arena isn't freed until the arena is reset.
+void* arena_reallocate(Arena* arena, void* pointer, size_t old_size, size_t new_size);
+#define ARENA_RESIZE_ARRAY(arena, type, ptr, old_count, new_count)  ((type*) arena_reallocate(arena, ptr, sizeof(type) * (old_count), sizeof(type) * (new_count)))
+
+
 // @TODO: Fix!
 #define allocate(allocator, type, count) (type*) allocate_raw(allocator, (int)(count)*sizeof(type), align_of(type))
 #define stack_top(allocator, type)   (type*) to_nearest_power_of_two((allocator).data + (allocator).ptr, align_of(type))
@@ -16,8 +16,6 @@ typedef enum {
     OP_LT,
 
     OP_NOT,
-    OP_AND,
-    OP_OR,
 
     OP_ADD,
     OP_SUB,
@@ -35,6 +33,7 @@ typedef enum {
 
     OP_JUMP,
     OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
     OP_LOOP,
 
     OP_CALL,
@@ -37,6 +37,16 @@ const char* ERROR_MESSAGE[] = {
         [COMPILE_ERROR_EXPECTED_EQUAL_AFTER_VAR_ASSIGN]          = "Expected '=' after variable assignment",
         [COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_DECL]    = "Expected ';' after variable declaration",
         [COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_ASSIGN]  = "Expected ';' after variable assignment",
+        [COMPILE_ERROR_EXPECTED_IMPORT_PATH]                     = "Expected a string with the path to import, but got '%.*s'",
+        [COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_IMPORT]      = "Expected ';' after import",
+        [COMPILE_ERROR_IMPORT_NOT_AT_TOP]                        = "Imports must be at the top of the file, before any other statement",
+        [COMPILE_ERROR_DIVISION_BY_ZERO]                         = "Division by zero in constant expression",
+        [COMPILE_ERROR_UNDEFINED_VARIABLE]                       = "Undefined variable '%.*s'",
+        [COMPILE_ERROR_UNDEFINED_FUNCTION]                       = "Undefined function '%.*s'",
+        [COMPILE_ERROR_WRONG_ARGUMENT_COUNT]                     = "Wrong number of arguments to '%.*s'",
+        [COMPILE_ERROR_CANT_INFER_TYPE]                          = "Can't infer the type of '%.*s'",
+        [COMPILE_ERROR_MISMATCHED_TYPES]                         = "Mismatched types, expected '%.*s'",
+        [COMPILE_ERROR_UNSUPPORTED_OPERATION]                    = "Operation not supported for type '%.*s'",
 };
 
 
@@ -122,6 +132,59 @@ void store_error(Parser* parser, Location start, ErrorCode code, Token token) {
 
 
 
+static ExpressionBuffer make_expression_buffer(Arena* arena) {
+    return (ExpressionBuffer) {
+        .data     = NULL,
+        .ptr      = 0,
+        .capacity = 0,
+        .arena    = arena,
+        .starts   = make_arena_dynarray_u32(arena),
+        .firsts   = make_arena_dynarray_u32(arena),
+        .pending  = make_arena_dynarray_u32(arena),
+    };
+}
+
+static void expression_buffer_clear(ExpressionBuffer* buffer) {
+    buffer->ptr = 0;
+    buffer->starts.count  = 0;
+    buffer->firsts.count  = 0;
+    buffer->pending.count = 0;
+}
+
+/* Appends a node and returns its index. `first` is the index of the
+ * first node in the subtree that the new node is the root of. */
+static u32 expression_buffer_push(ExpressionBuffer* buffer, const void* node, u32 size, u32 first) {
+    ASSERT(size % sizeof(Ast) == 0);
+    if (buffer->ptr + size > buffer->capacity) {
+        u32 old_capacity = buffer->capacity;
+        while (buffer->ptr + size > buffer->capacity)
+            buffer->capacity = GROW_CAPACITY(buffer->capacity);
+        buffer->data = ARENA_RESIZE_ARRAY(buffer->arena, u8, buffer->data, old_capacity, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->ptr, node, size);
+
+    u32 index = dynarray_u32_append(&buffer->starts, buffer->ptr);
+    dynarray_u32_append(&buffer->firsts, first);
+    buffer->ptr += size;
+    return index;
+}
+
+static inline u32 expression_buffer_next_index(ExpressionBuffer* buffer) {
+    return buffer->starts.count;
+}
+
+static inline Ast* expression_buffer_node(ExpressionBuffer* buffer, u32 index) {
+    return (Ast*) (buffer->data + buffer->starts.data[index]);
+}
+
+static inline u32 expression_buffer_node_end(ExpressionBuffer* buffer, u32 index) {
+    return (index + 1 < buffer->starts.count) ? buffer->starts.data[index+1] : buffer->ptr;
+}
+
+#define expression_push(parser, type, value, first) \
+    expression_buffer_push(&(parser)->look_ahead_buffer, &(value), sizeof(type), first)
+
+
 Parser make_parser(const char* source, const char* path, Array_Token tokens, StackAllocator buffer) {
     return (Parser) {
             .path              = path,
@@ -129,6 +192,7 @@ Parser make_parser(const char* source, const char* path, Array_Token tokens, Sta
             .location          = make_location(0, 1, 0),
             .tokens            = tokens,
             .token_it          = 0,
+            .stream            = NULL,
             .variables         = make_dynarray_Slice(),
             .variable_cache    = table_variable_make(),
             .name_count_for_current_depth = 0,
@@ -137,32 +201,42 @@ Parser make_parser(const char* source, const char* path, Array_Token tokens, Sta
             .strings           = make_dynarray_Slice(),
             .depth              = 0,
             .buffer            = buffer,
-            .look_ahead_buffer = make_stack(malloc(4096), 4096),
+            .look_ahead_buffer = make_expression_buffer(NULL),
             .error_count       = 0,
             .in_panic_mode     = 0,
     };
 }
 
-// @TODO: Add alignment also.
-#define prepend(parser, node, snapshot) do { \
-    ASSERTF((int)((parser)->look_ahead_buffer.ptr + sizeof(node)) < (int)(parser)->look_ahead_buffer.capacity, "Buffer overflow");      \
-    memmove((snapshot).data+sizeof(node)+(snapshot).ptr, (snapshot).data+(snapshot).ptr, (parser)->look_ahead_buffer.ptr);  \
-    memcpy((snapshot).data+(snapshot).ptr, &(node), sizeof(node));                            \
-    (parser)->look_ahead_buffer.ptr += sizeof(node);                         \
-} while(0)
+Parser make_streaming_parser(const char* source, const char* path, TokenStream* stream, StackAllocator buffer) {
+    Parser parser = make_parser(source, path, make_array_Token(NULL, 0), buffer);
+    parser.stream = stream;
+    return parser;
+}
 
-#define copy_over(parser) do { \
-    allocator_push_raw(&(parser)->buffer, (parser)->look_ahead_buffer.ptr, 1, (parser)->look_ahead_buffer.data); \
-    (parser)->look_ahead_buffer.ptr = 0;  \
-} while(0)
+void parser_use_arena(Parser* parser, Arena* arena) {
+    ASSERTF(parser->variables.data == NULL && parser->strings.data == NULL && parser->look_ahead_buffer.data == NULL,
+            "The arena must be set before the parser allocates anything");
 
+    parser->variables         = make_arena_dynarray_Slice(arena);
+    parser->variable_cache    = table_variable_make_arena(arena);
+    parser->types             = table_type_make_arena(arena);
+    parser->string_map        = table_u32_make_arena(arena);
+    parser->strings           = make_arena_dynarray_Slice(arena);
+    parser->look_ahead_buffer = make_expression_buffer(arena);
+}
 
 Token peek_token(Parser* parser) {
+    if (parser->stream)
+        return token_stream_peek(parser->stream, 0);
+
     Token token = *array_Token_get(&parser->tokens, parser->token_it);
     return token;
 }
 
 Token peek_past_next_token(Parser* parser) {
+    if (parser->stream)
+        return token_stream_peek(parser->stream, 1);
+
     if (parser->token_it + 1 < parser->tokens.count)
         return *array_Token_get(&parser->tokens, parser->token_it+1);
     else
@@ -170,6 +244,12 @@ Token peek_past_next_token(Parser* parser) {
 }
 
 Token next_token(Parser* parser) {
+    if (parser->stream) {
+        Token token = token_stream_next(parser->stream);
+        parser->location = token_location(token_stream_peek(parser->stream, 0));
+        return token;
+    }
+
     if (parser->token_it + 1 < parser->tokens.count) {
         Token token = *array_Token_get(&parser->tokens, parser->token_it++);
         Token next  = *array_Token_get(&parser->tokens, parser->token_it);
@@ -339,22 +419,118 @@ Ast_FuncCall* func_call(Parser* parser, StackAllocator* buffer) {
 }
 
 
-Ast* factor(Parser* parser, StackAllocator* buffer) {
+/* Same as `func_call`, but in post-order into the look-ahead buffer. */
+static u32 func_call_in_expression(Parser* parser) {
+    Ast_Identifier name = identifier(parser, COMPILE_ERROR_EXPECTED_FUNCTION_NAME);
+    Ast_FuncCall   node = make_func_call(parser->location, name, 0);
+
+    consume(parser, TOKEN_LEFT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_FUNCTION_NAME);
+
+    u32 first     = expression_buffer_next_index(&parser->look_ahead_buffer);
+    u32 arg_count = 0;
+
+    Token token = peek_token(parser);
+    while (token.type != TOKEN_RIGHT_PAREN && token.type != TOKEN_EOF) {
+        expression(parser);
+        ++arg_count;
+        if (peek_token(parser).type == TOKEN_COMMA)
+            token = next_token(parser);
+        else
+            break;
+    }
+
+    ASSERT(arg_count < 255);
+    node.arg_count = (u8) arg_count;
+
+    consume(parser, TOKEN_RIGHT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_ARGS);
+
+    return expression_push(parser, Ast_FuncCall, node, first);
+}
+
+
+static u32 bin_op(Parser* parser, Token token, Operation op, u32 left) {
+    Ast_BinOp node = (Ast_BinOp) {
+        .ast   = make_ast(AST_BIN_OP, token_location(token)),
+        .op    = op,
+        .right = 0,  // @NOTE: Patched in `copy_over`.
+        .type  = PrimitiveType_inferred,
+    };
+    u32 first = parser->look_ahead_buffer.firsts.data[left];
+    return expression_push(parser, Ast_BinOp, node, first);
+}
+
+
+/* Lays out the post-order tree rooted at `root` in pre-order into the
+ * parser's buffer, visiting each node once. Children of a node are found
+ * from its end: the last child ends just before the node and each
+ * child's subtree starts at `firsts`, which is just past its sibling. */
+static Ast* copy_over(Parser* parser, u32 root) {
+    ExpressionBuffer* scratch = &parser->look_ahead_buffer;
+    Ast* top = stack_top(parser->buffer, Ast);
+
+    scratch->pending.count = 0;
+    dynarray_u32_append(&scratch->pending, root);
+    while (scratch->pending.count > 0) {
+        u32  index = scratch->pending.data[--scratch->pending.count];
+        Ast* node  = expression_buffer_node(scratch, index);
+        int  size  = (int) (expression_buffer_node_end(scratch, index) - scratch->starts.data[index]);
+
+        switch (node->type) {
+            case AST_BIN_OP: {
+                u32 right = index - 1;
+                u32 left  = scratch->firsts.data[right] - 1;
+                u32 left_start = scratch->starts.data[scratch->firsts.data[left]];
+                u32 left_end   = expression_buffer_node_end(scratch, left);
+
+                Ast_BinOp n = *(Ast_BinOp*) node;
+                n.right = (left_end - left_start) / sizeof(Ast);
+                stack_push(&parser->buffer, Ast_BinOp, n);
+
+                dynarray_u32_append(&scratch->pending, right);
+                dynarray_u32_append(&scratch->pending, left);
+                break;
+            }
+            case AST_FUNC_CALL: {
+                Ast_FuncCall* n = (Ast_FuncCall*) node;
+                allocator_push_raw(&parser->buffer, size, align_of(Ast), node);
+
+                // @NOTE: Pushed last to first, so the first argument is popped first.
+                u32 arg = index - 1;
+                for (u32 i = 0; i < n->arg_count; ++i) {
+                    dynarray_u32_append(&scratch->pending, arg);
+                    arg = scratch->firsts.data[arg] - 1;
+                }
+                break;
+            }
+            default: {
+                allocator_push_raw(&parser->buffer, size, align_of(Ast), node);
+                break;
+            }
+        }
+    }
+
+    expression_buffer_clear(scratch);
+    return top;
+}
+
+
+static u32 factor(Parser* parser) {
     Token token = peek_token(parser);
     switch (token.type) {
         case TOKEN_LEFT_PAREN: {
             next_token(parser);
-            Ast* node = expression(parser);
+            u32 node = expression(parser);
             consume(parser, TOKEN_RIGHT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_GROUPING);
             return node;
         }
 
         case TOKEN_IDENTIFIER: {
             if (peek_past_next_token(parser).type == TOKEN_LEFT_PAREN) {
-                return (Ast*) func_call(parser, buffer);
+                return func_call_in_expression(parser);
             } else {
                 Ast_Identifier n = identifier(parser, INTERNAL_ERROR);
-                return stack_push(buffer, Ast_Identifier, n);
+                u32 index = expression_buffer_next_index(&parser->look_ahead_buffer);
+                return expression_push(parser, Ast_Identifier, n, index);
             }
         }
 
@@ -362,15 +538,15 @@ Ast* factor(Parser* parser, StackAllocator* buffer) {
         case TOKEN_I64:
         case TOKEN_STRING: {
             Ast_Literal n = literal(parser, INTERNAL_ERROR);
-            return stack_push(buffer, Ast_Literal, n);
+            u32 index = expression_buffer_next_index(&parser->look_ahead_buffer);
+            return expression_push(parser, Ast_Literal, n, index);
         }
         default:
             nax_panic("Unexpected token");
     }
 }
-Ast* product(Parser* parser) {
-    StackAllocator snapshot = parser->look_ahead_buffer;
-    Ast* node = factor(parser, &parser->look_ahead_buffer);
+static u32 product(Parser* parser) {
+    u32 node = factor(parser);
 
     while (true) {
         Token token = peek_token(parser);
@@ -383,20 +559,12 @@ Ast* product(Parser* parser) {
         }
         next_token(parser);
 
-        Ast* right = factor(parser, &parser->look_ahead_buffer);
-
-        Ast_BinOp bin_op = make_bin_op(
-            token_location(token),
-            op,
-            node, right,
-            PrimitiveType_inferred
-        );
-        prepend(parser, bin_op, snapshot);
+        factor(parser);
+        node = bin_op(parser, token, op, node);
     }
 }
-Ast* term(Parser* parser) {
-    StackAllocator snapshot = parser->look_ahead_buffer;
-    Ast* node = product(parser);
+static u32 term(Parser* parser) {
+    u32 node = product(parser);
 
     while (true) {
         Token token = peek_token(parser);
@@ -408,20 +576,12 @@ Ast* term(Parser* parser) {
         }
         next_token(parser);
 
-        Ast* right = product(parser);
-
-        Ast_BinOp bin_op = make_bin_op(
-            token_location(token),
-            op,
-            node, right,
-            PrimitiveType_inferred
-        );
-        prepend(parser, bin_op, snapshot);
+        product(parser);
+        node = bin_op(parser, token, op, node);
     }
 }
-Ast* relation(Parser* parser) {
-    StackAllocator snapshot = parser->look_ahead_buffer;
-    Ast* node = term(parser);
+static u32 relation(Parser* parser) {
+    u32 node = term(parser);
 
     while (true) {
         Token token = peek_token(parser);
@@ -437,20 +597,12 @@ Ast* relation(Parser* parser) {
         }
         next_token(parser);
 
-        Ast* right = term(parser);
-
-        Ast_BinOp bin_op = make_bin_op(
-            token_location(token),
-            op,
-            node, right,
-            PrimitiveType_inferred
-        );
-        prepend(parser, bin_op, snapshot);
+        term(parser);
+        node = bin_op(parser, token, op, node);
     }
 }
-Ast* and(Parser* parser) {
-    StackAllocator snapshot = parser->look_ahead_buffer;
-    Ast* node = relation(parser);
+static u32 and(Parser* parser) {
+    u32 node = relation(parser);
 
     while (true) {
         Token token = peek_token(parser);
@@ -461,20 +613,12 @@ Ast* and(Parser* parser) {
         }
         next_token(parser);
 
-        Ast* right = relation(parser);
-
-        Ast_BinOp bin_op = make_bin_op(
-            token_location(token),
-            op,
-            node, right,
-            PrimitiveType_inferred
-        );
-        prepend(parser, bin_op, snapshot);
+        relation(parser);
+        node = bin_op(parser, token, op, node);
     }
 }
-Ast* or(Parser* parser) {
-    StackAllocator snapshot = parser->look_ahead_buffer;
-    Ast* node = and(parser);
+static u32 or(Parser* parser) {
+    u32 node = and(parser);
 
     while (true) {
         Token token = peek_token(parser);
@@ -485,31 +629,19 @@ Ast* or(Parser* parser) {
         }
         next_token(parser);
 
-        Ast* right = and(parser);
-
-        Ast_BinOp bin_op = make_bin_op(
-            token_location(token),
-            op,
-            node, right,
-            PrimitiveType_inferred
-        );
-        prepend(parser, bin_op, snapshot);
+        and(parser);
+        node = bin_op(parser, token, op, node);
     }
 }
-Ast* expression(Parser* parser) {
-    Ast* node = or(parser);
+u32 expression(Parser* parser) {
+    u32 node = or(parser);
     return node;
 }
 
 /* Should be called from statements, not expressions. */
 Ast* expression_start(Parser* parser) {
-    Ast* node = or(parser);
-    if (parser->look_ahead_buffer.ptr != 0) {
-        Ast* top = stack_top(parser->buffer, Ast);
-        copy_over(parser);
-        return top;
-    }
-    return node;
+    u32 root = or(parser);
+    return copy_over(parser, root);
 }
 
 
@@ -536,7 +668,7 @@ Ast_Block* block(Parser* parser) {
     consume(parser, TOKEN_RIGHT_BRACE, COMPILE_ERROR_EXPECTED_BRACE_AFTER_BLOCK);
 
     block->stmt_count = stmt_count;
-    block->end = (Ast*)parser->buffer.data - (Ast*) block;
+    block->end = (Ast*)(parser->buffer.data + parser->buffer.ptr) - (Ast*) block;
 
     parser->name_count_for_current_depth = previous_name_count_for_current_depth;
     parser->depth -= 1;
@@ -678,6 +810,27 @@ Ast_ReturnStmt* return_stmt(Parser* parser) {
     return node;
 }
 
+Ast_Import* import_stmt(Parser* parser) {
+    Token import_ = consume(parser, TOKEN_IMPORT, INTERNAL_ERROR);
+    Token path    = consume(parser, TOKEN_STRING, COMPILE_ERROR_EXPECTED_IMPORT_PATH);
+    if (parser->in_panic_mode)
+        return NULL;
+
+    Slice view = token_view(parser->source, path);
+    u32 index;
+    if (!table_u32_get(&parser->string_map, view, &index)) {
+        index = parser->strings.count;
+        ASSERT(table_u32_add(&parser->string_map, view, index));
+        dynarray_Slice_append(&parser->strings, view);
+    }
+
+    Ast_Import  n    = make_import(token_location(import_), index);
+    Ast_Import* node = stack_push(&parser->buffer, Ast_Import, n);
+
+    consume(parser, TOKEN_END_STMT, COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_IMPORT);
+    return node;
+}
+
 
 Ast* statement(Parser* parser) {
     retry:;
@@ -707,6 +860,12 @@ Ast* statement(Parser* parser) {
             return NULL;
         } case TOKEN_RETURN: {
             return (Ast*) return_stmt(parser);
+        } case TOKEN_IMPORT: {
+            // @NOTE: The module loader only reads the imports at the top of
+            //  the file, so any other import would silently be ignored.
+            Ast_Import* node = import_stmt(parser);
+            store_error(parser, token_location(token), COMPILE_ERROR_IMPORT_NOT_AT_TOP, token);
+            return (Ast*) node;
         } case TOKEN_END_STMT: {
             next_token(parser);
             goto retry;
@@ -869,6 +1028,12 @@ Ast* visit(Ast* ast, Parser* parser, int indent) {
             }
             return next;
         }
+        case AST_IMPORT: {
+            Ast_Import* n = (Ast_Import*) ast;
+            Slice view = *dynarray_Slice_get(&parser->strings, n->path);
+            printf("AST_IMPORT: %.*s\n", view.count, view.source);
+            return (Ast*)(n+1);
+        }
         case AST_MODULE: {
             Ast_Module* n = (Ast_Module*) ast;
             printf("AST_MODULE: name=%s, stmt_count=%d\n", n->name, n->stmt_count);
@@ -898,8 +1063,15 @@ Ast_Module* module(Parser* parser, const char* name) {
     Ast_Module* node = stack_push(&parser->buffer, Ast_Module, n);
 
     u32 stmt_count = 0;
+    bool in_header  = true;
     while (token.type != TOKEN_EOF) {
-        Ast* stmt = statement(parser);
+        Ast* stmt;
+        if (in_header && token.type == TOKEN_IMPORT) {
+            stmt = (Ast*) import_stmt(parser);
+        } else {
+            in_header = false;
+            stmt = statement(parser);
+        }
         if (parser->error_count > 0) {
             synchronize(parser);
             if (parser->error_count == PARSER_MAX_ERRORS)
@@ -911,7 +1083,7 @@ Ast_Module* module(Parser* parser, const char* name) {
     }
 
     node->stmt_count = stmt_count;
-    node->end = (Ast*)parser->buffer.data - (Ast*) node;
+    node->end = (Ast*)(parser->buffer.data + parser->buffer.ptr) - (Ast*) node;
 
     return node;
 }
@@ -920,7 +1092,7 @@ Ast_Module* module(Parser* parser, const char* name) {
 
 static void synchronize(Parser* parser) {
     parser->in_panic_mode = false;
-    parser->look_ahead_buffer.ptr = 0;
+    expression_buffer_clear(&parser->look_ahead_buffer);
 
     // @NOTE: Skip over all tokens until we hit the start
     //  of a new statement.
@@ -935,6 +1107,7 @@ static void synchronize(Parser* parser) {
             case TOKEN_IF:
             case TOKEN_WHILE:
             case TOKEN_RETURN:
+            case TOKEN_IMPORT:
                 return;
             default:
                 next_token(parser);
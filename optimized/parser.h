@@ -46,7 +46,17 @@ typedef enum {
     COMPILE_ERROR_EXPECTED_EQUAL_AFTER_VAR_ASSIGN,
     COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_DECL,
     COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_ASSIGN,
-    COMPILE_ERROR_END = COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_ASSIGN,
+    COMPILE_ERROR_EXPECTED_IMPORT_PATH,
+    COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_IMPORT,
+    COMPILE_ERROR_IMPORT_NOT_AT_TOP,
+    COMPILE_ERROR_DIVISION_BY_ZERO,
+    COMPILE_ERROR_UNDEFINED_VARIABLE,
+    COMPILE_ERROR_UNDEFINED_FUNCTION,
+    COMPILE_ERROR_WRONG_ARGUMENT_COUNT,
+    COMPILE_ERROR_CANT_INFER_TYPE,
+    COMPILE_ERROR_MISMATCHED_TYPES,
+    COMPILE_ERROR_UNSUPPORTED_OPERATION,
+    COMPILE_ERROR_END = COMPILE_ERROR_UNSUPPORTED_OPERATION,
 } ErrorCode;
 
 
@@ -71,6 +81,27 @@ declare_table(u32, u32)
 
 declare_dynarray(Ast_Identifier)
 declare_dynarray(Slice)
+declare_dynarray(u32)
+
+
+// Expressions are built in post-order (children before their parent) so
+// nodes never have to be shifted when an operator is found after its
+// left operand. `expression_start` then lays the finished tree out in
+// pre-order into the parser's buffer in a single pass.
+typedef struct {
+    u8* data;
+    u32 ptr;
+    u32 capacity;
+    // Heap allocated if NULL.
+    Arena* arena;
+
+    // Byte offset of each node.
+    DynArray_u32 starts;
+    // Index of the first (left-most) node of each node's subtree.
+    DynArray_u32 firsts;
+    // Work list used when copying the tree over.
+    DynArray_u32 pending;
+} ExpressionBuffer;
 
 
 #define PARSER_MAX_ERRORS 32
@@ -81,6 +112,8 @@ typedef struct {
 
     Array_Token tokens;
     u32 token_it;
+    // If set, tokens are pulled from the stream instead of `tokens`.
+    TokenStream* stream;
 
     u32 depth;
 
@@ -102,7 +135,7 @@ typedef struct {
 
 
     StackAllocator buffer;
-    StackAllocator look_ahead_buffer;
+    ExpressionBuffer look_ahead_buffer;
 
     Error errors[PARSER_MAX_ERRORS];
     int   error_count;
@@ -110,10 +143,14 @@ typedef struct {
 } Parser;
 
 Parser make_parser(const char* source,  const char* path, Array_Token tokens, StackAllocator buffer);
+Parser make_streaming_parser(const char* source,  const char* path, TokenStream* stream, StackAllocator buffer);
+// Makes all tables and arrays owned by the parser allocate from `arena`, so
+// they're released all at once by resetting it. Must be called before parsing.
+void parser_use_arena(Parser* parser, Arena* arena);
 
 
 Ast* expression_start(Parser* parser);
-Ast* expression(Parser* parser);
+u32  expression(Parser* parser);
 Ast* statement(Parser* parser);
 Ast_Block* block(Parser* parser);
 Ast_VarAssign* var_assign(Parser* parser);
@@ -123,6 +160,7 @@ Ast_IfStmt* if_stmt(Parser* parser);
 Ast_WhileStmt* while_stmt(Parser* parser);
 //Ast_ForStmt* for_stmt(Parser* parser);
 Ast_ReturnStmt* return_stmt(Parser* parser);
+Ast_Import* import_stmt(Parser* parser);
 Ast_Module* module(Parser* parser, const char* name);
 
 
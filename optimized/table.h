@@ -2,6 +2,7 @@
 
 #include "c-preamble/nax_preamble.h"
 #include "slice.h"
+#include "memory.h"
 
 
 /* Things a table need:
@@ -49,6 +50,7 @@ typedef struct {
     u16* slots; /* @TODO: Use! */                                                                                                                                                       \
     int count;                                                                                                                                                                          \
     int capacity;                                                                                                                                                                       \
+    Arena* arena;  /* Heap allocated if NULL. */                                                                                                                                        \
 } Table_##V1;                                                                                                                                                                            \
                                                                                                                                                                                         \
 static inline bool entry_##V1##_value_compare(V0* value, u8 x);                                                                                                                          \
@@ -61,6 +63,7 @@ static inline Entry_##V1 entry_##V1##_make_free();
 static inline Entry_##V1 entry_##V1##_make_tombstone();                                                                                                                                    \
                                                                                                                                                                                         \
 Table_##V1 table_##V1##_make();                                                                                                                                                          \
+Table_##V1 table_##V1##_make_arena(Arena* arena);                                                                                                                                       \
 void table_##V1##_free(Table_##V1* table);                                                                                                                                                         \
 Entry_##V1* table_##V1##_find(Table_##V1* table, Slice key);                                                                                                                                              \
 Slice table_##V1##_delete(Table_##V1* table, Slice key);                                                                                                                                                      \
@@ -101,11 +104,16 @@ static inline Entry_##V1 entry_##V1##_make_tombstone() {
                                                                                                                                                                                         \
                                                                                                                                                                                         \
 Table_##V1 table_##V1##_make() {                                                                                                                                                          \
-    return (Table_##V1) { .entries=NULL, .count=0, .capacity=0 };                                                                                                                        \
+    return (Table_##V1) { .entries=NULL, .count=0, .capacity=0, .arena=NULL };                                                                                                            \
+}                                                                                                                                                                                       \
+Table_##V1 table_##V1##_make_arena(Arena* arena) {                                                                                                                                        \
+    return (Table_##V1) { .entries=NULL, .count=0, .capacity=0, .arena=arena };                                                                                                           \
 }                                                                                                                                                                                       \
 void table_##V1##_free(Table_##V1* table) {                                                                                                                                           \
-    FREE_ARRAY(Entry_##V1 , table->entries, table->capacity);                                                                                                                            \
-    *table = table_##V1##_make();                                                                                                                                                        \
+    /* Arena memory is released with the arena. */                                                                                                                                       \
+    if (table->arena == NULL)                                                                                                                                                            \
+        FREE_ARRAY(Entry_##V1 , table->entries, table->capacity);                                                                                                                        \
+    *table = table_##V1##_make_arena(table->arena);                                                                                                                                      \
 }                                                                                                                                                                                       \
 Entry_##V1* table_##V1##_find(Table_##V1* table, Slice key) {                                                                                                                              \
     u32 index = hash(key) % table->capacity;                                                                                                                                            \
@@ -188,7 +196,7 @@ void table_##V1##_copy(Table_##V1* from, Table_##V1* to) {
 }                                                                                                                                                                                       \
                                                                                                                                                                                         \
 void table_##V1##_grow(Table_##V1* table, int new_capacity) {                                                                                                                             \
-    Entry_##V1* entries = ALLOCATE_ARRAY(Entry_##V1, new_capacity);                                                                                                                       \
+    Entry_##V1* entries = ARENA_RESIZE_ARRAY(table->arena, Entry_##V1, NULL, 0, new_capacity);                                                                                            \
     for (int i = 0; i < new_capacity; i++) {                                                                                                                                            \
         entries[i] = entry_##V1##_make_free();                                                                                                                                           \
     }                                                                                                                                                                                   \
@@ -197,13 +205,15 @@ void table_##V1##_grow(Table_##V1* table, int new_capacity) {
     Table_##V1 new_table = (Table_##V1) {                                                                                                                                                 \
             .capacity=new_capacity,                                                                                                                                                     \
             .count=0,                                                                                                                                                                   \
-            .entries=entries                                                                                                                                                            \
+            .entries=entries,                                                                                                                                                             \
+            .arena=table->arena                                                                                                                                                           \
     };                                                                                                                                                                                  \
                                                                                                                                                                                         \
     table_##V1##_copy(&old_table, &new_table);                                                                                                                                           \
     *table = new_table;                                                                                                                                                                 \
                                                                                                                                                                                         \
-    FREE_ARRAY(Entry_##V1, old_table.entries, old_table.capacity);                                                                                                                       \
+    if (old_table.arena == NULL)                                                                                                                                                          \
+        FREE_ARRAY(Entry_##V1, old_table.entries, old_table.capacity);                                                                                                                    \
 }                                                                                                                                                                                       \
                                                                                                                                                                                         \
 bool table_##V1##_add(Table_##V1* table, Slice key, V0 value) {                                                                                                                            \
@@ -0,0 +1,38 @@
+#include "c-preamble/nax_preamble.h"
+
+#define NAX_LOGGING_IMPLEMENTATION
+#include "nax_logging/nax_logging.h"
+
+#define NAX_ALLOCATOR_IMPLEMENTATION
+#include "allocators/allocator.h"
+
+#include "test.h"
+#include "loader.h"
+
+define_table(Ast_Identifier, variable)
+define_table(Type, type)
+define_table(u32, u32)
+
+define_array(Token)
+define_dynarray(OpCode)
+define_dynarray(Chunk)
+define_dynarray(Location)
+define_dynarray(Value)
+define_dynarray(u8)
+define_dynarray(Variable)
+define_dynarray(Slice)
+define_dynarray(Ast_Identifier)
+define_dynarray(u32)
+define_dynarray(Module)
+define_dynarray(IrInstruction)
+define_dynarray(IrBlock)
+define_dynarray(IrFunction)
+
+#include "test_compiler.c"
+
+
+
+int main() {
+    Option options = option_default();
+    return RUN_TESTS(options, compiler) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
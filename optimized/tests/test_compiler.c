@@ -0,0 +1,60 @@
+#include "test.h"
+#include "tokenizer.h"
+#include "compiler.h"
+
+
+/* Compiles the source as a module, the way the loader does. */
+static Chunk compile_source(const char* source, Arena* arena) {
+    static u8 memory[64*1024];
+    StackAllocator allocator = make_stack(memory, sizeof(memory));
+
+    TokenStream stream = make_token_stream(source, "script");
+    Parser parser = make_streaming_parser(source, "script", &stream, split_stack(allocator));
+    parser_use_arena(&parser, arena);
+    Ast_Module* ast = module(&parser, "script");
+
+    Compiler compiler = compiler_make(&parser);
+    compile(&compiler, ast);
+    return *compiler.chunks.data;
+}
+
+/* Whether the last statement before the exit was folded into `value`. */
+static bool ends_with_constant(Chunk* chunk, i64 value) {
+    u32 count = chunk->code.count;
+    if (count < 3 || chunk->code.data[count-3] != OP_CONSTANT)
+        return false;
+
+    u8 id = chunk->code.data[count-2];
+    if (id + 1u != chunk->constants.count)
+        return false;
+    Value constant = chunk->constants.data[id];
+    return IS_I64(constant) && AS_I64(constant) == value;
+}
+
+TEST_SUIT_START(compiler)
+
+    START_TEST(Variables that are never reassigned are folded)
+        Arena arena = make_arena();
+        Chunk chunk = compile_source("var x = 1;\nvar y = x + 2;\ny;\n", &arena);
+        CHECK_TRUE(ends_with_constant(&chunk, 3));
+        chunk_free(&chunk);
+        arena_free(&arena);
+    END_TEST
+
+    START_TEST(Assignments in a nested block are writes to the outer variable)
+        Arena arena = make_arena();
+        Chunk chunk = compile_source("var x = 1;\n{ x = 2; }\nx;\n", &arena);
+        CHECK_TRUE(!ends_with_constant(&chunk, 1));
+        chunk_free(&chunk);
+        arena_free(&arena);
+    END_TEST
+
+    START_TEST(Shadowing in a nested block leaves the outer variable constant)
+        Arena arena = make_arena();
+        Chunk chunk = compile_source("var x = 1;\n{ var x = 2; x = 3; }\nx;\n", &arena);
+        CHECK_TRUE(ends_with_constant(&chunk, 1));
+        chunk_free(&chunk);
+        arena_free(&arena);
+    END_TEST
+
+TEST_SUIT_END
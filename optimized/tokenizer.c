@@ -427,7 +427,10 @@ TokenResult token_at(const char* source, Location location) {
         case 'o': if (is_keyword(c+1, "r"))      T(S("or"),     TOKEN_OR);         else goto identifier;
         case 't': if (is_keyword(c+1, "rue"))    T(S("true"),   TOKEN_TRUE);       else goto identifier;
         case 'v': if (is_keyword(c+1, "ar"))     T(S("var"),    TOKEN_VAR);        else goto identifier;
-        case 'i': if (is_keyword(c+1, "f"))      T(S("if"),     TOKEN_IF);         else goto identifier;
+        case 'i':
+            if (is_keyword(c+1, "f"))     T(S("if"),     TOKEN_IF);
+            if (is_keyword(c+1, "mport")) T(S("import"), TOKEN_IMPORT);
+            goto identifier;
         case 'e': if (is_keyword(c+1, "lse"))    T(S("else"),   TOKEN_ELSE);       else goto identifier;
         case 'w': if (is_keyword(c+1, "hile"))   T(S("while"),  TOKEN_WHILE);      else goto identifier;
         case 'r': if (is_keyword(c+1, "eturn"))  T(S("return"), TOKEN_RETURN);     else goto identifier;
@@ -536,6 +539,7 @@ Slice token_view(const char* source, Token token) {
         case TOKEN_WHILE:    return SLICE("while");
         case TOKEN_FOR:      return SLICE("for");
         case TOKEN_RETURN:   return SLICE("return");
+        case TOKEN_IMPORT:   return SLICE("import");
 
         case TOKEN_COMMA:    return SLICE(",");
         case TOKEN_DOT:      return SLICE(".");
@@ -659,3 +663,99 @@ Array_Token tokenize(const char* source, const char* path, StackAllocator* alloc
 
     return make_array_Token(all_tokens, count);
 }
+
+
+TokenStream make_token_stream(const char* source, const char* path) {
+    return (TokenStream) {
+        .source      = source,
+        .path        = path,
+        .location    = make_location(0, 1, 1),
+        .head        = 0,
+        .tail        = 0,
+        .error_count = 0,
+        .reached_eof = false,
+    };
+}
+
+
+/* Fills the free part of the ring buffer. Errors are reported as they
+ * are found, but like `tokenize` we don't exit until the whole source
+ * has been seen, so all of them are reported at once. */
+static void token_stream_refill(TokenStream* stream) {
+    while (!stream->reached_eof && stream->tail - stream->head < TOKEN_STREAM_CAPACITY) {
+        TokenResult result = token_at(stream->source, stream->location);
+        stream->location = result.next;
+
+        if (token_is_error(result.token.type)) {
+            if (stream->error_count++ < 32)
+                print_error(make_tokenizer_error(stream->source, stream->path, result.token));
+            continue;
+        }
+
+        Token token;
+        memcpy(&token, &result.token, sizeof(token));
+        stream->tokens[stream->tail++ & (TOKEN_STREAM_CAPACITY-1)] = token;
+
+        if (token.type == TOKEN_EOF) {
+            stream->reached_eof = true;
+            if (stream->error_count != 0)
+                exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+/* Returns the token `ahead` tokens past the current one, or EOF if
+ * the source ends before that. */
+Token token_stream_peek(TokenStream* stream, u32 ahead) {
+    nax_assert(ahead < TOKEN_STREAM_CAPACITY);
+    if (stream->tail - stream->head <= ahead)
+        token_stream_refill(stream);
+
+    u32 index = stream->head + ahead;
+    if (index >= stream->tail)
+        index = stream->tail - 1;  // @NOTE: Only possible after EOF, which is the last token.
+    return stream->tokens[index & (TOKEN_STREAM_CAPACITY-1)];
+}
+
+
+Token token_stream_next(TokenStream* stream) {
+    Token token = token_stream_peek(stream, 0);
+    if (token.type != TOKEN_EOF)
+        stream->head += 1;
+    return token;
+}
+
+
+/* Reads the `import "<path>";` statements at the top of the source
+ * without tokenizing the rest of it, so the dependencies of a module
+ * are known before it's parsed. Stops at the first token that isn't
+ * part of an import; malformed imports are left for the parser to
+ * report. Returns the number of paths written to `imports`, without
+ * the quotes. */
+int tokenize_imports(const char* source, Slice* imports, int capacity) {
+    int count = 0;
+    Location location = make_location(0, 1, 1);
+
+    while (count < capacity) {
+        TokenResult import_ = token_at(source, location);
+        if (import_.token.type != (TokenTypeOpt) TOKEN_IMPORT)
+            break;
+
+        TokenResult path = token_at(source, import_.next);
+        if (path.token.type != (TokenTypeOpt) TOKEN_STRING)
+            break;
+
+        TokenResult end = token_at(source, path.next);
+        if (end.token.type != (TokenTypeOpt) TOKEN_END_STMT)
+            break;
+
+        TokenView view = parse_string(source, token_opt_location(path.token));
+        Slice quoted = slice_from_view(source, view);
+        imports[count++] = (Slice) { .source=quoted.source+1, .count=quoted.count-2 };
+
+        location = end.next;
+    }
+
+    return count;
+}
@@ -56,6 +56,7 @@ typedef enum {
     TOKEN_WHILE,
     TOKEN_FOR,
     TOKEN_RETURN,
+    TOKEN_IMPORT,
 
     TOKEN_COMMA,
     TOKEN_DOT,
@@ -98,3 +99,29 @@ declare_array(Token)
 Array_Token tokenize(const char* source, const char* path, StackAllocator* allocator);
 
 
+// Pull-based alternative to `tokenize`. Tokens are produced into a ring
+// buffer on demand, so memory stays bounded by the window instead of
+// growing with the size of the source.
+#define TOKEN_STREAM_CAPACITY 64
+static_assert((TOKEN_STREAM_CAPACITY & (TOKEN_STREAM_CAPACITY-1)) == 0, "Must be a power of two");
+
+typedef struct {
+    const char* source;
+    const char* path;
+    Location    location;
+
+    Token tokens[TOKEN_STREAM_CAPACITY];
+    u32   head;  // Index of the current token (never wraps, masked on access).
+    u32   tail;  // One past the last buffered token.
+
+    int   error_count;
+    bool  reached_eof;
+} TokenStream;
+
+int tokenize_imports(const char* source, Slice* imports, int capacity);
+
+TokenStream make_token_stream(const char* source, const char* path);
+Token token_stream_peek(TokenStream* stream, u32 ahead);
+Token token_stream_next(TokenStream* stream);
+
+
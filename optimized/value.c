@@ -76,7 +76,7 @@ const char* type_string(Value value) {
 
 bool value_equals(Value a, Value b) {
     // @TODO: Shouldn't require runt-time check for types.
-    if (is_type(a.type, b.type))
+    if (!is_type(a.type, b.type))
         PANIC("Values a and b are not the same");
 
 
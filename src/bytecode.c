@@ -0,0 +1,424 @@
+#include "bytecode.h"
+#include "memory.h"
+#include "error.h"
+#include "opcodes.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+ * The cache is written next to the source as '<path>c' and is only
+ * meant to be read back on the same machine, so everything is stored
+ * in native byte order.
+ *
+ *   Header   := "CHNC" u32(version) u64(source hash)
+ *   Function := u32(name size or NO_NAME) u8[name size] i32(arity)
+ *               i32(upvalue count) Capture[upvalue count]
+ *               i32(code count) u8[code count] Location[code count]
+ *               i32(constant count) Constant[constant count]
+ *               i32(inlined count) InlinedCall[inlined count]
+ *   Constant := u8(value type) payload
+ *
+ * Objects are written by value; strings as their size and characters,
+ * and functions recursively.
+ */
+static const char BYTECODE_MAGIC[4] = { 'C', 'H', 'N', 'C' };
+static const u32  NO_NAME = 0xFFFFFFFF;
+
+
+static u64 hash_source(const char* source) {
+    u64 hash = 14695981039346656037u;
+    for (const char* c = source; *c != '\0'; ++c) {
+        hash ^= (u8) *c;
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+
+char* bytecode_cache_path(const char* path) {
+    size_t size = strlen(path);
+    char*  cache_path = ALLOCATE_ARRAY(char, size + 2);
+    memcpy(cache_path, path, size);
+    cache_path[size]   = 'c';
+    cache_path[size+1] = '\0';
+    return cache_path;
+}
+
+
+
+/* ---- Writing ---- */
+
+#define write_value(file, type, value) do { type x_ = (value); fwrite(&x_, sizeof(type), 1, file); } while (0)
+
+
+static bool write_function(FILE* file, ObjFunction* function) {
+    if (function->name == NULL) {
+        write_value(file, u32, NO_NAME);
+    } else {
+        write_value(file, u32, (u32) function->name->size);
+        fwrite(function->name->data, 1, function->name->size, file);
+    }
+    write_value(file, i32, function->arity);
+    write_value(file, i32, function->upvalue_count);
+    fwrite(function->captures, sizeof(Capture), function->upvalue_count, file);
+
+    Chunk* chunk = &function->chunk;
+    write_value(file, i32, chunk->count);
+    fwrite(chunk->code,  sizeof(u8),       chunk->count, file);
+    fwrite(chunk->lines, sizeof(Location), chunk->count, file);
+
+    write_value(file, i32, chunk->constant_count);
+    for (int i = 0; i < chunk->constant_count; ++i) {
+        Value value = chunk->constants[i];
+        write_value(file, u8, (u8) value.type);
+        switch (value.type) {
+            case VALUE_NULL: break;
+            case VALUE_BOOL: write_value(file, u8,  AS_BOOL(value)); break;
+            case VALUE_F64:  write_value(file, f64, AS_F64(value));  break;
+            case VALUE_I64:  write_value(file, i64, AS_I64(value));  break;
+            case VALUE_OBJ: {
+                Obj* obj = AS_OBJ(value);
+                write_value(file, u8, (u8) obj->type);
+                if (obj->type == OBJ_STRING) {
+                    ObjString* string = AS_STRING(obj);
+                    write_value(file, u32, (u32) string->size);
+                    fwrite(string->data, 1, string->size, file);
+                } else if (obj->type == OBJ_FUNCTION) {
+                    if (!write_function(file, AS_FUNCTION(obj)))
+                        return false;
+                } else {
+                    // @NOTE: Natives are bound at runtime and never constants.
+                    return false;
+                }
+                break;
+            }
+            case VALUE_INVALID:
+                return false;
+        }
+    }
+
+    write_value(file, i32, chunk->inlined_count);
+    fwrite(chunk->inlined, sizeof(InlinedCall), chunk->inlined_count, file);
+    return true;
+}
+
+
+/* Writes the cache for `path` compiled from `source`. The cache is
+ * written to a temporary file first and renamed, so a concurrent run
+ * never reads a half-written cache. */
+bool bytecode_write(const char* path, const char* source, ObjFunction* script) {
+    char* cache_path = bytecode_cache_path(path);
+    size_t size = strlen(cache_path);
+    char*  temporary_path = ALLOCATE_ARRAY(char, size + 5);
+    memcpy(temporary_path, cache_path, size);
+    memcpy(temporary_path + size, ".tmp", 5);
+
+    bool success = false;
+    FILE* file = fopen(temporary_path, "wb");
+    if (file) {
+        fwrite(BYTECODE_MAGIC, 1, sizeof(BYTECODE_MAGIC), file);
+        write_value(file, u32, BYTECODE_VERSION);
+        write_value(file, u64, hash_source(source));
+
+        success = write_function(file, script);
+        success = (fclose(file) == 0) && success;
+        success = success && rename(temporary_path, cache_path) == 0;
+        if (!success)
+            remove(temporary_path);
+    }
+
+    FREE_ARRAY(char, temporary_path, size + 5);
+    FREE_ARRAY(char, cache_path, size + 1);
+    return success;
+}
+
+
+
+/* ---- Loading ---- */
+
+typedef struct {
+    const u8* data;
+    size_t    offset;
+    size_t    size;
+    bool      failed;
+} Reader;
+
+static const void* read_bytes(Reader* reader, size_t count) {
+    if (reader->failed || reader->size - reader->offset < count) {
+        reader->failed = true;
+        return NULL;
+    }
+    const void* result = reader->data + reader->offset;
+    reader->offset += count;
+    return result;
+}
+
+/* Reads a `type` from the cache, or zero if it's too short. */
+#define define_read(type)                                   \
+static type read_##type(Reader* reader) {                   \
+    type result = 0;                                        \
+    const void* data = read_bytes(reader, sizeof(type));    \
+    if (data != NULL)                                       \
+        memcpy(&result, data, sizeof(type));                \
+    return result;                                          \
+}
+define_read(u8)
+define_read(u32)
+define_read(u64)
+define_read(i32)
+define_read(i64)
+define_read(f64)
+
+
+/* Frees a function that was read from a cache and never ran, with its
+ * name and the strings and functions in its constants, which only it
+ * refers to. */
+static void free_function(ObjFunction* function) {
+    for (int i = 0; i < function->chunk.constant_count; ++i) {
+        Value value = function->chunk.constants[i];
+        if (IS_STRING(value))
+            object_free(AS_OBJ(value));
+        else if (IS_FUNCTION(value))
+            free_function(AS_FUNCTION(AS_OBJ(value)));
+    }
+    if (function->name != NULL)
+        object_free((Obj*) function->name);
+    object_free((Obj*) function);
+}
+
+
+static bool read_function_into(Reader* reader, ObjFunction* function, int depth);
+
+static ObjFunction* read_function(Reader* reader, int depth) {
+    // @NOTE: Guard against corrupt caches nesting functions forever.
+    if (depth > 256) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    ObjFunction* function = function_make();
+    if (!read_function_into(reader, function, depth)) {
+        reader->failed = true;
+        free_function(function);
+        return NULL;
+    }
+    return function;
+}
+
+static bool read_function_into(Reader* reader, ObjFunction* function, int depth) {
+    u32 name_size = read_u32(reader);
+    if (reader->failed)
+        return false;
+    if (name_size != NO_NAME) {
+        const char* name = read_bytes(reader, name_size);
+        if (name == NULL)
+            return false;
+        function->name = string_make(name, (int) name_size);
+    }
+    function->arity = read_i32(reader);
+
+    i32 upvalue_count = read_i32(reader);
+    if (reader->failed || upvalue_count < 0 || upvalue_count > UINT8_MAX)
+        return false;
+    if (upvalue_count > 0) {
+        const u8* captures = read_bytes(reader, (size_t) upvalue_count * sizeof(Capture));
+        if (captures == NULL)
+            return false;
+        function->captures      = ALLOCATE_ARRAY(Capture, upvalue_count);
+        function->upvalue_count = upvalue_count;
+        memcpy(function->captures, captures, (size_t) upvalue_count * sizeof(Capture));
+    }
+
+    i32 count = read_i32(reader);
+    if (reader->failed || count < 0)
+        return false;
+
+    const u8* code  = read_bytes(reader, (size_t) count);
+    const u8* lines = read_bytes(reader, (size_t) count * sizeof(Location));
+    if (reader->failed)
+        return false;
+
+    for (i32 i = 0; i < count; ++i) {
+        Location location;
+        memcpy(&location, lines + i * sizeof(Location), sizeof(Location));
+        chunk_write(&function->chunk, code[i], location);
+    }
+
+    i32 constant_count = read_i32(reader);
+    if (reader->failed || constant_count < 0 || constant_count > CHUNK_CONSTANTS_MAX)
+        return false;
+
+    for (i32 i = 0; i < constant_count; ++i) {
+        Value value;
+        switch ((ValueType) read_u8(reader)) {
+            case VALUE_NULL: value = MAKE_NULL(); break;
+            case VALUE_BOOL: value = MAKE_BOOL(read_u8(reader) != 0); break;
+            case VALUE_F64:  value = MAKE_F64(read_f64(reader));       break;
+            case VALUE_I64:  value = MAKE_I64(read_i64(reader));       break;
+            case VALUE_OBJ: {
+                ObjType type = (ObjType) read_u8(reader);
+                if (type == OBJ_STRING) {
+                    u32 size = read_u32(reader);
+                    const char* data = read_bytes(reader, size);
+                    if (data == NULL)
+                        return false;
+                    value = MAKE_OBJ(string_make(data, (int) size));
+                } else if (type == OBJ_FUNCTION) {
+                    ObjFunction* inner = read_function(reader, depth + 1);
+                    if (inner == NULL)
+                        return false;
+                    value = MAKE_OBJ(inner);
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case VALUE_INVALID:
+            default:
+                return false;
+        }
+        if (reader->failed)
+            return false;
+        chunk_add_constant(&function->chunk, value);
+    }
+
+    i32 inlined_count = read_i32(reader);
+    if (reader->failed || inlined_count < 0)
+        return false;
+    const u8* inlined = read_bytes(reader, (size_t) inlined_count * sizeof(InlinedCall));
+    if (reader->failed)
+        return false;
+    for (i32 i = 0; i < inlined_count; ++i) {
+        InlinedCall call;
+        memcpy(&call, inlined + i * sizeof(InlinedCall), sizeof(InlinedCall));
+        if (call.start < 0 || call.start > call.end || call.end > count)
+            return false;
+        chunk_add_inlined(&function->chunk, call);
+    }
+
+    // @NOTE: Also rejects caches whose code unbalances the stack.
+    function->max_stack = chunk_max_stack(&function->chunk, function->arity + 1);
+    return function->max_stack >= 0;
+}
+
+
+/* Checks the operands that index something, which chunk_max_stack
+ * doesn't: constants, local slots, upvalues, and the captures and slots
+ * of the frame of `enclosing`, the function that declares `function`, or
+ * NULL for the script. A cache that passes the hash check could still be
+ * corrupt, and the VM reads these without any check. */
+static bool check_operands(const ObjFunction* function, const ObjFunction* enclosing) {
+    const Chunk* chunk = &function->chunk;
+    if (enclosing == NULL && function->upvalue_count > 0)
+        return false;
+    for (int i = 0; i < function->upvalue_count; ++i) {
+        Capture capture = function->captures[i];
+        int limit = capture.is_local ? enclosing->max_stack : enclosing->upvalue_count;
+        if (capture.index >= limit)
+            return false;
+    }
+
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        u8 instruction = chunk->code[i];
+        u8 operand     = (chunk_instruction_size(instruction) > 1) ? chunk->code[i + 1] : 0;
+        switch (instruction) {
+            case OP_CONSTANT:
+                if (operand >= chunk->constant_count)
+                    return false;
+                break;
+            case OP_DEFINE_GLOBAL:
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+                if (operand >= chunk->constant_count || !IS_STRING(chunk->constants[operand]))
+                    return false;
+                break;
+            case OP_CLOSURE:
+                if (operand >= chunk->constant_count || !IS_FUNCTION(chunk->constants[operand]))
+                    return false;
+                break;
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                if (operand >= function->max_stack)
+                    return false;
+                break;
+            case OP_GET_UPVALUE:
+            case OP_SET_UPVALUE:
+                if (operand >= function->upvalue_count)
+                    return false;
+                break;
+            case OP_GET_ENCLOSING:
+            case OP_SET_ENCLOSING:
+                if (enclosing == NULL || operand >= enclosing->max_stack)
+                    return false;
+                break;
+            case OP_STORE_LOCAL:
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_LESS_CONSTANT:
+            case OP_GREATER_CONSTANT:
+            case OP_ADD_LOCAL:
+            case OP_LESS_LOCAL:
+                // @NOTE: Superinstructions are only made for tier 1.
+                return false;
+            default:
+                break;
+        }
+    }
+
+    for (int i = 0; i < chunk->inlined_count; ++i) {
+        if (chunk->inlined[i].name >= chunk->constant_count || !IS_STRING(chunk->constants[chunk->inlined[i].name]))
+            return false;
+    }
+
+    for (int i = 0; i < chunk->constant_count; ++i) {
+        if (IS_FUNCTION(chunk->constants[i]) && !check_operands(AS_FUNCTION(AS_OBJ(chunk->constants[i])), function))
+            return false;
+    }
+    return true;
+}
+
+
+/* Returns the cached script for `path`, or NULL if there's no cache or
+ * it was made from another source or by another version of the VM. */
+ObjFunction* bytecode_load(const char* path, const char* source) {
+    char* cache_path = bytecode_cache_path(path);
+    int descriptor = open(cache_path, O_RDONLY);
+    FREE_ARRAY(char, cache_path, strlen(path) + 2);
+    if (descriptor < 0)
+        return NULL;
+
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+        close(descriptor);
+        return NULL;
+    }
+
+    size_t size = (size_t) info.st_size;
+    void*  data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    Reader reader = (Reader) { .data=data, .offset=0, .size=size, .failed=false };
+
+    ObjFunction* script = NULL;
+    const void* magic = read_bytes(&reader, sizeof(BYTECODE_MAGIC));
+    if (magic && memcmp(magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) == 0) {
+        u32 version = read_u32(&reader);
+        u64 hash    = read_u64(&reader);
+        if (version == BYTECODE_VERSION && hash == hash_source(source)) {
+            script = read_function(&reader, 0);
+            if (script != NULL && (reader.failed || reader.offset != reader.size || !check_operands(script, NULL))) {
+                free_function(script);
+                script = NULL;
+            }
+        }
+    }
+
+    munmap(data, size);
+    return script;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "preamble.h"
+#include "object.h"
+
+
+// Bump when the instruction set or the layout of the cache changes,
+// so old caches are recompiled instead of run.
+#define BYTECODE_VERSION 6
+
+
+char* bytecode_cache_path(const char* path);
+bool bytecode_write(const char* path, const char* source, ObjFunction* script);
+ObjFunction* bytecode_load(const char* path, const char* source);
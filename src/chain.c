@@ -2,9 +2,13 @@
 #include "chunk.h"
 #include "compiler.h"
 #include "interpreter.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "executor.h"
 
 #include "error.h"
 #include <time.h>
+#include <unistd.h>
 
 
 const char* USAGE = ""
@@ -12,12 +16,14 @@ const char* USAGE = ""
 "  OPTIONS:\n"
 "    -q, --quiet           Don't output anything from the compiler\n"
 "    -t, --time            Output time to finish command\n"
+"    --jit                 Compile hot functions into native code (x86-64 Linux)\n"
 "  SUBCOMMAND:\n"
-"    com  [file]           Compile the project or a given file\n"
+"    com  [file]           Compile a file into a bytecode cache ('<file>c')\n"
 "    dis  <file>           Disassemble a file\n"
 "    dot  <file>           Generates a dot Graphviz file\n"
+"    par  <file> [N] [R]   Run a file R times, spread over N threads\n"
 "    repl                  Start the interactive session\n"
-"    run  <file>           Run a file\n"
+"    run  <file>           Run a file, from its bytecode cache if up to date\n"
 "    sim  <file>           Interpret a file\n"
 "    help                  Show this output\n";
 
@@ -27,6 +33,7 @@ typedef enum {
     COM,
     DIS,
     DOT,
+    PAR,
     REPL,
     RUN,
     SIM,
@@ -39,6 +46,7 @@ const char* RUN_MODE_STRING[] = {
         [COM]  = "com",
         [DIS]  = "dis",
         [DOT]  = "dot",
+        [PAR]  = "par",
         [REPL] = "repl",
         [RUN]  = "run",
         [SIM]  = "sim",
@@ -52,17 +60,33 @@ typedef struct {
     RunMode mode;
     bool is_quiet;
     bool take_time;
+    bool use_jit;
+    // Threads and runs of `par`, where 0 is the default.
+    int  worker_count;
+    int  run_count;
 } ArgCommands;
 
 
 
 void pretty_print_source(const char* path, const char* source);
 
+static VM* make_vm(ArgCommands* commands) {
+    VMConfig config = VM_CONFIG_DEFAULT;
+    config.use_jit  = commands->use_jit;
+
+    VM* vm = vm_create(&config);
+    if (vm == NULL) {
+        fprintf(stderr, "Couldn't create the VM\n");
+        exit(EXIT_FAILURE);
+    }
+    return vm;
+}
+
 // @TODO: Implement keywords to change the command struct
 //  during interactive session (like psql).
 static void repl(ArgCommands* commands) {
     char line[1024];
-    vm_init();
+    VM* vm = make_vm(commands);
     while (true) {
         printf("> ");
 
@@ -71,9 +95,12 @@ static void repl(ArgCommands* commands) {
             break;
         }
 
-        vm_interpret("repl", line, commands->is_quiet);
+        // @NOTE: Later lines may use the globals of this one.
+        ObjFunction* script = compile("repl", line, OPTIMIZE_ALL & ~OPTIMIZE_DEAD_GLOBALS);
+        if (script != NULL)
+            vm_interpret_function(vm, "repl", line, script, commands->is_quiet);
     }
-    vm_free();
+    vm_destroy(vm);
 }
 
 
@@ -142,6 +169,25 @@ int parse_dot(int argc, const char* const argv[], ArgCommands* commands) {
     }
     return 0;
 }
+int parse_par(int argc, const char* const argv[], ArgCommands* commands) {
+    if (commands->mode == NO_RUN_MODE) {
+        commands->mode = PAR;
+    } else {
+        fprintf(stderr, "'%s' is a top-level subcommand, not a subcommand for '%s'. They can't be run at the same time.\n", RUN_MODE_STRING[PAR], RUN_MODE_STRING[commands->mode]);
+        exit(EXIT_FAILURE);
+    }
+    int consumed = 0;
+    if (argc > consumed) {
+        commands->input_file = argv[consumed++];
+    }
+    if (argc > consumed && argv[consumed][0] >= '0' && argv[consumed][0] <= '9') {
+        commands->worker_count = atoi(argv[consumed++]);
+    }
+    if (argc > consumed && argv[consumed][0] >= '0' && argv[consumed][0] <= '9') {
+        commands->run_count = atoi(argv[consumed++]);
+    }
+    return consumed;
+}
 int parse_repl(int argc,const char* const argv[], ArgCommands* commands) {
     if (commands->mode == NO_RUN_MODE) {
         commands->mode = REPL;
@@ -186,19 +232,21 @@ int main(int argc, const char* const argv[]) {
         exit(EXIT_SUCCESS);
     }
 
-    ArgCommands commands = { .working_file=argv[0], .input_file=0, .mode=NO_RUN_MODE, .is_quiet=false, .take_time=false };
+    ArgCommands commands = { .working_file=argv[0], .input_file=0, .mode=NO_RUN_MODE, .is_quiet=false, .take_time=false, .use_jit=false, .worker_count=0, .run_count=0 };
     argv++; argc--;
     for (int i = 0; i < argc; ++i) {
         const char* const arg = argv[i];
         if      (is_argument(arg, RUN_MODE_STRING[COM]))   {  i += parse_build(argc-i-1, argv+i+1, &commands); }
         else if (is_argument(arg, RUN_MODE_STRING[DIS]))   {  i += parse_dis(argc-i-1,   argv+i+1, &commands); }
         else if (is_argument(arg, RUN_MODE_STRING[DOT]))   {  i += parse_dot(argc-i-1,   argv+i+1, &commands); }
+        else if (is_argument(arg, RUN_MODE_STRING[PAR]))   {  i += parse_par(argc-i-1,   argv+i+1, &commands); }
         else if (is_argument(arg, RUN_MODE_STRING[REPL]))  {  i += parse_repl(argc-i-1,  argv+i+1, &commands); }
         else if (is_argument(arg, RUN_MODE_STRING[RUN]))   {  i += parse_run(argc-i-1,   argv+i+1, &commands); }
         else if (is_argument(arg, RUN_MODE_STRING[SIM]))   {  i += parse_sim(argc-i-1,   argv+i+1, &commands); }
         else if (is_argument(arg, RUN_MODE_STRING[HELP]))  {  commands.mode = HELP; }
         else if (is_argument(arg, "-q") || is_argument(arg, "--quiet")) {  commands.is_quiet  = true; }
         else if (is_argument(arg, "-t") || is_argument(arg, "--time"))  {  commands.take_time = true; }
+        else if (is_argument(arg, "--jit"))                              {  commands.use_jit   = true; }
         else {
             // @TODO: Check that there are no more commands.
             fprintf(stderr, "Unknown command '%s'\n", argv[i]);
@@ -207,6 +255,11 @@ int main(int argc, const char* const argv[]) {
         }
     }
 
+    if (commands.use_jit && !JIT_SUPPORTED) {
+        fprintf(stderr, "The JIT isn't supported on this platform, running without it.\n");
+        commands.use_jit = false;
+    }
+
     clock_t start = (commands.take_time) ? clock() : 0;
     switch (commands.mode) {
         case NO_RUN_MODE: {
@@ -215,10 +268,19 @@ int main(int argc, const char* const argv[]) {
             break;
         } case COM: {
             ASSERTF(commands.input_file != NULL, "Not implemented");
+            const char*  source = load_file(commands.input_file);
+            ObjFunction* script = compile(commands.input_file, source, OPTIMIZE_ALL);
+            if (script == NULL) {
+                exit(EXIT_FAILURE);
+            }
+            if (!bytecode_write(commands.input_file, source, script)) {
+                fprintf(stderr, "Couldn't write the bytecode cache for '%s'\n", commands.input_file);
+                exit(EXIT_FAILURE);
+            }
             break;
         } case DIS: {
             // @TODO: Read from a disassembled file instead.
-            ObjFunction* script = compile(commands.input_file, load_file(commands.input_file));
+            ObjFunction* script = compile(commands.input_file, load_file(commands.input_file), OPTIMIZE_ALL);
             if (script) {
                 chunk_disassemble(&script->chunk, commands.input_file);
             } else {
@@ -228,15 +290,48 @@ int main(int argc, const char* const argv[]) {
         } case DOT: {
             PANIC("TODO: Implement dot generation.");
             break;
+        } case PAR: {
+            // @NOTE: Compiled once with all passes, as the shared
+            //  functions aren't promoted to tier 1 while running.
+            const char*  source = load_file(commands.input_file);
+            ObjFunction* script = bytecode_load(commands.input_file, source);
+            if (script == NULL)
+                script = compile(commands.input_file, source, OPTIMIZE_ALL);
+            if (script == NULL)
+                exit(EXIT_FAILURE);
+
+            ExecutorConfig config = { .worker_count=commands.worker_count, .run_count=commands.run_count, .vm=VM_CONFIG_DEFAULT };
+            if (config.worker_count <= 0)
+                config.worker_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+            if (config.run_count <= 0)
+                config.run_count = config.worker_count;
+
+            int failed = executor_run(&config, commands.input_file, source, script, commands.is_quiet);
+            if (failed > 0) {
+                fprintf(stderr, "[%d of %d runs failed]\n", failed, config.run_count);
+                exit(EXIT_FAILURE);
+            }
+            break;
         } case REPL: {
             repl(&commands);
             break;
         } case RUN: {
-            PANIC("TODO: Implement loading bytecode and runing.");
+            // @NOTE: The source is still needed to validate the cache
+            //  and for error messages.
+            const char*  source = load_file(commands.input_file);
+            ObjFunction* script = bytecode_load(commands.input_file, source);
+            VM* vm = make_vm(&commands);
+            if (script != NULL) {
+                vm_interpret_function(vm, commands.input_file, source, script, commands.is_quiet);
+            } else {
+                vm_interpret(vm, commands.input_file, source, commands.is_quiet);
+            }
+            vm_destroy(vm);
+            break;
         } case SIM: {
-            vm_init();
-            vm_interpret(commands.input_file, load_file(commands.input_file), commands.is_quiet);
-            vm_free();
+            VM* vm = make_vm(&commands);
+            vm_interpret(vm, commands.input_file, load_file(commands.input_file), commands.is_quiet);
+            vm_destroy(vm);
             break;
         } case HELP: {
             printf("%s", USAGE);
@@ -2,6 +2,7 @@
 #include "chunk.h"
 #include "opcodes.h"
 #include "error.h"
+#include "native.h"
 
 
 // Internal
@@ -10,6 +11,7 @@ static int instruction_simple(const char* name, int offset);
 static int instruction_byte(const char* name, Chunk* chunk, int offset);
 static int instruction_jump(const char* name, int sign, Chunk* chunk, int offset);
 static int instruction_identifier(const char* name, Chunk* chunk, int offset);
+static int instruction_native(const char* name, Chunk* chunk, int offset);
 static void chunk_add_line(Chunk* chunk, Location location);
 
 Chunk chunk_make() {
@@ -29,10 +31,19 @@ Chunk chunk_make() {
     Local* local = &chunk.locals[chunk.local_count++];
     local->depth = 0;
     local->name  =  token_make_empty();
+    local->is_captured = false;
+    local->escapes     = false;
+    local->closure     = -1;
+    local->function    = -1;
 
     chunk.code     = NULL;
     chunk.count    = 0;
     chunk.capacity = 0;
+    chunk.caches   = NULL;
+
+    chunk.inlined          = NULL;
+    chunk.inlined_count    = 0;
+    chunk.inlined_capacity = 0;
 
     return chunk;
 }
@@ -66,10 +77,57 @@ int chunk_add_constant(Chunk* chunk, Value constant) {
     return chunk->constant_count++;
 }
 
+void chunk_add_inlined(Chunk* chunk, InlinedCall call) {
+    if (chunk->inlined_capacity < chunk->inlined_count + 1) {
+        int old_capacity = chunk->inlined_capacity;
+        chunk->inlined_capacity = GROW_CAPACITY(old_capacity);
+        chunk->inlined = RESIZE_ARRAY(InlinedCall, chunk->inlined, old_capacity, chunk->inlined_capacity);
+    }
+    chunk->inlined[chunk->inlined_count++] = call;
+}
+
+/* Finds the inlined calls whose code contains `offset`, outermost first,
+ * and returns how many there are. The calls inlined into a function that
+ * was then inlined itself lie within its range, so they can't be nested
+ * deeper than functions are, and `calls` needs room for that many. They
+ * are added before the call around them, which wins a tie in size. */
+int chunk_inlined_at(const Chunk* chunk, int offset, const InlinedCall** calls, int max) {
+    int count = 0;
+    for (int i = 0; i < chunk->inlined_count && count < max; ++i) {
+        const InlinedCall* call = &chunk->inlined[i];
+        if (call->start > offset || offset >= call->end)
+            continue;
+
+        int j = count++;
+        while (j > 0 && calls[j - 1]->end - calls[j - 1]->start <= call->end - call->start) {
+            calls[j] = calls[j - 1];
+            j--;
+        }
+        calls[j] = call;
+    }
+    return count;
+}
+
 void chunk_free(Chunk* chunk) {
+    if (chunk->caches != NULL)
+        FREE_ARRAY(InlineCache, chunk->caches, chunk->count);
+    FREE_ARRAY(InlinedCall, chunk->inlined, chunk->inlined_capacity);
     FREE_ARRAY(u8,  chunk->code,  chunk->capacity);
     FREE_ARRAY(int, chunk->lines, chunk->capacity);
-    *chunk = chunk_make();
+    FREE_ARRAY(int, chunk->locations, chunk->location_capacity);
+    // @NOTE: Not reset with chunk_make, which would allocate again.
+    chunk->code      = NULL;
+    chunk->lines     = NULL;
+    chunk->locations = NULL;
+    chunk->caches    = NULL;
+    chunk->inlined   = NULL;
+    chunk->count     = 0;
+    chunk->capacity  = 0;
+    chunk->location_count    = 0;
+    chunk->location_capacity = 0;
+    chunk->constant_count    = 0;
+    chunk->inlined_count     = 0;
+    chunk->inlined_capacity  = 0;
 }
 
 Location chunk_line(const Chunk* chunk, int offset) {
@@ -164,30 +222,184 @@ int chunk_instruction_disassemble(Chunk* chunk, int offset) {
         case OP_EQUAL:         return instruction_simple("OP_EQUAL",    offset);
         case OP_GREATER:       return instruction_simple("OP_GREATER",  offset);
         case OP_LESS:          return instruction_simple("OP_LESS",     offset);
-        case OP_AND:           return instruction_simple("OP_AND",      offset);
-        case OP_OR:            return instruction_simple("OP_OR",       offset);
         case OP_ADD:           return instruction_simple("OP_ADD",      offset);
         case OP_SUBTRACT:      return instruction_simple("OP_SUBTRACT", offset);
         case OP_MULTIPLY:      return instruction_simple("OP_MULTIPLY", offset);
         case OP_DIVIDE:        return instruction_simple("OP_DIVIDE",   offset);
         case OP_NULL:          return instruction_simple("OP_NULL",     offset);
+        case OP_YIELD:         return instruction_simple("OP_YIELD",    offset);
+        case OP_RESUME:        return instruction_simple("OP_RESUME",   offset);
+        case OP_CLOSE_UPVALUE: return instruction_simple("OP_CLOSE_UPVALUE", offset);
         case OP_RETURN:        return instruction_simple("OP_RETURN",   offset);
         case OP_CONSTANT:      return instruction_constant("OP_CONSTANT",      chunk, offset);
+        case OP_CLOSURE:       return instruction_constant("OP_CLOSURE",       chunk, offset);
         case OP_DEFINE_GLOBAL: return instruction_identifier("OP_DEFINE_GLOBAL", chunk, offset);
         case OP_GET_GLOBAL:    return instruction_identifier("OP_GET_GLOBAL",    chunk, offset);
         case OP_SET_GLOBAL:    return instruction_identifier("OP_SET_GLOBAL",    chunk, offset);
         case OP_GET_LOCAL:     return instruction_byte("OP_GET_LOCAL", chunk, offset);
         case OP_SET_LOCAL:     return instruction_byte("OP_SET_LOCAL", chunk, offset);
         case OP_CALL:          return instruction_byte("OP_CALL",      chunk, offset);
+        case OP_TAIL_CALL:     return instruction_byte("OP_TAIL_CALL", chunk, offset);
+        case OP_GET_UPVALUE:   return instruction_byte("OP_GET_UPVALUE",   chunk, offset);
+        case OP_SET_UPVALUE:   return instruction_byte("OP_SET_UPVALUE",   chunk, offset);
+        case OP_GET_ENCLOSING: return instruction_byte("OP_GET_ENCLOSING", chunk, offset);
+        case OP_SET_ENCLOSING: return instruction_byte("OP_SET_ENCLOSING", chunk, offset);
+        case OP_CALL_NATIVE_TYPED: return instruction_native("OP_CALL_NATIVE_TYPED", chunk, offset);
         case OP_JUMP_IF_FALSE: return instruction_jump("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_JUMP_IF_TRUE:  return instruction_jump("OP_JUMP_IF_TRUE",  1, chunk, offset);
         case OP_JUMP:          return instruction_jump("OP_JUMP",  1, chunk, offset);
         case OP_LOOP:          return instruction_jump("OP_LOOP", -1, chunk, offset);
+        case OP_STORE_LOCAL:       return instruction_byte("OP_STORE_LOCAL", chunk, offset);
+        case OP_ADD_LOCAL:         return instruction_byte("OP_ADD_LOCAL",   chunk, offset);
+        case OP_LESS_LOCAL:        return instruction_byte("OP_LESS_LOCAL",  chunk, offset);
+        case OP_ADD_CONSTANT:      return instruction_constant("OP_ADD_CONSTANT",      chunk, offset);
+        case OP_SUBTRACT_CONSTANT: return instruction_constant("OP_SUBTRACT_CONSTANT", chunk, offset);
+        case OP_LESS_CONSTANT:     return instruction_constant("OP_LESS_CONSTANT",     chunk, offset);
+        case OP_GREATER_CONSTANT:  return instruction_constant("OP_GREATER_CONSTANT",  chunk, offset);
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
     }
 }
 
+// The size of an instruction and its operands, in bytes.
+int chunk_instruction_size(u8 instruction) {
+    switch (instruction) {
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_CLOSURE:
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE:
+        case OP_GET_ENCLOSING:
+        case OP_SET_ENCLOSING:
+        case OP_CALL_NATIVE_TYPED:
+        case OP_STORE_LOCAL:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_LESS_CONSTANT:
+        case OP_GREATER_CONSTANT:
+        case OP_ADD_LOCAL:
+        case OP_LESS_LOCAL:
+            return 2;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_LOOP:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+static const struct { u8 pops; u8 pushes; } STACK_EFFECTS[] = {
+#define X(type, pops, pushes) [OP_ ## type] = { pops, pushes },
+    ALL_OPCODES(X)
+#undef X
+};
+
+/* Runs the chunk on the heights of the stack instead of on values, from
+ * `height` values at its start, and returns the most that it can have.
+ * `heights` gets the height before each instruction, or -1 where none is
+ * reached. Every instruction must be reached with the same height from
+ * all paths, so it returns -1 for code that unbalances the stack, as well
+ * as for unknown instructions and jumps out of the chunk. Jumps past the
+ * end are ignored if `is_partial`, as the compiler patches them later. */
+static int stack_heights(const Chunk* chunk, int height, int* heights, bool is_partial) {
+    int* worklist = ALLOCATE_ARRAY(int, chunk->count + 1);
+    for (int i = 0; i <= chunk->count; ++i)
+        heights[i] = -1;
+
+    int max   = height;
+    int count = 0;
+    heights[0] = height;
+    worklist[count++] = 0;
+    while (count > 0 && max >= 0) {
+        int offset = worklist[--count];
+        if (offset == chunk->count)
+            continue;
+
+        u8 instruction = chunk->code[offset];
+        int size = chunk_instruction_size(instruction);
+        if (instruction >= sizeof(STACK_EFFECTS) / sizeof(*STACK_EFFECTS) || offset + size > chunk->count) {
+            max = -1;
+            break;
+        }
+
+        int pops = STACK_EFFECTS[instruction].pops;
+        if (instruction == OP_CALL || instruction == OP_TAIL_CALL)
+            pops += chunk->code[offset + 1];
+        if (instruction == OP_CALL_NATIVE_TYPED) {
+            if (chunk->code[offset + 1] >= TYPED_NATIVE_COUNT) {
+                max = -1;
+                break;
+            }
+            pops += typed_native_arity(&TYPED_NATIVES[chunk->code[offset + 1]]);
+        }
+        if (heights[offset] < pops) {
+            max = -1;
+            break;
+        }
+        int after = heights[offset] - pops + STACK_EFFECTS[instruction].pushes;
+        if (after > max)
+            max = after;
+
+        int targets[2];
+        int target_count = 0;
+        switch (instruction) {
+            case OP_EXIT:
+            case OP_RETURN:
+                break;
+            case OP_JUMP:
+            case OP_LOOP:
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE: {
+                int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+                targets[target_count++] = offset + size + ((instruction == OP_LOOP) ? -jump : jump);
+                if (instruction == OP_JUMP_IF_FALSE || instruction == OP_JUMP_IF_TRUE)
+                    targets[target_count++] = offset + size;
+                break;
+            }
+            default:
+                targets[target_count++] = offset + size;
+        }
+
+        for (int i = 0; i < target_count; ++i) {
+            int target = targets[i];
+            if (is_partial && target > chunk->count)
+                continue;
+            if (target < 0 || target > chunk->count || (heights[target] != -1 && heights[target] != after)) {
+                max = -1;
+                break;
+            }
+            if (heights[target] == -1) {
+                heights[target] = after;
+                worklist[count++] = target;
+            }
+        }
+    }
+
+    FREE_ARRAY(int, worklist, chunk->count + 1);
+    return max;
+}
+
+int chunk_max_stack(const Chunk* chunk, int height) {
+    int* heights = ALLOCATE_ARRAY(int, chunk->count + 1);
+    int  max     = stack_heights(chunk, height, heights, false);
+    FREE_ARRAY(int, heights, chunk->count + 1);
+    return max;
+}
+
+// `heights` must have room for `chunk->count + 1`.
+bool chunk_stack_heights(const Chunk* chunk, int height, int* heights) {
+    return stack_heights(chunk, height, heights, true) >= 0;
+}
+
 static int instruction_jump(const char* name, int sign, Chunk* chunk, int offset) {
     uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
     jump |= chunk->code[offset + 2];
@@ -201,6 +413,12 @@ static int instruction_byte(const char* name, Chunk* chunk, int offset) {
     return offset + 2;
 }
 
+static int instruction_native(const char* name, Chunk* chunk, int offset) {
+    uint8_t index = chunk->code[offset + 1];
+    printf("%-20s %-4d '%s'\n", name, index, (index < TYPED_NATIVE_COUNT) ? TYPED_NATIVES[index].name : "?");
+    return offset + 2;
+}
+
 static int instruction_simple(const char* name, int offset) {
     printf("%s\n", name);
     return offset + 1;
@@ -7,9 +7,45 @@
 typedef struct {
     Token name;
     int   depth;
+    // Closed over by a closure, so it's moved off the stack when it goes
+    // out of scope.
+    bool  is_captured;
+    // Used as anything but the callee of a call in its own function, or
+    // captured by another. For local functions that capture variables,
+    // the offset of their OP_CLOSURE, or -1.
+    bool  escapes;
+    int   closure;
+    // For local functions that capture nothing, the constant that holds
+    // the function, or -1. Calls to it by its name may be inlined.
+    int   function;
 } Local;
 
 
+/* A range of code that was copied from a local function, in place of a
+ * call to it. The result is stored into `slot`, where the callee was.
+ * `name` is the constant with the name of the function and `call` the
+ * location of the call, so errors can show the frame it would have had. */
+typedef struct {
+    int      start;
+    int      end;
+    u8       slot;
+    u8       name;
+    u8       arity;
+    Location call;
+} InlinedCall;
+
+
+/* The inline cache of an instruction, at its offset in the side table of
+ * the chunk. An OP_GET_GLOBAL remembers the function or native that the
+ * global held at `version` of the globals, and an OP_CALL remembers its
+ * last callee and what kind of object it is. */
+typedef struct {
+    Value   value;
+    u32     version;
+    ObjType kind;
+} InlineCache;
+
+
 typedef struct {
     Value constants[CHUNK_CONSTANTS_MAX];
     int constant_count;
@@ -28,6 +64,14 @@ typedef struct {
     u8* code;
     int count;
     int capacity;
+
+    // One per byte of `code`, allocated by the VM on the first call
+    // through a global. Only VMs with the tiers write to it.
+    InlineCache* caches;
+
+    InlinedCall* inlined;
+    int inlined_count;
+    int inlined_capacity;
 } Chunk;
 
 
@@ -36,7 +80,12 @@ void  chunk_write(Chunk* chunk, u8 byte, Location location);
 uint8_t chunk_peek(Chunk* chunk);
 void  chunk_free(Chunk* chunk);
 int   chunk_add_constant(Chunk* chunk, Value constant);
+void  chunk_add_inlined(Chunk* chunk, InlinedCall call);
+int   chunk_inlined_at(const Chunk* chunk, int offset, const InlinedCall** calls, int max);
 void  chunk_disassemble(Chunk* chunk, const char* name);
 int   chunk_instruction_disassemble(Chunk* chunk, int offset);
+int   chunk_instruction_size(u8 instruction);
+int   chunk_max_stack(const Chunk* chunk, int height);
+bool  chunk_stack_heights(const Chunk* chunk, int height, int* heights);
 
 Location chunk_line(const Chunk* chunk, int offset);
@@ -2,6 +2,8 @@
 #include "opcodes.h"
 #include "object.h"
 #include "value.h"
+#include "memory.h"
+#include "native.h"
 
 
 typedef enum {
@@ -34,6 +36,10 @@ static void variable(Compiler* compiler, bool can_assign);
 static void grouping(Compiler* compiler, bool can_assign);
 static void unary(Compiler* compiler, bool can_assign);
 static void binary(Compiler* compiler, bool can_assign);
+static void and_(Compiler* compiler, bool can_assign);
+static void or_(Compiler* compiler, bool can_assign);
+static void yield(Compiler* compiler, bool can_assign);
+static void resume(Compiler* compiler, bool can_assign);
 static void expression(Compiler* compiler, Location start);
 static void variable_declaration(Compiler* self);
 static void statement(Compiler* compiler);
@@ -55,6 +61,7 @@ static ObjFunction* compiler_end(Compiler* self);
 static void function_declaration(Compiler* self);
 static void function(Compiler* self);
 static uint8_t argument_list(Compiler* self);
+static void native_call(Compiler* self, Token name, int index);
 static void return_statement(Compiler* self);
 
 
@@ -70,8 +77,17 @@ Compiler compiler_make(const char* path, const char* source) {
     compiler.current  = token_make_empty();
     compiler.previous = token_make_empty();
 
+    compiler.enclosing_count = 0;
     compiler.scope_depth   = 0;
     compiler.const_ptr     = 0;
+    compiler.constant_offsets[0] = -1;
+    compiler.constant_offsets[1] = -1;
+    compiler.last_jump_target    = 0;
+    compiler.last_call_offset    = -1;
+    compiler.callee_offset       = -1;
+    compiler.callee_local        = -1;
+    compiler.inline_site_count   = 0;
+    compiler.flags         = OPTIMIZE_NONE;
     compiler.had_error     = false;
     compiler.in_panic_mode = false;
 
@@ -183,12 +199,14 @@ ParseRule rules[] = {           //  prefix    infix
         [TOKEN_LESS]          = {   NULL,     binary,  PRECEDENCE_COMPARISON  },
         [TOKEN_LESS_EQUAL]    = {   NULL,     binary,  PRECEDENCE_COMPARISON  },
 
-        [TOKEN_AND]           = {   NULL,     binary, PRECEDENCE_AND     },
-        [TOKEN_OR]            = {   NULL,     binary, PRECEDENCE_OR      },
+        [TOKEN_AND]           = {   NULL,     and_,   PRECEDENCE_AND     },
+        [TOKEN_OR]            = {   NULL,     or_,    PRECEDENCE_OR      },
 
         [TOKEN_STRING]        = {   string,   NULL,   PRECEDENCE_NONE    },
 
         [TOKEN_RETURN]        = {   NULL,     NULL,   PRECEDENCE_NONE    },
+        [TOKEN_YIELD]         = {   yield,    NULL,   PRECEDENCE_NONE    },
+        [TOKEN_RESUME]        = {   resume,   NULL,   PRECEDENCE_NONE    },
         [TOKEN_END_STMT]      = {   NULL,     NULL,   PRECEDENCE_NONE    },
         [TOKEN_ERROR]         = {   NULL,     NULL,   PRECEDENCE_NONE    },
         [TOKEN_EOF]           = {   NULL,     NULL,   PRECEDENCE_NONE    },
@@ -235,6 +253,10 @@ static uint8_t parse_variable(Compiler* self, ErrorCode code) {
     if (self->scope_depth > 0)
         return 0;
 
+    // @NOTE: The calls of typed natives are bound when they're compiled.
+    Token name = previous_token(self);
+    if (typed_native_find(slice_str_offset(self->source, name.location.index, name.count)) != -1)
+        store_error(self, name.location, COMPILE_ERROR_REDEFINITION_OF_NATIVE_FUNCTION, name);
     return identifier_constant(self, &self->previous);
 }
 
@@ -276,6 +298,10 @@ static void add_local(Compiler* self, Token name) {
     Local* local = &self->function->chunk.locals[self->function->chunk.local_count++];
     local->name  = name;
     local->depth = -1;
+    local->is_captured = false;
+    local->escapes     = false;
+    local->closure     = -1;
+    local->function    = -1;
 }
 
 static void mark_initialized(Compiler* self) {
@@ -305,9 +331,9 @@ static void literal(Compiler* self, bool can_assign) {
     }
 }
 
-static int resolve_local(Compiler* self, Token* name) {
-    for (int i = self->function->chunk.local_count - 1; i >= 0; i--) {
-        Local* local = &self->function->chunk.locals[i];
+static int resolve_local(Compiler* self, ObjFunction* function, Token* name) {
+    for (int i = function->chunk.local_count - 1; i >= 0; i--) {
+        Local* local = &function->chunk.locals[i];
         if (identifiers_equal(self, name, &local->name)) {
             if (local->depth == -1) {
                 store_error(self, name->location, COMPILE_ERROR_READING_VARIABLE_IN_OWN_INITIALIZER, *name);
@@ -319,13 +345,76 @@ static int resolve_local(Compiler* self, Token* name) {
     return -1;
 }
 
+// The function being compiled at `level` of nesting, where the script
+// is at 0.
+static ObjFunction* function_at(Compiler* self, int level) {
+    return (level == self->enclosing_count) ? self->function : self->enclosing[level];
+}
+
+static int add_upvalue(Compiler* self, int level, u8 index, bool is_local) {
+    ObjFunction* function = function_at(self, level);
+    for (int i = 0; i < function->upvalue_count; ++i) {
+        Capture* capture = &function->captures[i];
+        if (capture->index == index && capture->is_local == is_local)
+            return i;
+    }
+
+    if (function->upvalue_count == UINT8_MAX) {
+        Token token = previous_token(self);
+        store_error(self, token.location, COMPILE_ERROR_TOO_MANY_UPVALUES, token);
+        return 0;
+    }
+    function->captures = RESIZE_ARRAY(Capture, function->captures, function->upvalue_count, function->upvalue_count + 1);
+    function->captures[function->upvalue_count] = (Capture) { .index=index, .is_local=is_local };
+    return function->upvalue_count++;
+}
+
+/* Resolves `name` as a variable that the function at `level` captures
+ * from the functions around it, and returns the index of its upvalue, or
+ * -1 if it's a global. */
+static int resolve_upvalue(Compiler* self, int level, Token* name) {
+    if (level == 0)
+        return -1;
+
+    ObjFunction* parent = function_at(self, level - 1);
+    int local = resolve_local(self, parent, name);
+    if (local != -1) {
+        parent->chunk.locals[local].escapes = true;
+        return add_upvalue(self, level, (u8) local, true);
+    }
+
+    int upvalue = resolve_upvalue(self, level - 1, name);
+    if (upvalue == -1)
+        return -1;
+
+    // @NOTE: Only a closure has upvalues to pass on, so the parent
+    //  has to be made into one.
+    int slot = self->enclosing_slots[level - 2];
+    if (slot != -1)
+        function_at(self, level - 2)->chunk.locals[slot].escapes = true;
+    return add_upvalue(self, level, (u8) upvalue, false);
+}
+
 static void named_variable(Compiler* self, Token name, bool can_assign) {
     uint8_t get_op, set_op;
-    int arg = resolve_local(self, &name);
+    int arg = resolve_local(self, self->function, &name);
     if (arg != -1) {
         get_op = OP_GET_LOCAL;
         set_op = OP_SET_LOCAL;
+        // @NOTE: A call binds tighter than anything around the name.
+        if (!check(self, TOKEN_LEFT_PAREN))
+            self->function->chunk.locals[arg].escapes = true;
+    } else if ((arg = resolve_upvalue(self, self->enclosing_count, &name)) != -1) {
+        get_op = OP_GET_UPVALUE;
+        set_op = OP_SET_UPVALUE;
     } else {
+        int native = typed_native_find(slice_str_offset(self->source, name.location.index, name.count));
+        if (native != -1 && check(self, TOKEN_LEFT_PAREN)) {
+            native_call(self, name, native);
+            return;
+        }
+        if (native != -1 && can_assign && check(self, TOKEN_EQUAL))
+            store_error(self, name.location, COMPILE_ERROR_REDEFINITION_OF_NATIVE_FUNCTION, name);
         arg = identifier_constant(self, &name);
         get_op = OP_GET_GLOBAL;
         set_op = OP_SET_GLOBAL;
@@ -336,6 +425,10 @@ static void named_variable(Compiler* self, Token name, bool can_assign) {
         emit_bytes(self, set_op, (uint8_t) arg);
     } else {
         emit_bytes(self, get_op, (uint8_t) arg);
+        if (get_op == OP_GET_LOCAL && check(self, TOKEN_LEFT_PAREN)) {
+            self->callee_offset = self->function->chunk.count - 2;
+            self->callee_local  = arg;
+        }
     }
 }
 
@@ -366,6 +459,8 @@ static void string(Compiler* self, bool can_assign) {
 }
 
 static void emit_constant(Compiler* compiler, Value value) {
+    compiler->constant_offsets[0] = compiler->constant_offsets[1];
+    compiler->constant_offsets[1] = compiler->function->chunk.count;
     emit_bytes(compiler, OP_CONSTANT, make_constant(compiler, value));
     compiler->constants[compiler->const_ptr++] = value;
 }
@@ -380,6 +475,89 @@ static u8 make_constant(Compiler* self, Value value) {
     return (u8) constant;
 }
 
+static void forget_constants(Compiler* self) {
+    self->constant_offsets[0] = -1;
+    self->constant_offsets[1] = -1;
+}
+
+/* Reads the values of the last `count` instructions if they all are
+ * constants and no jump lands between them. */
+static bool peek_constants(Compiler* self, int count, Value* values) {
+    Chunk* chunk = &self->function->chunk;
+    int first = chunk->count - 2 * count;
+    if (self->last_jump_target > first)
+        return false;
+
+    for (int i = 0; i < count; ++i) {
+        if (self->constant_offsets[2 - count + i] != first + 2 * i)
+            return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        values[i] = chunk->constants[chunk->code[first + 2 * i + 1]];
+    }
+    return true;
+}
+
+static void drop_constants(Compiler* self, int count) {
+    Chunk* chunk = &self->function->chunk;
+    for (int i = 0; i < count; ++i) {
+        chunk->count -= 2;
+        // Reuse the slot in the constant table if nothing else refers to it.
+        if (chunk->code[chunk->count + 1] == chunk->constant_count - 1)
+            chunk->constant_count -= 1;
+    }
+    forget_constants(self);
+}
+
+static void emit_folded(Compiler* self, Value value) {
+    if (IS_BOOL(value))
+        emit_byte(self, AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+    else
+        emit_constant(self, value);
+}
+
+/* Evaluates `a op b` the same way as the VM would. Returns false if it
+ * has to be left to run-time, e.g. for errors. */
+static bool fold_binary(TokenType operation, Value a, Value b, Value* result) {
+    if (IS_I64(a) && IS_I64(b)) {
+        // @NOTE: Overflow wraps around, as on the machine.
+        u64 x = (u64) AS_I64(a);
+        u64 y = (u64) AS_I64(b);
+        switch (operation) {
+            case TOKEN_PLUS:          *result = MAKE_I64((i64) (x + y)); return true;
+            case TOKEN_MINUS:         *result = MAKE_I64((i64) (x - y)); return true;
+            case TOKEN_STAR:          *result = MAKE_I64((i64) (x * y)); return true;
+            case TOKEN_SLASH: {
+                if (AS_I64(b) == 0 || (AS_I64(a) == INT64_MIN && AS_I64(b) == -1))
+                    return false;
+                *result = MAKE_I64(AS_I64(a) / AS_I64(b));
+                return true;
+            }
+            case TOKEN_EQUAL_EQUAL:   *result = MAKE_BOOL(AS_I64(a) == AS_I64(b)); return true;
+            case TOKEN_BANG_EQUAL:    *result = MAKE_BOOL(AS_I64(a) != AS_I64(b)); return true;
+            case TOKEN_GREATER:       *result = MAKE_BOOL(AS_I64(a) >  AS_I64(b)); return true;
+            case TOKEN_GREATER_EQUAL: *result = MAKE_BOOL(AS_I64(a) >= AS_I64(b)); return true;
+            case TOKEN_LESS:          *result = MAKE_BOOL(AS_I64(a) <  AS_I64(b)); return true;
+            case TOKEN_LESS_EQUAL:    *result = MAKE_BOOL(AS_I64(a) <= AS_I64(b)); return true;
+            default: return false;
+        }
+    } else if (IS_F64(a) && IS_F64(b)) {
+        // @NOTE: Comparing floats for equality is a run-time error.
+        switch (operation) {
+            case TOKEN_PLUS:          *result = MAKE_F64(AS_F64(a) + AS_F64(b));   return true;
+            case TOKEN_MINUS:         *result = MAKE_F64(AS_F64(a) - AS_F64(b));   return true;
+            case TOKEN_STAR:          *result = MAKE_F64(AS_F64(a) * AS_F64(b));   return true;
+            case TOKEN_SLASH:         *result = MAKE_F64(AS_F64(a) / AS_F64(b));   return true;
+            case TOKEN_GREATER:       *result = MAKE_BOOL(AS_F64(a) >  AS_F64(b)); return true;
+            case TOKEN_GREATER_EQUAL: *result = MAKE_BOOL(AS_F64(a) >= AS_F64(b)); return true;
+            case TOKEN_LESS:          *result = MAKE_BOOL(AS_F64(a) <  AS_F64(b)); return true;
+            case TOKEN_LESS_EQUAL:    *result = MAKE_BOOL(AS_F64(a) <= AS_F64(b)); return true;
+            default: return false;
+        }
+    }
+    return false;
+}
+
 static void grouping(Compiler* self, bool can_assign) {
     expression(self, self->current.location);
     consume(self, TOKEN_RIGHT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_ARGS);
@@ -392,6 +570,16 @@ static void unary(Compiler* self, bool can_assign) {
     // Compile the operand.
     parse_precedence(self, PRECEDENCE_UNARY, self->current.location);
 
+    Value operand;
+    if (operation == TOKEN_MINUS && peek_constants(self, 1, &operand) && (IS_I64(operand) || IS_F64(operand))) {
+        drop_constants(self, 1);
+        if (IS_I64(operand))
+            emit_constant(self, MAKE_I64((i64) (0 - (u64) AS_I64(operand))));
+        else
+            emit_constant(self, MAKE_F64(-AS_F64(operand)));
+        return;
+    }
+
     // Emit the operator instruction.
     switch (operation) {
         case TOKEN_MINUS:   emit_byte(self, OP_NEGATE);  break;
@@ -411,13 +599,20 @@ static void binary(Compiler* self, bool can_assign) {
     ParseRule* rule = get_rule(operation);
     parse_precedence(self, (Precedence)(rule->precedence + 1), self->current.location);
 
+    // Both operands are constants, so replace them with the result.
+    Value operands[2];
+    Value result;
+    if (peek_constants(self, 2, operands) && fold_binary(operation, operands[0], operands[1], &result)) {
+        drop_constants(self, 2);
+        emit_folded(self, result);
+        return;
+    }
+
     switch (operation) {
         case TOKEN_PLUS:          emit_byte(self,  OP_ADD);             break;
         case TOKEN_MINUS:         emit_byte(self,  OP_SUBTRACT);        break;
         case TOKEN_STAR:          emit_byte(self,  OP_MULTIPLY);        break;
         case TOKEN_SLASH:         emit_byte(self,  OP_DIVIDE);          break;
-        case TOKEN_AND:           emit_byte(self,  OP_AND);             break;
-        case TOKEN_OR:            emit_byte(self,  OP_OR);              break;
         case TOKEN_BANG_EQUAL:    emit_bytes(self, OP_EQUAL, OP_NOT);   break;
         case TOKEN_EQUAL_EQUAL:   emit_byte(self,  OP_EQUAL);           break;
         case TOKEN_GREATER:       emit_byte(self,  OP_GREATER);         break;
@@ -427,11 +622,60 @@ static void binary(Compiler* self, bool can_assign) {
         case TOKEN_END_STMT:      emit_byte(self,  OP_RETURN);          break;
         default: {
             Slice repr = slice_str_offset(self->source, token.location.index, token.count);
-            PANIC("Unexpected binary operation '%.*s'. Expected '+', '-', '*', '/', 'and', 'or', '!', '!=', '==', '<', '<=', '>', or, '>='", repr.count, repr.source);
+            PANIC("Unexpected binary operation '%.*s'. Expected '+', '-', '*', '/', '!', '!=', '==', '<', '<=', '>', or, '>='", repr.count, repr.source);
         }
     }
 }
 
+/* The left operand is on the stack. If it decides the result, it's
+ * left there and the right operand is skipped.
+ *
+ * @NOTE: Like the conditions of 'if' and 'while', the operands are
+ *  tested by `value_is_falsy` and needn't be booleans. The result is the
+ *  operand that decided it, so 'print 1 and 2;' prints 2 and
+ *  'print false or 0;' prints 0. */
+static void and_(Compiler* self, bool can_assign) {
+    int end_jump = emit_jump(self, OP_JUMP_IF_FALSE);
+    emit_byte(self, OP_POP);
+    parse_precedence(self, PRECEDENCE_AND + 1, self->current.location);
+    patch_jump(self, end_jump);
+}
+
+static void or_(Compiler* self, bool can_assign) {
+    int end_jump = emit_jump(self, OP_JUMP_IF_TRUE);
+    emit_byte(self, OP_POP);
+    parse_precedence(self, PRECEDENCE_OR + 1, self->current.location);
+    patch_jump(self, end_jump);
+}
+
+// 'yield value' suspends the coroutine, and evaluates to the value that
+// it's resumed with.
+static void yield(Compiler* self, bool can_assign) {
+    if (self->scope_depth == 0) {
+        Token token = previous_token(self);
+        store_error(self, token.location, COMPILE_ERROR_TRYING_TO_YIELD_FROM_SCRIPT, token);
+    }
+
+    if (check(self, TOKEN_END_STMT) || check(self, TOKEN_RIGHT_PAREN))
+        emit_byte(self, OP_NULL);
+    else
+        expression(self, self->current.location);
+    emit_byte(self, OP_YIELD);
+}
+
+// 'resume(coroutine, value)' continues the coroutine until it yields or
+// returns, and evaluates to that value. The value is optional.
+static void resume(Compiler* self, bool can_assign) {
+    consume(self, TOKEN_LEFT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_RESUME);
+    expression(self, self->current.location);
+    if (match(self, TOKEN_COMMA))
+        expression(self, self->current.location);
+    else
+        emit_byte(self, OP_NULL);
+    consume(self, TOKEN_RIGHT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_ARGS);
+    emit_byte(self, OP_RESUME);
+}
+
 static void expression(Compiler* self, Location start) {
     // We simply parse the lowest precedence level.
     // Except for PRECEDENCE_NONE.
@@ -493,6 +737,12 @@ static void return_statement(Compiler* self) {
     } else {
         expression(self, self->current.location);
         consume(self, TOKEN_END_STMT, COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_RETURN);
+
+        // @NOTE: The OP_RETURN is still needed after an OP_TAIL_CALL, for
+        //  natives and for the paths of 'and' and 'or' that skip the call.
+        Chunk* chunk = &self->function->chunk;
+        if (self->last_call_offset == chunk->count - 2 && chunk->code[chunk->count - 2] == OP_CALL)
+            chunk->code[chunk->count - 2] = OP_TAIL_CALL;
         emit_byte(self, OP_RETURN);
     }
 }
@@ -500,13 +750,24 @@ static void return_statement(Compiler* self) {
 static void function_declaration(Compiler* self) {
     uint8_t global = parse_variable(self, COMPILE_ERROR_EXPECTED_FUNCTION_NAME);
     mark_initialized(self);
+    int slot = (self->scope_depth > 0) ? self->function->chunk.local_count - 1 : -1;
 
+    if (self->enclosing_count == COMPILER_MAX_NESTING) {
+        Token token = previous_token(self);
+        store_error(self, token.location, COMPILE_ERROR_FUNCTIONS_NESTED_TOO_DEEPLY, token);
+        return;
+    }
     ObjFunction* previous = self->function;
+    self->enclosing[self->enclosing_count]       = previous;
+    self->enclosing_slots[self->enclosing_count] = slot;
+    self->enclosing_count++;
     begin_scope(self);
     {
         Slice name = slice_str_offset(self->source, self->previous.location.index, self->previous.count);
         self->function = function_make();
         self->function->name = string_make(name.source, name.count);
+        forget_constants(self);
+        self->last_call_offset = -1;
         function(self);
     }
     ObjFunction* function = compiler_end(self);
@@ -516,9 +777,21 @@ static void function_declaration(Compiler* self) {
         end_scope(self);
 
     self->function = previous;
-
-    if (function)
-        emit_bytes(self, OP_CONSTANT, make_constant(self, MAKE_OBJ(function)));
+    self->enclosing_count--;
+    forget_constants(self);
+    self->last_call_offset = -1;
+
+    if (function && function->upvalue_count == 0) {
+        u8 constant = make_constant(self, MAKE_OBJ(function));
+        emit_bytes(self, OP_CONSTANT, constant);
+        if (slot != -1)
+            self->function->chunk.locals[slot].function = constant;
+    } else if (function) {
+        // @NOTE: How it's made is settled at the end of its scope.
+        if (slot != -1)
+            self->function->chunk.locals[slot].closure = self->function->chunk.count;
+        emit_bytes(self, OP_CLOSURE, make_constant(self, MAKE_OBJ(function)));
+    }
 
     define_variable(self, global);
 }
@@ -596,6 +869,128 @@ static void for_statement(Compiler* self) {
     end_scope(self);
 }
 
+static bool is_same_global(Chunk* chunk, u8 a, u8 b) {
+    ObjString* x = AS_STRING(AS_OBJ(chunk->constants[a]));
+    ObjString* y = AS_STRING(AS_OBJ(chunk->constants[b]));
+    return x->size == y->size && memcmp(x->data, y->data, x->size) == 0;
+}
+
+/* Loads the globals that the condition of a loop always reads, and that
+ * the loop never assigns, once before the loop into hidden locals. The
+ * loop then reads the locals instead, so it doesn't have to look up the
+ * name on each iteration. Nothing is hoisted if the loop calls a
+ * function or resumes a coroutine, or yields to the one that resumed it,
+ * as they could assign any global.
+ *
+ * Only the condition is considered, as it's the only part that is run
+ * even if the loop isn't entered; loading an undefined global that the
+ * body would never read would otherwise be an error.
+ *
+ * Returns the number of hidden locals, which must be popped when the
+ * loop exits. */
+static int hoist_loop_invariants(Compiler* self, int loop_start, int condition_end, int loop_end) {
+    Chunk* chunk      = &self->function->chunk;
+    int    base_slot  = chunk->local_count;
+    int    max_slot   = base_slot - 1;
+
+    u8  hoisted[COMPILER_MAX_HOISTED_GLOBALS];
+    int hoisted_count = 0;
+
+    // @NOTE: The call of an inlined function may still be put back.
+    for (int i = 0; i < self->inline_site_count; ++i) {
+        if (self->inline_sites[i].caller == self->function && self->inline_sites[i].start >= loop_start)
+            return 0;
+    }
+
+    for (int i = loop_start; i < loop_end; i += chunk_instruction_size(chunk->code[i])) {
+        u8 instruction = chunk->code[i];
+        if (instruction == OP_CALL || instruction == OP_TAIL_CALL || instruction == OP_RESUME || instruction == OP_YIELD)
+            return 0;
+        // @NOTE: Functions declared in the loop may capture the locals
+        //  whose slots are moved.
+        if (instruction == OP_CLOSURE)
+            return 0;
+        if (instruction == OP_CONSTANT && IS_FUNCTION(chunk->constants[chunk->code[i + 1]]) && AS_FUNCTION(AS_OBJ(chunk->constants[chunk->code[i + 1]]))->upvalue_count > 0)
+            return 0;
+        if ((instruction == OP_GET_LOCAL || instruction == OP_SET_LOCAL) && chunk->code[i + 1] > max_slot)
+            max_slot = chunk->code[i + 1];
+    }
+
+    // The straight-line part of the condition, before any 'and' or 'or'.
+    for (int i = loop_start; i < condition_end; i += chunk_instruction_size(chunk->code[i])) {
+        u8 instruction = chunk->code[i];
+        if (instruction == OP_JUMP_IF_FALSE || instruction == OP_JUMP_IF_TRUE)
+            break;
+        if (instruction != OP_GET_GLOBAL || hoisted_count == COMPILER_MAX_HOISTED_GLOBALS)
+            continue;
+
+        bool is_new = true;
+        for (int j = 0; j < hoisted_count; ++j) {
+            if (is_same_global(chunk, hoisted[j], chunk->code[i + 1]))
+                is_new = false;
+        }
+        if (is_new)
+            hoisted[hoisted_count++] = chunk->code[i + 1];
+    }
+
+    for (int i = loop_start; i < loop_end; i += chunk_instruction_size(chunk->code[i])) {
+        u8 instruction = chunk->code[i];
+        if (instruction != OP_SET_GLOBAL && instruction != OP_DEFINE_GLOBAL)
+            continue;
+        for (int j = 0; j < hoisted_count; ++j) {
+            if (is_same_global(chunk, hoisted[j], chunk->code[i + 1]))
+                hoisted[j--] = hoisted[--hoisted_count];
+        }
+    }
+
+    if (hoisted_count == 0 || max_slot + hoisted_count > UINT8_MAX)
+        return 0;
+
+    // Make room for the preheader. The jumps in the loop are relative
+    // and are moved together with their targets, so they stay valid.
+    int size = 2 * hoisted_count;
+    for (int i = 0; i < size; ++i)
+        emit_byte(self, OP_INVALID);
+    memmove(chunk->code  + loop_start + size, chunk->code  + loop_start, chunk->count - size - loop_start);
+    memmove(chunk->lines + loop_start + size, chunk->lines + loop_start, sizeof(Location) * (chunk->count - size - loop_start));
+
+    for (int j = 0; j < hoisted_count; ++j) {
+        chunk->code[loop_start + 2 * j]      = OP_GET_GLOBAL;
+        chunk->code[loop_start + 2 * j + 1]  = hoisted[j];
+        chunk->lines[loop_start + 2 * j]     = chunk->lines[loop_start + size];
+        chunk->lines[loop_start + 2 * j + 1] = chunk->lines[loop_start + size];
+    }
+
+    // The hidden locals are placed below the ones declared in the loop.
+    for (int i = loop_start + size; i < loop_end + size; i += chunk_instruction_size(chunk->code[i])) {
+        u8 instruction = chunk->code[i];
+        if (instruction == OP_GET_GLOBAL) {
+            for (int j = 0; j < hoisted_count; ++j) {
+                if (is_same_global(chunk, hoisted[j], chunk->code[i + 1])) {
+                    chunk->code[i]     = OP_GET_LOCAL;
+                    chunk->code[i + 1] = (u8) (base_slot + j);
+                    break;
+                }
+            }
+        } else if ((instruction == OP_GET_LOCAL || instruction == OP_SET_LOCAL) && chunk->code[i + 1] >= base_slot) {
+            chunk->code[i + 1] += hoisted_count;
+        }
+    }
+    for (int i = 0; i < chunk->inlined_count; ++i) {
+        InlinedCall* call = &chunk->inlined[i];
+        if (call->start < loop_start)
+            continue;
+        call->start += size;
+        call->end   += size;
+        if (call->slot >= base_slot)
+            call->slot += hoisted_count;
+    }
+
+    forget_constants(self);
+    self->last_jump_target = chunk->count;
+    return hoisted_count;
+}
+
 static void while_statement(Compiler* self) {
     int loop_start = self->function->chunk.count;
 
@@ -607,9 +1002,16 @@ static void while_statement(Compiler* self) {
     emit_byte(self, OP_POP);
     declaration(self);
     emit_loop(self, loop_start);
+    int loop_end = self->function->chunk.count;
 
     patch_jump(self, exit_jump);
     emit_byte(self, OP_POP);
+
+    if (!self->had_error && (self->flags & OPTIMIZE_LOOP_INVARIANTS)) {
+        int hoisted_count = hoist_loop_invariants(self, loop_start, exit_jump - 1, loop_end);
+        for (int i = 0; i < hoisted_count; ++i)
+            emit_byte(self, OP_POP);
+    }
 }
 
 static void emit_loop(Compiler* self, int start) {
@@ -661,6 +1063,7 @@ static void patch_jump(Compiler* self, int offset) {
 
     self->function->chunk.code[offset]     = (jump >> 8) & 0xff;
     self->function->chunk.code[offset + 1] = jump & 0xff;
+    self->last_jump_target = self->function->chunk.count;
 }
 
 static void block(Compiler* self) {
@@ -675,16 +1078,255 @@ static void begin_scope(Compiler* self) {
     self->scope_depth += 1;
 }
 
+/* Settles how a local function that captures variables is made, once
+ * all uses of it have been seen at the end of its scope. If it's only
+ * called by its name in this function, every call runs right above the
+ * frame of this function, so it stays a plain function that reads the
+ * captured locals from there and nothing is allocated. Otherwise it's
+ * made into a closure, and the locals it captures are closed over. */
+static void settle_closure(Compiler* self, Local* local) {
+    Chunk*       chunk    = &self->function->chunk;
+    ObjFunction* function = AS_FUNCTION(AS_OBJ(chunk->constants[chunk->code[local->closure + 1]]));
+
+    bool on_stack = !local->escapes;
+    for (int i = 0; i < function->upvalue_count; ++i)
+        on_stack = on_stack && function->captures[i].is_local;
+
+    if (!on_stack) {
+        for (int i = 0; i < function->upvalue_count; ++i) {
+            if (function->captures[i].is_local)
+                chunk->locals[function->captures[i].index].is_captured = true;
+        }
+        return;
+    }
+
+    chunk->code[local->closure] = OP_CONSTANT;
+    Chunk* inner = &function->chunk;
+    for (int i = 0; i < inner->count; i += chunk_instruction_size(inner->code[i])) {
+        u8 instruction = inner->code[i];
+        if (instruction == OP_GET_UPVALUE || instruction == OP_SET_UPVALUE) {
+            inner->code[i]     = (instruction == OP_GET_UPVALUE) ? OP_GET_ENCLOSING : OP_SET_ENCLOSING;
+            inner->code[i + 1] = function->captures[inner->code[i + 1]].index;
+        }
+    }
+}
+
+/* Settles the calls to a local function that were inlined, once all
+ * uses of it have been seen at the end of its scope. If it escapes, it
+ * may have been assigned, so each call is put back over the start of its
+ * inlined code, followed by a jump over the rest. */
+static void settle_inlined_calls(Compiler* self, int local) {
+    Chunk* chunk   = &self->function->chunk;
+    bool   escapes = chunk->locals[local].escapes;
+    for (int i = self->inline_site_count - 1; i >= 0; --i) {
+        InlineSite site = self->inline_sites[i];
+        if (site.caller != self->function || site.local != local)
+            continue;
+        self->inline_sites[i] = self->inline_sites[--self->inline_site_count];
+        if (!escapes)
+            continue;
+
+        int jump = site.end - (site.start + 5);
+        u8  code[5] = { OP_CALL, site.arg_count, OP_JUMP, (jump >> 8) & 0xff, jump & 0xff };
+        for (int j = 0; j < 5; ++j) {
+            chunk->code[site.start + j]  = code[j];
+            chunk->lines[site.start + j] = site.call;
+        }
+        for (int j = chunk->inlined_count - 1; j >= 0; --j) {
+            if (chunk->inlined[j].start >= site.start && chunk->inlined[j].end <= site.end)
+                memmove(&chunk->inlined[j], &chunk->inlined[j + 1], sizeof(InlinedCall) * (--chunk->inlined_count - j));
+        }
+    }
+}
+
 static void end_scope(Compiler* self) {
     self->scope_depth -= 1;
-    while (self->function->chunk.local_count > 0 && self->function->chunk.locals[self->function->chunk.local_count - 1].depth > self->scope_depth) {
-        emit_byte(self, OP_POP);
-        self->function->chunk.local_count--;
+    Chunk* chunk = &self->function->chunk;
+    while (chunk->local_count > 0 && chunk->locals[chunk->local_count - 1].depth > self->scope_depth) {
+        Local* local = &chunk->locals[chunk->local_count - 1];
+        if (local->closure != -1 && !self->had_error)
+            settle_closure(self, local);
+        if (local->function != -1)
+            settle_inlined_calls(self, chunk->local_count - 1);
+        emit_byte(self, local->is_captured ? OP_CLOSE_UPVALUE : OP_POP);
+        chunk->local_count--;
     }
 }
 
+/* Copies the code of the local function in `local` in place of a call to
+ * it, whose callee was read at `callee_offset` and whose arguments are on
+ * the stack above it. They become the locals of the copy, which are
+ * moved up to where the callee is, and each return stores its value into
+ * the slot of the callee and pops the rest. Only functions that don't
+ * capture anything are inlined, as they don't depend on their frame, and
+ * only if the number of arguments is right, so call() reports the wrong
+ * ones. Returns false if the call has to be made. */
+static bool inline_call(Compiler* self, int local, int callee_offset, u8 arg_count) {
+    Chunk* chunk = &self->function->chunk;
+    int    index = chunk->locals[local].function;
+    if (!(self->flags & OPTIMIZE_INLINE_CALLS) || self->had_error || index == -1)
+        return false;
+
+    ObjFunction* callee = AS_FUNCTION(AS_OBJ(chunk->constants[index]));
+    Chunk*       code   = &callee->chunk;
+    // @NOTE: Placeholders of jumps that aren't patched yet could land in
+    //  a chunk that is larger than a jump can reach.
+    if (callee->arity != arg_count || code->count < 3 || code->count > COMPILER_INLINE_MAX_SIZE || chunk->count > UINT16_MAX)
+        return false;
+    if (self->inline_site_count == COMPILER_MAX_INLINE_SITES || chunk->constant_count + code->constant_count + code->inlined_count + 1 > UINT8_MAX + 1)
+        return false;
+
+    int* heights = ALLOCATE_ARRAY(int, code->count + 1);
+    int  caller_count = chunk->count;
+    int* callers = ALLOCATE_ARRAY(int, caller_count + 1);
+    int* offsets = ALLOCATE_ARRAY(int, code->count + 1);
+    int* jumps   = ALLOCATE_ARRAY(int, code->count + 1);
+    int* sources = ALLOCATE_ARRAY(int, code->count + 1);
+    bool can_inline = chunk_stack_heights(code, callee->arity + 1, heights) && chunk_stack_heights(chunk, self->function->arity + 1, callers);
+    int  base = can_inline ? callers[callee_offset] : -1;
+    int  last = 0;
+    for (int i = 0; can_inline && i < code->count; i += chunk_instruction_size(code->code[i])) {
+        if (heights[i] == -1)
+            continue;
+        last = i;
+        switch (code->code[i]) {
+            case OP_CLOSURE:
+            case OP_GET_UPVALUE:
+            case OP_SET_UPVALUE:
+            case OP_CLOSE_UPVALUE:
+            case OP_GET_ENCLOSING:
+            case OP_SET_ENCLOSING:
+            case OP_DEFINE_GLOBAL:
+            case OP_EXIT:
+                can_inline = false;
+                break;
+            case OP_CONSTANT:
+                can_inline = !IS_FUNCTION(code->constants[code->code[i + 1]]);
+                break;
+        }
+        can_inline = can_inline && base >= 0 && base + heights[i] + 1 <= UINT8_MAX;
+    }
+
+    // The code must have room for the call and the jump over the rest in
+    // case the call has to be put back.
+    int size = 0;
+    for (int i = 0; can_inline && i < code->count; i += chunk_instruction_size(code->code[i])) {
+        if (heights[i] != -1)
+            size += (code->code[i] == OP_RETURN) ? 2 + heights[i] - 1 + ((i != last) ? 3 : 0) : chunk_instruction_size(code->code[i]);
+    }
+    can_inline = can_inline && size >= 5;
+
+    if (can_inline) {
+        int start      = chunk->count;
+        int jump_count = 0;
+        for (int i = 0; i < code->count; i += chunk_instruction_size(code->code[i])) {
+            offsets[i] = chunk->count;
+            if (heights[i] == -1)
+                continue;
+
+            u8       instruction = code->code[i];
+            u8       operand     = (chunk_instruction_size(instruction) > 1) ? code->code[i + 1] : 0;
+            Location location    = code->lines[i];
+            switch (instruction) {
+                case OP_GET_LOCAL:
+                case OP_SET_LOCAL:
+                    chunk_write(chunk, instruction, location);
+                    chunk_write(chunk, (u8) (base + operand), location);
+                    break;
+                case OP_CONSTANT:
+                case OP_GET_GLOBAL:
+                case OP_SET_GLOBAL:
+                    chunk_write(chunk, instruction, location);
+                    chunk_write(chunk, make_constant(self, code->constants[operand]), location);
+                    break;
+                case OP_TAIL_CALL:
+                    chunk_write(chunk, OP_CALL, location);
+                    chunk_write(chunk, operand, location);
+                    break;
+                case OP_RETURN: {
+                    chunk_write(chunk, OP_SET_LOCAL, location);
+                    chunk_write(chunk, (u8) base, location);
+                    for (int j = 1; j < heights[i]; ++j)
+                        chunk_write(chunk, OP_POP, location);
+                    if (i != last) {
+                        sources[jump_count] = -1;
+                        jumps[jump_count++] = chunk->count;
+                        chunk_write(chunk, OP_JUMP, location);
+                        chunk_write(chunk, 0xff, location);
+                        chunk_write(chunk, 0xff, location);
+                    }
+                    break;
+                }
+                default: {
+                    for (int j = 0; j < chunk_instruction_size(instruction); ++j)
+                        chunk_write(chunk, code->code[i + j], location);
+                    // Only the jumps have two bytes of operands.
+                    if (chunk_instruction_size(instruction) == 3) {
+                        sources[jump_count] = i;
+                        jumps[jump_count++] = chunk->count - 3;
+                    }
+                    break;
+                }
+            }
+        }
+        offsets[code->count] = chunk->count;
+
+        // The jumps of the returns go to the end, and the others to where
+        // their target was copied.
+        int end = chunk->count;
+        for (int i = 0; i < jump_count; ++i) {
+            int at     = jumps[i];
+            int old    = sources[i];
+            int target = end;
+            if (old != -1) {
+                int jump = (code->code[old + 1] << 8) | code->code[old + 2];
+                target = offsets[(code->code[old] == OP_LOOP) ? old + 3 - jump : old + 3 + jump];
+            }
+            int jump = (chunk->code[at] == OP_LOOP) ? at + 3 - target : target - (at + 3);
+            chunk->code[at + 1] = (jump >> 8) & 0xff;
+            chunk->code[at + 2] = jump & 0xff;
+        }
+
+        for (int i = 0; i < code->inlined_count; ++i) {
+            InlinedCall inner = code->inlined[i];
+            inner.start = offsets[inner.start];
+            inner.end   = offsets[inner.end];
+            inner.slot  = (u8) (base + inner.slot);
+            inner.name  = make_constant(self, code->constants[inner.name]);
+            chunk_add_inlined(chunk, inner);
+        }
+        Location call = previous_token(self).location;
+        chunk_add_inlined(chunk, (InlinedCall) {
+            .start=start, .end=end, .slot=(u8) base, .arity=arg_count, .call=call,
+            .name=make_constant(self, MAKE_OBJ(callee->name)),
+        });
+        self->inline_sites[self->inline_site_count++] = (InlineSite) {
+            .caller=self->function, .local=local, .start=start, .end=end, .arg_count=arg_count, .call=call,
+        };
+
+        forget_constants(self);
+        self->last_jump_target = chunk->count;
+        self->last_call_offset = -1;
+    }
+
+    FREE_ARRAY(int, heights, code->count + 1);
+    FREE_ARRAY(int, callers, caller_count + 1);
+    FREE_ARRAY(int, offsets, code->count + 1);
+    FREE_ARRAY(int, jumps,   code->count + 1);
+    FREE_ARRAY(int, sources, code->count + 1);
+    return can_inline;
+}
+
 static void call(Compiler* self, bool can_assign) {
+    bool is_local = self->callee_offset != -1 && self->callee_offset == self->function->chunk.count - 2;
+    int  callee_offset = self->callee_offset;
+    int  callee_local  = self->callee_local;
+    self->callee_offset = -1;
+
     uint8_t arg_count = argument_list(self);
+    if (is_local && inline_call(self, callee_local, callee_offset, arg_count))
+        return;
+    self->last_call_offset = self->function->chunk.count;
     emit_bytes(self, OP_CALL, arg_count);
 }
 
@@ -703,6 +1345,40 @@ static uint8_t argument_list(Compiler* self) {
     return arg_count;
 }
 
+/* Compiles the arguments of a typed native straight onto the stack, as
+ * there's no callee to call through. Constant arguments are checked, and
+ * integers are converted to floats for the parameters that take floats,
+ * so the VM only checks the arguments that aren't constant. */
+static void native_call(Compiler* self, Token name, int index) {
+    const TypedNative* native = &TYPED_NATIVES[index];
+    int arity = typed_native_arity(native);
+    consume(self, TOKEN_LEFT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_ARGS);
+
+    int arg_count = 0;
+    if (!check(self, TOKEN_RIGHT_PAREN)) {
+        do {
+            expression(self, self->current.location);
+            Value constant;
+            if (arg_count < arity && peek_constants(self, 1, &constant)) {
+                NativeType type = typed_native_parameter(native, arg_count);
+                if (type == NATIVE_TYPE_F64 && IS_I64(constant)) {
+                    drop_constants(self, 1);
+                    emit_constant(self, MAKE_F64((f64) AS_I64(constant)));
+                } else if (!(type == NATIVE_TYPE_F64 && IS_F64(constant)) && !(type == NATIVE_TYPE_I64 && IS_I64(constant))) {
+                    Token token = previous_token(self);
+                    store_error(self, token.location, COMPILE_ERROR_WRONG_NATIVE_ARGUMENT_TYPE, token);
+                }
+            }
+            arg_count++;
+        } while (match(self, TOKEN_COMMA));
+    }
+    consume(self, TOKEN_RIGHT_PAREN, COMPILE_ERROR_EXPECTED_PARENS_AFTER_ARGS);
+    if (arg_count != arity)
+        store_error(self, name.location, COMPILE_ERROR_WRONG_NATIVE_ARGUMENT_COUNT, previous_token(self));
+
+    emit_bytes(self, OP_CALL_NATIVE_TYPED, (u8) index);
+}
+
 static void variable_declaration(Compiler* self) {
     uint8_t global = parse_variable(self, COMPILE_ERROR_EXPECTED_PARENS_AFTER_ARGS);
 
@@ -749,8 +1425,20 @@ static ObjFunction* compiler_end(Compiler* self) {
 }
 
 
-ObjFunction* compile(const char* path, const char* source) {
+// Runs after the optimizer, which changes the code of the functions.
+static void compute_max_stack(ObjFunction* function) {
+    Chunk* chunk = &function->chunk;
+    for (int i = 0; i < chunk->constant_count; ++i) {
+        if (IS_FUNCTION(chunk->constants[i]))
+            compute_max_stack(AS_FUNCTION(AS_OBJ(chunk->constants[i])));
+    }
+    function->max_stack = chunk_max_stack(chunk, function->arity + 1);
+    ASSERTF(function->max_stack >= 0, "The code of %s unbalances the stack\n", function->name ? function->name->data : "the script");
+}
+
+ObjFunction* compile(const char* path, const char* source, OptimizeFlags flags) {
     Compiler compiler = compiler_make(path, source);
+    compiler.flags    = flags;
 
     next(&compiler);
     while (!match(&compiler, TOKEN_EOF)) {
@@ -765,7 +1453,13 @@ ObjFunction* compile(const char* path, const char* source) {
 
 
     emit_byte(&compiler, OP_EXIT);
-    return compiler_end(&compiler);
+
+    ObjFunction* script = compiler_end(&compiler);
+    if (script) {
+        optimize(script, flags);
+        compute_max_stack(script);
+    }
+    return script;
 }
 
 
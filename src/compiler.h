@@ -4,8 +4,32 @@
 #include "value.h"
 #include "object.h"
 #include "error.h"
+#include "optimizer.h"
 
 #define COMPILER_MAX_ERRORS 32
+// Globals that a while loop may load once, before it starts.
+#define COMPILER_MAX_HOISTED_GLOBALS 8
+// Functions declared inside functions.
+#define COMPILER_MAX_NESTING 64
+// Local functions with at most this many bytes of code are inlined into
+// the calls to them.
+#define COMPILER_INLINE_MAX_SIZE 64
+// Inlined calls whose function may still turn out to escape.
+#define COMPILER_MAX_INLINE_SITES 64
+
+
+/* A call to a local function that was replaced by the code of the
+ * function, from `start` to `end` in the chunk of `caller`. Until the
+ * scope of the local ends, it may still be used as a value or assigned,
+ * so the call is then put back over the start of the code. */
+typedef struct {
+    ObjFunction* caller;
+    int      local;
+    int      start;
+    int      end;
+    u8       arg_count;
+    Location call;
+} InlineSite;
 
 
 typedef struct {
@@ -19,14 +43,37 @@ typedef struct {
 
     ObjFunction* function;
 
+    // The functions around `function`, outermost first, and the local
+    // slot in each that holds the next one, or -1 if it's a global.
+    ObjFunction* enclosing[COMPILER_MAX_NESTING];
+    int          enclosing_slots[COMPILER_MAX_NESTING];
+    int          enclosing_count;
+
     int   scope_depth;
 
     Value  constants[1024];
     int    const_ptr;
 
+    // Offsets of the last two constants and of the last place a jump
+    // lands, so constant operands can be folded.
+    int    constant_offsets[2];
+    int    last_jump_target;
+    // Offset of the last OP_CALL, so a call in tail position can be
+    // turned into an OP_TAIL_CALL.
+    int    last_call_offset;
+    // Offset of the last OP_GET_LOCAL that is followed by a call, and the
+    // local it reads, so calls to local functions can be inlined.
+    int    callee_offset;
+    int    callee_local;
+
+    InlineSite inline_sites[COMPILER_MAX_INLINE_SITES];
+    int        inline_site_count;
+
+    OptimizeFlags flags;
+
     bool   had_error;
     bool   in_panic_mode;
 } Compiler;
 
 
-ObjFunction* compile(const char* path, const char* source);
+ObjFunction* compile(const char* path, const char* source, OptimizeFlags flags);
@@ -11,6 +11,7 @@ const char* ERROR_MESSAGE[] = {
         [COMPILE_ERROR_EXPECTED_INFIX_TOKEN]                     = "Expected expression, but got '%.*s'",
         [COMPILE_ERROR_DECLARED_VARIABLE_TWICE]                  = "Already a variable with name '%.*s' in this scope",
         [COMPILE_ERROR_TRYING_TO_RETURN_FROM_SCRIPT]             = "Can't return from top-level code",
+        [COMPILE_ERROR_TRYING_TO_YIELD_FROM_SCRIPT]              = "Can't yield from top-level code",
         [COMPILE_ERROR_TOO_MANY_PARAMETERS]                      = "Can't have more than 255 parameters",
         [COMPILE_ERROR_TOO_MANY_ARGUMENTS]                       = "Can't have more than 255 arguments",
         [COMPILE_ERROR_TOO_MANY_CONSTANTS]                       = "Too many constants in one chunk",
@@ -35,6 +36,12 @@ const char* ERROR_MESSAGE[] = {
         [COMPILE_ERROR_EXPECTED_PARENS_AFTER_IF]                 = "Expected '(' after 'if'",
         [COMPILE_ERROR_EXPECTED_EQUAL_AFTER_VAR_DECL]            = "Must initialize variable! Expected '=' after variable declaration",
         [COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_DECL]    = "Expected ';' after variable declaration",
+        [COMPILE_ERROR_EXPECTED_PARENS_AFTER_RESUME]             = "Expected '(' after 'resume'",
+        [COMPILE_ERROR_TOO_MANY_UPVALUES]                        = "Too many closure variables in function",
+        [COMPILE_ERROR_FUNCTIONS_NESTED_TOO_DEEPLY]              = "Functions are nested too deeply",
+        [COMPILE_ERROR_REDEFINITION_OF_NATIVE_FUNCTION]          = "Can't redefine native function '%.*s'",
+        [COMPILE_ERROR_WRONG_NATIVE_ARGUMENT_COUNT]              = "Wrong number of arguments in call to native function '%.*s'",
+        [COMPILE_ERROR_WRONG_NATIVE_ARGUMENT_TYPE]               = "Expected a number as argument to native function, but got '%.*s'",
 
         [RUNTIME_ERROR_UNKNOWN_OP_CODE]                 = "Unknown opcode %.*s",
         [RUNTIME_ERROR_TOO_MANY_ARGUMENTS]              = "Too many arguments! %.*s",
@@ -44,6 +51,9 @@ const char* ERROR_MESSAGE[] = {
         [RUNTIME_ERROR_UNDEFINED_VARIABLE]              = "Variable '%.*s' has not been defined",
         [RUNTIME_ERROR_UNSAFE_FLOAT_COMPARISON]         = "Comparison between floats is inaccurate",
         [RUNTIME_ERROR_REDEFINITION_OF_NATIVE_FUNCTION] = "Native function '%.*s' is already defined",
+        [RUNTIME_ERROR_NATIVE_FAILED]                   = "Native function failed. %.*s",
+        [RUNTIME_ERROR_YIELD_OUTSIDE_COROUTINE]         = "Can only yield from a coroutine",
+        [RUNTIME_ERROR_INVALID_RESUME]                  = "Can only resume suspended coroutines. %.*s",
 };
 
 
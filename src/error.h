@@ -49,6 +49,7 @@ typedef enum {
     COMPILE_ERROR_EXPECTED_INFIX_TOKEN,
     COMPILE_ERROR_DECLARED_VARIABLE_TWICE,
     COMPILE_ERROR_TRYING_TO_RETURN_FROM_SCRIPT,
+    COMPILE_ERROR_TRYING_TO_YIELD_FROM_SCRIPT,
     COMPILE_ERROR_TOO_MANY_PARAMETERS,
     COMPILE_ERROR_TOO_MANY_ARGUMENTS,
     COMPILE_ERROR_TOO_MANY_CONSTANTS,
@@ -73,6 +74,12 @@ typedef enum {
     COMPILE_ERROR_EXPECTED_PARENS_AFTER_GROUPING,
     COMPILE_ERROR_EXPECTED_EQUAL_AFTER_VAR_DECL,
     COMPILE_ERROR_EXPECTED_END_STATEMENT_AFTER_VAR_DECL,
+    COMPILE_ERROR_EXPECTED_PARENS_AFTER_RESUME,
+    COMPILE_ERROR_TOO_MANY_UPVALUES,
+    COMPILE_ERROR_FUNCTIONS_NESTED_TOO_DEEPLY,
+    COMPILE_ERROR_REDEFINITION_OF_NATIVE_FUNCTION,
+    COMPILE_ERROR_WRONG_NATIVE_ARGUMENT_COUNT,
+    COMPILE_ERROR_WRONG_NATIVE_ARGUMENT_TYPE,
     COMPILE_ERROR_STOP_INDEX,
 
     RUNTIME_ERROR_START_INDEX,
@@ -84,6 +91,9 @@ typedef enum {
     RUNTIME_ERROR_UNDEFINED_VARIABLE,
     RUNTIME_ERROR_UNSAFE_FLOAT_COMPARISON,
     RUNTIME_ERROR_REDEFINITION_OF_NATIVE_FUNCTION,
+    RUNTIME_ERROR_NATIVE_FAILED,
+    RUNTIME_ERROR_YIELD_OUTSIDE_COROUTINE,
+    RUNTIME_ERROR_INVALID_RESUME,
     RUNTIME_ERROR_STOP_INDEX,
 } ErrorCode;
 
@@ -0,0 +1,91 @@
+#include "executor.h"
+#include "error.h"
+
+#include <pthread.h>
+
+
+typedef struct {
+    const char*  path;
+    const char*  source;
+    ObjFunction* script;
+    bool         quiet;
+    VMConfig     config;
+
+    pthread_mutex_t lock;
+    int next_run;
+    int run_count;
+    int failed;
+} Executor;
+
+typedef struct {
+    Executor* executor;
+    pthread_t thread;
+} Worker;
+
+
+// Returns the index of the next run, or -1 when all have been taken.
+static int take_run(Executor* executor) {
+    pthread_mutex_lock(&executor->lock);
+    int run = (executor->next_run < executor->run_count) ? executor->next_run++ : -1;
+    pthread_mutex_unlock(&executor->lock);
+    return run;
+}
+
+static void* worker_main(void* argument) {
+    Worker*   worker   = argument;
+    Executor* executor = worker->executor;
+
+    VM* vm = vm_create(&executor->config);
+    ASSERTF(vm != NULL, "Couldn't create the VM of a worker");
+
+    int failed = 0;
+    int runs   = 0;
+    while (take_run(executor) != -1) {
+        if (runs++ > 0 && vm_reset(vm) != NO_ERROR) {
+            failed++;
+            continue;
+        }
+        if (!vm_interpret_function(vm, executor->path, executor->source, executor->script, executor->quiet))
+            failed++;
+    }
+    vm_destroy(vm);
+
+    pthread_mutex_lock(&executor->lock);
+    executor->failed += failed;
+    pthread_mutex_unlock(&executor->lock);
+    return NULL;
+}
+
+
+int executor_run(const ExecutorConfig* config, const char* path, const char* source, ObjFunction* script, bool quiet) {
+    int worker_count = config->worker_count;
+    if (worker_count > EXECUTOR_MAX_WORKERS) worker_count = EXECUTOR_MAX_WORKERS;
+    if (worker_count > config->run_count)    worker_count = config->run_count;
+    if (worker_count < 1)                    worker_count = 1;
+
+    Executor executor = {
+        .path=path, .source=source, .script=script, .quiet=quiet, .config=config->vm,
+        .next_run=0, .run_count=config->run_count, .failed=0,
+    };
+    executor.config.use_tiers = false;
+    executor.config.use_jit   = false;
+    pthread_mutex_init(&executor.lock, NULL);
+
+    Worker workers[EXECUTOR_MAX_WORKERS];
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i] = (Worker) { .executor=&executor };
+    }
+
+    // @NOTE: The calling thread is the first worker.
+    for (int i = 1; i < worker_count; ++i) {
+        int result = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        ASSERTF(result == 0, "Couldn't create worker thread");
+    }
+    worker_main(&workers[0]);
+    for (int i = 1; i < worker_count; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&executor.lock);
+    return executor.failed;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "object.h"
+#include "interpreter.h"
+
+
+/* Runs one compiled script many times over a pool of worker threads. The
+ * script, its functions and their constants are compiled once and shared
+ * by all workers, which only read them. Each worker owns a VM with its
+ * own stack, objects and globals, which it resets between runs.
+ *
+ * As promoting a function writes to it, the shared functions stay in
+ * tier 0 and aren't compiled by the JIT.
+ */
+
+#define EXECUTOR_MAX_WORKERS 64
+
+
+typedef struct {
+    int worker_count;
+    int run_count;
+    // The configuration of the VM of each worker. The tiers and the JIT
+    // are turned off.
+    VMConfig vm;
+} ExecutorConfig;
+
+
+// Returns the number of runs that failed.
+int executor_run(const ExecutorConfig* config, const char* path, const char* source, ObjFunction* script, bool quiet);
@@ -4,31 +4,329 @@
 #include "compiler.h"
 #include "chunk.h"
 #include "object.h"
-
-#include <time.h>
+#include "jit.h"
+#include "optimizer.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "native.h"
+#include "numeric.h"
 
 
 #define STRING_TO_SLICE(x) ((Slice) { .source=x->data, .count=x->size })
 
-Error vm_run(const char* path, const char* source, bool quiet);
+Error vm_run(VM* vm, const char* path, const char* source, bool quiet);
 
 
-static Value clock_native(int arg_count, Value* args) {
-    if (arg_count != 0)
-        return MAKE_INVALID();
-    clock_t time = clock();
-    return MAKE_F64((double) time / (double) CLOCKS_PER_SEC);
+static Obj* own(VM* vm, Obj* object) {
+    object->next = vm->objects;
+    vm->objects  = object;
+    return object;
+}
+
+static Value native_error(VM* vm, const char* message) {
+    snprintf(vm->error_buffer, sizeof(vm->error_buffer), "%s", message);
+    return MAKE_INVALID();
+}
+
+static Scheduler* scheduler_of(VM* vm) {
+    if (vm->scheduler == NULL) {
+        VMConfig config = { .stack_size=vm->stack_limit, .frame_count=vm->frame_limit, .task_workers=vm->task_workers };
+        vm->scheduler = scheduler_create(vm->task_workers, config);
+    }
+    return vm->scheduler;
+}
+
+// Called before the globals or an array change, so the next spawn copies
+// them again. Any array may be in the globals.
+static void forget_task_globals(VM* vm) {
+    if (vm->task_globals != NULL) {
+        task_globals_release(vm->task_globals);
+        vm->task_globals = NULL;
+    }
+}
+
+// spawn(function, args...) calls the function as a task and returns its
+// handle.
+static Value spawn_native(VM* vm, int arg_count, Value* args) {
+    if (arg_count < 1 || !IS_FUNCTION(args[0]))
+        return native_error(vm, "spawn() expects a function and its arguments");
+    ObjFunction* function = AS_FUNCTION(AS_OBJ(args[0]));
+    if (function->arity != arg_count - 1)
+        return native_error(vm, "spawn() got the wrong number of arguments for the function");
+    for (int i = 1; i < arg_count; ++i) {
+        if (IS_COROUTINE(args[i]))
+            return native_error(vm, "spawn() can't pass a coroutine to another task");
+        if (IS_CLOSURE(args[i]))
+            return native_error(vm, "spawn() can't pass a closure to another task");
+    }
+
+    if (vm->task_globals == NULL)
+        vm->task_globals = task_globals_make(&vm->globals);
+    ObjTask* task = scheduler_spawn(scheduler_of(vm), vm->worker, function, arg_count - 1, args + 1, vm->task_globals, vm->path, vm->source);
+    if (task == NULL)
+        return native_error(vm, "spawn() couldn't queue the task, too many tasks are waiting");
+    return MAKE_OBJ(own(vm, (Obj*) task));
+}
+
+// join(handle) waits for a task and returns a copy of its result.
+static Value join_native(VM* vm, int arg_count, Value* args) {
+    if (arg_count != 1 || !IS_TASK(args[0]))
+        return native_error(vm, "join() expects a task");
+    Task* task = AS_TASK(AS_OBJ(args[0]))->task;
+    if (!scheduler_join(scheduler_of(vm), vm->worker, task))
+        return native_error(vm, "The joined task failed");
+    return value_copy(task->result, &vm->objects);
+}
+
+static ErrorCode call(VM* vm, ObjFunction* function, int arg_count);
+static ErrorCode call_native(VM* vm, ObjNative* native, int arg_count);
+static ErrorCode call_closure(VM* vm, ObjClosure* closure, int arg_count);
+static ObjUpvalue* capture_upvalue(VM* vm, Value* slot);
+static void close_upvalues(VM* vm, Value* last);
+static void switch_stacks(VM* vm, ObjCoroutine* coroutine);
+
+// coroutine(function, args...) makes a coroutine of the call, which runs
+// on the first resume.
+static Value coroutine_native(VM* vm, int arg_count, Value* args) {
+    if (arg_count < 1 || !(IS_FUNCTION(args[0]) || IS_CLOSURE(args[0])))
+        return native_error(vm, "coroutine() expects a function and its arguments");
+    ObjClosure*  closure  = IS_CLOSURE(args[0]) ? AS_CLOSURE(AS_OBJ(args[0])) : NULL;
+    ObjFunction* function = (closure != NULL) ? closure->function : AS_FUNCTION(AS_OBJ(args[0]));
+    if (function->arity != arg_count - 1)
+        return native_error(vm, "coroutine() got the wrong number of arguments for the function");
+
+    ObjCoroutine* coroutine = coroutine_make(function->max_stack, VM_COROUTINE_FRAMES);
+    own(vm, (Obj*) coroutine);
+    memcpy(coroutine->stacks.stack, args, sizeof(Value) * arg_count);
+    coroutine->stacks.stack_top += arg_count;
+
+    // @NOTE: The first frame is set up on the stacks of the coroutine.
+    ObjCoroutine* current = vm->coroutine;
+    switch_stacks(vm, coroutine);
+    ErrorCode result = (closure != NULL) ? call_closure(vm, closure, arg_count - 1) : call(vm, function, arg_count - 1);
+    switch_stacks(vm, current);
+    ASSERT(result == NO_ERROR);
+    return MAKE_OBJ(coroutine);
+}
+
+// done(coroutine) is true once the function of the coroutine has returned.
+static Value done_native(VM* vm, int arg_count, Value* args) {
+    if (arg_count != 1 || !IS_COROUTINE(args[0]))
+        return native_error(vm, "done() expects a coroutine");
+    return MAKE_BOOL(AS_COROUTINE(AS_OBJ(args[0]))->state == COROUTINE_DONE);
+}
+
+// ---- ARRAYS ----
+// The natives of arrays run the kernels of numeric.c over the elements, so
+// scripts do bulk work in C instead of in loops of the VM.
+
+// So the size of an array fits in an int.
+#define ARRAY_MAX_COUNT (INT32_MAX / 16)
+
+static ObjArray* array_argument(Value value) {
+    return IS_ARRAY(value) ? AS_ARRAY(AS_OBJ(value)) : NULL;
+}
+
+// Stores a number as an element. Integers are converted into floats, but
+// not the other way around.
+static bool store_element(ObjArray* array, int index, Value value) {
+    if      (array->type == ARRAY_F64 && IS_F64(value)) array->as.f64s[index] = AS_F64(value);
+    else if (array->type == ARRAY_F64 && IS_I64(value)) array->as.f64s[index] = (f64) AS_I64(value);
+    else if (array->type == ARRAY_I64 && IS_I64(value)) array->as.i64s[index] = AS_I64(value);
+    else    return false;
+    return true;
+}
+
+static bool valid_index(ObjArray* array, Value index) {
+    return IS_I64(index) && AS_I64(index) >= 0 && AS_I64(index) < array->count;
+}
+
+// array(count, value) makes an array of `count` copies of the number, with
+// elements of its type.
+static Value array_native(VM* vm, int arg_count, Value* args) {
+    if (arg_count != 2 || !IS_I64(args[0]) || !(IS_F64(args[1]) || IS_I64(args[1])))
+        return native_error(vm, "array() expects a count and a number");
+    if (AS_I64(args[0]) < 0 || AS_I64(args[0]) > ARRAY_MAX_COUNT)
+        return native_error(vm, "array() got a count out of range");
+    ObjArray* array = array_make(IS_F64(args[1]) ? ARRAY_F64 : ARRAY_I64, (int) AS_I64(args[0]));
+    for (int i = 0; i < array->count; ++i)
+        store_element(array, i, args[1]);
+    return MAKE_OBJ(own(vm, (Obj*) array));
+}
+
+// range(count) makes an array of the integers from 0 up to `count`.
+static Value range_native(VM* vm, int arg_count, Value* args) {
+    if (arg_count != 1 || !IS_I64(args[0]))
+        return native_error(vm, "range() expects a count");
+    if (AS_I64(args[0]) < 0 || AS_I64(args[0]) > ARRAY_MAX_COUNT)
+        return native_error(vm, "range() got a count out of range");
+    ObjArray* array = array_make(ARRAY_I64, (int) AS_I64(args[0]));
+    for (int i = 0; i < array->count; ++i)
+        array->as.i64s[i] = i;
+    return MAKE_OBJ(own(vm, (Obj*) array));
+}
+
+static Value len_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 1) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "len() expects an array");
+    return MAKE_I64(array->count);
+}
+
+static Value get_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 2) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "get() expects an array and an index");
+    if (!valid_index(array, args[1]))
+        return native_error(vm, "get() got an index out of range");
+    int index = (int) AS_I64(args[1]);
+    return (array->type == ARRAY_F64) ? MAKE_F64(array->as.f64s[index]) : MAKE_I64(array->as.i64s[index]);
+}
+
+// set(array, index, value) stores the value and returns it.
+static Value set_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 3) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "set() expects an array, an index and a value");
+    if (!valid_index(array, args[1]))
+        return native_error(vm, "set() got an index out of range");
+    forget_task_globals(vm);
+    if (!store_element(array, (int) AS_I64(args[1]), args[2]))
+        return native_error(vm, "set() got a value of the wrong type for the array");
+    return args[2];
+}
+
+static Value sum_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 1) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "sum() expects an array");
+    if (array->type == ARRAY_F64) return MAKE_F64(numeric_sum_f64(array->as.f64s, array->count));
+    else                          return MAKE_I64(numeric_sum_i64(array->as.i64s, array->count));
+}
+
+static Value dot_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* x = (arg_count == 2) ? array_argument(args[0]) : NULL;
+    ObjArray* y = (arg_count == 2) ? array_argument(args[1]) : NULL;
+    if (x == NULL || y == NULL || x->type != y->type || x->count != y->count)
+        return native_error(vm, "dot() expects two arrays of the same type and length");
+    if (x->type == ARRAY_F64) return MAKE_F64(numeric_dot_f64(x->as.f64s, y->as.f64s, x->count));
+    else                      return MAKE_I64(numeric_dot_i64(x->as.i64s, y->as.i64s, x->count));
+}
+
+// axpy(alpha, x, y) adds `alpha` times `x` to the floats of `y`, and
+// returns `y`.
+static Value axpy_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* x = (arg_count == 3) ? array_argument(args[1]) : NULL;
+    ObjArray* y = (arg_count == 3) ? array_argument(args[2]) : NULL;
+    if (x == NULL || y == NULL || !(IS_F64(args[0]) || IS_I64(args[0])) ||
+        x->type != ARRAY_F64 || y->type != ARRAY_F64 || x->count != y->count)
+        return native_error(vm, "axpy() expects a number and two arrays of floats of the same length");
+    f64 alpha = IS_F64(args[0]) ? AS_F64(args[0]) : (f64) AS_I64(args[0]);
+    forget_task_globals(vm);
+    numeric_axpy_f64(alpha, x->as.f64s, y->as.f64s, x->count);
+    return args[2];
+}
+
+static Value min_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 1) ? array_argument(args[0]) : NULL;
+    if (array == NULL || array->count == 0)
+        return native_error(vm, "min() expects an array that isn't empty");
+    if (array->type == ARRAY_F64) return MAKE_F64(numeric_min_f64(array->as.f64s, array->count));
+    else                          return MAKE_I64(numeric_min_i64(array->as.i64s, array->count));
 }
 
-static ErrorCode define_native(const char* name, NativeFn function) {
+static Value max_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 1) ? array_argument(args[0]) : NULL;
+    if (array == NULL || array->count == 0)
+        return native_error(vm, "max() expects an array that isn't empty");
+    if (array->type == ARRAY_F64) return MAKE_F64(numeric_max_f64(array->as.f64s, array->count));
+    else                          return MAKE_I64(numeric_max_i64(array->as.i64s, array->count));
+}
+
+// map_add_scalar(array, scalar) returns a new array with the scalar added
+// to each element.
+static Value map_add_scalar_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 2) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "map_add_scalar() expects an array and a number");
+    ObjArray* result = array_make(array->type, array->count);
+    if (array->type == ARRAY_F64 && (IS_F64(args[1]) || IS_I64(args[1]))) {
+        f64 scalar = IS_F64(args[1]) ? AS_F64(args[1]) : (f64) AS_I64(args[1]);
+        numeric_add_scalar_f64(array->as.f64s, scalar, result->as.f64s, array->count);
+    } else if (array->type == ARRAY_I64 && IS_I64(args[1])) {
+        numeric_add_scalar_i64(array->as.i64s, AS_I64(args[1]), result->as.i64s, array->count);
+    } else {
+        object_free((Obj*) result);
+        return native_error(vm, "map_add_scalar() got a scalar of the wrong type for the array");
+    }
+    return MAKE_OBJ(own(vm, (Obj*) result));
+}
+
+// sort(array) sorts the array in place and returns it.
+static Value sort_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 1) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "sort() expects an array");
+    forget_task_globals(vm);
+    if (array->type == ARRAY_F64) numeric_sort_f64(array->as.f64s, array->count);
+    else                          numeric_sort_i64(array->as.i64s, array->count);
+    return args[0];
+}
+
+// prefix_sum(array) replaces each element by the sum of the elements up to
+// it, and returns the array.
+static Value prefix_sum_native(VM* vm, int arg_count, Value* args) {
+    ObjArray* array = (arg_count == 1) ? array_argument(args[0]) : NULL;
+    if (array == NULL)
+        return native_error(vm, "prefix_sum() expects an array");
+    forget_task_globals(vm);
+    if (array->type == ARRAY_F64) numeric_prefix_sum_f64(array->as.f64s, array->count);
+    else                          numeric_prefix_sum_i64(array->as.i64s, array->count);
+    return args[0];
+}
+
+static ErrorCode define_native(VM* vm, const char* name, NativeFn function, const TypedNative* typed) {
     ObjString* string = string_make(name, (int) strlen(name));
-    vm_push(MAKE_OBJ(string));
-    vm_push(MAKE_OBJ(native_make(function)));
-    if (!table_add(&vm.globals, STRING_TO_SLICE(AS_STRING(AS_OBJ(vm.stack[0]))), vm.stack[1])) {
+    vm_push(vm, MAKE_OBJ(own(vm, (Obj*) string)));
+    vm_push(vm, MAKE_OBJ(own(vm, (Obj*) native_make(function, typed))));
+    if (!table_add(&vm->globals, STRING_TO_SLICE(AS_STRING(AS_OBJ(vm->stack[0]))), vm->stack[1])) {
         return RUNTIME_ERROR_REDEFINITION_OF_NATIVE_FUNCTION;
     }
-    vm_pop();
-    vm_pop();
+    vm_pop(vm);
+    vm_pop(vm);
+    return NO_ERROR;
+}
+
+static ErrorCode define_natives(VM* vm) {
+    static const struct { const char* name; NativeFn function; } NATIVES[] = {
+        { "spawn", spawn_native },
+        { "join",  join_native  },
+        { "coroutine", coroutine_native },
+        { "done",  done_native  },
+        { "array", array_native },
+        { "range", range_native },
+        { "len",   len_native   },
+        { "get",   get_native   },
+        { "set",   set_native   },
+        { "sum",   sum_native   },
+        { "dot",   dot_native   },
+        { "axpy",  axpy_native  },
+        { "min",   min_native   },
+        { "max",   max_native   },
+        { "map_add_scalar", map_add_scalar_native },
+        { "sort",  sort_native  },
+        { "prefix_sum", prefix_sum_native },
+    };
+    for (size_t i = 0; i < sizeof(NATIVES) / sizeof(*NATIVES); ++i) {
+        ErrorCode result = define_native(vm, NATIVES[i].name, NATIVES[i].function, NULL);
+        if (result != NO_ERROR)
+            return result;
+    }
+    for (int i = 0; i < TYPED_NATIVE_COUNT; ++i) {
+        ErrorCode result = define_native(vm, TYPED_NATIVES[i].name, NULL, &TYPED_NATIVES[i]);
+        if (result != NO_ERROR)
+            return result;
+    }
     return NO_ERROR;
 }
 
@@ -36,123 +334,334 @@ static ErrorCode define_native(const char* name, NativeFn function) {
 
 static void type_error_unary(const char* message, Value a);
 static void type_error_binary(const char* message, Value a, Value b);
-static ErrorCode call(ObjFunction* function, int arg_count);
+static Chunk* count_call(VM* vm, ObjFunction* function);
+static ErrorCode reserve_stack(VM* vm, int count);
+static void count_back_edge(VM* vm, CallFrame* frame, int loop);
+static bool run_call(VM* vm, const char* path, const char* source, ObjFunction* function, int arg_count, const Value* args, Value* result, bool quiet);
+
+ErrorCode call_value(VM* vm, Value peek, int count);
 
-ErrorCode call_value(Value peek, int count);
 
-VM vm = { 0 };
+#define VM_ERROR_MAKE(code_, arg_) (Error) { .path=path, .source=source, .function=(frame->function->name) ? (Slice) { .count=frame->function->name->size, .source=frame->function->name->data } : SLICE("script"), .code=code_, .start=chunk_line(frame->chunk, (int) (frame->ip - frame->chunk->code - 2)), .count=1, .arg=arg_ }
+
+
+static void print_frame(Error error, ObjString* name, int arity, Location loc) {
+    if (name == NULL) {
+        fprintf(stderr, "    at %s:%d:%d - <script>\n", error.path, loc.row, loc.col);
+    } else {
+        fprintf(stderr, "    at %s:%d:%d - fun %.*s(", error.path, loc.row, loc.col, name->size, name->data);
+        for (int j = 0; j < arity; ++j)
+            if (j != arity-1) fprintf(stderr, "_, ");
+            else fprintf(stderr, "_");
+        fprintf(stderr, ")\n");
+    }
 
+    Slice line = current_line(error.source, loc.index);
+    fprintf(stderr, "       %-4d| %.*s\n", loc.row, line.count, line.source);
+}
 
-#define VM_ERROR_MAKE(code_, arg_) (Error) { .path=path, .source=source, .function=(frame->function->name) ? (Slice) { .count=frame->function->name->size, .source=frame->function->name->data } : SLICE("script"), .code=code_, .start=chunk_line(&frame->function->chunk, (int) (frame->ip - frame->function->chunk.code - 2)), .count=1, .arg=arg_ }
+/* Prints a frame for each call that was inlined into the frame, where it
+ * was called from. The innermost one is only printed if `is_top` is
+ * false, at the line the frame is at, and returned otherwise. */
+static const InlinedCall* print_frames(Error error, CallFrame* frame, bool is_top) {
+    const InlinedCall* calls[COMPILER_MAX_NESTING];
+    int offset = (int) (frame->ip - frame->chunk->code - 1);
+    int count  = chunk_inlined_at(frame->chunk, offset, calls, COMPILER_MAX_NESTING);
+    if (count > 0)
+        print_frame(error, frame->function->name, frame->function->arity, calls[0]->call);
+    for (int i = 0; i + 1 < count; ++i)
+        print_frame(error, AS_STRING(AS_OBJ(frame->chunk->constants[calls[i]->name])), calls[i]->arity, calls[i + 1]->call);
+    if (is_top)
+        return (count > 0) ? calls[count - 1] : NULL;
 
+    Location loc = chunk_line(frame->chunk, offset);
+    if (count > 0)
+        print_frame(error, AS_STRING(AS_OBJ(frame->chunk->constants[calls[count - 1]->name])), calls[count - 1]->arity, loc);
+    else
+        print_frame(error, frame->function->name, frame->function->arity, loc);
+    return NULL;
+}
 
-static void runtime_error(Error error) {
-    if (vm.frame_count > 1) {
+static void runtime_error(VM* vm, Error error) {
+    CallFrame* top = &vm->frames[vm->frame_count - 1];
+    const InlinedCall* calls[COMPILER_MAX_NESTING];
+    bool is_inlined = chunk_inlined_at(top->chunk, (int) (top->ip - top->chunk->code - 1), calls, COMPILER_MAX_NESTING) > 0;
+    if (vm->frame_count > 1 || is_inlined) {
         fprintf(stderr, "Stacktrace:\n");
     }
-    for (int i = 0; i < vm.frame_count-1; ++i) {
-        CallFrame* frame = &vm.frames[i];
-        ObjFunction* function = frame->function;
-        Location loc = chunk_line(&function->chunk, (int) (frame->ip - function->chunk.code - 1));
-        if (function->name == NULL) {
-            fprintf(stderr, "    at %s:%d:%d - <script>\n", error.path, loc.row, loc.col);
-        } else {
-            fprintf(stderr, "    at %s:%d:%d - fun %.*s(", error.path, loc.row, loc.col, function->name->size, function->name->data);
-            for (int j = 0; j < function->arity; ++j)
-                if (j != function->arity-1) fprintf(stderr, "_, ");
-                else fprintf(stderr, "_");
-            fprintf(stderr, ")\n");
-        }
+    for (int i = 0; i < vm->frame_count-1; ++i)
+        print_frames(error, &vm->frames[i], false);
 
-        Slice line = current_line(error.source, loc.index);
-        fprintf(stderr, "       %-4d| %.*s\n", loc.row, line.count, line.source);
+    // The error is reported in the function that was inlined.
+    const InlinedCall* inlined = print_frames(error, top, true);
+    if (inlined != NULL) {
+        ObjString* name = AS_STRING(AS_OBJ(top->chunk->constants[inlined->name]));
+        error.function  = (Slice) { .count=name->size, .source=name->data };
     }
-
     print_error(error);
 
 }
 
 
-ErrorCode vm_init() {
-    memset(vm.stack,  0, VM_STACK_MAX  * sizeof(Value));
-    memset(vm.frames, 0, VM_FRAMES_MAX * sizeof(CallFrame));
+/* The versions of the globals of all VMs come from one counter, so two
+ * VMs never have the same version. The inline caches are in the chunks,
+ * which VMs share, so a cache filled by one VM must never match the
+ * globals of another. 0 is skipped as it marks an empty cache. */
+static u32 last_globals_version = 0;
 
-    vm.stack_top = vm.stack;
-    vm.objects   = NULL;
-    vm.globals   = table_make();
-    vm.frame_count = 0;
+static u32 next_globals_version(void) {
+    u32 version = __atomic_add_fetch(&last_globals_version, 1, __ATOMIC_RELAXED);
+    if (version == 0)
+        version = __atomic_add_fetch(&last_globals_version, 1, __ATOMIC_RELAXED);
+    return version;
+}
 
-    return define_native("clock", clock_native);
+VM* vm_create(const VMConfig* config) {
+    VMConfig defaults = VM_CONFIG_DEFAULT;
+    if (config == NULL)
+        config = &defaults;
+    ASSERT(config->stack_size > 0 && config->frame_count > 0);
+
+    VM* vm = ALLOCATE(VM);
+    vm->frame_capacity = (config->frame_count < VM_FRAMES_INITIAL) ? config->frame_count : VM_FRAMES_INITIAL;
+    vm->frames         = ALLOCATE_ARRAY(CallFrame, vm->frame_capacity);
+    vm->frame_limit    = config->frame_count;
+    vm->frame_count    = 0;
+    vm->stack_capacity = (config->stack_size < VM_STACK_INITIAL) ? config->stack_size : VM_STACK_INITIAL;
+    vm->stack          = ALLOCATE_ARRAY(Value, vm->stack_capacity);
+    vm->stack_limit    = config->stack_size;
+    vm->stack_top      = vm->stack;
+    vm->open_upvalues  = NULL;
+    vm->objects        = NULL;
+    vm->globals        = table_make();
+    vm->globals_version = next_globals_version();
+    vm->use_tiers      = config->use_tiers;
+    vm->use_jit        = config->use_jit && config->use_tiers && JIT_SUPPORTED;
+    vm->scheduler      = NULL;
+    vm->worker         = 0;
+    vm->task_workers   = config->task_workers;
+    vm->task_globals   = NULL;
+    vm->path           = NULL;
+    vm->source         = NULL;
+    vm->coroutine      = NULL;
+    vm->root           = (ExecutionStack) { 0 };
+
+    memset(vm->stack,  0, vm->stack_capacity  * sizeof(Value));
+    memset(vm->frames, 0, vm->frame_capacity * sizeof(CallFrame));
+
+    if (define_natives(vm) != NO_ERROR) {
+        vm_destroy(vm);
+        return NULL;
+    }
+    return vm;
 }
 
-void vm_free() {
-    Obj* object = vm.objects;
+static void free_objects(VM* vm) {
+    Obj* object = vm->objects;
     while (object != NULL) {
         Obj* next = object->next;
         object_free(object);
         object = next;
     }
-    table_free(&vm.globals);
+    vm->objects = NULL;
+}
+
+/* Clears the stack, the globals and the objects of a previous run, so
+ * the same VM can run another script from scratch. Tasks of the previous
+ * run keep running on the scheduler. */
+ErrorCode vm_reset(VM* vm) {
+    forget_task_globals(vm);
+    free_objects(vm);
+    table_free(&vm->globals);
+    vm->globals     = table_make();
+    vm->globals_version = next_globals_version();
+    vm->stack_top   = vm->stack;
+    vm->open_upvalues = NULL;
+    vm->frame_count = 0;
+    memset(vm->stack, 0, vm->stack_capacity * sizeof(Value));
+    return define_natives(vm);
 }
 
-void vm_push(Value value) {
-    *vm.stack_top = value;
-    vm.stack_top++;
+void vm_destroy(VM* vm) {
+    if (vm->scheduler != NULL)
+        scheduler_destroy(vm->scheduler);
+    forget_task_globals(vm);
+    free_objects(vm);
+    table_free(&vm->globals);
+    FREE_ARRAY(Value,     vm->stack,  vm->stack_capacity);
+    FREE_ARRAY(CallFrame, vm->frames, vm->frame_capacity);
+    FREE(VM, vm);
 }
 
-Value vm_pop() {
-    vm.stack_top--;
-    Value value = *vm.stack_top;
-    *vm.stack_top = MAKE_INVALID();
+void vm_push(VM* vm, Value value) {
+    *vm->stack_top = value;
+    vm->stack_top++;
+}
+
+Value vm_pop(VM* vm) {
+    vm->stack_top--;
+    Value value = *vm->stack_top;
+    *vm->stack_top = MAKE_INVALID();
     return value;
 }
 
-Value vm_peek(int x) {
-    return *(vm.stack_top-1-x);
+Value vm_peek(VM* vm, int x) {
+    return *(vm->stack_top-1-x);
+}
+
+static inline bool is_callable(Value value) {
+    return IS_OBJ(value) && (AS_OBJ(value)->type == OBJ_FUNCTION || AS_OBJ(value)->type == OBJ_NATIVE || AS_OBJ(value)->type == OBJ_CLOSURE);
+}
+
+// @NOTE: The caches only hold callable objects, so other globals change
+//  without invalidating them.
+static void invalidate_caches(VM* vm, Value previous) {
+    if (is_callable(previous))
+        vm->globals_version = next_globals_version();
 }
 
-void vm_interpret(const char* path, const char* source, bool quiet) {
-    ObjFunction* function = compile(path, source);
+void vm_define_global(VM* vm, Slice name, Value value) {
+    forget_task_globals(vm);
+    if (vm->globals.count > 0) {
+        Entry* entry = table_find(&vm->globals, name);
+        if (!slice_is_empty(entry->key))
+            invalidate_caches(vm, entry->value);
+    }
+    table_add(&vm->globals, name, value);
+}
+
+bool vm_set_global(VM* vm, Slice name, Value value) {
+    if (vm->globals.count == 0)
+        return false;
+    Entry* entry = table_find(&vm->globals, name);
+    if (slice_is_empty(entry->key))
+        return false;
+    invalidate_caches(vm, entry->value);
+    forget_task_globals(vm);
+    entry->value = value;
+    return true;
+}
+
+/* Returns the inline cache of the instruction at `offset`, and allocates
+ * the side table of the chunk on the first use. An empty cache has the
+ * version 0, which the globals never have. */
+static InlineCache* cache_at(Chunk* chunk, int offset) {
+    if (chunk->caches == NULL) {
+        chunk->caches = ALLOCATE_ARRAY(InlineCache, chunk->count);
+        memset(chunk->caches, 0, sizeof(InlineCache) * chunk->count);
+    }
+    return &chunk->caches[offset];
+}
+
+bool vm_interpret(VM* vm, const char* path, const char* source, bool quiet) {
+    ObjFunction* function = compile(path, source, OPTIMIZE_TIER_0);
 
     if (function == NULL)
-        return;
+        return false;
+
+    return vm_interpret_function(vm, path, source, function, quiet);
+}
+
+/* Runs an already compiled script. `source` is only used for errors. */
+bool vm_interpret_function(VM* vm, const char* path, const char* source, ObjFunction* function, bool quiet) {
+    Value result;
+    return run_call(vm, path, source, function, 0, NULL, &result, quiet);
+}
 
-    vm_push(MAKE_OBJ(function));
-    call(function, 0);
+/* Calls a function with `args` and runs it to its return. */
+bool vm_call(VM* vm, const char* path, const char* source, ObjFunction* function, int arg_count, const Value* args, Value* result) {
+    return run_call(vm, path, source, function, arg_count, args, result, true);
+}
+
+static bool run_call(VM* vm, const char* path, const char* source, ObjFunction* function, int arg_count, const Value* args, Value* result, bool quiet) {
+    vm->path   = path;
+    vm->source = source;
+    int frame_count = vm->frame_count;
+    if (reserve_stack(vm, arg_count + 1) != NO_ERROR)
+        return false;
+    vm_push(vm, MAKE_OBJ(function));
+    for (int i = 0; i < arg_count; ++i)
+        vm_push(vm, args[i]);
+    if (call(vm, function, arg_count) != NO_ERROR)
+        return false;
 
-    Error result = vm_run(path, source, quiet);
-    if (result.code != NO_ERROR) {
-        runtime_error(result);
+    Error error = vm_run(vm, path, source, quiet);
+    if (error.code != NO_ERROR) {
+        runtime_error(vm, error);
+        // @NOTE: The coroutines that were running can't be resumed after
+        //  an error.
+        while (vm->coroutine != NULL) {
+            ObjCoroutine* coroutine = vm->coroutine;
+            close_upvalues(vm, vm->stack);
+            coroutine->state = COROUTINE_DONE;
+            switch_stacks(vm, coroutine->caller);
+            coroutine->caller = NULL;
+        }
+        close_upvalues(vm, vm->stack);
+        // Unwinds the frames of the failed call, so the VM can run again.
+        vm->stack_top   = vm->frame_count > frame_count ? vm->frames[frame_count].slots : vm->stack_top;
+        vm->frame_count = frame_count;
+        return false;
     }
+    *result = vm_pop(vm);
+    return true;
 }
 
-Error vm_run(const char* path, const char* source, bool quiet) {
-    CallFrame* frame = &vm.frames[vm.frame_count - 1];
+Error vm_run(VM* vm, const char* path, const char* source, bool quiet) {
+    CallFrame* frame = &vm->frames[vm->frame_count - 1];
 
 #define READ_BYTE()     (*frame->ip++)
 #define READ_SHORT()    (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
-#define READ_CONSTANT() (frame->function->chunk.constants[READ_BYTE()])
+#define READ_CONSTANT() (frame->chunk->constants[READ_BYTE()])
 #define READ_STRING()   AS_STRING(AS_OBJ(READ_CONSTANT()))
-#define IS_SAME(type)   (IS_## type(vm_peek(0)) && IS_ ## type(vm_peek(1)))
+#define IS_SAME(type)   (IS_## type(vm_peek(vm, 0)) && IS_ ## type(vm_peek(vm, 1)))
 #define BINARY_OP(op, type) \
     do { \
-      Value b = vm_pop(); \
-      Value a = vm_pop(); \
-      vm_push(MAKE_##type(AS_##type(a) op AS_##type(b))); \
+      Value b = vm_pop(vm); \
+      Value a = vm_pop(vm); \
+      vm_push(vm, MAKE_##type(AS_##type(a) op AS_##type(b))); \
     } while (false)
 
 #define BINARY_RELATION(op, type) \
     do { \
-      Value b = vm_pop(); \
-      Value a = vm_pop(); \
-      vm_push(MAKE_BOOL(AS_ ## type(a) op AS_ ## type(b))); \
+      Value b = vm_pop(vm); \
+      Value a = vm_pop(vm); \
+      vm_push(vm, MAKE_BOOL(AS_ ## type(a) op AS_ ## type(b))); \
+    } while (false)
+
+// Continues in the native code of the function if it has been compiled,
+// until it gets to an instruction that it leaves to the interpreter.
+#define JIT_ENTER() \
+    do { \
+      if (vm->use_jit && frame->function->jit != NULL && frame->chunk == frame->function->optimized) \
+        frame->ip = jit_run(vm, frame->function->jit, frame); \
+    } while (false)
+
+// The superinstructions replace the left operand on the stack, and the
+// right one is a constant or a local.
+#define BINARY_OP_WITH(op, name, operand) \
+    do { \
+      Value  b = operand; \
+      Value* a = vm->stack_top - 1; \
+      if      (IS_I64(*a) && IS_I64(b)) *a = MAKE_I64(AS_I64(*a) op AS_I64(b)); \
+      else if (IS_F64(*a) && IS_F64(b)) *a = MAKE_F64(AS_F64(*a) op AS_F64(b)); \
+      else type_error_binary(name, b, *a); \
+    } while (false)
+
+#define BINARY_RELATION_WITH(op, name, operand) \
+    do { \
+      Value  b = operand; \
+      Value* a = vm->stack_top - 1; \
+      if      (IS_I64(*a) && IS_I64(b)) *a = MAKE_BOOL(AS_I64(*a) op AS_I64(b)); \
+      else if (IS_F64(*a) && IS_F64(b)) *a = MAKE_BOOL(AS_F64(*a) op AS_F64(b)); \
+      else type_error_binary(name, b, *a); \
     } while (false)
 
 #define BINARY_EQUALS() \
     do { \
-      Value b = vm_pop(); \
-      Value a = vm_pop(); \
-      vm_push(MAKE_BOOL(value_equals(a, b))); \
+      Value b = vm_pop(vm); \
+      Value a = vm_pop(vm); \
+      vm_push(vm, MAKE_BOOL(value_equals(a, b))); \
     } while (false)
 
 
@@ -160,45 +669,34 @@ Error vm_run(const char* path, const char* source, bool quiet) {
 #ifdef VM_DEBUG_TRACE_EXECUTION
         if (!quiet) {
             printf(">>         ");
-            if (vm.stack >= vm.stack_top)
+            if (vm->stack >= vm->stack_top)
                 printf("[ ]");
             else
-                for (Value* slot = vm.stack; slot < vm.stack_top; slot++) {
+                for (Value* slot = vm->stack; slot < vm->stack_top; slot++) {
                     printf("[ ");
                     print_value(*slot);
                     printf(" ]");
                 }
             printf("\n>> ");
-            chunk_instruction_disassemble(&frame->function->chunk, (int)(frame->ip - frame->function->chunk.code));
+            chunk_instruction_disassemble(frame->chunk, (int)(frame->ip - frame->chunk->code));
         }
 #endif
 
         u8 instruction;
         switch (instruction = READ_BYTE()) {
-            case OP_POP:      vm_pop();                   break;
-            case OP_CONSTANT: vm_push(READ_CONSTANT());   break;
-            case OP_TRUE:     vm_push(MAKE_BOOL(true));   break;
-            case OP_FALSE:    vm_push(MAKE_BOOL(false));  break;
+            case OP_POP:      vm_pop(vm);                   break;
+            case OP_CONSTANT: vm_push(vm, READ_CONSTANT());   break;
+            case OP_TRUE:     vm_push(vm, MAKE_BOOL(true));   break;
+            case OP_FALSE:    vm_push(vm, MAKE_BOOL(false));  break;
             case OP_NEGATE:   {
-                if      (IS_F64(vm_peek(0))) { vm_push(MAKE_F64(-AS_F64(vm_pop()))); }
-                else if (IS_I64(vm_peek(0))) { vm_push(MAKE_I64(-AS_I64(vm_pop()))); }
-                else type_error_unary("NEGATE", vm_peek(0));
+                if      (IS_F64(vm_peek(vm, 0))) { vm_push(vm, MAKE_F64(-AS_F64(vm_pop(vm)))); }
+                else if (IS_I64(vm_peek(vm, 0))) { vm_push(vm, MAKE_I64(-AS_I64(vm_pop(vm)))); }
+                else type_error_unary("NEGATE", vm_peek(vm, 0));
                 break;
             }
             case OP_NOT: {
-                if (IS_BOOL(vm_peek(0))) vm_push(MAKE_BOOL(!AS_BOOL(vm_pop())));
-                else type_error_unary("NOT", vm_peek(0));
-                break;
-            }
-            // @TODO: AND and OR should short-circuit.
-            case OP_AND: {
-                if   (IS_SAME(BOOL)) { BINARY_OP(&&, BOOL); }
-                else type_error_binary("AND", vm_peek(0), vm_peek(1));
-                break;
-            }
-            case OP_OR: {
-                if   (IS_SAME(BOOL)) { BINARY_OP(||, BOOL); }
-                else type_error_binary("OR", vm_peek(0), vm_peek(1));
+                if (IS_BOOL(vm_peek(vm, 0))) vm_push(vm, MAKE_BOOL(!AS_BOOL(vm_pop(vm))));
+                else type_error_unary("NOT", vm_peek(vm, 0));
                 break;
             }
             case OP_EQUAL: {
@@ -209,83 +707,103 @@ Error vm_run(const char* path, const char* source, bool quiet) {
             case OP_GREATER: {
                 if       (IS_SAME(F64)) { BINARY_RELATION(>, F64); }
                 else if  (IS_SAME(I64)) { BINARY_RELATION(>, I64); }
-                else type_error_binary("GREATER", vm_peek(0), vm_peek(1));
+                else type_error_binary("GREATER", vm_peek(vm, 0), vm_peek(vm, 1));
                 break;
             }
             case OP_LESS: {
                 if       (IS_SAME(F64)) { BINARY_RELATION(<, F64); }
                 else if  (IS_SAME(I64)) { BINARY_RELATION(<, I64); }
-                else type_error_binary("LESS", vm_peek(0), vm_peek(1));
+                else type_error_binary("LESS", vm_peek(vm, 0), vm_peek(vm, 1));
                 break;
             }
             case OP_ADD: {
                 if      (IS_SAME(F64)) { BINARY_OP(+, F64); }
                 else if (IS_SAME(I64)) { BINARY_OP(+, I64); }
-                else type_error_binary("ADD", vm_peek(0), vm_peek(1));
+                else type_error_binary("ADD", vm_peek(vm, 0), vm_peek(vm, 1));
                 break;
             }
             case OP_SUBTRACT: {
                 if      (IS_SAME(F64)) { BINARY_OP(-, F64) ; }
                 else if (IS_SAME(I64)) { BINARY_OP(-, I64) ; }
-                else type_error_binary("SUBTRACT", vm_peek(0), vm_peek(1));
+                else type_error_binary("SUBTRACT", vm_peek(vm, 0), vm_peek(vm, 1));
                 break;
             }
             case OP_MULTIPLY: {
                 if      (IS_SAME(F64)) { BINARY_OP(*, F64) ; }
                 else if (IS_SAME(I64)) { BINARY_OP(*, I64) ; }
-                else type_error_binary("MULTIPLY", vm_peek(0), vm_peek(1));
+                else type_error_binary("MULTIPLY", vm_peek(vm, 0), vm_peek(vm, 1));
                 break;
             }
             case OP_DIVIDE: {
                 if      (IS_SAME(F64)) { BINARY_OP(/, F64) ; }
                 else if (IS_SAME(I64)) { BINARY_OP(/, I64) ; }
-                else type_error_binary("DIVIDE", vm_peek(0), vm_peek(1));
+                else type_error_binary("DIVIDE", vm_peek(vm, 0), vm_peek(vm, 1));
                 break;
             }
             case OP_EXIT:
                 return VM_ERROR_MAKE(NO_ERROR, SLICE(""));
             case OP_PRINT: {
-                print_value(vm_pop());
+                // Keeps the lines of VMs on other threads apart.
+                flockfile(stdout);
+                print_value(vm_pop(vm));
                 printf("\n");
+                funlockfile(stdout);
                 break;
             }
             case OP_DEFINE_GLOBAL: {
                 ObjString* name = READ_STRING();
-                table_add(&vm.globals, (Slice) { name->data, name->size }, vm_peek(0));
-                vm_pop();
+                vm_define_global(vm, (Slice) { name->data, name->size }, vm_peek(vm, 0));
+                vm_pop(vm);
                 break;
             }
             case OP_GET_GLOBAL: {
+                // @NOTE: Without the tiers, the chunk may be run by VMs on
+                //  other threads, so the caches are only used with them.
+                InlineCache* cache = NULL;
+                if (vm->use_tiers) {
+                    cache = cache_at(frame->chunk, (int) (frame->ip - frame->chunk->code) - 1);
+                    if (cache->version == vm->globals_version) {
+                        frame->ip++;
+                        vm_push(vm, cache->value);
+                        break;
+                    }
+                }
                 ObjString* name = READ_STRING();
                 Value value;
-                if (!table_get(&vm.globals, (Slice) { name->data, name->size }, &value)) {
+                if (!table_get(&vm->globals, (Slice) { name->data, name->size }, &value)) {
                     return VM_ERROR_MAKE(RUNTIME_ERROR_UNDEFINED_VARIABLE, string_to_slice(name));
                 }
-                vm_push(value);
+                if (cache != NULL && is_callable(value))
+                    *cache = (InlineCache) { .value=value, .version=vm->globals_version, .kind=AS_OBJ(value)->type };
+                vm_push(vm, value);
                 break;
             }
             case OP_SET_GLOBAL: {
                 ObjString* name = READ_STRING();
-                Slice key = (Slice) { name->data, name->size };
-                if (!table_set(&vm.globals, key, vm_peek(0))) {
-                    table_delete(&vm.globals, key);
+                if (!vm_set_global(vm, (Slice) { name->data, name->size }, vm_peek(vm, 0))) {
                     return VM_ERROR_MAKE(RUNTIME_ERROR_UNDEFINED_VARIABLE, string_to_slice(name));
                 }
                 break;
             }
             case OP_GET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                vm_push(frame->slots[slot]);
+                vm_push(vm, frame->slots[slot]);
                 break;
             }
             case OP_SET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                frame->slots[slot] = vm_peek(0);
+                frame->slots[slot] = vm_peek(vm, 0);
                 break;
             }
             case OP_JUMP_IF_FALSE: {
                 uint16_t offset = READ_SHORT();
-                if (value_is_falsy(vm_peek(0)))
+                if (value_is_falsy(vm_peek(vm, 0)))
+                    frame->ip += offset;
+                break;
+            }
+            case OP_JUMP_IF_TRUE: {
+                uint16_t offset = READ_SHORT();
+                if (!value_is_falsy(vm_peek(vm, 0)))
                     frame->ip += offset;
                 break;
             }
@@ -296,19 +814,67 @@ Error vm_run(const char* path, const char* source, bool quiet) {
             }
             case OP_LOOP: {
                 uint16_t offset = READ_SHORT();
+                int      loop   = (int) (frame->ip - frame->chunk->code) - 3;
                 frame->ip -= offset;
+                if (vm->use_tiers && frame->chunk == &frame->function->chunk)
+                    count_back_edge(vm, frame, loop);
+                JIT_ENTER();
                 break;
             }
+            case OP_TAIL_CALL: {
+                // Reuses the current frame, by moving the callee and its
+                // arguments down to the slots of the caller.
+                int   arg_count = frame->ip[0];
+                Value callee    = vm_peek(vm, arg_count);
+                // @NOTE: A function with upvalues that isn't a closure reads
+                //  them from the frame that is replaced.
+                if (IS_FUNCTION(callee) && AS_FUNCTION(AS_OBJ(callee))->arity == arg_count && AS_FUNCTION(AS_OBJ(callee))->upvalue_count == 0) {
+                    ObjFunction* function = AS_FUNCTION(AS_OBJ(callee));
+                    close_upvalues(vm, frame->slots);
+                    memmove(frame->slots, vm->stack_top - arg_count - 1, sizeof(Value) * (arg_count + 1));
+                    vm->stack_top    = frame->slots + arg_count + 1;
+                    if (reserve_stack(vm, function->max_stack - arg_count - 1) != NO_ERROR)
+                        return VM_ERROR_MAKE(RUNTIME_ERROR_STACK_OVERFLOW, SLICE(""));
+                    frame->function = function;
+                    frame->chunk    = count_call(vm, function);
+                    frame->ip       = frame->chunk->code;
+                    frame->closure  = NULL;
+                    JIT_ENTER();
+                    break;
+                }
+                // Natives and invalid calls are handled as an ordinary call,
+                // and the OP_RETURN after it returns the result.
+            }
+            // Fall through.
             case OP_CALL: {
-                int arg_count = READ_BYTE();
-                ErrorCode result = call_value(vm_peek(arg_count), arg_count);
+                int   offset    = (int) (frame->ip - frame->chunk->code) - 1;
+                int   arg_count = READ_BYTE();
+                Value callee    = vm_peek(vm, arg_count);
+                ErrorCode result;
+                if (vm->use_tiers && IS_OBJ(callee)) {
+                    // The kind of the callee is looked up once per call site
+                    // while it calls the same object.
+                    InlineCache* cache = cache_at(frame->chunk, offset);
+                    if (cache->version != vm->globals_version || AS_OBJ(cache->value) != AS_OBJ(callee))
+                        *cache = (InlineCache) { .value=callee, .version=vm->globals_version, .kind=AS_OBJ(callee)->type };
+                    switch (cache->kind) {
+                        case OBJ_FUNCTION: result = call(vm, AS_FUNCTION(AS_OBJ(callee)), arg_count);      break;
+                        case OBJ_NATIVE:   result = call_native(vm, AS_NATIVE(AS_OBJ(callee)), arg_count); break;
+                        case OBJ_CLOSURE:  result = call_closure(vm, AS_CLOSURE(AS_OBJ(callee)), arg_count); break;
+                        default:           result = RUNTIME_ERROR_INVALID_CALL;                             break;
+                    }
+                } else {
+                    result = call_value(vm, callee, arg_count);
+                }
+                frame = &vm->frames[vm->frame_count - 1];
                 if (result != NO_ERROR) {
-                    static char buffer[256] = { 0 };
+                    char* buffer = vm->error_buffer;
                     switch (result) {
                         case RUNTIME_ERROR_TOO_FEW_ARGUMENTS:
                         case RUNTIME_ERROR_TOO_MANY_ARGUMENTS: {
                             // @NOTE: Safe as these errors can only happen for valid functions.
-                            ObjFunction* function = AS_FUNCTION(AS_OBJ(vm_peek(arg_count)));
+                            Value callee = vm_peek(vm, arg_count);
+                            ObjFunction* function = IS_CLOSURE(callee) ? AS_CLOSURE(AS_OBJ(callee))->function : AS_FUNCTION(AS_OBJ(callee));
                             Slice fn = string_to_slice(function->name);
                             int c = snprintf(buffer, 256, "Function %.*s(", fn.count, fn.source);
                             ASSERT(0 < c && c <= 256);
@@ -327,7 +893,7 @@ Error vm_run(const char* path, const char* source, bool quiet) {
                         }
                         case RUNTIME_ERROR_INVALID_CALL: {
                             // @NOTE: Safe as these errors can only happen for valid functions.
-                            Value value = vm_peek(arg_count);
+                            Value value = vm_peek(vm, arg_count);
                             const char* type = type_string(value);
                             int c = snprintf(buffer, 256, "Value is not a callable object, it's a '%s'", type);
                             ASSERT(0 < c && c <= 256);
@@ -337,34 +903,150 @@ Error vm_run(const char* path, const char* source, bool quiet) {
                         case RUNTIME_ERROR_STACK_OVERFLOW: {
                             return VM_ERROR_MAKE(result, SLICE(""));
                         }
+                        case RUNTIME_ERROR_NATIVE_FAILED: {
+                            Slice repr = (Slice) { .source=buffer, .count=(int) strlen(buffer) };
+                            return VM_ERROR_MAKE(result, repr);
+                        }
                         default:
                             PANIC("Unhandled error %d", result);
                     }
 
                 }
-                frame = &vm.frames[vm.frame_count - 1];
+                JIT_ENTER();
                 break;
             }
             case OP_RETURN: {
-                Value result = vm_pop();
-                vm.frame_count--;
-                if (vm.frame_count == 0) {
-                    vm_pop();
-                    return VM_ERROR_MAKE(NO_ERROR, SLICE(""));
+                Value result = vm_pop(vm);
+                close_upvalues(vm, frame->slots);
+                vm->frame_count--;
+                vm->stack_top = frame->slots;
+                vm_push(vm, result);
+                if (vm->frame_count == 0) {
+                    // @NOTE: The result of the outermost call is left on
+                    //  the stack for `vm_call`.
+                    ObjCoroutine* coroutine = vm->coroutine;
+                    if (coroutine == NULL)
+                        return VM_ERROR_MAKE(NO_ERROR, SLICE(""));
+
+                    // A coroutine that returns is done, and its result
+                    // is the result of the resume.
+                    coroutine->state = COROUTINE_DONE;
+                    switch_stacks(vm, coroutine->caller);
+                    coroutine->caller = NULL;
+                    coroutine_free_stacks(coroutine);
+                    vm_push(vm, result);
                 }
 
-                vm.stack_top = frame->slots;
-                vm_push(result);
-                frame = &vm.frames[vm.frame_count - 1];
+                frame = &vm->frames[vm->frame_count - 1];
+                JIT_ENTER();
                 break;
 
             }
             case OP_NULL: {
-                vm_push(MAKE_NULL());
+                vm_push(vm, MAKE_NULL());
+                break;
+            }
+            case OP_YIELD: {
+                ObjCoroutine* coroutine = vm->coroutine;
+                if (coroutine == NULL)
+                    return VM_ERROR_MAKE(RUNTIME_ERROR_YIELD_OUTSIDE_COROUTINE, SLICE(""));
+
+                Value value = vm_pop(vm);
+                coroutine->state = COROUTINE_SUSPENDED;
+                switch_stacks(vm, coroutine->caller);
+                coroutine->caller = NULL;
+                vm_push(vm, value);
+                frame = &vm->frames[vm->frame_count - 1];
+                break;
+            }
+            case OP_RESUME: {
+                Value target = vm_peek(vm, 1);
+                if (!IS_COROUTINE(target) || (AS_COROUTINE(AS_OBJ(target))->state != COROUTINE_CREATED && AS_COROUTINE(AS_OBJ(target))->state != COROUTINE_SUSPENDED)) {
+                    char* buffer = vm->error_buffer;
+                    int c = IS_COROUTINE(target) ?
+                        snprintf(buffer, 256, "The coroutine is %s", AS_COROUTINE(AS_OBJ(target))->state == COROUTINE_DONE ? "done" : "already running") :
+                        snprintf(buffer, 256, "Value is not a coroutine, it's a '%s'", type_string(target));
+                    ASSERT(0 < c && c <= 256);
+                    return VM_ERROR_MAKE(RUNTIME_ERROR_INVALID_RESUME, ((Slice) { .source=buffer, .count=c }));
+                }
+
+                Value value = vm_pop(vm);
+                vm_pop(vm);
+                ObjCoroutine* coroutine = AS_COROUTINE(AS_OBJ(target));
+                // @NOTE: The value of the first resume has nowhere to go.
+                bool started = coroutine->state == COROUTINE_SUSPENDED;
+                coroutine->state  = COROUTINE_RUNNING;
+                coroutine->caller = vm->coroutine;
+                switch_stacks(vm, coroutine);
+                if (started)
+                    vm_push(vm, value);
+                frame = &vm->frames[vm->frame_count - 1];
+                break;
+            }
+            case OP_CLOSURE: {
+                ObjFunction* function = AS_FUNCTION(AS_OBJ(READ_CONSTANT()));
+                ObjClosure*  closure  = (ObjClosure*) own(vm, (Obj*) closure_make(function));
+                for (int i = 0; i < function->upvalue_count; ++i) {
+                    Capture capture = function->captures[i];
+                    closure->upvalues[i] = capture.is_local ? capture_upvalue(vm, frame->slots + capture.index) : frame->closure->upvalues[capture.index];
+                }
+                vm_push(vm, MAKE_OBJ(closure));
+                break;
+            }
+            case OP_GET_UPVALUE: {
+                uint8_t index = READ_BYTE();
+                vm_push(vm, *frame->closure->upvalues[index]->location);
+                break;
+            }
+            case OP_SET_UPVALUE: {
+                uint8_t index = READ_BYTE();
+                *frame->closure->upvalues[index]->location = vm_peek(vm, 0);
+                break;
+            }
+            case OP_CLOSE_UPVALUE: {
+                close_upvalues(vm, vm->stack_top - 1);
+                vm_pop(vm);
+                break;
+            }
+            // The function was called by the one it's declared in, whose
+            // frame is right below.
+            case OP_GET_ENCLOSING: {
+                uint8_t slot = READ_BYTE();
+                vm_push(vm, frame[-1].slots[slot]);
+                break;
+            }
+            case OP_SET_ENCLOSING: {
+                uint8_t slot = READ_BYTE();
+                frame[-1].slots[slot] = vm_peek(vm, 0);
                 break;
             }
+            case OP_CALL_NATIVE_TYPED: {
+                const TypedNative* native = &TYPED_NATIVES[READ_BYTE()];
+                int   arity = typed_native_arity(native);
+                Value result;
+                if (!typed_native_call(native, vm->stack_top - arity, &result)) {
+                    char* buffer = vm->error_buffer;
+                    int c = snprintf(buffer, 256, "%s() expects numbers", native->name);
+                    ASSERT(0 < c && c <= 256);
+                    return VM_ERROR_MAKE(RUNTIME_ERROR_NATIVE_FAILED, ((Slice) { .source=buffer, .count=c }));
+                }
+                vm->stack_top -= arity;
+                vm_push(vm, result);
+                break;
+            }
+            case OP_STORE_LOCAL: {
+                uint8_t slot = READ_BYTE();
+                frame->slots[slot] = vm_pop(vm);
+                break;
+            }
+            case OP_ADD_CONSTANT:      BINARY_OP_WITH(+, "ADD",      READ_CONSTANT());        break;
+            case OP_SUBTRACT_CONSTANT: BINARY_OP_WITH(-, "SUBTRACT", READ_CONSTANT());        break;
+            case OP_LESS_CONSTANT:     BINARY_RELATION_WITH(<, "LESS",    READ_CONSTANT());   break;
+            case OP_GREATER_CONSTANT:  BINARY_RELATION_WITH(>, "GREATER", READ_CONSTANT());   break;
+            case OP_ADD_LOCAL:         BINARY_OP_WITH(+, "ADD",      frame->slots[READ_BYTE()]);  break;
+            case OP_LESS_LOCAL:        BINARY_RELATION_WITH(<, "LESS", frame->slots[READ_BYTE()]); break;
             default: {
-                static char buffer[4] = { 0 };
+                char* buffer = vm->error_buffer;
                 int c = snprintf(buffer, 4, "%d", instruction);
                 ASSERT(0 < c && c <= 4);
                 Slice repr = (Slice) { .source=buffer, .count=c };
@@ -378,33 +1060,205 @@ Error vm_run(const char* path, const char* source, bool quiet) {
 #undef READ_SHORT
 #undef READ_STRING
 #undef BINARY_OP
+#undef BINARY_OP_WITH
+#undef BINARY_RELATION_WITH
 #undef IS_SAME
+#undef JIT_ENTER
 }
 
 
-static ErrorCode call(ObjFunction* function, int arg_count) {
+static ErrorCode call(VM* vm, ObjFunction* function, int arg_count) {
     if (arg_count != function->arity)
         return (arg_count > function->arity) ? RUNTIME_ERROR_TOO_MANY_ARGUMENTS: RUNTIME_ERROR_TOO_FEW_ARGUMENTS;
 
-    if (vm.frame_count == VM_FRAMES_MAX)
-        return RUNTIME_ERROR_STACK_OVERFLOW;
+    // @NOTE: The frames are moved, so the callers load theirs again.
+    if (vm->frame_count == vm->frame_capacity) {
+        if (vm->frame_capacity == vm->frame_limit)
+            return RUNTIME_ERROR_STACK_OVERFLOW;
+        int capacity = GROW_CAPACITY(vm->frame_capacity);
+        if (capacity > vm->frame_limit)
+            capacity = vm->frame_limit;
+        vm->frames         = RESIZE_ARRAY(CallFrame, vm->frames, vm->frame_capacity, capacity);
+        vm->frame_capacity = capacity;
+    }
+    // @NOTE: The only check of the size of the stack for the frame, as
+    //  the compiler knows how high the function can fill it.
+    ErrorCode result = reserve_stack(vm, function->max_stack - arg_count - 1);
+    if (result != NO_ERROR)
+        return result;
 
-    CallFrame* frame = &vm.frames[vm.frame_count++];
+    CallFrame* frame = &vm->frames[vm->frame_count++];
     frame->function = function;
-    frame->ip = function->chunk.code;
-    frame->slots = vm.stack_top - arg_count - 1;
+    frame->chunk = count_call(vm, function);
+    frame->ip = frame->chunk->code;
+    frame->slots = vm->stack_top - arg_count - 1;
+    frame->closure = NULL;
     return NO_ERROR;
 }
 
-ErrorCode call_value(Value callee, int arg_count) {
+static ErrorCode call_closure(VM* vm, ObjClosure* closure, int arg_count) {
+    ErrorCode result = call(vm, closure->function, arg_count);
+    if (result == NO_ERROR)
+        vm->frames[vm->frame_count - 1].closure = closure;
+    return result;
+}
+
+/* Returns the upvalue for a stack slot, shared by all closures that
+ * capture the slot while it's in scope. */
+static ObjUpvalue* capture_upvalue(VM* vm, Value* slot) {
+    ObjUpvalue*  upvalue = vm->open_upvalues;
+    ObjUpvalue** link    = &vm->open_upvalues;
+    while (upvalue != NULL && upvalue->location > slot) {
+        link    = &upvalue->next_open;
+        upvalue = upvalue->next_open;
+    }
+    if (upvalue != NULL && upvalue->location == slot)
+        return upvalue;
+
+    ObjUpvalue* created = (ObjUpvalue*) own(vm, (Obj*) upvalue_make(slot));
+    created->next_open = upvalue;
+    *link = created;
+    return created;
+}
+
+// Moves the values of the slots from `last` and up into their upvalues.
+static void close_upvalues(VM* vm, Value* last) {
+    while (vm->open_upvalues != NULL && vm->open_upvalues->location >= last) {
+        ObjUpvalue* upvalue = vm->open_upvalues;
+        upvalue->closed   = *upvalue->location;
+        upvalue->location = &upvalue->closed;
+        vm->open_upvalues = upvalue->next_open;
+    }
+}
+
+/* Makes the VM run on the stacks of `coroutine`, or on its own stacks
+ * if NULL, and keeps the ones it ran on in their owner. */
+static void switch_stacks(VM* vm, ObjCoroutine* coroutine) {
+    ExecutionStack* current = (vm->coroutine != NULL) ? &vm->coroutine->stacks : &vm->root;
+    *current = (ExecutionStack) {
+        .frames=vm->frames, .frame_count=vm->frame_count, .frame_capacity=vm->frame_capacity,
+        .stack=vm->stack, .stack_top=vm->stack_top, .stack_capacity=vm->stack_capacity,
+        .open_upvalues=vm->open_upvalues,
+    };
+
+    ExecutionStack* next = (coroutine != NULL) ? &coroutine->stacks : &vm->root;
+    vm->frames         = next->frames;
+    vm->frame_count    = next->frame_count;
+    vm->frame_capacity = next->frame_capacity;
+    vm->stack          = next->stack;
+    vm->stack_top      = next->stack_top;
+    vm->stack_capacity = next->stack_capacity;
+    vm->open_upvalues  = next->open_upvalues;
+    vm->coroutine      = coroutine;
+}
+
+/* Makes room for `count` values above the top of the stack that runs,
+ * which is the one of the VM or of the running coroutine. The frames
+ * and the open upvalues point into the stack, so when it's moved to a
+ * larger one they're fixed up. */
+static ErrorCode reserve_stack(VM* vm, int count) {
+    int used = (int) (vm->stack_top - vm->stack);
+    if (used + count <= vm->stack_capacity)
+        return NO_ERROR;
+    if (used + count > vm->stack_limit)
+        return RUNTIME_ERROR_STACK_OVERFLOW;
+
+    int capacity = vm->stack_capacity;
+    while (capacity < used + count)
+        capacity *= 2;
+    if (capacity > vm->stack_limit)
+        capacity = vm->stack_limit;
+
+    Value* stack = ALLOCATE_ARRAY(Value, capacity);
+    memcpy(stack, vm->stack, sizeof(Value) * used);
+    for (int i = 0; i < vm->frame_count; ++i)
+        vm->frames[i].slots = stack + (vm->frames[i].slots - vm->stack);
+    for (ObjUpvalue* upvalue = vm->open_upvalues; upvalue != NULL; upvalue = upvalue->next_open)
+        upvalue->location = stack + (upvalue->location - vm->stack);
+    FREE_ARRAY(Value, vm->stack, vm->stack_capacity);
+    vm->stack          = stack;
+    vm->stack_top      = stack + used;
+    vm->stack_capacity = capacity;
+    return NO_ERROR;
+}
+
+/* Promotes a function to tier 1, where new calls run a copy of its chunk
+ * with the passes that are too expensive for cold code. Frames that are
+ * already running it move over on their next back-edge. */
+static void promote(VM* vm, ObjFunction* function) {
+    // @NOTE: The JIT doesn't translate the superinstructions.
+    OptimizeFlags flags = vm->use_jit ? (OptimizeFlags) (OPTIMIZE_TIER_1 & ~OPTIMIZE_SUPERINSTRUCTIONS) : OPTIMIZE_TIER_1;
+    function->optimized_offsets = ALLOCATE_ARRAY(int, function->chunk.count + 1);
+    function->optimized = optimize_chunk_copy(&function->chunk, flags, function->optimized_offsets);
+    if (vm->use_jit)
+        function->jit = jit_compile(function->optimized);
+
+    // @NOTE: The passes only remove and fuse instructions, so the frames
+    //  that move to tier 1 on a back-edge have room on the stack.
+    ASSERT(chunk_max_stack(function->optimized, function->arity + 1) <= function->max_stack);
+}
+
+// Returns the chunk that a new frame of the function should run.
+static Chunk* count_call(VM* vm, ObjFunction* function) {
+    if (!vm->use_tiers)
+        return &function->chunk;
+    if (function->optimized == NULL && ++function->call_count >= VM_TIER_UP_CALLS)
+        promote(vm, function);
+    return (function->optimized != NULL) ? function->optimized : &function->chunk;
+}
+
+/* Counts the back-edge of the OP_LOOP at `loop` in a frame in tier 0,
+ * whose ip is at the header of the loop. Once the function is in tier 1,
+ * the frame continues at the same header in its chunk, where the stack
+ * is the same as the passes don't move values across jump targets. */
+static void count_back_edge(VM* vm, CallFrame* frame, int loop) {
+    ObjFunction* function = frame->function;
+    if (function->optimized == NULL) {
+        if (function->back_edge_counts == NULL) {
+            function->back_edge_counts = ALLOCATE_ARRAY(int, function->chunk.count);
+            memset(function->back_edge_counts, 0, sizeof(int) * function->chunk.count);
+        }
+        if (++function->back_edge_counts[loop] < VM_TIER_UP_BACK_EDGES)
+            return;
+        promote(vm, function);
+    }
+
+    int header = (int) (frame->ip - function->chunk.code);
+    frame->chunk = function->optimized;
+    frame->ip    = function->optimized->code + function->optimized_offsets[header];
+}
+
+static Value call_typed_native(VM* vm, const TypedNative* native, int arg_count, Value* args) {
+    Value result;
+    if (arg_count != typed_native_arity(native)) {
+        snprintf(vm->error_buffer, sizeof(vm->error_buffer), "%s() takes %d arguments", native->name, typed_native_arity(native));
+        return MAKE_INVALID();
+    }
+    if (!typed_native_call(native, args, &result)) {
+        snprintf(vm->error_buffer, sizeof(vm->error_buffer), "%s() expects numbers", native->name);
+        return MAKE_INVALID();
+    }
+    return result;
+}
+
+static ErrorCode call_native(VM* vm, ObjNative* native, int arg_count) {
+    // @NOTE: Typed natives get here when they're called as values.
+    Value* args   = vm->stack_top - arg_count;
+    Value  result = (native->typed != NULL) ? call_typed_native(vm, native->typed, arg_count, args) : native->function(vm, arg_count, args);
+    if (IS_INVALID(result))
+        return RUNTIME_ERROR_NATIVE_FAILED;
+    vm->stack_top -= arg_count + 1;
+    vm_push(vm, result);
+    return NO_ERROR;
+}
+
+ErrorCode call_value(VM* vm, Value callee, int arg_count) {
     if (IS_FUNCTION(callee)) {
-        return call(AS_FUNCTION(AS_OBJ(callee)), arg_count);
+        return call(vm, AS_FUNCTION(AS_OBJ(callee)), arg_count);
+    } else if (IS_CLOSURE(callee)) {
+        return call_closure(vm, AS_CLOSURE(AS_OBJ(callee)), arg_count);
     } else if (IS_NATIVE(callee)) {
-        NativeFn native = AS_NATIVE(AS_OBJ(callee))->function;
-        Value result = native(arg_count, vm.stack_top - arg_count);
-        vm.stack_top -= arg_count + 1;
-        vm_push(result);
-        return NO_ERROR;
+        return call_native(vm, AS_NATIVE(AS_OBJ(callee)), arg_count);
     } else {
         return RUNTIME_ERROR_INVALID_CALL;
     }
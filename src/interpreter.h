@@ -6,32 +6,106 @@
 #include "error.h"
 
 
-#define VM_STACK_MAX  1024
-#define VM_FRAMES_MAX 64
+// The default sizes of the stack and of the call frames. They start with
+// room for the initial sizes and are moved to larger ones when a call
+// needs more, up to the sizes in the config.
+#define VM_STACK_INITIAL  1024
+#define VM_STACK_MAX      (1 << 20)
+#define VM_FRAMES_INITIAL 64
+#define VM_FRAMES_MAX     4096
 
+// A function is promoted to tier 1 after this many calls, or this many
+// back-edges of one of its loops.
+#define VM_TIER_UP_CALLS      64
+#define VM_TIER_UP_BACK_EDGES 1024
 
-typedef struct {
-    ObjFunction* function;
-    uint8_t* ip;
-    Value*   slots;
-} CallFrame;
+// The stacks of a coroutine start with room for this many frames and for
+// the first one, and grow on calls like the stacks of the VM. They're
+// limited by the sizes of the stacks of the VM.
+#define VM_COROUTINE_FRAMES  4
 
 
 typedef struct {
-    CallFrame frames[VM_FRAMES_MAX];
+    // Most values on the stack and most nested calls.
+    int  stack_size;
+    int  frame_count;
+    // Counts calls and back-edges to promote hot functions to tier 1, which
+    // writes to the functions. Off when they're shared between threads.
+    bool use_tiers;
+    // Compiles functions into native code when they're promoted to tier 1.
+    // Ignored where the JIT isn't supported or without the tiers.
+    bool use_jit;
+    // Workers of the scheduler for `spawn`, or 0 for one per processor.
+    int  task_workers;
+} VMConfig;
+
+#define VM_CONFIG_DEFAULT ((VMConfig) { .stack_size=VM_STACK_MAX, .frame_count=VM_FRAMES_MAX, .use_tiers=true, .use_jit=false, .task_workers=0 })
+
+
+/* Each VM owns its stack, frames and globals, so separate instances can
+ * run on separate threads. The compiled functions belong to the VM that
+ * runs them, as they're promoted to tier 1 in place, unless the tiers are
+ * off and the functions are only read. */
+typedef struct VM {
+    CallFrame* frames;
     int frame_count;
+    int frame_capacity;
 
-    Value  stack[VM_STACK_MAX];
+    Value* stack;
     Value* stack_top;
+    int    stack_capacity;
+    // The stacks grow on calls up to these many frames and values.
+    int    frame_limit;
+    int    stack_limit;
+    // The upvalues that still point into the stack, highest slot first.
+    struct ObjUpvalue* open_upvalues;
+
     Obj*   objects;
     Table  globals;
-} VM;
+    // Replaced when a global that held a function or a native changes, which
+    // invalidates the inline caches of the calls through the globals. No
+    // two VMs have the same version, as they share the caches.
+    u32    globals_version;
+    bool   use_tiers;
+    bool   use_jit;
+
+    // The scheduler of the tasks spawned by this VM, created on the first
+    // spawn, and the worker that the VM runs on. Tasks share the scheduler
+    // of the VM that spawned them.
+    struct Scheduler* scheduler;
+    int    worker;
+    int    task_workers;
+    // The copy of the globals for the tasks that this VM spawns, made on
+    // a spawn and dropped when a global or an array changes.
+    struct TaskGlobals* task_globals;
+
+    // The coroutine that runs, or NULL. The stacks above are the ones of
+    // the coroutine while it runs, and the ones of the VM are kept in
+    // `root` meanwhile.
+    struct ObjCoroutine* coroutine;
+    ExecutionStack       root;
 
-extern VM vm;
+    // The script that runs, for the errors of spawned tasks.
+    const char* path;
+    const char* source;
+
+    // The arguments of runtime errors point into this.
+    char error_buffer[256];
+} VM;
 
-ErrorCode vm_init();
-void  vm_free();
-void  vm_push(Value value);
-Value vm_pop();
-Value vm_peek(int x);
-void  vm_interpret(const char* path, const char* source, bool quiet);
+// `config` is NULL for the defaults. Returns NULL if the natives couldn't
+// be defined.
+VM*   vm_create(const VMConfig* config);
+void  vm_destroy(VM* vm);
+ErrorCode vm_reset(VM* vm);
+void  vm_push(VM* vm, Value value);
+Value vm_pop(VM* vm);
+Value vm_peek(VM* vm, int x);
+// Change the globals, keeping the inline caches valid. `vm_set_global`
+// returns false if the global isn't defined.
+void  vm_define_global(VM* vm, Slice name, Value value);
+bool  vm_set_global(VM* vm, Slice name, Value value);
+// Return false on compile or runtime errors.
+bool  vm_interpret(VM* vm, const char* path, const char* source, bool quiet);
+bool  vm_interpret_function(VM* vm, const char* path, const char* source, ObjFunction* function, bool quiet);
+bool  vm_call(VM* vm, const char* path, const char* source, ObjFunction* function, int arg_count, const Value* args, Value* result);
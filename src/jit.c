@@ -0,0 +1,428 @@
+#include "jit.h"
+#include "opcodes.h"
+#include "memory.h"
+#include "table.h"
+#include "chunk.h"
+
+
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/*
+ * The stencils are written for these registers, which are callee-saved
+ * so they survive the calls to the helpers:
+ *     rbx - vm->stack_top
+ *     r12 - frame->slots
+ *     r13 - &vm->stack_top, where rbx is written back when leaving, and
+ *           which the helpers get their VM from.
+ * All other registers are scratch. A value is the 8 bytes of its union
+ * followed by its type, so the top of the stack is at [rbx-16] and its
+ * type at [rbx-8].
+ */
+STATIC_ASSERT(sizeof(Value) == 16, value_is_16_bytes);
+STATIC_ASSERT(offsetof(Value, type) == 8, value_type_at_8);
+
+// Called with the slots of the frame, the address of the stack top and
+// the native address of the instruction to start at. Returns the offset
+// of the instruction where the interpreter should continue.
+typedef int (*JitEntry)(Value* slots, Value** stack_top, u8* target);
+
+// The largest stencil, together with an exit for its guards.
+#define JIT_MAX_CODE_PER_BYTE 96
+
+
+typedef struct {
+    // Offset of the rel32 in the code.
+    int  at;
+    // Offset into the chunk.
+    int  target;
+    // Leaves to the interpreter at `target` instead of jumping to it.
+    bool is_exit;
+} JitPatch;
+
+typedef struct {
+    Chunk* chunk;
+    u8*    code;
+    int    count;
+    int    capacity;
+    int    epilogue;
+    // Indexed by the offset of an instruction.
+    int*   entries;
+    int*   exits;
+
+    JitPatch* patches;
+    int       patch_count;
+    int       patch_capacity;
+} Jit;
+
+
+static void emit(Jit* self, const u8* bytes, int count) {
+    ASSERT(self->count + count <= self->capacity);
+    memcpy(self->code + self->count, bytes, count);
+    self->count += count;
+}
+
+#define EMIT(...) do { const u8 bytes_[] = { __VA_ARGS__ }; emit(self, bytes_, (int) sizeof(bytes_)); } while (false)
+
+static void emit_u32(Jit* self, u32 value) {
+    emit(self, (const u8*) &value, sizeof(value));
+}
+
+static void emit_u64(Jit* self, u64 value) {
+    emit(self, (const u8*) &value, sizeof(value));
+}
+
+static void emit_jump(Jit* self, int target, bool is_exit) {
+    if (self->patch_count == self->patch_capacity) {
+        int capacity = GROW_CAPACITY(self->patch_capacity);
+        self->patches = RESIZE_ARRAY(JitPatch, self->patches, self->patch_capacity, capacity);
+        self->patch_capacity = capacity;
+    }
+    self->patches[self->patch_count++] = (JitPatch) { .at=self->count, .target=target, .is_exit=is_exit };
+    emit_u32(self, 0);
+}
+
+// Emits a short jump forward, which is resolved by `bind_label`.
+static int emit_label(Jit* self, u8 instruction) {
+    EMIT(instruction, 0);
+    return self->count - 1;
+}
+
+static void bind_label(Jit* self, int label) {
+    int distance = self->count - (label + 1);
+    ASSERT(distance <= INT8_MAX);
+    self->code[label] = (u8) distance;
+}
+
+
+static u64 value_bits(Value value) {
+    if (IS_BOOL(value))
+        return AS_BOOL(value);
+    if (IS_NULL(value) || IS_INVALID(value))
+        return 0;
+    u64 bits;
+    memcpy(&bits, &value.as, sizeof(bits));
+    return bits;
+}
+
+
+/* ---- Stencils ---- */
+
+static void emit_exit(Jit* self, int offset) {
+    EMIT(0x49, 0x89, 0x5D, 0x00);                      // mov [r13], rbx
+    EMIT(0xB8); emit_u32(self, (u32) offset);          // mov eax, offset
+    EMIT(0xE9); emit_u32(self, (u32) (self->epilogue - (self->count + 4)));  // jmp epilogue
+}
+
+// Leaves to the interpreter at `offset` unless the value at `displacement`
+// from rbx has the type.
+static void emit_guard(Jit* self, i8 displacement, ValueType type, int offset) {
+    EMIT(0x83, 0x7B, (u8) (displacement + 8), (u8) type);  // cmp dword [rbx+displacement+8], type
+    EMIT(0x0F, 0x85); emit_jump(self, offset, true);       // jne exit
+}
+
+static void emit_push(Jit* self, Value value) {
+    EMIT(0x48, 0xB8); emit_u64(self, value_bits(value));    // mov rax, bits
+    EMIT(0x48, 0x89, 0x03);                                 // mov [rbx], rax
+    EMIT(0xC7, 0x43, 0x08); emit_u32(self, value.type);     // mov dword [rbx+8], type
+    EMIT(0x48, 0x83, 0xC3, 0x10);                           // add rbx, 16
+}
+
+static void emit_pop(Jit* self) {
+    EMIT(0x48, 0x83, 0xEB, 0x10);                           // sub rbx, 16
+    EMIT(0xC7, 0x43, 0x08); emit_u32(self, VALUE_INVALID);  // mov dword [rbx+8], VALUE_INVALID
+}
+
+static void emit_get_local(Jit* self, u8 slot) {
+    u32 displacement = slot * sizeof(Value);
+    EMIT(0x49, 0x8B, 0x84, 0x24); emit_u32(self, displacement);      // mov rax, [r12+slot]
+    EMIT(0x49, 0x8B, 0x94, 0x24); emit_u32(self, displacement + 8);  // mov rdx, [r12+slot+8]
+    EMIT(0x48, 0x89, 0x03);                                          // mov [rbx], rax
+    EMIT(0x48, 0x89, 0x53, 0x08);                                    // mov [rbx+8], rdx
+    EMIT(0x48, 0x83, 0xC3, 0x10);                                    // add rbx, 16
+}
+
+static void emit_set_local(Jit* self, u8 slot) {
+    u32 displacement = slot * sizeof(Value);
+    EMIT(0x48, 0x8B, 0x43, 0xF0);                                    // mov rax, [rbx-16]
+    EMIT(0x48, 0x8B, 0x53, 0xF8);                                    // mov rdx, [rbx-8]
+    EMIT(0x49, 0x89, 0x84, 0x24); emit_u32(self, displacement);      // mov [r12+slot], rax
+    EMIT(0x49, 0x89, 0x94, 0x24); emit_u32(self, displacement + 8);  // mov [r12+slot+8], rdx
+}
+
+// Only integers are handled, the interpreter takes the rest.
+static void emit_arithmetic(Jit* self, u8 instruction, int offset) {
+    emit_guard(self, -16, VALUE_I64, offset);
+    emit_guard(self, -32, VALUE_I64, offset);
+    EMIT(0x48, 0x8B, 0x43, 0xE0);                 // mov rax, [rbx-32]
+    switch (instruction) {
+        case OP_ADD:      EMIT(0x48, 0x03, 0x43, 0xF0);       break;  // add  rax, [rbx-16]
+        case OP_SUBTRACT: EMIT(0x48, 0x2B, 0x43, 0xF0);       break;  // sub  rax, [rbx-16]
+        case OP_MULTIPLY: EMIT(0x48, 0x0F, 0xAF, 0x43, 0xF0); break;  // imul rax, [rbx-16]
+        default: PANIC("Unhandled instruction %d", instruction);
+    }
+    EMIT(0x48, 0x89, 0x43, 0xE0);                 // mov [rbx-32], rax
+    emit_pop(self);
+}
+
+static void emit_relation(Jit* self, u8 instruction, int offset) {
+    emit_guard(self, -16, VALUE_I64, offset);
+    emit_guard(self, -32, VALUE_I64, offset);
+    EMIT(0x48, 0x8B, 0x43, 0xE0);                 // mov rax, [rbx-32]
+    EMIT(0x48, 0x3B, 0x43, 0xF0);                 // cmp rax, [rbx-16]
+    switch (instruction) {
+        case OP_EQUAL:   EMIT(0x0F, 0x94, 0xC0); break;  // sete al
+        case OP_LESS:    EMIT(0x0F, 0x9C, 0xC0); break;  // setl al
+        case OP_GREATER: EMIT(0x0F, 0x9F, 0xC0); break;  // setg al
+        default: PANIC("Unhandled instruction %d", instruction);
+    }
+    EMIT(0x0F, 0xB6, 0xC0);                       // movzx eax, al
+    EMIT(0x48, 0x89, 0x43, 0xE0);                 // mov [rbx-32], rax
+    EMIT(0xC7, 0x43, 0xE8); emit_u32(self, VALUE_BOOL);  // mov dword [rbx-24], VALUE_BOOL
+    emit_pop(self);
+}
+
+// Follows `value_is_falsy` for booleans and integers.
+static void emit_branch(Jit* self, bool jump_if_falsy, int target, int offset) {
+    u8 condition = jump_if_falsy ? 0x84 : 0x85;  // je or jne
+    EMIT(0x8B, 0x43, 0xF8);                      // mov eax, [rbx-8]
+    EMIT(0x83, 0xF8, VALUE_BOOL);                // cmp eax, VALUE_BOOL
+    int not_bool = emit_label(self, 0x75);       // jne not_bool
+    EMIT(0x80, 0x7B, 0xF0, 0x00);                // cmp byte [rbx-16], 0
+    EMIT(0x0F, condition); emit_jump(self, target, false);
+    int next = emit_label(self, 0xEB);           // jmp next
+    bind_label(self, not_bool);
+    EMIT(0x83, 0xF8, VALUE_I64);                 // cmp eax, VALUE_I64
+    EMIT(0x0F, 0x85); emit_jump(self, offset, true);
+    EMIT(0x48, 0x83, 0x7B, 0xF0, 0x00);          // cmp qword [rbx-16], 0
+    EMIT(0x0F, condition); emit_jump(self, target, false);
+    bind_label(self, next);
+}
+
+// Calls `helper(&value, name, vm)`, where the value is at `displacement`
+// from rbx. Leaves to the interpreter if it returns false and `offset`
+// isn't -1.
+static void emit_call(Jit* self, void* helper, i8 displacement, ObjString* name, int offset) {
+    EMIT(0x48, 0x8D, 0x7B, (u8) displacement);              // lea rdi, [rbx+displacement]
+    EMIT(0x48, 0xBE); emit_u64(self, (u64) (uintptr_t) name);    // mov rsi, name
+    EMIT(0x49, 0x8D, 0x95); emit_u32(self, (u32) -(i32) offsetof(VM, stack_top));  // lea rdx, [r13-stack_top]
+    EMIT(0x48, 0xB8); emit_u64(self, (u64) (uintptr_t) helper);  // mov rax, helper
+    EMIT(0xFF, 0xD0);                                        // call rax
+    if (offset != -1) {
+        EMIT(0x84, 0xC0);                                    // test al, al
+        EMIT(0x0F, 0x84); emit_jump(self, offset, true);     // je exit
+    }
+}
+
+
+/* ---- Helpers ---- */
+
+static bool helper_get_global(Value* top, ObjString* name, VM* vm) {
+    return table_get(&vm->globals, string_to_slice(name), top);
+}
+
+// The interpreter reports the error after the same lookup, which it
+// does on a table without the key.
+static bool helper_set_global(Value* value, ObjString* name, VM* vm) {
+    return vm_set_global(vm, string_to_slice(name), *value);
+}
+
+static bool helper_define_global(Value* value, ObjString* name, VM* vm) {
+    vm_define_global(vm, string_to_slice(name), *value);
+    return true;
+}
+
+static bool helper_print(Value* value, ObjString* unused, VM* vm) {
+    flockfile(stdout);
+    print_value(*value);
+    printf("\n");
+    funlockfile(stdout);
+    return true;
+}
+
+
+/* ---- Compilation ---- */
+
+static int jump_target(Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    if (chunk->code[offset] == OP_LOOP)
+        return offset + 3 - jump;
+    return offset + 3 + jump;
+}
+
+static void emit_instruction(Jit* self, int offset) {
+    Chunk* chunk = self->chunk;
+    u8 instruction = chunk->code[offset];
+    u8 operand     = (offset + 1 < chunk->count) ? chunk->code[offset + 1] : 0;
+
+    switch (instruction) {
+        case OP_POP:      emit_pop(self);                           break;
+        case OP_CONSTANT: emit_push(self, chunk->constants[operand]); break;
+        case OP_TRUE:     emit_push(self, MAKE_BOOL(true));         break;
+        case OP_FALSE:    emit_push(self, MAKE_BOOL(false));        break;
+        case OP_NULL:     emit_push(self, MAKE_NULL());             break;
+        case OP_GET_LOCAL: emit_get_local(self, operand);           break;
+        case OP_SET_LOCAL: emit_set_local(self, operand);           break;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:  emit_arithmetic(self, instruction, offset); break;
+        case OP_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:   emit_relation(self, instruction, offset);   break;
+        case OP_NEGATE: {
+            emit_guard(self, -16, VALUE_I64, offset);
+            EMIT(0x48, 0xF7, 0x5B, 0xF0);            // neg qword [rbx-16]
+            break;
+        }
+        case OP_NOT: {
+            emit_guard(self, -16, VALUE_BOOL, offset);
+            EMIT(0x0F, 0xB6, 0x43, 0xF0);            // movzx eax, byte [rbx-16]
+            EMIT(0x83, 0xF0, 0x01);                  // xor eax, 1
+            EMIT(0x48, 0x89, 0x43, 0xF0);            // mov [rbx-16], rax
+            break;
+        }
+        case OP_JUMP:
+        case OP_LOOP: {
+            EMIT(0xE9); emit_jump(self, jump_target(chunk, offset), false);
+            break;
+        }
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE: {
+            emit_branch(self, instruction == OP_JUMP_IF_FALSE, jump_target(chunk, offset), offset);
+            break;
+        }
+        case OP_GET_GLOBAL: {
+            emit_call(self, (void*) helper_get_global, 0, AS_STRING(AS_OBJ(chunk->constants[operand])), offset);
+            EMIT(0x48, 0x83, 0xC3, 0x10);            // add rbx, 16
+            break;
+        }
+        case OP_SET_GLOBAL: {
+            emit_call(self, (void*) helper_set_global, -16, AS_STRING(AS_OBJ(chunk->constants[operand])), offset);
+            break;
+        }
+        case OP_DEFINE_GLOBAL: {
+            emit_call(self, (void*) helper_define_global, -16, AS_STRING(AS_OBJ(chunk->constants[operand])), -1);
+            emit_pop(self);
+            break;
+        }
+        case OP_PRINT: {
+            emit_call(self, (void*) helper_print, -16, NULL, -1);
+            emit_pop(self);
+            break;
+        }
+        // @NOTE: Calls, returns and division (which traps on zero) are
+        //  left to the interpreter.
+        default:
+            emit_exit(self, offset);
+            break;
+    }
+}
+
+JitFunction* jit_compile(Chunk* chunk) {
+    long page = sysconf(_SC_PAGESIZE);
+    int  size = (int) ((64 + (long) chunk->count * JIT_MAX_CODE_PER_BYTE + page - 1) / page * page);
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+
+    Jit jit = (Jit) {
+        .chunk    = chunk,
+        .code     = memory,
+        .capacity = size,
+        .entries  = ALLOCATE_ARRAY(int, chunk->count + 1),
+        .exits    = ALLOCATE_ARRAY(int, chunk->count + 1),
+    };
+    Jit* self = &jit;
+    for (int i = 0; i <= chunk->count; ++i) {
+        jit.entries[i] = -1;
+        jit.exits[i]   = -1;
+    }
+
+    EMIT(0x53);                // push rbx
+    EMIT(0x41, 0x54);          // push r12
+    EMIT(0x41, 0x55);          // push r13
+    EMIT(0x49, 0x89, 0xFC);    // mov r12, rdi
+    EMIT(0x49, 0x89, 0xF5);    // mov r13, rsi
+    EMIT(0x48, 0x8B, 0x1E);    // mov rbx, [rsi]
+    EMIT(0xFF, 0xE2);          // jmp rdx
+
+    jit.epilogue = jit.count;
+    EMIT(0x41, 0x5D);          // pop r13
+    EMIT(0x41, 0x5C);          // pop r12
+    EMIT(0x5B);                // pop rbx
+    EMIT(0xC3);                // ret
+
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        jit.entries[i] = jit.count;
+        emit_instruction(self, i);
+    }
+    // Running past the end continues in the interpreter as well.
+    jit.entries[chunk->count] = jit.count;
+    emit_exit(self, chunk->count);
+
+    for (int i = 0; i < jit.patch_count; ++i) {
+        JitPatch patch = jit.patches[i];
+        int destination;
+        if (patch.is_exit) {
+            if (jit.exits[patch.target] == -1) {
+                jit.exits[patch.target] = jit.count;
+                emit_exit(self, patch.target);
+            }
+            destination = jit.exits[patch.target];
+        } else {
+            destination = jit.entries[patch.target];
+        }
+        ASSERT(destination != -1);
+        i32 relative = destination - (patch.at + 4);
+        memcpy(jit.code + patch.at, &relative, sizeof(relative));
+    }
+
+    FREE_ARRAY(int, jit.exits, chunk->count + 1);
+    FREE_ARRAY(JitPatch, jit.patches, jit.patch_capacity);
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        FREE_ARRAY(int, jit.entries, chunk->count + 1);
+        return NULL;
+    }
+
+    JitFunction* result = ALLOCATE(JitFunction);
+    *result = (JitFunction) { .code=memory, .size=size, .entries=jit.entries, .count=chunk->count };
+    return result;
+}
+
+void jit_free(JitFunction* jit) {
+    if (jit == NULL)
+        return;
+    munmap(jit->code, jit->size);
+    FREE_ARRAY(int, jit->entries, jit->count + 1);
+    FREE(JitFunction, jit);
+}
+
+u8* jit_run(VM* vm, JitFunction* jit, CallFrame* frame) {
+    u8* code   = frame->chunk->code;
+    int offset = (int) (frame->ip - code);
+    ASSERT(0 <= offset && offset <= jit->count && jit->entries[offset] != -1);
+
+    JitEntry entry;
+    memcpy(&entry, &jit->code, sizeof(entry));
+    int resume = entry(frame->slots, &vm->stack_top, jit->code + jit->entries[offset]);
+    return code + resume;
+}
+
+#else
+
+JitFunction* jit_compile(Chunk* chunk) {
+    return NULL;
+}
+
+void jit_free(JitFunction* jit) {
+}
+
+u8* jit_run(VM* vm, JitFunction* jit, CallFrame* frame) {
+    PANIC("The JIT isn't supported on this platform");
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "preamble.h"
+#include "object.h"
+#include "interpreter.h"
+
+
+/* A baseline JIT that translates the tier 1 chunk of a function into
+ * x86-64 by copying a precompiled stencil of machine code per opcode,
+ * patching in its operands and resolving the jumps afterwards. With the
+ * JIT, a function is compiled when it's promoted to tier 1.
+ *
+ * The native code keeps all values on the VM stack, so it can be entered
+ * and left at any instruction. Instructions that aren't translated, and
+ * guards on the operand types that fail, return to `vm_run` which
+ * continues at the same instruction. The interpreter enters the native
+ * code again on calls, returns and loops.
+ */
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+
+typedef struct JitFunction {
+    u8* code;
+    int size;
+    // Offset into `code` for each offset into the chunk.
+    int* entries;
+    int  count;
+} JitFunction;
+
+
+// Returns NULL if the platform isn't supported.
+JitFunction* jit_compile(Chunk* chunk);
+void         jit_free(JitFunction* jit);
+
+// Runs the native code of the chunk in `frame` from its `ip`, and
+// returns the `ip` where the interpreter should continue.
+u8* jit_run(VM* vm, JitFunction* jit, CallFrame* frame);
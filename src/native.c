@@ -0,0 +1,79 @@
+// @NOTE: Before error.h, which has a macro called log.
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "native.h"
+#include "error.h"
+
+
+static f64 clock_seconds(void) {
+    return (f64) clock() / (f64) CLOCKS_PER_SEC;
+}
+
+// Rounds towards zero.
+static i64 to_int(f64 x) {
+    return (i64) x;
+}
+
+const TypedNative TYPED_NATIVES[] = {
+    { "clock", NATIVE_SIGNATURE_F64,         { .f64_        = clock_seconds } },
+    { "sqrt",  NATIVE_SIGNATURE_F64_F64,     { .f64_f64     = sqrt  } },
+    { "sin",   NATIVE_SIGNATURE_F64_F64,     { .f64_f64     = sin   } },
+    { "cos",   NATIVE_SIGNATURE_F64_F64,     { .f64_f64     = cos   } },
+    { "exp",   NATIVE_SIGNATURE_F64_F64,     { .f64_f64     = exp   } },
+    { "log",   NATIVE_SIGNATURE_F64_F64,     { .f64_f64     = log   } },
+    { "round", NATIVE_SIGNATURE_F64_F64,     { .f64_f64     = round } },
+    { "pow",   NATIVE_SIGNATURE_F64_F64_F64, { .f64_f64_f64 = pow   } },
+    { "atan2", NATIVE_SIGNATURE_F64_F64_F64, { .f64_f64_f64 = atan2 } },
+    { "to_int", NATIVE_SIGNATURE_I64_F64,    { .i64_f64     = to_int } },
+};
+const int TYPED_NATIVE_COUNT = (int) (sizeof(TYPED_NATIVES) / sizeof(*TYPED_NATIVES));
+STATIC_ASSERT(sizeof(TYPED_NATIVES) / sizeof(*TYPED_NATIVES) <= UINT8_MAX + 1, typed_natives_fit_in_an_operand);
+
+static const struct {
+    int        arity;
+    NativeType parameters[NATIVE_TYPED_MAX_ARITY];
+} SIGNATURES[] = {
+    [NATIVE_SIGNATURE_F64]         = { 0, { 0 } },
+    [NATIVE_SIGNATURE_F64_F64]     = { 1, { NATIVE_TYPE_F64 } },
+    [NATIVE_SIGNATURE_F64_F64_F64] = { 2, { NATIVE_TYPE_F64, NATIVE_TYPE_F64 } },
+    [NATIVE_SIGNATURE_I64_F64]     = { 1, { NATIVE_TYPE_F64 } },
+};
+
+
+int typed_native_find(Slice name) {
+    for (int i = 0; i < TYPED_NATIVE_COUNT; ++i) {
+        const char* other = TYPED_NATIVES[i].name;
+        if (strlen(other) == (size_t) name.count && memcmp(other, name.source, (size_t) name.count) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int typed_native_arity(const TypedNative* native) {
+    return SIGNATURES[native->signature].arity;
+}
+
+NativeType typed_native_parameter(const TypedNative* native, int index) {
+    ASSERT(index < typed_native_arity(native));
+    return SIGNATURES[native->signature].parameters[index];
+}
+
+bool typed_native_call(const TypedNative* native, const Value* args, Value* result) {
+    // @NOTE: All parameters are floats so far, which also take integers.
+    f64 x[NATIVE_TYPED_MAX_ARITY];
+    for (int i = 0; i < typed_native_arity(native); ++i) {
+        if      (IS_F64(args[i])) x[i] = AS_F64(args[i]);
+        else if (IS_I64(args[i])) x[i] = (f64) AS_I64(args[i]);
+        else    return false;
+    }
+
+    switch (native->signature) {
+        case NATIVE_SIGNATURE_F64:         *result = MAKE_F64(native->function.f64_());                 break;
+        case NATIVE_SIGNATURE_F64_F64:     *result = MAKE_F64(native->function.f64_f64(x[0]));         break;
+        case NATIVE_SIGNATURE_F64_F64_F64: *result = MAKE_F64(native->function.f64_f64_f64(x[0], x[1])); break;
+        case NATIVE_SIGNATURE_I64_F64:     *result = MAKE_I64(native->function.i64_f64(x[0]));         break;
+    }
+    return true;
+}
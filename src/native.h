@@ -0,0 +1,57 @@
+#pragma once
+
+#include "preamble.h"
+#include "value.h"
+#include "slice.h"
+
+
+/* Natives whose signatures are declared up front, so the compiler knows
+ * them. A call by the name of one compiles to OP_CALL_NATIVE_TYPED, with
+ * the arity checked and the types of constant arguments checked or
+ * converted at compile time. The VM then only checks the tags of the
+ * other arguments, and calls the C function with the unboxed values in
+ * registers instead of through an array of values.
+ *
+ * The names are reserved, so the compiler rejects globals that redefine
+ * them. They're also defined as ordinary natives, so they can be used as
+ * values, which are called with the checks at run time.
+ */
+
+#define NATIVE_TYPED_MAX_ARITY 2
+
+typedef enum {
+    NATIVE_TYPE_F64,
+    NATIVE_TYPE_I64,
+} NativeType;
+
+// The shapes of C functions that typed natives can have, named after the
+// result and the parameters.
+typedef enum {
+    NATIVE_SIGNATURE_F64,
+    NATIVE_SIGNATURE_F64_F64,
+    NATIVE_SIGNATURE_F64_F64_F64,
+    NATIVE_SIGNATURE_I64_F64,
+} NativeSignature;
+
+typedef struct TypedNative {
+    const char*     name;
+    NativeSignature signature;
+    union {
+        f64 (*f64_)(void);
+        f64 (*f64_f64)(f64);
+        f64 (*f64_f64_f64)(f64, f64);
+        i64 (*i64_f64)(f64);
+    } function;
+} TypedNative;
+
+extern const TypedNative TYPED_NATIVES[];
+extern const int         TYPED_NATIVE_COUNT;
+
+
+// Returns the index of the typed native called `name`, or -1.
+int        typed_native_find(Slice name);
+int        typed_native_arity(const TypedNative* native);
+NativeType typed_native_parameter(const TypedNative* native, int index);
+// Calls the native with the arguments at `args`, whose count must be its
+// arity. Returns false if an argument has the wrong type.
+bool       typed_native_call(const TypedNative* native, const Value* args, Value* result);
@@ -0,0 +1,401 @@
+#include "numeric.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NUMERIC_X86
+#include <immintrin.h>
+#endif
+
+
+// @NOTE: SSE2 is part of x86-64, so only AVX is checked at run time. Its
+//  kernels are compiled for it on their own, so the rest of the program
+//  runs on any x86-64 processor.
+#ifdef NUMERIC_X86
+#define AVX __attribute__((target("avx")))
+static bool has_avx(void) { return __builtin_cpu_supports("avx"); }
+#endif
+
+static NumericPath forced_path = NUMERIC_BEST;
+
+NumericPath numeric_path(void) {
+#ifdef NUMERIC_X86
+    NumericPath best = has_avx() ? NUMERIC_AVX : NUMERIC_SSE2;
+#else
+    NumericPath best = NUMERIC_SCALAR;
+#endif
+    return (forced_path < best) ? forced_path : best;
+}
+
+void numeric_force_path(NumericPath path) {
+    forced_path = path;
+}
+
+// Integers wrap on overflow, through unsigned arithmetic.
+static i64 wrap_add(i64 a, i64 b) { return (i64) ((u64) a + (u64) b); }
+static i64 wrap_mul(i64 a, i64 b) { return (i64) ((u64) a * (u64) b); }
+
+
+// ---- SUM ----
+#ifdef NUMERIC_X86
+AVX static f64 sum_f64_avx(const f64* x, int count) {
+    __m256d a = _mm256_setzero_pd();
+    __m256d b = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        a = _mm256_add_pd(a, _mm256_loadu_pd(x + i));
+        b = _mm256_add_pd(b, _mm256_loadu_pd(x + i + 4));
+    }
+    for (; i + 4 <= count; i += 4)
+        a = _mm256_add_pd(a, _mm256_loadu_pd(x + i));
+
+    a = _mm256_add_pd(a, b);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    f64 result = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; i < count; ++i)
+        result += x[i];
+    return result;
+}
+
+static f64 sum_f64_sse2(const f64* x, int count) {
+    __m128d a = _mm_setzero_pd();
+    __m128d b = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a = _mm_add_pd(a, _mm_loadu_pd(x + i));
+        b = _mm_add_pd(b, _mm_loadu_pd(x + i + 2));
+    }
+    a = _mm_add_pd(a, b);
+    f64 result = _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+    for (; i < count; ++i)
+        result += x[i];
+    return result;
+}
+#endif
+
+static f64 sum_f64_scalar(const f64* x, int count) {
+    f64 result = 0.0;
+    for (int i = 0; i < count; ++i)
+        result += x[i];
+    return result;
+}
+
+f64 numeric_sum_f64(const f64* x, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:  return sum_f64_avx(x, count);
+        case NUMERIC_SSE2: return sum_f64_sse2(x, count);
+#endif
+        default:           return sum_f64_scalar(x, count);
+    }
+}
+
+i64 numeric_sum_i64(const i64* x, int count) {
+    i64 result = 0;
+    for (int i = 0; i < count; ++i)
+        result = wrap_add(result, x[i]);
+    return result;
+}
+
+
+// ---- DOT ----
+#ifdef NUMERIC_X86
+AVX static f64 dot_f64_avx(const f64* x, const f64* y, int count) {
+    __m256d a = _mm256_setzero_pd();
+    __m256d b = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        a = _mm256_add_pd(a, _mm256_mul_pd(_mm256_loadu_pd(x + i),     _mm256_loadu_pd(y + i)));
+        b = _mm256_add_pd(b, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+    }
+    for (; i + 4 <= count; i += 4)
+        a = _mm256_add_pd(a, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+
+    a = _mm256_add_pd(a, b);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    f64 result = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; i < count; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+static f64 dot_f64_sse2(const f64* x, const f64* y, int count) {
+    __m128d a = _mm_setzero_pd();
+    __m128d b = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        a = _mm_add_pd(a, _mm_mul_pd(_mm_loadu_pd(x + i),     _mm_loadu_pd(y + i)));
+        b = _mm_add_pd(b, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+    }
+    a = _mm_add_pd(a, b);
+    f64 result = _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+    for (; i < count; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+#endif
+
+static f64 dot_f64_scalar(const f64* x, const f64* y, int count) {
+    f64 result = 0.0;
+    for (int i = 0; i < count; ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+f64 numeric_dot_f64(const f64* x, const f64* y, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:  return dot_f64_avx(x, y, count);
+        case NUMERIC_SSE2: return dot_f64_sse2(x, y, count);
+#endif
+        default:           return dot_f64_scalar(x, y, count);
+    }
+}
+
+i64 numeric_dot_i64(const i64* x, const i64* y, int count) {
+    i64 result = 0;
+    for (int i = 0; i < count; ++i)
+        result = wrap_add(result, wrap_mul(x[i], y[i]));
+    return result;
+}
+
+
+// ---- AXPY ----
+#ifdef NUMERIC_X86
+AVX static void axpy_f64_avx(f64 alpha, const f64* x, f64* y, int count) {
+    __m256d a = _mm256_set1_pd(alpha);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_mul_pd(a, _mm256_loadu_pd(x + i)), _mm256_loadu_pd(y + i)));
+    for (; i < count; ++i)
+        y[i] += alpha * x[i];
+}
+
+static void axpy_f64_sse2(f64 alpha, const f64* x, f64* y, int count) {
+    __m128d a = _mm_set1_pd(alpha);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_mul_pd(a, _mm_loadu_pd(x + i)), _mm_loadu_pd(y + i)));
+    for (; i < count; ++i)
+        y[i] += alpha * x[i];
+}
+#endif
+
+static void axpy_f64_scalar(f64 alpha, const f64* x, f64* y, int count) {
+    for (int i = 0; i < count; ++i)
+        y[i] += alpha * x[i];
+}
+
+void numeric_axpy_f64(f64 alpha, const f64* x, f64* y, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:  axpy_f64_avx(alpha, x, y, count);    break;
+        case NUMERIC_SSE2: axpy_f64_sse2(alpha, x, y, count);   break;
+#endif
+        default:           axpy_f64_scalar(alpha, x, y, count); break;
+    }
+}
+
+
+// ---- MIN AND MAX ----
+#ifdef NUMERIC_X86
+AVX static f64 min_f64_avx(const f64* x, int count) {
+    f64 result = x[0];
+    int i = 0;
+    if (count >= 4) {
+        __m256d a = _mm256_loadu_pd(x);
+        for (i = 4; i + 4 <= count; i += 4)
+            a = _mm256_min_pd(a, _mm256_loadu_pd(x + i));
+        __m128d half = _mm_min_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        result = _mm_cvtsd_f64(_mm_min_sd(half, _mm_unpackhi_pd(half, half)));
+    }
+    for (; i < count; ++i)
+        result = (x[i] < result) ? x[i] : result;
+    return result;
+}
+
+AVX static f64 max_f64_avx(const f64* x, int count) {
+    f64 result = x[0];
+    int i = 0;
+    if (count >= 4) {
+        __m256d a = _mm256_loadu_pd(x);
+        for (i = 4; i + 4 <= count; i += 4)
+            a = _mm256_max_pd(a, _mm256_loadu_pd(x + i));
+        __m128d half = _mm_max_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        result = _mm_cvtsd_f64(_mm_max_sd(half, _mm_unpackhi_pd(half, half)));
+    }
+    for (; i < count; ++i)
+        result = (x[i] > result) ? x[i] : result;
+    return result;
+}
+
+static f64 min_f64_sse2(const f64* x, int count) {
+    f64 result = x[0];
+    int i = 0;
+    if (count >= 2) {
+        __m128d a = _mm_loadu_pd(x);
+        for (i = 2; i + 2 <= count; i += 2)
+            a = _mm_min_pd(a, _mm_loadu_pd(x + i));
+        result = _mm_cvtsd_f64(_mm_min_sd(a, _mm_unpackhi_pd(a, a)));
+    }
+    for (; i < count; ++i)
+        result = (x[i] < result) ? x[i] : result;
+    return result;
+}
+
+static f64 max_f64_sse2(const f64* x, int count) {
+    f64 result = x[0];
+    int i = 0;
+    if (count >= 2) {
+        __m128d a = _mm_loadu_pd(x);
+        for (i = 2; i + 2 <= count; i += 2)
+            a = _mm_max_pd(a, _mm_loadu_pd(x + i));
+        result = _mm_cvtsd_f64(_mm_max_sd(a, _mm_unpackhi_pd(a, a)));
+    }
+    for (; i < count; ++i)
+        result = (x[i] > result) ? x[i] : result;
+    return result;
+}
+#endif
+
+static f64 min_f64_scalar(const f64* x, int count) {
+    f64 result = x[0];
+    for (int i = 1; i < count; ++i)
+        result = (x[i] < result) ? x[i] : result;
+    return result;
+}
+
+static f64 max_f64_scalar(const f64* x, int count) {
+    f64 result = x[0];
+    for (int i = 1; i < count; ++i)
+        result = (x[i] > result) ? x[i] : result;
+    return result;
+}
+
+f64 numeric_min_f64(const f64* x, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:  return min_f64_avx(x, count);
+        case NUMERIC_SSE2: return min_f64_sse2(x, count);
+#endif
+        default:           return min_f64_scalar(x, count);
+    }
+}
+
+f64 numeric_max_f64(const f64* x, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:  return max_f64_avx(x, count);
+        case NUMERIC_SSE2: return max_f64_sse2(x, count);
+#endif
+        default:           return max_f64_scalar(x, count);
+    }
+}
+
+i64 numeric_min_i64(const i64* x, int count) {
+    i64 result = x[0];
+    for (int i = 1; i < count; ++i)
+        result = (x[i] < result) ? x[i] : result;
+    return result;
+}
+
+i64 numeric_max_i64(const i64* x, int count) {
+    i64 result = x[0];
+    for (int i = 1; i < count; ++i)
+        result = (x[i] > result) ? x[i] : result;
+    return result;
+}
+
+
+// ---- ADD SCALAR ----
+#ifdef NUMERIC_X86
+AVX static void add_scalar_f64_avx(const f64* x, f64 scalar, f64* y, int count) {
+    __m256d s = _mm256_set1_pd(scalar);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(x + i), s));
+    for (; i < count; ++i)
+        y[i] = x[i] + scalar;
+}
+
+static void add_scalar_f64_sse2(const f64* x, f64 scalar, f64* y, int count) {
+    __m128d s = _mm_set1_pd(scalar);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(x + i), s));
+    for (; i < count; ++i)
+        y[i] = x[i] + scalar;
+}
+
+// SSE2 has 64-bit integer additions, which wrap.
+static void add_scalar_i64_sse2(const i64* x, i64 scalar, i64* y, int count) {
+    __m128i s = _mm_set1_epi64x(scalar);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_si128((__m128i*) (y + i), _mm_add_epi64(_mm_loadu_si128((const __m128i*) (x + i)), s));
+    for (; i < count; ++i)
+        y[i] = wrap_add(x[i], scalar);
+}
+#endif
+
+static void add_scalar_f64_scalar(const f64* x, f64 scalar, f64* y, int count) {
+    for (int i = 0; i < count; ++i)
+        y[i] = x[i] + scalar;
+}
+
+static void add_scalar_i64_scalar(const i64* x, i64 scalar, i64* y, int count) {
+    for (int i = 0; i < count; ++i)
+        y[i] = wrap_add(x[i], scalar);
+}
+
+void numeric_add_scalar_f64(const f64* x, f64 scalar, f64* y, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:  add_scalar_f64_avx(x, scalar, y, count);    break;
+        case NUMERIC_SSE2: add_scalar_f64_sse2(x, scalar, y, count);   break;
+#endif
+        default:           add_scalar_f64_scalar(x, scalar, y, count); break;
+    }
+}
+
+void numeric_add_scalar_i64(const i64* x, i64 scalar, i64* y, int count) {
+    switch (numeric_path()) {
+#ifdef NUMERIC_X86
+        case NUMERIC_AVX:
+        case NUMERIC_SSE2: add_scalar_i64_sse2(x, scalar, y, count);   break;
+#endif
+        default:           add_scalar_i64_scalar(x, scalar, y, count); break;
+    }
+}
+
+
+// ---- SORT ----
+static int compare_f64(const void* a, const void* b) {
+    f64 x = *(const f64*) a;
+    f64 y = *(const f64*) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_i64(const void* a, const void* b) {
+    i64 x = *(const i64*) a;
+    i64 y = *(const i64*) b;
+    return (x > y) - (x < y);
+}
+
+void numeric_sort_f64(f64* x, int count) {
+    qsort(x, (size_t) count, sizeof(f64), compare_f64);
+}
+
+void numeric_sort_i64(i64* x, int count) {
+    qsort(x, (size_t) count, sizeof(i64), compare_i64);
+}
+
+
+// ---- PREFIX SUM ----
+void numeric_prefix_sum_f64(f64* x, int count) {
+    for (int i = 1; i < count; ++i)
+        x[i] += x[i-1];
+}
+
+void numeric_prefix_sum_i64(i64* x, int count) {
+    for (int i = 1; i < count; ++i)
+        x[i] = wrap_add(x[i], x[i-1]);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "preamble.h"
+
+
+/* Kernels over contiguous buffers of numbers, for the natives of arrays.
+ * The ones over floats use AVX when the processor has it, SSE2 on other
+ * x86-64 processors, and plain loops elsewhere. The vector kernels add in
+ * a different order than the loops, so sums of floats may differ in the
+ * last bits between processors.
+ *
+ * The integer kernels are plain loops, as SSE2 and AVX have no 64-bit
+ * multiplies or comparisons, and they wrap on overflow.
+ */
+
+typedef enum {
+    NUMERIC_SCALAR,
+    NUMERIC_SSE2,
+    NUMERIC_AVX,
+    NUMERIC_BEST,
+} NumericPath;
+
+// The kernels that the floats use, which is the best one the processor
+// has unless a worse one is forced. Forcing NUMERIC_BEST undoes it, and
+// is only meant for tests.
+NumericPath numeric_path(void);
+void        numeric_force_path(NumericPath path);
+
+f64  numeric_sum_f64(const f64* x, int count);
+i64  numeric_sum_i64(const i64* x, int count);
+f64  numeric_dot_f64(const f64* x, const f64* y, int count);
+i64  numeric_dot_i64(const i64* x, const i64* y, int count);
+// y = alpha * x + y.
+void numeric_axpy_f64(f64 alpha, const f64* x, f64* y, int count);
+
+// `count` must be at least 1. NaNs are unordered, so the result is
+// unspecified if there are any.
+f64  numeric_min_f64(const f64* x, int count);
+f64  numeric_max_f64(const f64* x, int count);
+i64  numeric_min_i64(const i64* x, int count);
+i64  numeric_max_i64(const i64* x, int count);
+
+// y = x + scalar, where `y` may be `x`.
+void numeric_add_scalar_f64(const f64* x, f64 scalar, f64* y, int count);
+void numeric_add_scalar_i64(const i64* x, i64 scalar, i64* y, int count);
+
+// In place, ascending.
+void numeric_sort_f64(f64* x, int count);
+void numeric_sort_i64(i64* x, int count);
+
+// In place, so each element becomes the sum of the elements up to it.
+// These add in order, as each sum depends on the one before.
+void numeric_prefix_sum_f64(f64* x, int count);
+void numeric_prefix_sum_i64(i64* x, int count);
@@ -1,6 +1,10 @@
 #include "object.h"
 #include "error.h"
 #include "memory.h"
+#include "jit.h"
+#include "scheduler.h"
+
+#include <inttypes.h>
 
 
 static Obj* make_obj(Obj* obj, ObjType type) { obj->type = type; return obj; }
@@ -12,6 +16,11 @@ void print_object(Obj* obj) {
         case OBJ_STRING:   print_string(AS_STRING(obj));     break;
         case OBJ_FUNCTION: print_function(AS_FUNCTION(obj)); break;
         case OBJ_NATIVE:   print_native(AS_NATIVE(obj));    break;
+        case OBJ_TASK:     print_task(AS_TASK(obj));        break;
+        case OBJ_COROUTINE: print_coroutine(AS_COROUTINE(obj)); break;
+        case OBJ_CLOSURE:  print_closure(AS_CLOSURE(obj));  break;
+        case OBJ_UPVALUE:  printf("<upvalue>");             break;
+        case OBJ_ARRAY:    print_array(AS_ARRAY(obj));      break;
         case OBJ_INVALID:  error(INTERPRETER, "<INVALID>");
     }
 }
@@ -33,6 +42,29 @@ void print_native(ObjNative* function) {
     printf("<native fn>");
 }
 
+void print_task(ObjTask* task) {
+    printf("<task>");
+}
+
+void print_coroutine(ObjCoroutine* coroutine) {
+    printf("<coroutine>");
+}
+
+void print_closure(ObjClosure* closure) {
+    print_function(closure->function);
+}
+
+void print_array(ObjArray* array) {
+    printf("[");
+    for (int i = 0; i < array->count; ++i) {
+        if (i > 0)
+            printf(", ");
+        if (array->type == ARRAY_F64) printf("%g",   array->as.f64s[i]);
+        else                          printf("%" PRId64, array->as.i64s[i]);
+    }
+    printf("]");
+}
+
 
 
 void print_object_type(Obj* obj) {
@@ -40,6 +72,11 @@ void print_object_type(Obj* obj) {
         case OBJ_STRING:   printf("String");   break;
         case OBJ_FUNCTION: printf("Function"); break;
         case OBJ_NATIVE:   printf("Native");   break;
+        case OBJ_TASK:     printf("Task");     break;
+        case OBJ_COROUTINE: printf("Coroutine"); break;
+        case OBJ_CLOSURE:  printf("Closure");  break;
+        case OBJ_UPVALUE:  printf("Upvalue");  break;
+        case OBJ_ARRAY:    printf("Array");    break;
         case OBJ_INVALID:  error(INTERPRETER, "<INVALID>");
     }
 }
@@ -49,6 +86,11 @@ const char* object_type_string(Obj* obj) {
         case OBJ_STRING:   return "String";
         case OBJ_FUNCTION: return "Function";
         case OBJ_NATIVE:   return "Native";
+        case OBJ_TASK:     return "Task";
+        case OBJ_COROUTINE: return "Coroutine";
+        case OBJ_CLOSURE:  return "Closure";
+        case OBJ_UPVALUE:  return "Upvalue";
+        case OBJ_ARRAY:    return "Array";
         case OBJ_INVALID:  error(INTERPRETER, "<INVALID>");
     }
 }
@@ -62,6 +104,16 @@ void object_free(Obj* obj) {
         }
         case OBJ_FUNCTION: {
             ObjFunction* function = AS_FUNCTION(obj);
+            if (function->back_edge_counts != NULL)
+                FREE_ARRAY(int, function->back_edge_counts, function->chunk.count);
+            if (function->optimized != NULL) {
+                FREE_ARRAY(int, function->optimized_offsets, function->chunk.count + 1);
+                chunk_free(function->optimized);
+                FREE(Chunk, function->optimized);
+            }
+            jit_free(function->jit);
+            if (function->captures != NULL)
+                FREE_ARRAY(Capture, function->captures, function->upvalue_count);
             chunk_free(&function->chunk);
             FREE(ObjFunction, obj);
             break;
@@ -70,6 +122,31 @@ void object_free(Obj* obj) {
             FREE(ObjNative, obj);
             break;
         }
+        case OBJ_TASK: {
+            task_release(AS_TASK(obj)->task);
+            FREE(ObjTask, obj);
+            break;
+        }
+        case OBJ_COROUTINE: {
+            coroutine_free_stacks(AS_COROUTINE(obj));
+            FREE(ObjCoroutine, obj);
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = AS_CLOSURE(obj);
+            FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalue_count);
+            FREE(ObjClosure, obj);
+            break;
+        }
+        case OBJ_UPVALUE: {
+            FREE(ObjUpvalue, obj);
+            break;
+        }
+        case OBJ_ARRAY: {
+            ObjArray* array = AS_ARRAY(obj);
+            FREE_RAW(array, sizeof(ObjArray) + array->count * sizeof(u64));
+            break;
+        }
         case OBJ_INVALID:  error(INTERPRETER, "<INVALID>");
     }
 }
@@ -85,6 +162,11 @@ bool objects_equals(Obj* a, Obj* b) {
             return string_a->size == string_b->size &&
             memcmp(string_a->data, string_b->data, string_a->size) == 0;
         }
+        case OBJ_TASK:    return AS_TASK(a)->task == AS_TASK(b)->task;
+        case OBJ_COROUTINE:
+        case OBJ_CLOSURE:
+        case OBJ_UPVALUE:
+        case OBJ_ARRAY:
         case OBJ_FUNCTION:
         case OBJ_NATIVE:  return a == b;
         case OBJ_INVALID:
@@ -113,12 +195,114 @@ ObjFunction* function_make() {
     function->arity = 0;
     function->name  = NULL;
     function->chunk = chunk_make();
+    function->call_count        = 0;
+    function->back_edge_counts  = NULL;
+    function->optimized         = NULL;
+    function->optimized_offsets = NULL;
+    function->jit               = NULL;
+    function->captures          = NULL;
+    function->upvalue_count     = 0;
+    function->max_stack         = 0;
     return function;
 }
 
 
-ObjNative* native_make(NativeFn function) {
+ObjNative* native_make(NativeFn function, const struct TypedNative* typed) {
     ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
     native->function = function;
+    native->typed    = typed;
     return native;
 }
+
+ObjTask* task_make(struct Task* task) {
+    ObjTask* handle = ALLOCATE_OBJ(ObjTask, OBJ_TASK);
+    handle->task = task;
+    task_retain(task);
+    return handle;
+}
+
+
+ObjCoroutine* coroutine_make(int stack_capacity, int frame_capacity) {
+    ObjCoroutine* coroutine = ALLOCATE_OBJ(ObjCoroutine, OBJ_COROUTINE);
+    coroutine->state  = COROUTINE_CREATED;
+    coroutine->caller = NULL;
+    coroutine->stacks = (ExecutionStack) {
+        .frames=ALLOCATE_ARRAY(CallFrame, frame_capacity), .frame_count=0, .frame_capacity=frame_capacity,
+        .stack=ALLOCATE_ARRAY(Value, stack_capacity), .stack_top=NULL, .stack_capacity=stack_capacity,
+    };
+    coroutine->stacks.stack_top = coroutine->stacks.stack;
+    return coroutine;
+}
+
+ObjClosure* closure_make(ObjFunction* function) {
+    ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+    closure->function      = function;
+    closure->upvalues      = ALLOCATE_ARRAY(ObjUpvalue*, function->upvalue_count);
+    closure->upvalue_count = function->upvalue_count;
+    return closure;
+}
+
+ObjUpvalue* upvalue_make(Value* slot) {
+    ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
+    upvalue->location  = slot;
+    upvalue->closed    = MAKE_NULL();
+    upvalue->next_open = NULL;
+    return upvalue;
+}
+
+
+// The elements of both types are 8 bytes, after a header that keeps them
+// aligned.
+STATIC_ASSERT(sizeof(f64) == sizeof(u64) && sizeof(i64) == sizeof(u64), array_elements_are_8_bytes);
+STATIC_ASSERT(sizeof(ObjArray) % sizeof(u64) == 0, array_elements_are_aligned);
+
+ObjArray* array_make(ArrayType type, int count) {
+    ObjArray* array = (ObjArray*) calloc(1, sizeof(ObjArray) + count * sizeof(u64));
+    array->obj.type = OBJ_ARRAY;
+    array->type     = type;
+    array->count    = count;
+    array->as.f64s  = (f64*) (array + 1);
+    return array;
+}
+
+
+// The stacks are freed as soon as the coroutine is done.
+void coroutine_free_stacks(ObjCoroutine* coroutine) {
+    FREE_ARRAY(CallFrame, coroutine->stacks.frames, coroutine->stacks.frame_capacity);
+    FREE_ARRAY(Value,     coroutine->stacks.stack,  coroutine->stacks.stack_capacity);
+    coroutine->stacks = (ExecutionStack) { 0 };
+}
+
+
+/* Copies a value into another heap, linking the new objects into
+ * `objects`. Functions are shared instead, as they're only read once
+ * compiled and live as long as the script. Arrays are copied with their
+ * elements, so tasks don't share them. Coroutines and closures can't
+ * leave their heap, as they share their state, and are copied as an
+ * invalid value. */
+Value value_copy(Value value, Obj** objects) {
+    if (!IS_OBJ(value))
+        return value;
+
+    Obj* obj  = AS_OBJ(value);
+    Obj* copy = NULL;
+    switch (obj->type) {
+        case OBJ_STRING:   copy = (Obj*) string_make(AS_STRING(obj)->data, AS_STRING(obj)->size); break;
+        case OBJ_NATIVE:   copy = (Obj*) native_make(AS_NATIVE(obj)->function, AS_NATIVE(obj)->typed); break;
+        case OBJ_TASK:     copy = (Obj*) task_make(AS_TASK(obj)->task); break;
+        case OBJ_ARRAY: {
+            ObjArray* array = AS_ARRAY(obj);
+            copy = (Obj*) array_make(array->type, array->count);
+            memcpy(AS_ARRAY(copy)->as.f64s, array->as.f64s, array->count * sizeof(u64));
+            break;
+        }
+        case OBJ_FUNCTION: return value;
+        case OBJ_COROUTINE:
+        case OBJ_CLOSURE:
+        case OBJ_UPVALUE:  return MAKE_INVALID();
+        case OBJ_INVALID:  error(INTERPRETER, "<INVALID>");
+    }
+    copy->next = *objects;
+    *objects   = copy;
+    return MAKE_OBJ(copy);
+}
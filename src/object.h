@@ -12,25 +12,148 @@ typedef struct {
     char data[];
 } ObjString;
 
+// Where a closure finds a variable that it captures when it's made, as a
+// local slot of the enclosing function or one of its upvalues.
+typedef struct {
+    u8   index;
+    bool is_local;
+} Capture;
+
 typedef struct {
     Obj obj;
     int arity;
     Chunk chunk;
     ObjString* name;
+
+    Capture* captures;
+    int      upvalue_count;
+
+    // The most values that a frame of the function has on the stack, from
+    // the callee and the arguments up.
+    int  max_stack;
+
+    // Hotness counters of tier 0. The back-edges are counted per loop,
+    // by the offset of its OP_LOOP, and allocated on the first one.
+    int  call_count;
+    int* back_edge_counts;
+
+    // The re-optimized chunk of tier 1, or NULL while the function is in
+    // tier 0, and the offset in it of each instruction in `chunk`.
+    Chunk* optimized;
+    int*   optimized_offsets;
+    // Native code for `optimized` when the VM runs with the JIT.
+    struct JitFunction* jit;
 } ObjFunction;
 
 
-typedef Value (*NativeFn)(int arg_count, Value* args);
+struct VM;
+struct Task;
+struct ObjClosure;
+struct ObjUpvalue;
+
+// Natives return an invalid value on errors, with the message written
+// to the error buffer of the VM.
+typedef struct CallFrame {
+    ObjFunction* function;
+    // The chunk of the tier that the frame runs.
+    Chunk*   chunk;
+    uint8_t* ip;
+    Value*   slots;
+    // The closure that the frame runs, or NULL for a plain function.
+    struct ObjClosure* closure;
+} CallFrame;
+
+// The value stack and the call frames that a VM runs on.
+typedef struct {
+    CallFrame* frames;
+    int frame_count;
+    int frame_capacity;
+
+    Value* stack;
+    Value* stack_top;
+    int    stack_capacity;
+
+    // The upvalues that still point into `stack`, highest slot first.
+    struct ObjUpvalue* open_upvalues;
+} ExecutionStack;
+
+typedef enum {
+    COROUTINE_CREATED,
+    COROUTINE_SUSPENDED,
+    COROUTINE_RUNNING,
+    COROUTINE_DONE,
+} CoroutineState;
+
+/* A call that runs on stacks of its own, so it can be suspended by
+ * 'yield' and continued by 'resume'. The stacks start small and grow on
+ * calls. While the coroutine runs, the VM works on them directly, so
+ * `stacks` is only up to date while it doesn't. */
+typedef struct ObjCoroutine {
+    Obj obj;
+    CoroutineState state;
+    ExecutionStack stacks;
+    // The coroutine that resumed it, or NULL for the stacks of the VM.
+    struct ObjCoroutine* caller;
+} ObjCoroutine;
+
+
+typedef Value (*NativeFn)(struct VM* vm, int arg_count, Value* args);
 typedef struct {
     Obj obj;
     NativeFn function;
+    // The typed native that the object is called as instead, or NULL.
+    const struct TypedNative* typed;
 } ObjNative;
 
+/* A variable captured by a closure. It points into the stack while the
+ * variable is in scope, and holds the value itself once it's closed. */
+typedef struct ObjUpvalue {
+    Obj    obj;
+    Value* location;
+    Value  closed;
+    struct ObjUpvalue* next_open;
+} ObjUpvalue;
+
+typedef struct ObjClosure {
+    Obj          obj;
+    ObjFunction* function;
+    ObjUpvalue** upvalues;
+    int          upvalue_count;
+} ObjClosure;
+
+typedef enum {
+    ARRAY_F64,
+    ARRAY_I64,
+} ArrayType;
+
+/* A fixed number of floats or integers, stored contiguously after the
+ * header so the natives can run their kernels over them. */
+typedef struct {
+    Obj       obj;
+    ArrayType type;
+    int       count;
+    union {
+        f64* f64s;
+        i64* i64s;
+    } as;
+} ObjArray;
+
+// A handle to a task spawned on the scheduler, which owns the task.
+typedef struct {
+    Obj obj;
+    struct Task* task;
+} ObjTask;
+
 
 #define AS_STRING(object)   ((ObjString*)(object))
 #define AS_CSTRING(object)  (AS_STRING(object)->data)
 #define AS_FUNCTION(object) ((ObjFunction*)(object))
 #define AS_NATIVE(object)   (((ObjNative*)(object)))
+#define AS_TASK(object)     ((ObjTask*)(object))
+#define AS_COROUTINE(object) ((ObjCoroutine*)(object))
+#define AS_CLOSURE(object)  ((ObjClosure*)(object))
+#define AS_UPVALUE(object)  ((ObjUpvalue*)(object))
+#define AS_ARRAY(object)    ((ObjArray*)(object))
 
 void print_object(Obj* obj);
 void print_object_type(Obj* obj);
@@ -40,6 +163,10 @@ const char* object_type_string(Obj* obj);
 void print_string(ObjString* string);
 void print_function(ObjFunction* function);
 void print_native(ObjNative* function);
+void print_task(ObjTask* task);
+void print_coroutine(ObjCoroutine* coroutine);
+void print_closure(ObjClosure* closure);
+void print_array(ObjArray* array);
 
 void object_free(Obj* obj);
 bool objects_equals(Obj* a, Obj* b);
@@ -48,4 +175,13 @@ Slice string_to_slice(ObjString* string);
 
 ObjString* string_make(const char* chars, int size);
 ObjFunction* function_make();
-ObjNative* native_make(NativeFn function);
+ObjNative* native_make(NativeFn function, const struct TypedNative* typed);
+ObjTask* task_make(struct Task* task);
+ObjCoroutine* coroutine_make(int stack_capacity, int frame_capacity);
+void coroutine_free_stacks(ObjCoroutine* coroutine);
+ObjClosure* closure_make(ObjFunction* function);
+ObjUpvalue* upvalue_make(Value* slot);
+// The elements are zeroed.
+ObjArray* array_make(ArrayType type, int count);
+
+Value value_copy(Value value, Obj** objects);
@@ -18,8 +18,6 @@ typedef enum {
     OP_LESS,
 
     OP_NOT,
-    OP_AND,
-    OP_OR,
 
     OP_ADD,
     OP_SUBTRACT,
@@ -36,11 +34,39 @@ typedef enum {
 
     OP_JUMP,
     OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
     OP_LOOP,
 
     OP_CALL,
+    OP_TAIL_CALL,
     OP_RETURN,
     OP_NULL,
+    OP_YIELD,
+    OP_RESUME,
+
+    // Closures. A local function that is only ever called by its name
+    // in the function around it reads the captured locals straight from
+    // the frame below its own instead.
+    OP_CLOSURE,
+    OP_GET_UPVALUE,
+    OP_SET_UPVALUE,
+    OP_CLOSE_UPVALUE,
+    OP_GET_ENCLOSING,
+    OP_SET_ENCLOSING,
+
+    // A call of a typed native by its name, whose operand is its index in
+    // TYPED_NATIVES. There's no callee on the stack, only the arguments.
+    OP_CALL_NATIVE_TYPED,
+
+    // Superinstructions, which only appear in chunks that have been
+    // promoted to tier 1. The operand is the right-hand side.
+    OP_STORE_LOCAL,
+    OP_ADD_CONSTANT,
+    OP_SUBTRACT_CONSTANT,
+    OP_LESS_CONSTANT,
+    OP_GREATER_CONSTANT,
+    OP_ADD_LOCAL,
+    OP_LESS_LOCAL,
 } OpCode;
 
 typedef enum {
@@ -68,38 +94,57 @@ static Type_List x = { .size=4, .types={ TYPE_ANY, TYPE_ANY } };
 #define TYPE_EMPTY { .size = 0 .types = 0 }
 
 // https://github.com/tsoding/bm/blob/master/bm/src/bm.c
-// X(type, has_operand, input_type, output_type)
+// X(type, pops, pushes), the values that each instruction takes from the
+// stack and leaves on it. The calls also pop one value per argument, as
+// given by their operand or the typed native that they call, and a yield
+// leaves the value it's resumed with.
 #define ALL_OPCODES(X)                                                                                              \
                                                                                                                     \
-    X(INVALID, false)                                                                                                   \
-    X(EXIT, false)                                                                                                      \
-    X(PRINT, false, TYPE_LIST(TYPE_UNSIGNED_INT, TYPE_ANY), TYPE_EMPTY)                                                             \
-    X(POP, false, TYPE_EMPTY, )                                                                                                       \
-    X(CONSTANT, false)                                                                                                  \
-    X(TRUE, false)                                                                                                      \
-    X(FALSE, false)                                                                                                     \
-    X(EQUAL, false)                                                                                                     \
-    X(GREATER, false)                                                                                                   \
-    X(LESS, false)                                                                                                      \
-    X(NOT, false)                                                                                                       \
-    X(AND, false)                                                                                                       \
-    X(OR, false)                                                                                                        \
-    X(ADD, false)                                                                                                       \
-    X(SUBTRACT, false)                                                                                                  \
-    X(MULTIPLY, false)                                                                                                  \
-    X(DIVIDE, false)                                                                                                    \
-    X(NEGATE, false)                                                                                                    \
-    X(DEFINE_GLOBAL, false)                                                                                             \
-    X(GET_GLOBAL, false)                                                                                                \
-    X(SET_GLOBAL, false)                                                                                                \
-    X(GET_LOCAL, false)                                                                                                 \
-    X(SET_LOCAL, false)                                                                                                 \
-    X(JUMP, false)                                                                                                      \
-    X(JUMP_IF_FALSE, false)                                                                                             \
-    X(LOOP, false)                                                                                                      \
-    X(CALL, false)                                                                                                      \
-    X(RETURN, false)                                                                                                    \
-    X(NULL, false)                                                                                                      \
+    X(INVALID, 0, 0)                                                                                                \
+    X(EXIT, 0, 0)                                                                                                   \
+    X(PRINT, 1, 0)                                                                                                  \
+    X(POP, 1, 0)                                                                                                    \
+    X(CONSTANT, 0, 1)                                                                                               \
+    X(TRUE, 0, 1)                                                                                                   \
+    X(FALSE, 0, 1)                                                                                                  \
+    X(EQUAL, 2, 1)                                                                                                  \
+    X(GREATER, 2, 1)                                                                                                \
+    X(LESS, 2, 1)                                                                                                   \
+    X(NOT, 1, 1)                                                                                                    \
+    X(ADD, 2, 1)                                                                                                    \
+    X(SUBTRACT, 2, 1)                                                                                               \
+    X(MULTIPLY, 2, 1)                                                                                               \
+    X(DIVIDE, 2, 1)                                                                                                 \
+    X(NEGATE, 1, 1)                                                                                                 \
+    X(DEFINE_GLOBAL, 1, 0)                                                                                          \
+    X(GET_GLOBAL, 0, 1)                                                                                             \
+    X(SET_GLOBAL, 1, 1)                                                                                             \
+    X(GET_LOCAL, 0, 1)                                                                                              \
+    X(SET_LOCAL, 1, 1)                                                                                              \
+    X(JUMP, 0, 0)                                                                                                   \
+    X(JUMP_IF_FALSE, 1, 1)                                                                                          \
+    X(JUMP_IF_TRUE, 1, 1)                                                                                           \
+    X(LOOP, 0, 0)                                                                                                   \
+    X(CALL, 1, 1)                                                                                                   \
+    X(TAIL_CALL, 1, 1)                                                                                              \
+    X(RETURN, 1, 0)                                                                                                 \
+    X(NULL, 0, 1)                                                                                                   \
+    X(YIELD, 1, 1)                                                                                                  \
+    X(RESUME, 2, 1)                                                                                                 \
+    X(CLOSURE, 0, 1)                                                                                                \
+    X(GET_UPVALUE, 0, 1)                                                                                            \
+    X(SET_UPVALUE, 1, 1)                                                                                            \
+    X(CLOSE_UPVALUE, 1, 0)                                                                                          \
+    X(GET_ENCLOSING, 0, 1)                                                                                          \
+    X(SET_ENCLOSING, 1, 1)                                                                                          \
+    X(CALL_NATIVE_TYPED, 0, 1)                                                                                      \
+    X(STORE_LOCAL, 1, 0)                                                                                            \
+    X(ADD_CONSTANT, 1, 1)                                                                                           \
+    X(SUBTRACT_CONSTANT, 1, 1)                                                                                      \
+    X(LESS_CONSTANT, 1, 1)                                                                                          \
+    X(GREATER_CONSTANT, 1, 1)                                                                                       \
+    X(ADD_LOCAL, 1, 1)                                                                                              \
+    X(LESS_LOCAL, 1, 1)                                                                                             \
 
 
 
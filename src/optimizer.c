@@ -0,0 +1,421 @@
+#include "optimizer.h"
+#include "opcodes.h"
+#include "memory.h"
+#include "table.h"
+#include "error.h"
+
+
+/*
+ * Works on the bytecode of one chunk at a time. The passes only mark
+ * instructions as removed, so the offsets stay valid between them, and
+ * the chunk is compacted once at the end, where every jump that is kept
+ * is re-targeted. A jump to a removed instruction lands on the first
+ * kept instruction after it.
+ */
+typedef struct {
+    Chunk* chunk;
+    // Indexed by the offset of an instruction.
+    bool* is_removed;
+    bool* is_leader;
+    bool* is_reachable;
+    int*  worklist;
+} Optimizer;
+
+
+static bool is_jump(u8 instruction) {
+    return instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE || instruction == OP_JUMP_IF_TRUE || instruction == OP_LOOP;
+}
+
+// Pushes a single value without any other effect.
+static bool is_pure_push(u8 instruction) {
+    return instruction == OP_CONSTANT || instruction == OP_TRUE || instruction == OP_FALSE || instruction == OP_NULL || instruction == OP_GET_LOCAL;
+}
+
+static int jump_target(Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    if (chunk->code[offset] == OP_LOOP)
+        return offset + 3 - jump;
+    return offset + 3 + jump;
+}
+
+
+static Optimizer optimizer_make(Chunk* chunk) {
+    Optimizer self = (Optimizer) {
+        .chunk        = chunk,
+        .is_removed   = ALLOCATE_ARRAY(bool, chunk->count + 1),
+        .is_leader    = ALLOCATE_ARRAY(bool, chunk->count + 1),
+        .is_reachable = ALLOCATE_ARRAY(bool, chunk->count + 1),
+        .worklist     = ALLOCATE_ARRAY(int,  chunk->count + 1),
+    };
+    memset(self.is_removed,   0, sizeof(bool) * (chunk->count + 1));
+    memset(self.is_leader,    0, sizeof(bool) * (chunk->count + 1));
+    memset(self.is_reachable, 0, sizeof(bool) * (chunk->count + 1));
+    return self;
+}
+
+static void optimizer_free(Optimizer* self) {
+    FREE_ARRAY(bool, self->is_removed,   self->chunk->count + 1);
+    FREE_ARRAY(bool, self->is_leader,    self->chunk->count + 1);
+    FREE_ARRAY(bool, self->is_reachable, self->chunk->count + 1);
+    FREE_ARRAY(int,  self->worklist,     self->chunk->count + 1);
+}
+
+
+static int next_kept(Optimizer* self, int offset) {
+    while (offset < self->chunk->count && self->is_removed[offset])
+        offset += chunk_instruction_size(self->chunk->code[offset]);
+    return offset;
+}
+
+static void find_leaders(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    memset(self->is_leader, 0, sizeof(bool) * (chunk->count + 1));
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (!self->is_removed[i] && is_jump(chunk->code[i]))
+            self->is_leader[next_kept(self, jump_target(chunk, i))] = true;
+    }
+}
+
+
+/* A conditional jump right after a constant either always or never
+ * jumps. The condition is left on the stack as it's popped on both
+ * paths, so the jump becomes an OP_JUMP or is removed. */
+static void fold_constant_branches(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    find_leaders(self);
+
+    int previous = -1;
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (self->is_removed[i])
+            continue;
+
+        u8 instruction = chunk->code[i];
+        bool is_conditional = instruction == OP_JUMP_IF_FALSE || instruction == OP_JUMP_IF_TRUE;
+        if (is_conditional && previous != -1 && !self->is_leader[i]) {
+            bool is_known = true;
+            bool is_falsy = false;
+            switch (chunk->code[previous]) {
+                case OP_TRUE:     is_falsy = false; break;
+                case OP_FALSE:    is_falsy = true;  break;
+                case OP_NULL:     is_falsy = true;  break;
+                case OP_CONSTANT: is_falsy = value_is_falsy(chunk->constants[chunk->code[previous + 1]]); break;
+                default:          is_known = false; break;
+            }
+
+            if (is_known) {
+                bool is_taken = (instruction == OP_JUMP_IF_FALSE) == is_falsy;
+                if (is_taken)
+                    chunk->code[i] = OP_JUMP;
+                else
+                    self->is_removed[i] = true;
+            }
+        }
+        previous = i;
+    }
+}
+
+static void remove_unreachable_code(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    memset(self->is_reachable, 0, sizeof(bool) * (chunk->count + 1));
+
+    int count = 0;
+    self->worklist[count++] = 0;
+    while (count > 0) {
+        int i = self->worklist[--count];
+        while (i < chunk->count && !self->is_reachable[i]) {
+            self->is_reachable[i] = true;
+
+            u8  instruction = chunk->code[i];
+            int next        = i + chunk_instruction_size(instruction);
+            if (self->is_removed[i]) {
+                i = next;
+                continue;
+            }
+
+            if (is_jump(instruction)) {
+                int target = jump_target(chunk, i);
+                if (!self->is_reachable[target] && count < chunk->count)
+                    self->worklist[count++] = target;
+                if (instruction == OP_JUMP || instruction == OP_LOOP)
+                    break;
+            } else if (instruction == OP_RETURN || instruction == OP_EXIT) {
+                break;
+            }
+            i = next;
+        }
+    }
+
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (!self->is_reachable[i])
+            self->is_removed[i] = true;
+    }
+}
+
+/* Jumps that land on the next instruction that is kept are left
+ * behind by the branches that have been removed. */
+static void remove_jumps_to_next(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+            if (self->is_removed[i] || chunk->code[i] != OP_JUMP)
+                continue;
+            if (next_kept(self, jump_target(chunk, i)) == next_kept(self, i + 3)) {
+                self->is_removed[i] = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* Locals live in the stack slots of their frame and can only be reached
+ * from other functions that capture them, so a slot that is never read
+ * and never captured is dead. */
+static void remove_dead_local_stores(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    bool is_read[UINT8_MAX + 1] = { 0 };
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (!self->is_removed[i] && chunk->code[i] == OP_GET_LOCAL)
+            is_read[chunk->code[i + 1]] = true;
+    }
+    for (int i = 0; i < chunk->constant_count; ++i) {
+        if (!IS_FUNCTION(chunk->constants[i]))
+            continue;
+        ObjFunction* function = AS_FUNCTION(AS_OBJ(chunk->constants[i]));
+        for (int j = 0; j < function->upvalue_count; ++j) {
+            if (function->captures[j].is_local)
+                is_read[function->captures[j].index] = true;
+        }
+    }
+    // The returns of an inlined call store the result in the slot of the
+    // callee, where it's read as a temporary.
+    for (int i = 0; i < chunk->inlined_count; ++i)
+        is_read[chunk->inlined[i].slot] = true;
+
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        // @NOTE: OP_SET_LOCAL leaves the value on the stack.
+        if (!self->is_removed[i] && chunk->code[i] == OP_SET_LOCAL && !is_read[chunk->code[i + 1]])
+            self->is_removed[i] = true;
+    }
+}
+
+static void remove_popped_values(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    find_leaders(self);
+
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (self->is_removed[i] || !is_pure_push(chunk->code[i]))
+            continue;
+
+        int next = next_kept(self, i + chunk_instruction_size(chunk->code[i]));
+        if (next < chunk->count && chunk->code[next] == OP_POP && !self->is_leader[next]) {
+            self->is_removed[i]    = true;
+            self->is_removed[next] = true;
+        }
+    }
+}
+
+static void remove_dead_globals(Optimizer* self, Table* used) {
+    Chunk* chunk = self->chunk;
+    find_leaders(self);
+
+    int previous = -1;
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (self->is_removed[i])
+            continue;
+
+        if (chunk->code[i] == OP_DEFINE_GLOBAL && previous != -1 && is_pure_push(chunk->code[previous]) && !self->is_leader[i]) {
+            Slice name = string_to_slice(AS_STRING(AS_OBJ(chunk->constants[chunk->code[i + 1]])));
+            Value unused;
+            if (!table_get(used, name, &unused)) {
+                self->is_removed[previous] = true;
+                self->is_removed[i]        = true;
+                previous = -1;
+                continue;
+            }
+        }
+        previous = i;
+    }
+}
+
+
+// The superinstruction for `first` followed by `second`, where the
+// operand of `first` stays the operand of the superinstruction.
+static u8 superinstruction(u8 first, u8 second) {
+    switch (first) {
+        case OP_SET_LOCAL: {
+            if (second == OP_POP) return OP_STORE_LOCAL;
+            break;
+        }
+        case OP_CONSTANT: {
+            if (second == OP_ADD)      return OP_ADD_CONSTANT;
+            if (second == OP_SUBTRACT) return OP_SUBTRACT_CONSTANT;
+            if (second == OP_LESS)     return OP_LESS_CONSTANT;
+            if (second == OP_GREATER)  return OP_GREATER_CONSTANT;
+            break;
+        }
+        case OP_GET_LOCAL: {
+            if (second == OP_ADD)  return OP_ADD_LOCAL;
+            if (second == OP_LESS) return OP_LESS_LOCAL;
+            break;
+        }
+    }
+    return OP_INVALID;
+}
+
+/* Both instructions of a pair have the same size as the superinstruction
+ * and the instruction that is dropped, so the offsets stay valid. A pair
+ * is never fused across a jump target. */
+static void fuse_superinstructions(Optimizer* self) {
+    Chunk* chunk = self->chunk;
+    find_leaders(self);
+
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (self->is_removed[i])
+            continue;
+
+        int next = next_kept(self, i + chunk_instruction_size(chunk->code[i]));
+        if (next >= chunk->count || self->is_leader[next])
+            continue;
+
+        u8 fused = superinstruction(chunk->code[i], chunk->code[next]);
+        if (fused != OP_INVALID) {
+            ASSERT(chunk_instruction_size(fused) == chunk_instruction_size(chunk->code[i]));
+            chunk->code[i] = fused;
+            self->is_removed[next] = true;
+        }
+    }
+}
+
+
+/* Moves the kept instructions to the front and re-targets the jumps.
+ * Offsets only shrink, so all jumps stay in range. If `offsets_out` isn't
+ * NULL, it gets the new offset of every old one. */
+static void compact(Optimizer* self, int* offsets_out) {
+    Chunk* chunk = self->chunk;
+
+    int* offsets = ALLOCATE_ARRAY(int, chunk->count + 1);
+    int  cursor  = 0;
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        offsets[i] = cursor;
+        if (!self->is_removed[i])
+            cursor += chunk_instruction_size(chunk->code[i]);
+    }
+    offsets[chunk->count] = cursor;
+    if (offsets_out != NULL)
+        memcpy(offsets_out, offsets, sizeof(int) * (chunk->count + 1));
+    for (int i = 0; i < chunk->inlined_count; ++i) {
+        chunk->inlined[i].start = offsets[chunk->inlined[i].start];
+        chunk->inlined[i].end   = offsets[chunk->inlined[i].end];
+    }
+
+    // @NOTE: The code before `i` has been overwritten, so the size is read
+    //  before the instruction is moved and the targets come from `offsets`.
+    int count = 0;
+    int size  = 0;
+    for (int i = 0; i < chunk->count; i += size) {
+        u8 instruction = chunk->code[i];
+        size = chunk_instruction_size(instruction);
+        if (self->is_removed[i])
+            continue;
+
+        int target = is_jump(instruction) ? offsets[jump_target(chunk, i)] : 0;
+
+        memmove(chunk->code  + count, chunk->code  + i, size);
+        memmove(chunk->lines + count, chunk->lines + i, sizeof(Location) * size);
+
+        if (is_jump(instruction)) {
+            int jump = (instruction == OP_LOOP) ? count + 3 - target : target - (count + 3);
+            chunk->code[count + 1] = (jump >> 8) & 0xff;
+            chunk->code[count + 2] = jump & 0xff;
+        }
+        count += size;
+    }
+
+    FREE_ARRAY(int, offsets, chunk->count + 1);
+    optimizer_free(self);
+    chunk->count = count;
+}
+
+
+static void run_passes(Optimizer* self, OptimizeFlags flags) {
+    if (flags & OPTIMIZE_UNREACHABLE_CODE) {
+        fold_constant_branches(self);
+        remove_unreachable_code(self);
+        remove_jumps_to_next(self);
+    }
+    if (flags & OPTIMIZE_DEAD_STORES) {
+        remove_dead_local_stores(self);
+        remove_popped_values(self);
+    }
+    if (flags & OPTIMIZE_SUPERINSTRUCTIONS)
+        fuse_superinstructions(self);
+}
+
+static void optimize_function(ObjFunction* function, OptimizeFlags flags) {
+    Chunk* chunk = &function->chunk;
+    for (int i = 0; i < chunk->constant_count; ++i) {
+        if (IS_FUNCTION(chunk->constants[i]))
+            optimize_function(AS_FUNCTION(AS_OBJ(chunk->constants[i])), flags);
+    }
+
+    Optimizer optimizer = optimizer_make(chunk);
+    run_passes(&optimizer, flags);
+    compact(&optimizer, NULL);
+}
+
+static void collect_used_globals(ObjFunction* function, Table* used) {
+    Chunk* chunk = &function->chunk;
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        u8 instruction = chunk->code[i];
+        if (instruction == OP_GET_GLOBAL || instruction == OP_SET_GLOBAL) {
+            Slice name = string_to_slice(AS_STRING(AS_OBJ(chunk->constants[chunk->code[i + 1]])));
+            table_add(used, name, MAKE_BOOL(true));
+        }
+    }
+    for (int i = 0; i < chunk->constant_count; ++i) {
+        if (IS_FUNCTION(chunk->constants[i]))
+            collect_used_globals(AS_FUNCTION(AS_OBJ(chunk->constants[i])), used);
+    }
+}
+
+
+void optimize(ObjFunction* script, OptimizeFlags flags) {
+    optimize_function(script, flags);
+
+    // @NOTE: Assignments count as uses, as assigning to a global that
+    //  isn't defined is a run-time error.
+    if (flags & OPTIMIZE_DEAD_GLOBALS) {
+        Table used = table_make();
+        collect_used_globals(script, &used);
+
+        Optimizer optimizer = optimizer_make(&script->chunk);
+        remove_dead_globals(&optimizer, &used);
+        compact(&optimizer, NULL);
+        table_free(&used);
+    }
+}
+
+Chunk* optimize_chunk_copy(const Chunk* chunk, OptimizeFlags flags, int* offsets) {
+    Chunk* copy = ALLOCATE(Chunk);
+    *copy = *chunk;
+    copy->capacity = chunk->count;
+    copy->code     = ALLOCATE_ARRAY(u8,       chunk->count);
+    copy->lines    = ALLOCATE_ARRAY(Location, chunk->count);
+    memcpy(copy->code,  chunk->code,  sizeof(u8)       * chunk->count);
+    memcpy(copy->lines, chunk->lines, sizeof(Location) * chunk->count);
+
+    // @NOTE: Only the lines are needed to report errors.
+    copy->locations         = NULL;
+    copy->location_count    = 0;
+    copy->location_capacity = 0;
+    copy->caches            = NULL;
+    copy->inlined           = ALLOCATE_ARRAY(InlinedCall, chunk->inlined_capacity);
+    memcpy(copy->inlined, chunk->inlined, sizeof(InlinedCall) * chunk->inlined_count);
+
+    Optimizer optimizer = optimizer_make(copy);
+    run_passes(&optimizer, flags);
+    compact(&optimizer, offsets);
+    return copy;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "preamble.h"
+#include "object.h"
+
+
+typedef enum {
+    OPTIMIZE_NONE              = 0,
+    // Folds branches on constant conditions and removes the code
+    // that can't be reached from the start of a function.
+    OPTIMIZE_UNREACHABLE_CODE  = 1 << 0,
+    // Removes stores to locals that are never read, and pure values
+    // that are popped right away.
+    OPTIMIZE_DEAD_STORES       = 1 << 1,
+    // Removes global definitions with a pure initializer that are never
+    // read or assigned. Only valid when the script is the whole program,
+    // so not in the repl.
+    OPTIMIZE_DEAD_GLOBALS      = 1 << 2,
+    // Fuses pairs of instructions into superinstructions, and specializes
+    // the binary operations on a constant or local operand. Only for the
+    // chunks of tier 1, so never part of the bytecode cache.
+    OPTIMIZE_SUPERINSTRUCTIONS = 1 << 3,
+    // Loads the globals that the condition of a while loop reads, and
+    // that the loop never assigns, once before the loop. Done by the
+    // compiler rather than by `optimize`.
+    OPTIMIZE_LOOP_INVARIANTS   = 1 << 4,
+    // Replaces the calls to small local functions that capture nothing
+    // with their code. Also done by the compiler.
+    OPTIMIZE_INLINE_CALLS      = 1 << 5,
+
+    OPTIMIZE_ALL = OPTIMIZE_UNREACHABLE_CODE | OPTIMIZE_DEAD_STORES | OPTIMIZE_DEAD_GLOBALS | OPTIMIZE_LOOP_INVARIANTS | OPTIMIZE_INLINE_CALLS,
+
+    // Code that is interpreted straight after it's compiled only gets the
+    // passes of the compiler and the whole-program pass, and the rest once
+    // it's hot enough for tier 1.
+    OPTIMIZE_TIER_0 = OPTIMIZE_DEAD_GLOBALS | OPTIMIZE_LOOP_INVARIANTS | OPTIMIZE_INLINE_CALLS,
+    OPTIMIZE_TIER_1 = OPTIMIZE_UNREACHABLE_CODE | OPTIMIZE_DEAD_STORES | OPTIMIZE_SUPERINSTRUCTIONS,
+} OptimizeFlags;
+
+
+/* Rewrites the bytecode of `script` and all functions in its constants,
+ * patching the jump offsets of the code that is kept. */
+void optimize(ObjFunction* script, OptimizeFlags flags);
+
+/* Returns an optimized copy of a single chunk, leaving the functions in
+ * its constants alone. `offsets` must have room for `chunk->count + 1`
+ * and gets the offset in the copy of every instruction in `chunk`, which
+ * is the next instruction that is kept for the ones that are removed. */
+Chunk* optimize_chunk_copy(const Chunk* chunk, OptimizeFlags flags, int* offsets);
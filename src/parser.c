@@ -250,7 +250,11 @@ TokenResult token_after(const char* source, Token token) {
     case 'i': if (is_keyword(c+1, "f"))      T(S("if"),     TOKEN_IF);          goto identifier;
     case 'e': if (is_keyword(c+1, "lse"))    T(S("else"),   TOKEN_ELSE);        goto identifier;
     case 'w': if (is_keyword(c+1, "hile"))   T(S("while"),  TOKEN_WHILE);       goto identifier;
-    case 'r': if (is_keyword(c+1, "eturn"))  T(S("return"), TOKEN_RETURN);      goto identifier;
+    case 'r':
+        if (is_keyword(c+1, "eturn"))  T(S("return"), TOKEN_RETURN);
+        if (is_keyword(c+1, "esume"))  T(S("resume"), TOKEN_RESUME);
+        goto identifier;
+    case 'y': if (is_keyword(c+1, "ield"))   T(S("yield"),  TOKEN_YIELD);       goto identifier;
 
     // @TODO: Do we need .<num> syntax? How does that work with prefixes such as 0x, 0o, and 0b?
     // case '.': if (!is_digit(*(c+1))) return T(1, TOKEN_DOT); else seen_dot = true;  // and fall through.
@@ -0,0 +1,334 @@
+#include "scheduler.h"
+#include "error.h"
+#include "memory.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+
+typedef struct {
+    Scheduler* scheduler;
+    int        index;
+    pthread_t  thread;
+    u32        seed;
+
+    // The VMs of the tasks on this worker, one for each level of joins
+    // that run other tasks.
+    VM* vms[SCHEDULER_MAX_DEPTH];
+    int depth;
+
+    Deque deque;
+} Worker;
+
+struct Scheduler {
+    Worker*  workers;
+    int      worker_count;
+    VMConfig config;
+
+    // Spawned tasks that haven't been taken yet. Idle workers sleep on
+    // `changed` while it's zero.
+    int  pending;
+    bool shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+};
+
+
+static void free_object_list(Obj* object) {
+    while (object != NULL) {
+        Obj* next = object->next;
+        object_free(object);
+        object = next;
+    }
+}
+
+TaskGlobals* task_globals_make(Table* globals) {
+    TaskGlobals* copy = ALLOCATE(TaskGlobals);
+    copy->globals    = table_make();
+    copy->objects    = NULL;
+    copy->references = 1;
+    for (int i = 0; i < globals->capacity; ++i) {
+        Entry* entry = &globals->entries[i];
+        if (slice_is_empty(entry->key))
+            continue;
+        // @NOTE: Coroutines stay behind.
+        Value value = value_copy(entry->value, &copy->objects);
+        if (IS_INVALID(value))
+            continue;
+        ObjString* key = string_make(entry->key.source, entry->key.count);
+        key->obj.next = copy->objects;
+        copy->objects = (Obj*) key;
+        table_add(&copy->globals, string_to_slice(key), value);
+    }
+    return copy;
+}
+
+void task_globals_release(TaskGlobals* globals) {
+    if (__atomic_sub_fetch(&globals->references, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    free_object_list(globals->objects);
+    table_free(&globals->globals);
+    FREE(TaskGlobals, globals);
+}
+
+void task_retain(Task* task) {
+    __atomic_add_fetch(&task->references, 1, __ATOMIC_RELAXED);
+}
+
+void task_release(Task* task) {
+    if (__atomic_sub_fetch(&task->references, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    free_object_list(task->objects);
+    FREE_ARRAY(Value, task->args, task->arg_count);
+    if (task->globals != NULL)
+        task_globals_release(task->globals);
+    FREE(Task, task);
+}
+
+
+bool deque_push(Deque* deque, Task* task) {
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    i64 top    = __atomic_load_n(&deque->top,    __ATOMIC_ACQUIRE);
+    if (bottom - top >= SCHEDULER_DEQUE_SIZE)
+        return false;
+    __atomic_store_n(&deque->tasks[bottom % SCHEDULER_DEQUE_SIZE], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+Task* deque_take(Deque* deque) {
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    Task* task = NULL;
+    if (top <= bottom) {
+        task = __atomic_load_n(&deque->tasks[bottom % SCHEDULER_DEQUE_SIZE], __ATOMIC_RELAXED);
+        if (top == bottom) {
+            // The last task, which a thief may take at the same time.
+            if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                task = NULL;
+            __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+Task* deque_steal(Deque* deque) {
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+        return NULL;
+
+    Task* task = __atomic_load_n(&deque->tasks[top % SCHEDULER_DEQUE_SIZE], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return task;
+}
+
+
+static Task* find_task(Worker* worker) {
+    Scheduler* scheduler = worker->scheduler;
+    Task* task = deque_take(&worker->deque);
+    for (int i = 0; task == NULL && i < scheduler->worker_count; ++i) {
+        // @NOTE: Victims are picked with xorshift, so that thieves don't
+        //  all go for the same deque.
+        worker->seed ^= worker->seed << 13;
+        worker->seed ^= worker->seed >> 17;
+        worker->seed ^= worker->seed << 5;
+        Worker* victim = &scheduler->workers[worker->seed % (u32) scheduler->worker_count];
+        if (victim != worker)
+            task = deque_steal(&victim->deque);
+    }
+    if (task != NULL)
+        __atomic_fetch_sub(&scheduler->pending, 1, __ATOMIC_RELAXED);
+    return task;
+}
+
+static void run_task(Worker* worker, Task* task) {
+    ASSERT(worker->depth < SCHEDULER_MAX_DEPTH);
+    VM* vm = worker->vms[worker->depth];
+    if (vm == NULL) {
+        vm = vm_create(&worker->scheduler->config);
+        ASSERTF(vm != NULL, "Couldn't create the VM of a task");
+        vm->scheduler = worker->scheduler;
+        vm->worker    = worker->index;
+        worker->vms[worker->depth] = vm;
+    } else {
+        ErrorCode result = vm_reset(vm);
+        ASSERT(result == NO_ERROR);
+    }
+
+    // @NOTE: The natives are already defined. The arrays are copied into
+    //  the VM, as the task may change them.
+    Table* globals = &task->globals->globals;
+    for (int i = 0; i < globals->capacity; ++i) {
+        Entry* entry = &globals->entries[i];
+        if (slice_is_empty(entry->key))
+            continue;
+        Value value = IS_ARRAY(entry->value) ? value_copy(entry->value, &vm->objects) : entry->value;
+        table_add(&vm->globals, entry->key, value);
+    }
+
+    worker->depth++;
+    Value result;
+    Obj*  objects = NULL;
+    bool  success = vm_call(vm, task->path, task->source, task->function, task->arg_count, task->args, &result);
+    if (success) {
+        task->result = value_copy(result, &objects);
+        success = !IS_INVALID(task->result);
+    }
+    worker->depth--;
+
+    // Only the result is kept. The VM keeps the globals until it's reset,
+    // but doesn't read them.
+    free_object_list(task->objects);
+    task->objects = objects;
+    FREE_ARRAY(Value, task->args, task->arg_count);
+    task->args      = NULL;
+    task->arg_count = 0;
+    task_globals_release(task->globals);
+    task->globals   = NULL;
+
+    __atomic_store_n(&task->state, success ? TASK_DONE : TASK_FAILED, __ATOMIC_RELEASE);
+    task_release(task);
+}
+
+static void* worker_main(void* argument) {
+    Worker*    worker    = argument;
+    Scheduler* scheduler = worker->scheduler;
+    while (true) {
+        Task* task = find_task(worker);
+        if (task != NULL) {
+            run_task(worker, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&scheduler->lock);
+        while (__atomic_load_n(&scheduler->pending, __ATOMIC_RELAXED) == 0 && !scheduler->shutdown)
+            pthread_cond_wait(&scheduler->changed, &scheduler->lock);
+        bool stop = scheduler->shutdown && __atomic_load_n(&scheduler->pending, __ATOMIC_RELAXED) == 0;
+        pthread_mutex_unlock(&scheduler->lock);
+        if (stop)
+            return NULL;
+    }
+}
+
+
+Scheduler* scheduler_create(int worker_count, VMConfig config) {
+    if (worker_count <= 0)                    worker_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_count > SCHEDULER_MAX_WORKERS) worker_count = SCHEDULER_MAX_WORKERS;
+    if (worker_count < 1)                     worker_count = 1;
+
+    Scheduler* scheduler = ALLOCATE(Scheduler);
+    scheduler->workers      = ALLOCATE_ARRAY(Worker, worker_count);
+    scheduler->worker_count = worker_count;
+    scheduler->config       = config;
+    scheduler->config.use_tiers = false;
+    scheduler->config.use_jit   = false;
+    scheduler->pending  = 0;
+    scheduler->shutdown = false;
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->changed, NULL);
+
+    for (int i = 0; i < worker_count; ++i) {
+        Worker* worker = &scheduler->workers[i];
+        memset(worker, 0, sizeof(Worker));
+        worker->scheduler = scheduler;
+        worker->index     = i;
+        worker->seed      = 2463534242u + (u32) i;
+    }
+
+    // @NOTE: The thread that created the scheduler is the first worker.
+    for (int i = 1; i < worker_count; ++i) {
+        int result = pthread_create(&scheduler->workers[i].thread, NULL, worker_main, &scheduler->workers[i]);
+        ASSERTF(result == 0, "Couldn't create worker thread");
+    }
+    return scheduler;
+}
+
+void scheduler_destroy(Scheduler* scheduler) {
+    Worker* first = &scheduler->workers[0];
+    Task*   task;
+    while ((task = find_task(first)) != NULL)
+        run_task(first, task);
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->shutdown = true;
+    pthread_cond_broadcast(&scheduler->changed);
+    pthread_mutex_unlock(&scheduler->lock);
+    for (int i = 1; i < scheduler->worker_count; ++i) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < scheduler->worker_count; ++i) {
+        for (int j = 0; j < SCHEDULER_MAX_DEPTH; ++j) {
+            VM* vm = scheduler->workers[i].vms[j];
+            if (vm != NULL) {
+                vm->scheduler = NULL;
+                vm_destroy(vm);
+            }
+        }
+    }
+
+    pthread_cond_destroy(&scheduler->changed);
+    pthread_mutex_destroy(&scheduler->lock);
+    FREE_ARRAY(Worker, scheduler->workers, scheduler->worker_count);
+    FREE(Scheduler, scheduler);
+}
+
+
+ObjTask* scheduler_spawn(Scheduler* scheduler, int worker_index, ObjFunction* function, int arg_count, Value* args, TaskGlobals* globals, const char* path, const char* source) {
+    Task* task = ALLOCATE(Task);
+    task->function   = function;
+    task->args       = ALLOCATE_ARRAY(Value, arg_count);
+    task->arg_count  = arg_count;
+    task->result     = MAKE_NULL();
+    task->globals    = globals;
+    task->objects    = NULL;
+    task->path       = path;
+    task->source     = source;
+    task->state      = TASK_PENDING;
+    task->references = 1;
+    __atomic_add_fetch(&globals->references, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < arg_count; ++i)
+        task->args[i] = value_copy(args[i], &task->objects);
+
+    // @NOTE: The handle is made first, as the task may be run and
+    //  released by another worker as soon as it's pushed.
+    ObjTask* handle = task_make(task);
+    Worker*  worker = &scheduler->workers[worker_index];
+    __atomic_fetch_add(&scheduler->pending, 1, __ATOMIC_RELAXED);
+    if (!deque_push(&worker->deque, task)) {
+        __atomic_fetch_sub(&scheduler->pending, 1, __ATOMIC_RELAXED);
+        if (worker->depth == SCHEDULER_MAX_DEPTH) {
+            object_free((Obj*) handle);
+            task_release(task);
+            return NULL;
+        }
+        run_task(worker, task);
+        return handle;
+    }
+
+    pthread_mutex_lock(&scheduler->lock);
+    pthread_cond_signal(&scheduler->changed);
+    pthread_mutex_unlock(&scheduler->lock);
+    return handle;
+}
+
+bool scheduler_join(Scheduler* scheduler, int worker_index, Task* task) {
+    Worker* worker = &scheduler->workers[worker_index];
+    while (__atomic_load_n(&task->state, __ATOMIC_ACQUIRE) == TASK_PENDING) {
+        Task* other = (worker->depth < SCHEDULER_MAX_DEPTH) ? find_task(worker) : NULL;
+        if (other != NULL)
+            run_task(worker, other);
+        else
+            sched_yield();
+    }
+    return __atomic_load_n(&task->state, __ATOMIC_ACQUIRE) == TASK_DONE;
+}
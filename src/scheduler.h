@@ -0,0 +1,109 @@
+#pragma once
+
+#include "preamble.h"
+#include "object.h"
+#include "interpreter.h"
+
+
+/* A work-stealing scheduler for the tasks of `spawn` and `join`. Every
+ * worker has a Chase-Lev deque, where it pushes and takes its own tasks
+ * at the bottom while idle workers steal from the top. The thread of the
+ * VM that created the scheduler is the first worker, and the others get
+ * a thread each.
+ *
+ * Each task runs on a VM of its own, with its own stack, objects and
+ * globals. The globals start as a copy of those of the spawning VM when
+ * the task was spawned, and changes to them aren't seen by other VMs.
+ * The tasks spawned while the globals of a VM don't change share one
+ * copy, which they only read, and the arrays in it are copied again for
+ * each task when it runs. The arguments and the result are copied
+ * between the heaps, except functions which are shared as they're only
+ * read. As these VMs run without the tiers, the shared functions are
+ * never written by them.
+ *
+ * A task is freed once it has run and all its handles are freed.
+ *
+ * A worker that joins a task that isn't done runs other tasks meanwhile,
+ * on a new VM for each level of nesting.
+ */
+
+#define SCHEDULER_MAX_WORKERS 64
+#define SCHEDULER_DEQUE_SIZE  1024
+#define SCHEDULER_MAX_DEPTH   16
+
+
+typedef enum {
+    TASK_PENDING,
+    TASK_DONE,
+    TASK_FAILED,
+} TaskState;
+
+// A copy of the globals of a VM, which is freed with its last reference.
+typedef struct TaskGlobals {
+    Table globals;
+    // The copies of the values and of the names.
+    Obj*  objects;
+    int   references;
+} TaskGlobals;
+
+typedef struct Task {
+    ObjFunction* function;
+    Value* args;
+    int    arg_count;
+    Value  result;
+    // Released, like the arguments, once the task has run.
+    TaskGlobals* globals;
+
+    // The copies of the arguments, and then of the result.
+    Obj*   objects;
+    // Only used for errors.
+    const char* path;
+    const char* source;
+
+    TaskState state;
+    // One for each handle, and one until the task has run.
+    int references;
+} Task;
+
+/* The deque of Chase and Lev, with the orderings of Lê et al. for weak
+ * memory models. It doesn't grow, so a spawn on a full deque runs the
+ * task immediately instead. A zeroed deque is empty. */
+typedef struct {
+    i64   top;
+    i64   bottom;
+    Task* tasks[SCHEDULER_DEQUE_SIZE];
+} Deque;
+
+typedef struct Scheduler Scheduler;
+
+
+// `worker_count` is 0 for one per processor.
+Scheduler* scheduler_create(int worker_count, VMConfig config);
+// Runs the remaining tasks and stops the workers.
+void       scheduler_destroy(Scheduler* scheduler);
+
+// Spawns a call of `function` from a VM on `worker`, copying the
+// arguments and sharing `globals`. Returns the handle of the task, which
+// the caller owns, or NULL if the deque of the worker is full and it's
+// too deeply nested to run the task itself.
+ObjTask* scheduler_spawn(Scheduler* scheduler, int worker, ObjFunction* function, int arg_count, Value* args, TaskGlobals* globals, const char* path, const char* source);
+// Runs other tasks on `worker` until `task` is done. Returns false if
+// the task failed.
+bool  scheduler_join(Scheduler* scheduler, int worker, Task* task);
+
+// Copies `globals` with one reference, for the VM that spawns the tasks.
+TaskGlobals* task_globals_make(Table* globals);
+void         task_globals_release(TaskGlobals* globals);
+
+// Called for the handles of a task. The last release frees it.
+void task_retain(Task* task);
+void task_release(Task* task);
+
+// Pushes a task at the bottom. Returns false if the deque is full. Only
+// called by the owner.
+bool  deque_push(Deque* deque, Task* task);
+// Takes the task pushed last. Only called by the owner.
+Task* deque_take(Deque* deque);
+// Takes the task pushed first. Returns NULL if the deque is empty or if
+// another thread took it first.
+Task* deque_steal(Deque* deque);
@@ -48,6 +48,9 @@ typedef enum {
     TOKEN_FOR,
     TOKEN_RETURN,
 
+    TOKEN_YIELD,
+    TOKEN_RESUME,
+
     TOKEN_COMMA,
     TOKEN_DOT,
 
@@ -104,6 +107,9 @@ typedef enum {
     X(TOKEN_FOR, SLICE("for"))             \
     X(TOKEN_RETURN, SLICE("return"))       \
                                             \
+    X(TOKEN_YIELD, SLICE("yield"))         \
+    X(TOKEN_RESUME, SLICE("resume"))       \
+                                            \
     X(TOKEN_COMMA, SLICE(","))             \
     X(TOKEN_DOT, SLICE("."))               \
                                             \
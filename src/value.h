@@ -7,6 +7,11 @@ typedef enum {
     OBJ_STRING,
     OBJ_FUNCTION,
     OBJ_NATIVE,
+    OBJ_TASK,
+    OBJ_COROUTINE,
+    OBJ_CLOSURE,
+    OBJ_UPVALUE,
+    OBJ_ARRAY,
 } ObjType;
 
 struct Obj {
@@ -60,6 +65,10 @@ Value impl_MAKE_OBJ(Obj* value);
 #define IS_STRING(value)    is_obj_type(value, OBJ_STRING)
 #define IS_FUNCTION(value)  is_obj_type(value, OBJ_FUNCTION)
 #define IS_NATIVE(value)    is_obj_type(value, OBJ_NATIVE)
+#define IS_TASK(value)      is_obj_type(value, OBJ_TASK)
+#define IS_COROUTINE(value) is_obj_type(value, OBJ_COROUTINE)
+#define IS_CLOSURE(value)   is_obj_type(value, OBJ_CLOSURE)
+#define IS_ARRAY(value)     is_obj_type(value, OBJ_ARRAY)
 
 
 void print_value(Value value);
@@ -1,10 +1,22 @@
 #include "test.h"
 #include "test_table.c"
 #include "test_expression.c"
+#include "test_bytecode.c"
+#include "test_optimizer.c"
+#include "test_scheduler.c"
+#include "test_interpreter.c"
+#include "test_closures.c"
+#include "test_chunk.c"
+#include "test_numeric.c"
+#include "test_natives.c"
+#include "test_executor.c"
+#include "test_tail_calls.c"
+#include "test_tiers.c"
+#include "test_jit.c"
 
 
 
 int main() {
     Option options = option_default();
-    RUN_TESTS(options, table, chain_expresssion);
+    return RUN_TESTS(options, table, chain_expresssion, bytecode_cache, optimizer, scheduler, interpreter, closures, chunk, numeric, typed_natives, executor, tail_calls, tiers, jit) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
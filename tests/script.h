@@ -0,0 +1,123 @@
+#pragma once
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "interpreter.h"
+#include "compiler.h"
+#include "opcodes.h"
+
+
+typedef struct {
+    FILE* output;
+    int   fd;
+    int   saved;
+} OutputCapture;
+
+// Sends `fd`, stdout or stderr, to a temporary file until output_capture_end.
+static OutputCapture output_capture_begin(int fd) {
+    fflush(stdout);
+    fflush(stderr);
+    OutputCapture capture = { .output=tmpfile(), .fd=fd, .saved=dup(fd) };
+    dup2(fileno(capture.output), fd);
+    return capture;
+}
+
+// Restores the file and returns what was printed, which the caller frees.
+static char* output_capture_end(OutputCapture capture) {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(capture.saved, capture.fd);
+    close(capture.saved);
+
+    struct stat info;
+    fstat(fileno(capture.output), &info);
+    char* result = calloc(1, (size_t) info.st_size + 1);
+    pread(fileno(capture.output), result, (size_t) info.st_size, 0);
+    fclose(capture.output);
+    return result;
+}
+
+/* Runs a compiled script on `vm` and returns what it printed, or NULL if
+ * it failed. The result is freed by the caller. */
+static char* run_on_vm(VM* vm, ObjFunction* script, const char* source) {
+    OutputCapture capture = output_capture_begin(STDOUT_FILENO);
+    bool succeeded = vm_interpret_function(vm, "script", source, script, true);
+    char* result = output_capture_end(capture);
+
+    if (!succeeded) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+/* Runs a compiled script on a new VM. The tiers are off, so the chunks
+ * run as they were compiled. */
+static char* run_function(ObjFunction* script, const char* source) {
+    VMConfig config  = VM_CONFIG_DEFAULT;
+    config.use_tiers = false;
+    VM*   vm     = vm_create(&config);
+    char* result = run_on_vm(vm, script, source);
+    vm_destroy(vm);
+    return result;
+}
+
+static char* run_script(const char* source, OptimizeFlags flags) {
+    ObjFunction* script = compile("script", source, flags);
+    if (script == NULL)
+        return NULL;
+    return run_function(script, source);
+}
+
+// Frees `output`, which may be NULL.
+static bool output_equals(char* output, const char* expected) {
+    bool result = output != NULL && strcmp(output, expected) == 0;
+    free(output);
+    return result;
+}
+
+
+// Whether the source prints `expected` both when compiled without and
+// with all optimizations.
+static bool optimized_output_equals(const char* source, const char* expected) {
+    bool unoptimized = output_equals(run_script(source, OPTIMIZE_NONE), expected);
+    bool optimized   = output_equals(run_script(source, OPTIMIZE_ALL),  expected);
+    return unoptimized && optimized;
+}
+
+// Whether the source prints `expected` without the tiers, with them, and
+// with the JIT. Hot code has to run often enough to be promoted.
+static bool tiered_output_equals(const char* source, const char* expected) {
+    bool result = output_equals(run_script(source, OPTIMIZE_TIER_0), expected);
+    for (int jit = 0; jit < 2; ++jit) {
+        VMConfig config = VM_CONFIG_DEFAULT;
+        config.use_jit  = jit;
+        VM* vm = vm_create(&config);
+        result = output_equals(run_on_vm(vm, compile("script", source, OPTIMIZE_TIER_0), source), expected) && result;
+        vm_destroy(vm);
+    }
+    return result;
+}
+
+static bool chunk_contains(const Chunk* chunk, u8 opcode) {
+    for (int i = 0; i < chunk->count; i += chunk_instruction_size(chunk->code[i])) {
+        if (chunk->code[i] == opcode)
+            return true;
+    }
+    return false;
+}
+
+// Finds a function by name among the constants of `function`, at any depth.
+static ObjFunction* find_function(ObjFunction* function, const char* name) {
+    if (function->name != NULL && strcmp(function->name->data, name) == 0)
+        return function;
+    for (int i = 0; i < function->chunk.constant_count; ++i) {
+        if (!IS_FUNCTION(function->chunk.constants[i]))
+            continue;
+        ObjFunction* found = find_function(AS_FUNCTION(AS_OBJ(function->chunk.constants[i])), name);
+        if (found != NULL)
+            return found;
+    }
+    return NULL;
+}
@@ -378,11 +378,14 @@ void check_output(const Option* options, TestSuitInfo* test_suit_info, const Tes
 
 
 typedef bool (*TestFunction)(Option options);
-void run_tests(const TestFunction* functions, int count, Option option) {
+// Returns whether all test suites succeeded.
+bool run_tests(const TestFunction* functions, int count, Option option) {
     // TODO: Allow parallelization.
+    bool succeeded = true;
     for (int i = 0; i < count; ++i) {
-        functions[i](option);
+        succeeded = functions[i](option) && succeeded;
     }
+    return succeeded;
 }
 #define RUN_TESTS(option, ...) run_tests( (TestFunction[]) { __VA_ARGS__ }, sizeof((TestFunction[]) { __VA_ARGS__ }) / sizeof((TestFunction[]) { __VA_ARGS__ } [0]), options)
 
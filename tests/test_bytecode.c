@@ -0,0 +1,181 @@
+#include "test.h"
+#include "script.h"
+#include "bytecode.h"
+#include "opcodes.h"
+#include "memory.h"
+
+
+static const char* BYTECODE_TEST_PATH   = "test_bytecode.chain";
+static const char* BYTECODE_TEST_SOURCE =
+    "fun add(a, b) { return a + b; }\n"
+    "var s = \"abc\";\n"
+    "print add(1, 2);\n"
+    "print s;\n"
+    "print add(1.5, 2.0);\n";
+
+// The offset of the version in the header, and of the code of the script
+// right after its empty name, arity, upvalue count and code count.
+#define BYTECODE_VERSION_OFFSET 4
+#define BYTECODE_CODE_OFFSET    (4 + 4 + 8 + 4 + 4 + 4 + 4)
+
+
+static bool write_test_cache(void) {
+    ObjFunction* script = compile(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE, OPTIMIZE_ALL);
+    return script != NULL && bytecode_write(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE, script);
+}
+
+// Overwrites the cache with `size` bytes at `offset`.
+static void patch_test_cache(long offset, const void* data, size_t size) {
+    char* path = bytecode_cache_path(BYTECODE_TEST_PATH);
+    FILE* file = fopen(path, "r+b");
+    fseek(file, offset, SEEK_SET);
+    fwrite(data, 1, size, file);
+    fclose(file);
+    free(path);
+}
+
+static void truncate_test_cache(off_t size) {
+    char* path = bytecode_cache_path(BYTECODE_TEST_PATH);
+    truncate(path, size);
+    free(path);
+}
+
+static off_t test_cache_size(void) {
+    char* path = bytecode_cache_path(BYTECODE_TEST_PATH);
+    struct stat info;
+    stat(path, &info);
+    free(path);
+    return info.st_size;
+}
+
+// Writes a cache of a script with the given code and constants.
+static bool write_code_cache(const u8* code, int count, const Value* constants, int constant_count) {
+    ObjFunction* script = function_make();
+    for (int i = 0; i < count; ++i)
+        chunk_write(&script->chunk, code[i], (Location) { 0 });
+    for (int i = 0; i < constant_count; ++i)
+        chunk_add_constant(&script->chunk, constants[i]);
+    return bytecode_write(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE, script);
+}
+
+static void remove_test_cache(void) {
+    char* path = bytecode_cache_path(BYTECODE_TEST_PATH);
+    remove(path);
+    free(path);
+}
+
+
+TEST_SUIT_START(bytecode_cache)
+
+    START_TEST(Round trip)
+        ObjFunction* script = compile(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE, OPTIMIZE_ALL);
+        CHECK_TRUE(script != NULL);
+        CHECK_TRUE(bytecode_write(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE, script));
+
+        ObjFunction* loaded = bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE);
+        CHECK_TRUE(loaded != NULL);
+        CHECK_EQ(loaded->chunk.count, script->chunk.count);
+        CHECK_EQ(memcmp(loaded->chunk.code, script->chunk.code, script->chunk.count), 0);
+        CHECK_EQ(loaded->chunk.constant_count, script->chunk.constant_count);
+        CHECK_EQ(loaded->max_stack, script->max_stack);
+        CHECK_TRUE(output_equals(run_function(loaded, BYTECODE_TEST_SOURCE), "3\n\"abc\"\n3.5\n"));
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects another version)
+        CHECK_TRUE(write_test_cache());
+        u32 version = BYTECODE_VERSION + 1;
+        patch_test_cache(BYTECODE_VERSION_OFFSET, &version, sizeof(version));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects another source)
+        CHECK_TRUE(write_test_cache());
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, "print 1;\n") == NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects a truncated cache)
+        CHECK_TRUE(write_test_cache());
+        off_t size = test_cache_size();
+        truncate_test_cache(size - 1);
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        truncate_test_cache(size / 2);
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        truncate_test_cache(0);
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects trailing bytes)
+        CHECK_TRUE(write_test_cache());
+        u8 extra = 0;
+        patch_test_cache((long) test_cache_size(), &extra, sizeof(extra));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects corrupt code)
+        CHECK_TRUE(write_test_cache());
+        u8 opcode = 0xFF;
+        patch_test_cache(BYTECODE_CODE_OFFSET, &opcode, sizeof(opcode));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects out of range operands)
+        Value constants[] = { MAKE_I64(1), MAKE_OBJ(string_make("x", 1)) };
+        const u8 valid[] = { OP_CONSTANT, 0, OP_DEFINE_GLOBAL, 1, OP_EXIT };
+        CHECK_TRUE(write_code_cache(valid, sizeof(valid), constants, 2));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) != NULL);
+
+        const u8 constant[] = { OP_CONSTANT, 2, OP_POP, OP_EXIT };
+        CHECK_TRUE(write_code_cache(constant, sizeof(constant), constants, 2));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+
+        const u8 global[] = { OP_GET_GLOBAL, 0, OP_POP, OP_EXIT };
+        CHECK_TRUE(write_code_cache(global, sizeof(global), constants, 2));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+
+        const u8 local[] = { OP_GET_LOCAL, 200, OP_POP, OP_EXIT };
+        CHECK_TRUE(write_code_cache(local, sizeof(local), constants, 2));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+
+        const u8 upvalue[] = { OP_GET_UPVALUE, 0, OP_POP, OP_EXIT };
+        CHECK_TRUE(write_code_cache(upvalue, sizeof(upvalue), constants, 2));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+
+        const u8 enclosing[] = { OP_GET_ENCLOSING, 0, OP_POP, OP_EXIT };
+        CHECK_TRUE(write_code_cache(enclosing, sizeof(enclosing), constants, 2));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects out of range captures)
+        ObjFunction* inner = function_make();
+        inner->upvalue_count = 1;
+        inner->captures      = ALLOCATE_ARRAY(Capture, 1);
+        inner->captures[0]   = (Capture) { .index=100, .is_local=true };
+        chunk_write(&inner->chunk, OP_NULL,   (Location) { 0 });
+        chunk_write(&inner->chunk, OP_RETURN, (Location) { 0 });
+
+        Value constants[] = { MAKE_OBJ(inner) };
+        const u8 code[] = { OP_CLOSURE, 0, OP_POP, OP_EXIT };
+        CHECK_TRUE(write_code_cache(code, sizeof(code), constants, 1));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+
+        inner->captures[0] = (Capture) { .index=0, .is_local=true };
+        CHECK_TRUE(write_code_cache(code, sizeof(code), constants, 1));
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) != NULL);
+        remove_test_cache();
+    END_TEST
+
+    START_TEST(Rejects a bad magic)
+        CHECK_TRUE(write_test_cache());
+        patch_test_cache(0, "XXXX", 4);
+        CHECK_TRUE(bytecode_load(BYTECODE_TEST_PATH, BYTECODE_TEST_SOURCE) == NULL);
+        remove_test_cache();
+    END_TEST
+
+TEST_SUIT_END
@@ -0,0 +1,112 @@
+#include "test.h"
+#include "chunk.h"
+#include "opcodes.h"
+#include "native.h"
+
+
+// The most values on the stack while running `code` from a stack with
+// one value, as the callee of a function without parameters.
+static int max_stack_of(const u8* code, int count) {
+    Chunk chunk = chunk_make();
+    for (int i = 0; i < count; ++i)
+        chunk_write(&chunk, code[i], (Location) { 0 });
+    int max = chunk_max_stack(&chunk, 1);
+    chunk_free(&chunk);
+    return max;
+}
+
+#define MAX_STACK_OF(...) max_stack_of((const u8[]) { __VA_ARGS__ }, sizeof((const u8[]) { __VA_ARGS__ }))
+
+
+TEST_SUIT_START(chunk)
+
+    START_TEST(Max stack of straight-line code)
+        CHECK_EQ(MAX_STACK_OF(OP_EXIT), 1);
+        CHECK_EQ(MAX_STACK_OF(OP_CONSTANT, 0, OP_CONSTANT, 0, OP_ADD, OP_PRINT, OP_EXIT), 3);
+        CHECK_EQ(MAX_STACK_OF(OP_POP, OP_POP, OP_EXIT), -1);
+    END_TEST
+
+    START_TEST(Max stack of balanced branches)
+        // if (true) 1; else print null + null;
+        CHECK_EQ(MAX_STACK_OF(
+            /*  0 */ OP_TRUE,
+            /*  1 */ OP_JUMP_IF_FALSE, 0, 6,
+            /*  4 */ OP_POP,
+            /*  5 */ OP_CONSTANT, 0,
+            /*  7 */ OP_JUMP, 0, 4,
+            /* 10 */ OP_POP,
+            /* 11 */ OP_NULL,
+            /* 12 */ OP_NULL,
+            /* 13 */ OP_ADD,
+            /* 14 */ OP_PRINT,
+            /* 15 */ OP_EXIT
+        ), 3);
+    END_TEST
+
+    START_TEST(Max stack of a loop)
+        CHECK_EQ(MAX_STACK_OF(
+            /*  0 */ OP_TRUE,
+            /*  1 */ OP_JUMP_IF_FALSE, 0, 8,
+            /*  4 */ OP_POP,
+            /*  5 */ OP_NULL,
+            /*  6 */ OP_NULL,
+            /*  7 */ OP_ADD,
+            /*  8 */ OP_POP,
+            /*  9 */ OP_LOOP, 0, 12,
+            /* 12 */ OP_POP,
+            /* 13 */ OP_EXIT
+        ), 3);
+    END_TEST
+
+    START_TEST(Max stack rejects unbalanced merges)
+        // The else branch leaves one value more than the then branch.
+        CHECK_EQ(MAX_STACK_OF(
+            /*  0 */ OP_TRUE,
+            /*  1 */ OP_JUMP_IF_FALSE, 0, 6,
+            /*  4 */ OP_POP,
+            /*  5 */ OP_CONSTANT, 0,
+            /*  7 */ OP_JUMP, 0, 4,
+            /* 10 */ OP_POP,
+            /* 11 */ OP_NULL,
+            /* 12 */ OP_NULL,
+            /* 13 */ OP_NULL,
+            /* 14 */ OP_PRINT,
+            /* 15 */ OP_EXIT
+        ), -1);
+
+        // A loop whose body pushes a value on each iteration.
+        CHECK_EQ(MAX_STACK_OF(OP_NULL, OP_LOOP, 0, 4, OP_EXIT), -1);
+    END_TEST
+
+    START_TEST(Max stack rejects jumps out of the chunk)
+        CHECK_EQ(MAX_STACK_OF(OP_JUMP, 0, 100, OP_EXIT), -1);
+        CHECK_EQ(MAX_STACK_OF(OP_LOOP, 0, 100, OP_EXIT), -1);
+        CHECK_EQ(MAX_STACK_OF(OP_TRUE, OP_JUMP_IF_TRUE, 0xFF, 0xFF, OP_EXIT), -1);
+        // The end of the chunk is a valid target, but the operand of a
+        // jump can't be cut off by it.
+        CHECK_EQ(MAX_STACK_OF(OP_JUMP, 0, 0), 1);
+        CHECK_EQ(MAX_STACK_OF(OP_NULL, OP_POP, OP_JUMP, 0), -1);
+        CHECK_EQ(MAX_STACK_OF(0xFF), -1);
+    END_TEST
+
+    START_TEST(Max stack pops the arguments of calls)
+        // The callee, two arguments and then the result.
+        CHECK_EQ(MAX_STACK_OF(OP_GET_LOCAL, 0, OP_CONSTANT, 0, OP_CONSTANT, 0, OP_CALL, 2, OP_POP, OP_POP, OP_EXIT), 4);
+        CHECK_EQ(MAX_STACK_OF(OP_GET_LOCAL, 0, OP_CONSTANT, 0, OP_CALL, 1, OP_POP, OP_POP, OP_POP, OP_EXIT), -1);
+        CHECK_EQ(MAX_STACK_OF(OP_CONSTANT, 0, OP_CALL, 5, OP_POP, OP_EXIT), -1);
+        CHECK_EQ(MAX_STACK_OF(OP_GET_LOCAL, 0, OP_CONSTANT, 0, OP_TAIL_CALL, 1, OP_RETURN), 3);
+    END_TEST
+
+    START_TEST(Max stack pops the arguments of typed natives)
+        u8 pow   = (u8) typed_native_find(SLICE("pow"));
+        u8 sqrt_ = (u8) typed_native_find(SLICE("sqrt"));
+        u8 clock = (u8) typed_native_find(SLICE("clock"));
+        CHECK_EQ(MAX_STACK_OF(OP_CONSTANT, 0, OP_CONSTANT, 0, OP_CALL_NATIVE_TYPED, pow, OP_POP, OP_EXIT), 3);
+        CHECK_EQ(MAX_STACK_OF(OP_CONSTANT, 0, OP_CALL_NATIVE_TYPED, sqrt_, OP_POP, OP_EXIT), 2);
+        CHECK_EQ(MAX_STACK_OF(OP_CALL_NATIVE_TYPED, clock, OP_POP, OP_EXIT), 2);
+        // pow pops two values, so nothing is left for the second OP_POP.
+        CHECK_EQ(MAX_STACK_OF(OP_CONSTANT, 0, OP_CALL_NATIVE_TYPED, pow, OP_POP, OP_POP, OP_EXIT), -1);
+        CHECK_EQ(MAX_STACK_OF(OP_CALL_NATIVE_TYPED, (u8) TYPED_NATIVE_COUNT, OP_POP, OP_EXIT), -1);
+    END_TEST
+
+TEST_SUIT_END
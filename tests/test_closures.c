@@ -0,0 +1,120 @@
+#include "test.h"
+#include "script.h"
+
+
+TEST_SUIT_START(closures)
+
+    START_TEST(Captures of a local function stay on the enclosing frame)
+        const char* source =
+            "fun outer(n) {\n"
+            "    var total = 0;\n"
+            "    fun add(x) { total = total + x; }\n"
+            "    add(n);\n"
+            "    add(2);\n"
+            "    return total;\n"
+            "}\n"
+            "var i = 0;\n"
+            "var sum = 0;\n"
+            "while (i < 100) {\n"
+            "    sum = sum + outer(i);\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print outer(5);\n"
+            "print sum;\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        ObjFunction* outer  = find_function(script, "outer");
+        ObjFunction* add    = find_function(script, "add");
+        CHECK_TRUE(!chunk_contains(&outer->chunk, OP_CLOSURE));
+        CHECK_TRUE(chunk_contains(&add->chunk, OP_GET_ENCLOSING));
+        CHECK_TRUE(chunk_contains(&add->chunk, OP_SET_ENCLOSING));
+        CHECK_TRUE(!chunk_contains(&add->chunk, OP_GET_UPVALUE));
+        CHECK_TRUE(tiered_output_equals(source, "7\n5150\n"));
+    END_TEST
+
+    START_TEST(Escaping functions become heap closures)
+        const char* source =
+            "fun counter() {\n"
+            "    var count = 0;\n"
+            "    fun next() {\n"
+            "        count = count + 1;\n"
+            "        return count;\n"
+            "    }\n"
+            "    return next;\n"
+            "}\n"
+            "var a = counter();\n"
+            "var b = counter();\n"
+            "print a();\n"
+            "print a();\n"
+            "print b();\n"
+            "var i = 0;\n"
+            "while (i < 100) {\n"
+            "    a();\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print a();\n"
+            "print b();\n";
+
+        ObjFunction* script  = compile("script", source, OPTIMIZE_NONE);
+        ObjFunction* counter = find_function(script, "counter");
+        ObjFunction* next    = find_function(script, "next");
+        CHECK_TRUE(chunk_contains(&counter->chunk, OP_CLOSURE));
+        CHECK_TRUE(chunk_contains(&next->chunk, OP_GET_UPVALUE));
+        CHECK_TRUE(chunk_contains(&next->chunk, OP_SET_UPVALUE));
+        CHECK_TRUE(!chunk_contains(&next->chunk, OP_GET_ENCLOSING));
+        CHECK_TRUE(tiered_output_equals(source, "1\n2\n1\n103\n2\n"));
+    END_TEST
+
+    START_TEST(Recursive local functions become heap closures)
+        // The function reads its own name as an upvalue, so it can't rely
+        // on the frame below it being the one that declared it.
+        const char* source =
+            "fun sum_to(n) {\n"
+            "    var step = 1;\n"
+            "    fun walk(i) {\n"
+            "        if (i > n) return 0;\n"
+            "        return i + walk(i + step);\n"
+            "    }\n"
+            "    return walk(1);\n"
+            "}\n"
+            "var i = 0;\n"
+            "var sum = 0;\n"
+            "while (i < 100) {\n"
+            "    sum = sum + sum_to(i);\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print sum_to(10);\n"
+            "print sum;\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&find_function(script, "sum_to")->chunk, OP_CLOSURE));
+        CHECK_TRUE(!chunk_contains(&find_function(script, "walk")->chunk, OP_GET_ENCLOSING));
+        CHECK_TRUE(tiered_output_equals(source, "55\n166650\n"));
+    END_TEST
+
+    START_TEST(Tail calls to functions on the enclosing frame return their value)
+        // The call is compiled as a tail call, but `add` reads `base` from
+        // the frame that a tail call would replace, so it's made as an
+        // ordinary call.
+        const char* source =
+            "fun outer(x) {\n"
+            "    var base = 10;\n"
+            "    fun add(y) { return base + y; }\n"
+            "    return add(x);\n"
+            "}\n"
+            "var i = 0;\n"
+            "var sum = 0;\n"
+            "while (i < 100) {\n"
+            "    sum = sum + outer(i);\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print outer(5);\n"
+            "print sum;\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&find_function(script, "outer")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(chunk_contains(&find_function(script, "add")->chunk, OP_GET_ENCLOSING));
+        CHECK_TRUE(tiered_output_equals(source, "15\n5950\n"));
+    END_TEST
+
+TEST_SUIT_END
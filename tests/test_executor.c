@@ -0,0 +1,84 @@
+#include "test.h"
+#include "script.h"
+#include "executor.h"
+
+
+static const char* EXECUTOR_TEST_SOURCE =
+    "var total = 0;\n"
+    "fun adder() {\n"
+    "    var sum = 0;\n"
+    "    fun add(x) {\n"
+    "        sum = sum + x;\n"
+    "        return sum;\n"
+    "    }\n"
+    "    return add;\n"
+    "}\n"
+    "var add = adder();\n"
+    "var i = 0;\n"
+    "while (i < 100) {\n"
+    "    total = add(i);\n"
+    "    i = i + 1;\n"
+    "}\n"
+    "print total;\n";
+
+// Counts the lines of `output` that are `line`, and frees it.
+static int count_lines(char* output, const char* line) {
+    int count  = 0;
+    int length = (int) strlen(line);
+    for (char* at = output; *at != '\0'; at = strchr(at, '\n') + 1) {
+        count += strncmp(at, line, (size_t) length) == 0 && at[length] == '\n';
+    }
+    free(output);
+    return count;
+}
+
+
+TEST_SUIT_START(executor)
+
+    START_TEST(Runs a script on many workers)
+        ObjFunction* script = compile("script", EXECUTOR_TEST_SOURCE, OPTIMIZE_ALL);
+        ExecutorConfig config = { .worker_count=4, .run_count=64, .vm=VM_CONFIG_DEFAULT };
+
+        OutputCapture capture = output_capture_begin(STDOUT_FILENO);
+        int failed = executor_run(&config, "script", EXECUTOR_TEST_SOURCE, script, true);
+        char* output = output_capture_end(capture);
+        CHECK_EQ(failed, 0);
+        CHECK_EQ(count_lines(output, "4950"), 64);
+    END_TEST
+
+    START_TEST(Counts the runs that fail)
+        const char*  source = "print 1;\nprint undefined;\n";
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        ExecutorConfig config = { .worker_count=3, .run_count=10, .vm=VM_CONFIG_DEFAULT };
+
+        OutputCapture capture = output_capture_begin(STDOUT_FILENO);
+        int failed = executor_run(&config, "script", source, script, true);
+        char* output = output_capture_end(capture);
+        CHECK_EQ(failed, 10);
+        CHECK_EQ(count_lines(output, "1"), 10);
+    END_TEST
+
+    START_TEST(Resetting a VM clears its globals)
+        const char* define = "var leftover = 1;\nfun helper() { return 2; }\n";
+        const char* read   = "print leftover;\n";
+        const char* call   = "print helper();\n";
+        const char* native = "var root = sqrt;\nprint root(9.0);\n";
+        ObjFunction* defining = compile("script", define, OPTIMIZE_NONE);
+        ObjFunction* reading  = compile("script", read,   OPTIMIZE_NONE);
+        ObjFunction* calling  = compile("script", call,   OPTIMIZE_NONE);
+        ObjFunction* natives  = compile("script", native, OPTIMIZE_NONE);
+
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, defining, define), ""));
+        CHECK_TRUE(output_equals(run_on_vm(vm, reading,  read), "1\n"));
+        CHECK_TRUE(output_equals(run_on_vm(vm, calling,  call), "2\n"));
+
+        CHECK_EQ(vm_reset(vm), NO_ERROR);
+        CHECK_TRUE(run_on_vm(vm, reading, read) == NULL);
+        CHECK_TRUE(run_on_vm(vm, calling, call) == NULL);
+        // The natives are defined again.
+        CHECK_TRUE(output_equals(run_on_vm(vm, natives, native), "3\n"));
+        vm_destroy(vm);
+    END_TEST
+
+TEST_SUIT_END
@@ -7,8 +7,9 @@ TEST_SUIT_START(chain_expresssion)
 
     START_TEST(Simple expression)
         const char* source = "(1 + 2 + 3*4 + 5) + (6*7 - 8*9*10/11*12);";
-        CHECK_EQ(INTERPRET_OK, vm_interpret(__FILE__, source));
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(vm_interpret(vm, __FILE__, source, false));
+        vm_destroy(vm);
     END_TEST
 
 TEST_SUIT_END
-
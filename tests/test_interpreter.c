@@ -0,0 +1,149 @@
+#include "test.h"
+#include "script.h"
+
+
+TEST_SUIT_START(interpreter)
+
+    START_TEST(Inline caches are not shared between VMs)
+        // Both VMs run the same chunk, which holds the caches, but their
+        // globals name different functions. Nothing is optimized, as the
+        // functions would otherwise be removed as dead globals.
+        const char*  call_source = "print answer();\n";
+        ObjFunction* call  = compile("script", call_source, OPTIMIZE_NONE);
+        ObjFunction* one   = compile("script", "fun answer() { return 1; }\n", OPTIMIZE_NONE);
+        ObjFunction* two   = compile("script", "fun answer() { return 2; }\n", OPTIMIZE_NONE);
+
+        VM* first  = vm_create(NULL);
+        VM* second = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(first,  one, ""), ""));
+        CHECK_TRUE(output_equals(run_on_vm(second, two, ""), ""));
+        CHECK_TRUE(output_equals(run_on_vm(first,  call, call_source), "1\n"));
+        CHECK_TRUE(output_equals(run_on_vm(second, call, call_source), "2\n"));
+        CHECK_TRUE(output_equals(run_on_vm(first,  call, call_source), "1\n"));
+        vm_destroy(first);
+        vm_destroy(second);
+    END_TEST
+
+    START_TEST(Inline caches see redefined functions)
+        const char* source =
+            "fun answer() { return 1; }\n"
+            "fun relay() { return answer(); }\n"
+            "print relay();\n"
+            "fun answer() { return 2; }\n"
+            "print relay();\n";
+
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, compile("script", source, OPTIMIZE_NONE), source), "1\n2\n"));
+        vm_destroy(vm);
+    END_TEST
+
+    START_TEST(Open upvalues survive the stack growing)
+        // The recursion needs more than the initial stack and frames, while
+        // `captured` is open in the frame of `outer`.
+        CHECK_TRUE(tiered_output_equals(
+            "fun deep(n, probe) {\n"
+            "    if (n == 0) return probe();\n"
+            "    return deep(n - 1, probe) + 0;\n"
+            "}\n"
+            "fun outer() {\n"
+            "    var captured = 1;\n"
+            "    fun get() { return captured; }\n"
+            "    fun put(v) { captured = v; }\n"
+            "    print deep(2000, get);\n"
+            "    put(captured + 41);\n"
+            "    print deep(3000, get);\n"
+            "    print captured;\n"
+            "    return get;\n"
+            "}\n"
+            "var get = outer();\n"
+            "print get();\n",
+            "1\n42\n42\n42\n"
+        ));
+    END_TEST
+
+    START_TEST(Open upvalues of a coroutine survive its stack growing)
+        CHECK_TRUE(tiered_output_equals(
+            "fun deep(n, probe) {\n"
+            "    if (n == 0) return probe();\n"
+            "    return deep(n - 1, probe) + 0;\n"
+            "}\n"
+            "fun body() {\n"
+            "    var captured = 7;\n"
+            "    fun get() { return captured; }\n"
+            "    fun put(v) { captured = v; }\n"
+            "    yield deep(2000, get);\n"
+            "    put(captured * 6);\n"
+            "    yield deep(3000, get);\n"
+            "    return captured;\n"
+            "}\n"
+            "fun one() { return 1; }\n"
+            "var co = coroutine(body);\n"
+            "print resume(co);\n"
+            "print deep(2500, one);\n"
+            "print resume(co);\n"
+            "print resume(co);\n",
+            "7\n1\n42\n42\n"
+        ));
+    END_TEST
+
+    START_TEST(Overflows at the limits of the config)
+        const char* shallow  = "fun deep(n) {\n    if (n == 0) return 0;\n    return deep(n - 1) + 1;\n}\nprint deep(10);\n";
+        const char* too_deep = "fun deep(n) {\n    if (n == 0) return 0;\n    return deep(n - 1) + 1;\n}\nprint deep(100);\n";
+
+        // Few frames, but plenty of stack.
+        VMConfig frames = { .stack_size=VM_STACK_MAX, .frame_count=32, .use_tiers=false };
+        // Plenty of frames, but little stack.
+        VMConfig values = { .stack_size=64, .frame_count=VM_FRAMES_MAX, .use_tiers=false };
+        VMConfig configs[] = { frames, values };
+        for (int i = 0; i < 2; ++i) {
+            VM* vm = vm_create(&configs[i]);
+            CHECK_TRUE(output_equals(run_on_vm(vm, compile("script", shallow, OPTIMIZE_NONE), shallow), "10\n"));
+            CHECK_TRUE(run_on_vm(vm, compile("script", too_deep, OPTIMIZE_NONE), too_deep) == NULL);
+            // The VM can run again after the overflow.
+            CHECK_TRUE(output_equals(run_on_vm(vm, compile("script", shallow, OPTIMIZE_NONE), shallow), "10\n"));
+            vm_destroy(vm);
+        }
+    END_TEST
+
+    START_TEST(And and or skip the right operand)
+        const char* source =
+            "fun loud(x) {\n"
+            "    print x;\n"
+            "    return x;\n"
+            "}\n"
+            "var calls = 0;\n"
+            "fun touch() {\n"
+            "    calls = calls + 1;\n"
+            "    return true;\n"
+            "}\n"
+            "print false and loud(1);\n"
+            "print true or loud(2);\n"
+            "print true and loud(3);\n"
+            "print false or loud(4);\n"
+            "var i = 0;\n"
+            "var hits = 0;\n"
+            "while (i < 2000) {\n"
+            "    if (i < 0 and touch()) hits = hits + 1;\n"
+            "    if (i >= 0 or touch()) hits = hits + 1;\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print calls;\n"
+            "print hits;\n";
+
+        CHECK_TRUE(tiered_output_equals(source, "false\ntrue\n3\n3\n4\n4\n0\n2000\n"));
+    END_TEST
+
+    START_TEST(And and or result in the operand that decided them)
+        const char* source =
+            "print 1 and 2;\n"
+            "print 0 and 2;\n"
+            "print false or 0;\n"
+            "print 0 or 1.5;\n"
+            "print 0.0 or 0;\n"
+            "print 1 or false;\n";
+
+        CHECK_TRUE(output_equals(run_script(source, OPTIMIZE_NONE), "2\n0\n0\n1.5\n0\n1\n"));
+        CHECK_TRUE(output_equals(run_script(source, OPTIMIZE_ALL),  "2\n0\n0\n1.5\n0\n1\n"));
+    END_TEST
+
+TEST_SUIT_END
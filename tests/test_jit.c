@@ -0,0 +1,140 @@
+#include "test.h"
+#include "script.h"
+#include "jit.h"
+
+
+/* Whether the source prints `expected` both in the interpreter without
+ * the tiers and with the JIT, and the function `name` (the script if
+ * it's NULL) got compiled into native code on the way. */
+static bool jit_output_equals(const char* source, const char* name, const char* expected) {
+    ObjFunction* script = compile("script", source, OPTIMIZE_TIER_0);
+    VMConfig config = VM_CONFIG_DEFAULT;
+    config.use_jit  = true;
+    VM* vm = vm_create(&config);
+    bool result = output_equals(run_on_vm(vm, script, source), expected);
+    ObjFunction* function = (name == NULL) ? script : find_function(script, name);
+    result = result && (!JIT_SUPPORTED || function->jit != NULL);
+    vm_destroy(vm);
+
+    return output_equals(run_script(source, OPTIMIZE_TIER_0), expected) && result;
+}
+
+TEST_SUIT_START(jit)
+
+    START_TEST(A type guard leaves the native code in the middle of a loop)
+        // The additions are on integers when the loop is compiled, and on
+        // floats after the first half.
+        const char* source =
+            "fun mix(n) {\n"
+            "    var x = 0;\n"
+            "    var step = 1;\n"
+            "    var i = 0;\n"
+            "    while (i < n) {\n"
+            "        x = x + step;\n"
+            "        i = i + 1;\n"
+            "        if (i == 1500) {\n"
+            "            x = 0.5;\n"
+            "            step = 1.5;\n"
+            "        }\n"
+            "    }\n"
+            "    return x;\n"
+            "}\n"
+            "print mix(3000);\n"
+            "print mix(3000);\n"
+            "print mix(1000);\n";
+
+        CHECK_TRUE(jit_output_equals(source, "mix", "2250.5\n2250.5\n1000\n"));
+    END_TEST
+
+    START_TEST(Branches on values that are not booleans)
+        const char* source =
+            "fun classify(x) {\n"
+            "    if (x) return 1;\n"
+            "    return 0;\n"
+            "}\n"
+            "fun countdown(n) {\n"
+            "    var steps = 0;\n"
+            "    while (n) {\n"
+            "        steps = steps + 1;\n"
+            "        n = n - 1;\n"
+            "    }\n"
+            "    return steps;\n"
+            "}\n"
+            "var i = 0;\n"
+            "var total = 0;\n"
+            "while (i < 200) {\n"
+            "    total = total + classify(i) + classify(i - i) + classify(0.0) + classify(1.5);\n"
+            "    total = total + classify(\"s\") + classify(false) + classify(true);\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print total;\n"
+            "print countdown(5000);\n";
+
+        CHECK_TRUE(jit_output_equals(source, "classify", "799\n5000\n"));
+        CHECK_TRUE(jit_output_equals(source, "countdown", "799\n5000\n"));
+    END_TEST
+
+    START_TEST(Globals are read written and defined from native code)
+        // The script itself is compiled after enough back-edges, so the
+        // globals after the loop are defined by the native code.
+        const char* source =
+            "var counter = 0;\n"
+            "fun bump() {\n"
+            "    counter = counter + 1;\n"
+            "    return counter;\n"
+            "}\n"
+            "var i = 0;\n"
+            "var total = 0;\n"
+            "while (i < 3000) {\n"
+            "    total = total + bump();\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "var after = total + counter;\n"
+            "print after;\n"
+            "print counter;\n";
+
+        CHECK_TRUE(jit_output_equals(source, "bump", "4504500\n3000\n"));
+        CHECK_TRUE(jit_output_equals(source, NULL, "4504500\n3000\n"));
+    END_TEST
+
+    START_TEST(Setting an undefined global from native code fails)
+        const char* source =
+            "fun poke(k) {\n"
+            "    if (k == 100) missing = 1;\n"
+            "    return k;\n"
+            "}\n"
+            "var i = 0;\n"
+            "while (i < 200) {\n"
+            "    poke(i);\n"
+            "    i = i + 1;\n"
+            "}\n";
+
+        VMConfig config = VM_CONFIG_DEFAULT;
+        config.use_jit  = true;
+        VM* vm = vm_create(&config);
+        CHECK_TRUE(run_on_vm(vm, compile("script", source, OPTIMIZE_TIER_0), source) == NULL);
+        vm_destroy(vm);
+    END_TEST
+
+    START_TEST(Calls return into native code)
+        const char* source =
+            "fun inc(x) {\n"
+            "    return x + 1;\n"
+            "}\n"
+            "fun run(n) {\n"
+            "    var i = 0;\n"
+            "    var total = 0;\n"
+            "    while (i < n) {\n"
+            "        total = inc(total) + i;\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    return total;\n"
+            "}\n"
+            "print run(5000);\n"
+            "print run(10);\n";
+
+        CHECK_TRUE(jit_output_equals(source, "run", "12502500\n55\n"));
+        CHECK_TRUE(jit_output_equals(source, "inc", "12502500\n55\n"));
+    END_TEST
+
+TEST_SUIT_END
@@ -0,0 +1,61 @@
+#include "test.h"
+#include "script.h"
+#include "native.h"
+
+
+TEST_SUIT_START(typed_natives)
+
+    START_TEST(Typed natives are called without boxing)
+        const char* source = "print sqrt(16.0);\nprint pow(2.0, 10.0);\nprint to_int(2.7);\n";
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&script->chunk, OP_CALL_NATIVE_TYPED));
+        CHECK_TRUE(!chunk_contains(&script->chunk, OP_CALL));
+        CHECK_TRUE(tiered_output_equals(source, "4\n1024\n2\n"));
+    END_TEST
+
+    START_TEST(Integer constants become floats at compile time)
+        const char* source = "print sqrt(16);\nprint pow(2, 10);\nprint to_int(3);\n";
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        int floats = 0;
+        for (int i = 0; i < script->chunk.constant_count; ++i) {
+            CHECK_TRUE(!IS_I64(script->chunk.constants[i]));
+            floats += IS_F64(script->chunk.constants[i]);
+        }
+        CHECK_EQ(floats, 4);
+        CHECK_TRUE(tiered_output_equals(source, "4\n1024\n3\n"));
+    END_TEST
+
+    START_TEST(Wrong arguments are compile errors)
+        // Only constant arguments have a type before they're run.
+        CHECK_TRUE(compile("script", "print sqrt(\"a\");\n",     OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(compile("script", "print sqrt(1.0, 2.0);\n",  OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(compile("script", "print pow(1.0);\n",        OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(compile("script", "print clock(1.0);\n",      OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(compile("script", "var sqrt = 1;\nsqrt = 2;\n", OPTIMIZE_NONE) == NULL);
+    END_TEST
+
+    START_TEST(The tags of other arguments are checked at run time)
+        // Integers are converted, and anything else is an error.
+        CHECK_TRUE(tiered_output_equals("var x = 4;\nprint sqrt(x);\nprint pow(x, 0.5);\n", "2\n2\n"));
+        CHECK_TRUE(run_script("var x = \"a\";\nprint sqrt(x);\n", OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(run_script("print sqrt(true);\n", OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(run_script("var x = false;\nprint pow(2.0, x);\n", OPTIMIZE_NONE) == NULL);
+        CHECK_TRUE(run_script("var x = \"a\";\nprint to_int(x);\n", OPTIMIZE_NONE) == NULL);
+    END_TEST
+
+    START_TEST(Typed natives can be used as values)
+        // Without a call right after the name, the boxed native is used.
+        const char* source =
+            "var root = sqrt;\n"
+            "var power = pow;\n"
+            "print root(9.0);\n"
+            "print power(2.0, 3.0);\n"
+            "print power(2, 3);\n"
+            "fun apply(op, x) { return op(x); }\n"
+            "print apply(sqrt, 25.0);\n";
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(!chunk_contains(&script->chunk, OP_CALL_NATIVE_TYPED));
+        CHECK_TRUE(tiered_output_equals(source, "3\n8\n8\n5\n"));
+    END_TEST
+
+TEST_SUIT_END
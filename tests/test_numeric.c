@@ -0,0 +1,135 @@
+#include "test.h"
+#include "numeric.h"
+
+
+// Every kernel runs at these lengths, so that each vector loop and each
+// tail after it runs at least once.
+static const int NUMERIC_TEST_LENGTHS[] = { 0, 1, 3, 5, 9 };
+#define NUMERIC_TEST_MAX_LENGTH 9
+
+// Small integers, so that the sums of the floats are exact in any order.
+static void numeric_test_data(f64* f, i64* i, int count, int seed) {
+    for (int k = 0; k < count; ++k) {
+        i[k] = ((k * 7 + seed * 3) % 11) - 5;
+        f[k] = (f64) i[k];
+    }
+}
+
+// Runs all kernels on the current path and returns the number of wrong results.
+static int numeric_test_kernels(void) {
+    int wrong = 0;
+    for (int l = 0; l < (int) (sizeof(NUMERIC_TEST_LENGTHS) / sizeof(*NUMERIC_TEST_LENGTHS)); ++l) {
+        int count = NUMERIC_TEST_LENGTHS[l];
+        f64 xf[NUMERIC_TEST_MAX_LENGTH], yf[NUMERIC_TEST_MAX_LENGTH], zf[NUMERIC_TEST_MAX_LENGTH];
+        i64 xi[NUMERIC_TEST_MAX_LENGTH], yi[NUMERIC_TEST_MAX_LENGTH], zi[NUMERIC_TEST_MAX_LENGTH];
+        numeric_test_data(xf, xi, count, 1);
+        numeric_test_data(yf, yi, count, 2);
+
+        f64 sum_f = 0, dot_f = 0;
+        i64 sum_i = 0, dot_i = 0;
+        for (int k = 0; k < count; ++k) {
+            sum_f += xf[k];
+            sum_i += xi[k];
+            dot_f += xf[k] * yf[k];
+            dot_i += xi[k] * yi[k];
+        }
+        wrong += numeric_sum_f64(xf, count) != sum_f;
+        wrong += numeric_sum_i64(xi, count) != sum_i;
+        wrong += numeric_dot_f64(xf, yf, count) != dot_f;
+        wrong += numeric_dot_i64(xi, yi, count) != dot_i;
+
+        if (count > 0) {
+            f64 min_f = xf[0], max_f = xf[0];
+            i64 min_i = xi[0], max_i = xi[0];
+            for (int k = 1; k < count; ++k) {
+                min_f = (xf[k] < min_f) ? xf[k] : min_f;
+                max_f = (xf[k] > max_f) ? xf[k] : max_f;
+                min_i = (xi[k] < min_i) ? xi[k] : min_i;
+                max_i = (xi[k] > max_i) ? xi[k] : max_i;
+            }
+            wrong += numeric_min_f64(xf, count) != min_f;
+            wrong += numeric_max_f64(xf, count) != max_f;
+            wrong += numeric_min_i64(xi, count) != min_i;
+            wrong += numeric_max_i64(xi, count) != max_i;
+        }
+
+        memcpy(zf, yf, sizeof(f64) * (size_t) count);
+        numeric_axpy_f64(2.0, xf, zf, count);
+        for (int k = 0; k < count; ++k)
+            wrong += zf[k] != 2.0 * xf[k] + yf[k];
+
+        numeric_add_scalar_f64(xf, 0.5, zf, count);
+        numeric_add_scalar_i64(xi, 3, zi, count);
+        for (int k = 0; k < count; ++k) {
+            wrong += zf[k] != xf[k] + 0.5;
+            wrong += zi[k] != xi[k] + 3;
+        }
+        // In place, and wrapping on overflow.
+        zi[0] = INT64_MAX;
+        numeric_add_scalar_i64(zi, 1, zi, count > 0 ? 1 : 0);
+        wrong += count > 0 && zi[0] != INT64_MIN;
+
+        memcpy(zf, xf, sizeof(f64) * (size_t) count);
+        memcpy(zi, xi, sizeof(i64) * (size_t) count);
+        numeric_sort_f64(zf, count);
+        numeric_sort_i64(zi, count);
+        for (int k = 1; k < count; ++k) {
+            wrong += zf[k - 1] > zf[k];
+            wrong += zi[k - 1] > zi[k];
+        }
+        wrong += numeric_sum_i64(zi, count) != sum_i;
+
+        memcpy(zf, xf, sizeof(f64) * (size_t) count);
+        memcpy(zi, xi, sizeof(i64) * (size_t) count);
+        numeric_prefix_sum_f64(zf, count);
+        numeric_prefix_sum_i64(zi, count);
+        f64 running_f = 0;
+        i64 running_i = 0;
+        for (int k = 0; k < count; ++k) {
+            running_f += xf[k];
+            running_i += xi[k];
+            wrong += zf[k] != running_f;
+            wrong += zi[k] != running_i;
+        }
+    }
+    return wrong;
+}
+
+
+TEST_SUIT_START(numeric)
+
+    START_TEST(Kernels on the best path)
+        numeric_force_path(NUMERIC_BEST);
+        CHECK_EQ(numeric_test_kernels(), 0);
+    END_TEST
+
+    START_TEST(Kernels on the SSE2 path)
+        numeric_force_path(NUMERIC_SSE2);
+        CHECK_TRUE(numeric_path() <= NUMERIC_SSE2);
+        CHECK_EQ(numeric_test_kernels(), 0);
+        numeric_force_path(NUMERIC_BEST);
+    END_TEST
+
+    START_TEST(Kernels on the scalar path)
+        numeric_force_path(NUMERIC_SCALAR);
+        CHECK_EQ(numeric_path(), NUMERIC_SCALAR);
+        CHECK_EQ(numeric_test_kernels(), 0);
+        numeric_force_path(NUMERIC_BEST);
+    END_TEST
+
+    START_TEST(Inexact sums of floats stay close)
+        f64 x[NUMERIC_TEST_MAX_LENGTH];
+        f64 expected = 0;
+        for (int k = 0; k < NUMERIC_TEST_MAX_LENGTH; ++k) {
+            x[k] = 1.0 / (k + 1);
+            expected += x[k];
+        }
+        for (int path = NUMERIC_SCALAR; path <= NUMERIC_BEST; ++path) {
+            numeric_force_path((NumericPath) path);
+            f64 difference = numeric_sum_f64(x, NUMERIC_TEST_MAX_LENGTH) - expected;
+            CHECK_TRUE(difference < 1e-12 && difference > -1e-12);
+        }
+        numeric_force_path(NUMERIC_BEST);
+    END_TEST
+
+TEST_SUIT_END
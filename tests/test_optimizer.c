@@ -0,0 +1,289 @@
+#include "test.h"
+#include "script.h"
+
+
+// What the script prints to stderr, where it fails.
+static char* error_trace(const char* source, OptimizeFlags flags) {
+    OutputCapture capture = output_capture_begin(STDERR_FILENO);
+    char* output = run_script(source, flags);
+    char* trace  = output_capture_end(capture);
+    free(output);
+    return trace;
+}
+
+TEST_SUIT_START(optimizer)
+
+    START_TEST(Hoists globals read by the condition)
+        const char* source =
+            "var i = 0;\n"
+            "var limit = 4;\n"
+            "var total = 0;\n"
+            "while (i < limit) {\n"
+            "    total = total + i;\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print total;\n"
+            "print limit;\n";
+
+        // The script has no locals of its own, so a local is the hoisted global.
+        ObjFunction* hoisted = compile("script", source, OPTIMIZE_LOOP_INVARIANTS);
+        ObjFunction* plain   = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&hoisted->chunk, OP_GET_LOCAL));
+        CHECK_TRUE(!chunk_contains(&plain->chunk, OP_GET_LOCAL));
+        CHECK_TRUE(optimized_output_equals(source, "6\n4\n"));
+    END_TEST
+
+    START_TEST(Hoisting moves the locals of the loop)
+        CHECK_TRUE(optimized_output_equals(
+            "var i = 0;\n"
+            "var limit = 3;\n"
+            "while (i < limit) {\n"
+            "    var square = i * i;\n"
+            "    var j = 0;\n"
+            "    while (j < limit) {\n"
+            "        var product = square * j;\n"
+            "        print product;\n"
+            "        j = j + 1;\n"
+            "    }\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print i;\n",
+            "0\n0\n0\n0\n1\n2\n0\n4\n8\n3\n"
+        ));
+    END_TEST
+
+    START_TEST(Keeps globals that the loop assigns)
+        CHECK_TRUE(optimized_output_equals(
+            "var i = 0;\n"
+            "var limit = 10;\n"
+            "while (i < limit) {\n"
+            "    limit = limit - 2;\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print i;\n"
+            "print limit;\n",
+            "4\n2\n"
+        ));
+    END_TEST
+
+    START_TEST(Keeps globals when the loop calls a function)
+        CHECK_TRUE(optimized_output_equals(
+            "var i = 0;\n"
+            "var limit = 5;\n"
+            "fun shrink() { limit = limit - 1; }\n"
+            "while (i < limit) {\n"
+            "    shrink();\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print i;\n"
+            "print limit;\n",
+            "3\n2\n"
+        ));
+    END_TEST
+
+    START_TEST(Keeps globals when the loop resumes a coroutine)
+        CHECK_TRUE(optimized_output_equals(
+            "var limit = 3;\n"
+            "var i = 0;\n"
+            "fun shrink() {\n"
+            "    while (true) {\n"
+            "        limit = limit - 1;\n"
+            "        yield 0;\n"
+            "    }\n"
+            "}\n"
+            "var co = coroutine(shrink);\n"
+            "while (i < limit) {\n"
+            "    resume(co, 0);\n"
+            "    i = i + 1;\n"
+            "    print i;\n"
+            "}\n"
+            "print limit;\n",
+            "1\n2\n1\n"
+        ));
+    END_TEST
+
+    START_TEST(Keeps globals when the loop yields)
+        CHECK_TRUE(optimized_output_equals(
+            "var limit = 3;\n"
+            "fun walk() {\n"
+            "    var n = 0;\n"
+            "    while (n < limit) {\n"
+            "        yield n;\n"
+            "        n = n + 1;\n"
+            "    }\n"
+            "    return 9;\n"
+            "}\n"
+            "var co = coroutine(walk);\n"
+            "print resume(co);\n"
+            "limit = 1;\n"
+            "print resume(co);\n",
+            "0\n9\n"
+        ));
+    END_TEST
+
+    START_TEST(Folds branches on constant conditions)
+        const char* source =
+            "if (true) print 1; else print 2;\n"
+            "if (false) print 3; else print 4;\n"
+            "while (false) print 5;\n"
+            "print true and 6;\n"
+            "print false or 7;\n";
+
+        ObjFunction* optimized = compile("script", source, OPTIMIZE_ALL);
+        CHECK_TRUE(!chunk_contains(&optimized->chunk, OP_JUMP_IF_FALSE));
+        CHECK_TRUE(optimized_output_equals(source, "1\n4\n6\n7\n"));
+    END_TEST
+
+    START_TEST(Removes unreachable code)
+        CHECK_TRUE(optimized_output_equals(
+            "fun pick(x) {\n"
+            "    if (x > 0) return 1;\n"
+            "    else return 2;\n"
+            "    print 3;\n"
+            "}\n"
+            "fun early() {\n"
+            "    return 4;\n"
+            "    print 5;\n"
+            "}\n"
+            "print pick(1);\n"
+            "print pick(0);\n"
+            "print early();\n",
+            "1\n2\n4\n"
+        ));
+    END_TEST
+
+    START_TEST(Removes dead stores)
+        CHECK_TRUE(optimized_output_equals(
+            "fun store(a) {\n"
+            "    var unused = a * 2;\n"
+            "    var x = 1;\n"
+            "    x = a;\n"
+            "    a + 1;\n"
+            "    \"discarded\";\n"
+            "    return x;\n"
+            "}\n"
+            "print store(10);\n",
+            "10\n"
+        ));
+    END_TEST
+
+    START_TEST(Removes dead globals)
+        const char* source =
+            "var unused = \"never read\";\n"
+            "var used = 1;\n"
+            "print used;\n";
+
+        ObjFunction* optimized = compile("script", source, OPTIMIZE_ALL);
+        ObjFunction* plain     = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(optimized->chunk.count < plain->chunk.count);
+        CHECK_TRUE(optimized_output_equals(source, "1\n"));
+    END_TEST
+
+    START_TEST(Inlines calls to small local functions)
+        const char* source =
+            "fun outer(n) {\n"
+            "    fun twice(x) {\n"
+            "        var y = x * 2;\n"
+            "        if (y > 10) return y - 1;\n"
+            "        return y;\n"
+            "    }\n"
+            "    fun pick(a, b) {\n"
+            "        if (a < b) return a;\n"
+            "        return b;\n"
+            "    }\n"
+            "    var total = 0;\n"
+            "    var i = 0;\n"
+            "    while (i < n) {\n"
+            "        total = total + twice(i) + pick(i, 3);\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    return total + twice(pick(n, 4));\n"
+            "}\n"
+            "print outer(10);\n"
+            "print outer(2000);\n";
+
+        ObjFunction* plain   = compile("script", source, OPTIMIZE_NONE);
+        ObjFunction* inlined = compile("script", source, OPTIMIZE_INLINE_CALLS);
+        CHECK_TRUE(chunk_contains(&find_function(plain, "outer")->chunk, OP_CALL));
+        CHECK_TRUE(!chunk_contains(&find_function(inlined, "outer")->chunk, OP_CALL));
+        CHECK_TRUE(!chunk_contains(&find_function(inlined, "outer")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(optimized_output_equals(source, "118\n4002008\n"));
+        CHECK_TRUE(tiered_output_equals(source, "118\n4002008\n"));
+    END_TEST
+
+    START_TEST(Keeps calls to local functions that escape)
+        // `inc` is inlined before `h` is seen, and put back after.
+        const char* source =
+            "fun keep(n) {\n"
+            "    fun inc(x) { return x + 1; }\n"
+            "    var total = inc(n);\n"
+            "    var h = inc;\n"
+            "    return total + inc(n) + h(n);\n"
+            "}\n"
+            "fun swap(n) {\n"
+            "    fun inc(x) { return x + 1; }\n"
+            "    var total = inc(n);\n"
+            "    inc = keep;\n"
+            "    return total + inc(n);\n"
+            "}\n"
+            "print keep(4);\n"
+            "print swap(4);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_ALL);
+        CHECK_TRUE(chunk_contains(&find_function(script, "keep")->chunk, OP_CALL));
+        CHECK_TRUE(find_function(script, "keep")->chunk.inlined_count == 0);
+        CHECK_TRUE(find_function(script, "swap")->chunk.inlined_count == 0);
+        CHECK_TRUE(optimized_output_equals(source, "15\n20\n"));
+    END_TEST
+
+    START_TEST(Keeps calls with the wrong number of arguments)
+        const char* source =
+            "fun wrong(n) {\n"
+            "    fun inc(x) { return x + 1; }\n"
+            "    return inc(n, n);\n"
+            "}\n"
+            "print wrong(1);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_ALL);
+        CHECK_TRUE(chunk_contains(&find_function(script, "wrong")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(run_script(source, OPTIMIZE_ALL) == NULL);
+    END_TEST
+
+    START_TEST(Errors in inlined functions show their frames)
+        // `middle` and `broken` are inlined into `outer`, but the traces are
+        // the same as without.
+        const char* functions =
+            "fun boom(x) {\n"
+            "    return missing + x;\n"
+            "}\n"
+            "fun outer(n) {\n"
+            "    fun middle(x) {\n"
+            "        var y = x + 1;\n"
+            "        return boom(y) + 1;\n"
+            "    }\n"
+            "    fun broken(x) {\n"
+            "        var y = x + 2;\n"
+            "        return missing + y;\n"
+            "    }\n"
+            "    if (n > 0) return middle(n) + 1;\n"
+            "    return broken(n) + 1;\n"
+            "}\n";
+        const char* calls[]    = { "print outer(1);\n", "print outer(0);\n" };
+        const char* expected[] = { "fun middle(_)", "Error in 'broken'" };
+
+        for (int i = 0; i < 2; ++i) {
+            char source[1024];
+            snprintf(source, sizeof(source), "%s%s", functions, calls[i]);
+            ObjFunction* script = compile("script", source, OPTIMIZE_ALL);
+            CHECK_TRUE(find_function(script, "outer")->chunk.inlined_count == 2);
+
+            char* plain   = error_trace(source, OPTIMIZE_NONE);
+            char* inlined = error_trace(source, OPTIMIZE_ALL);
+            CHECK_TRUE(strcmp(plain, inlined) == 0);
+            CHECK_TRUE(strstr(inlined, expected[i]) != NULL);
+            free(plain);
+            free(inlined);
+        }
+    END_TEST
+
+TEST_SUIT_END
@@ -0,0 +1,193 @@
+#include "test.h"
+#include "script.h"
+#include "scheduler.h"
+
+#include <pthread.h>
+
+
+#define DEQUE_TEST_TASKS   20000
+#define DEQUE_TEST_THIEVES 3
+
+static Task deque_test_tasks[DEQUE_TEST_TASKS];
+static int  deque_test_taken[DEQUE_TEST_TASKS];
+static bool deque_test_done;
+
+static void deque_test_count(Task* task) {
+    __atomic_fetch_add(&deque_test_taken[task - deque_test_tasks], 1, __ATOMIC_RELAXED);
+}
+
+static void* deque_test_thief(void* argument) {
+    Deque* deque = argument;
+    while (!__atomic_load_n(&deque_test_done, __ATOMIC_ACQUIRE)) {
+        Task* task = deque_steal(deque);
+        if (task != NULL)
+            deque_test_count(task);
+    }
+    return NULL;
+}
+
+
+TEST_SUIT_START(scheduler)
+
+    START_TEST(Deque takes from the bottom and steals from the top)
+        static Deque deque;
+        Task tasks[3];
+        CHECK_TRUE(deque_take(&deque)  == NULL);
+        CHECK_TRUE(deque_steal(&deque) == NULL);
+
+        for (int i = 0; i < 3; ++i)
+            CHECK_TRUE(deque_push(&deque, &tasks[i]));
+        CHECK_TRUE(deque_take(&deque)  == &tasks[2]);
+        CHECK_TRUE(deque_steal(&deque) == &tasks[0]);
+        CHECK_TRUE(deque_take(&deque)  == &tasks[1]);
+        CHECK_TRUE(deque_take(&deque)  == NULL);
+        CHECK_TRUE(deque_steal(&deque) == NULL);
+    END_TEST
+
+    START_TEST(Deque is bounded)
+        static Deque deque;
+        Task task;
+        for (int i = 0; i < SCHEDULER_DEQUE_SIZE; ++i)
+            CHECK_TRUE(deque_push(&deque, &task));
+        CHECK_TRUE(!deque_push(&deque, &task));
+        CHECK_TRUE(deque_steal(&deque) == &task);
+        CHECK_TRUE(deque_push(&deque, &task));
+    END_TEST
+
+    START_TEST(Deque hands out each task once under contention)
+        static Deque deque;
+        pthread_t thieves[DEQUE_TEST_THIEVES];
+        for (int i = 0; i < DEQUE_TEST_THIEVES; ++i)
+            pthread_create(&thieves[i], NULL, deque_test_thief, &deque);
+
+        // The owner pushes in bursts and takes some back, so the last
+        // task is often raced for.
+        int pushed = 0;
+        while (pushed < DEQUE_TEST_TASKS) {
+            for (int i = 0; i < 7 && pushed < DEQUE_TEST_TASKS; ++i) {
+                if (deque_push(&deque, &deque_test_tasks[pushed]))
+                    ++pushed;
+            }
+            for (int i = 0; i < 3; ++i) {
+                Task* task = deque_take(&deque);
+                if (task != NULL)
+                    deque_test_count(task);
+            }
+        }
+        for (Task* task = deque_take(&deque); task != NULL; task = deque_take(&deque))
+            deque_test_count(task);
+
+        __atomic_store_n(&deque_test_done, true, __ATOMIC_RELEASE);
+        for (int i = 0; i < DEQUE_TEST_THIEVES; ++i)
+            pthread_join(thieves[i], NULL);
+
+        int wrong = 0;
+        for (int i = 0; i < DEQUE_TEST_TASKS; ++i)
+            wrong += deque_test_taken[i] != 1;
+        CHECK_EQ(wrong, 0);
+    END_TEST
+
+    START_TEST(Spawn and join)
+        CHECK_TRUE(output_equals(run_script(
+            "fun count(n) {\n"
+            "    var total = 0;\n"
+            "    var i = 0;\n"
+            "    while (i < n) {\n"
+            "        total = total + i;\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    return total;\n"
+            "}\n"
+            "fun split(n) {\n"
+            "    if (n < 2) { return 1; }\n"
+            "    var a = spawn(split, n - 1);\n"
+            "    var b = spawn(split, n - 2);\n"
+            "    return join(a) + join(b);\n"
+            "}\n"
+            "var a = spawn(count, 1000);\n"
+            "var b = spawn(count, 10);\n"
+            "print join(b);\n"
+            "print join(a);\n"
+            "print join(a) == join(a);\n"
+            "print split(10);\n",
+            OPTIMIZE_ALL), "45\n499500\ntrue\n89\n"));
+    END_TEST
+
+    START_TEST(Tasks get a copy of the globals)
+        CHECK_TRUE(output_equals(run_script(
+            "var x = 1;\n"
+            "var name = \"abc\";\n"
+            "fun bump() {\n"
+            "    x = x + 1;\n"
+            "    return name;\n"
+            "}\n"
+            "var task = spawn(bump);\n"
+            "print join(task);\n"
+            "print x;\n",
+            OPTIMIZE_ALL), "\"abc\"\n1\n"));
+    END_TEST
+
+    START_TEST(Calling a global closure in a task fails)
+        // Closures aren't copied to the globals of a task, so the task
+        // fails on an undefined global and so does the join.
+        CHECK_TRUE(run_script(
+            "fun make() {\n"
+            "    var x = 1;\n"
+            "    fun read() { return x; }\n"
+            "    return read;\n"
+            "}\n"
+            "var counter = make();\n"
+            "fun call() { return counter(); }\n"
+            "print counter();\n"
+            "print join(spawn(call));\n",
+            OPTIMIZE_ALL) == NULL);
+    END_TEST
+
+    START_TEST(Tasks see the globals as they were spawned)
+        // Each task changes its own copy of the array, and the last one
+        // sees the change made before it was spawned.
+        CHECK_TRUE(output_equals(run_script(
+            "var data = range(4);\n"
+            "fun bump(k) {\n"
+            "    set(data, 0, get(data, 0) + k);\n"
+            "    return sum(data);\n"
+            "}\n"
+            "var a = spawn(bump, 10);\n"
+            "var b = spawn(bump, 20);\n"
+            "set(data, 3, 100);\n"
+            "var c = spawn(bump, 30);\n"
+            "print join(a);\n"
+            "print join(b);\n"
+            "print join(c);\n"
+            "print sum(data);\n",
+            OPTIMIZE_ALL), "16\n26\n133\n103\n"));
+    END_TEST
+
+    START_TEST(Joined tasks keep only their result)
+        const char* source =
+            "var data = range(1000);\n"
+            "fun pick(values, k) {\n"
+            "    return get(values, k) + get(data, k);\n"
+            "}\n"
+            "var i = 0;\n"
+            "var total = 0;\n"
+            "while (i < 100) {\n"
+            "    total = total + join(spawn(pick, data, i));\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "var last = spawn(pick, data, 7);\n"
+            "print join(last) + total;\n";
+
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, compile("script", source, OPTIMIZE_ALL), source), "9914\n"));
+        Value last;
+        CHECK_TRUE(table_get(&vm->globals, SLICE("last"), &last) && IS_TASK(last));
+        Task* task = AS_TASK(AS_OBJ(last))->task;
+        CHECK_TRUE(task->state == TASK_DONE);
+        CHECK_TRUE(task->globals == NULL && task->args == NULL && task->objects == NULL);
+        // Only the handle in the globals holds it.
+        CHECK_EQ(task->references, 1);
+        vm_destroy(vm);
+    END_TEST
+
+TEST_SUIT_END
@@ -20,12 +20,12 @@ TEST_SUIT_START(table)
 
     START_TEST(Add and check they exist)
         Table table = table_make();
-        table_add(&table, SLICE("a"), I64_VALUE(0));
-        table_add(&table, SLICE("b"), I64_VALUE(1));
-        table_add(&table, SLICE("c"), I64_VALUE(2));
-        table_add(&table, SLICE("d"), I64_VALUE(3));
-        table_add(&table, SLICE("e"), I64_VALUE(4));
-        table_add(&table, SLICE("f"), I64_VALUE(5));
+        table_add(&table, SLICE("a"), MAKE_I64(0));
+        table_add(&table, SLICE("b"), MAKE_I64(1));
+        table_add(&table, SLICE("c"), MAKE_I64(2));
+        table_add(&table, SLICE("d"), MAKE_I64(3));
+        table_add(&table, SLICE("e"), MAKE_I64(4));
+        table_add(&table, SLICE("f"), MAKE_I64(5));
 
         CHECK_EQ(table.count, 6);
 
@@ -40,12 +40,12 @@ TEST_SUIT_START(table)
 
     START_TEST(Add and check other dont exist)
         Table table = table_make();
-        table_add(&table, SLICE("a"), I64_VALUE(0));
-        table_add(&table, SLICE("b"), I64_VALUE(1));
-        table_add(&table, SLICE("c"), I64_VALUE(2));
-        table_add(&table, SLICE("d"), I64_VALUE(3));
-        table_add(&table, SLICE("e"), I64_VALUE(4));
-        table_add(&table, SLICE("f"), I64_VALUE(5));
+        table_add(&table, SLICE("a"), MAKE_I64(0));
+        table_add(&table, SLICE("b"), MAKE_I64(1));
+        table_add(&table, SLICE("c"), MAKE_I64(2));
+        table_add(&table, SLICE("d"), MAKE_I64(3));
+        table_add(&table, SLICE("e"), MAKE_I64(4));
+        table_add(&table, SLICE("f"), MAKE_I64(5));
 
         CHECK_EQ(table.count, 6);
 
@@ -58,9 +58,9 @@ TEST_SUIT_START(table)
 
     START_TEST(Add and remove)
         Table table = table_make();
-        table_add(&table, SLICE("a"), I64_VALUE(0));
-        table_add(&table, SLICE("b"), I64_VALUE(1));
-        table_add(&table, SLICE("c"), I64_VALUE(2));
+        table_add(&table, SLICE("a"), MAKE_I64(0));
+        table_add(&table, SLICE("b"), MAKE_I64(1));
+        table_add(&table, SLICE("c"), MAKE_I64(2));
 
         CHECK_EQ(table.count, 3);
 
@@ -87,7 +87,7 @@ TEST_SUIT_START(table)
         const int size = 1000000;
         for (int i = 0; i < size; ++i) {
             Slice key = generate_key(i);
-            table_add(&table, key, I64_VALUE(i));
+            table_add(&table, key, MAKE_I64(i));
         }
 
         CHECK_EQ(table.count, size);
@@ -0,0 +1,102 @@
+#include "test.h"
+#include "script.h"
+
+
+TEST_SUIT_START(tail_calls)
+
+    START_TEST(Self recursion runs deeper than the frame limit)
+        const char* source =
+            "fun count(n, total) {\n"
+            "    if (n == 0) return total;\n"
+            "    return count(n - 1, total + 2);\n"
+            "}\n"
+            "print count(100000, 0);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&find_function(script, "count")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(100000 > VM_FRAMES_MAX);
+        CHECK_TRUE(tiered_output_equals(source, "200000\n"));
+    END_TEST
+
+    START_TEST(Recursion that is not in tail position still overflows)
+        const char* source =
+            "fun count(n) {\n"
+            "    if (n == 0) return 0;\n"
+            "    return count(n - 1) + 1;\n"
+            "}\n"
+            "print count(100000);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(!chunk_contains(&find_function(script, "count")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(run_script(source, OPTIMIZE_NONE) == NULL);
+    END_TEST
+
+    START_TEST(Mutual recursion runs deeper than the frame limit)
+        const char* source =
+            "fun is_even(n) {\n"
+            "    if (n == 0) return true;\n"
+            "    return is_odd(n - 1);\n"
+            "}\n"
+            "fun is_odd(n) {\n"
+            "    if (n == 0) return false;\n"
+            "    return is_even(n - 1);\n"
+            "}\n"
+            "print is_even(100000);\n"
+            "print is_odd(100001);\n"
+            "print is_odd(100000);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&find_function(script, "is_even")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(chunk_contains(&find_function(script, "is_odd")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(tiered_output_equals(source, "true\ntrue\nfalse\n"));
+    END_TEST
+
+    START_TEST(The path of or that skips the call still returns)
+        const char* source =
+            "fun reach(n, done) {\n"
+            "    if (n == 0) return true;\n"
+            "    return done or reach(n - 1, done);\n"
+            "}\n"
+            "print reach(100000, false);\n"
+            "print reach(100000, true);\n"
+            "print reach(3, true) and reach(3, false);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&find_function(script, "reach")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(tiered_output_equals(source, "true\ntrue\ntrue\n"));
+    END_TEST
+
+    START_TEST(Natives and closures in tail position are ordinary calls)
+        const char* source =
+            "var square_root = sqrt;\n"
+            "fun root(x) {\n"
+            "    return square_root(x);\n"
+            "}\n"
+            "fun adder(k) {\n"
+            "    fun add(x) { return x + k; }\n"
+            "    return add;\n"
+            "}\n"
+            "var add_two = adder(2);\n"
+            "fun apply(x) {\n"
+            "    return add_two(x);\n"
+            "}\n"
+            "fun twice(x) {\n"
+            "    return apply(apply(x));\n"
+            "}\n"
+            "print root(16.0);\n"
+            "print twice(1);\n"
+            "var i = 0;\n"
+            "var sum = 0;\n"
+            "while (i < 100) {\n"
+            "    sum = sum + twice(i);\n"
+            "    i = i + 1;\n"
+            "}\n"
+            "print sum;\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_NONE);
+        CHECK_TRUE(chunk_contains(&find_function(script, "root")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(chunk_contains(&find_function(script, "apply")->chunk, OP_TAIL_CALL));
+        CHECK_TRUE(tiered_output_equals(source, "4\n5\n5350\n"));
+    END_TEST
+
+TEST_SUIT_END
@@ -0,0 +1,139 @@
+#include "test.h"
+#include "script.h"
+
+
+// Calls `step` `count` times from a loop in the script.
+static char* step_source(int count) {
+    const char* format =
+        "fun step(x) {\n"
+        "    var y = x + 1;\n"
+        "    y = y - 2;\n"
+        "    y = y + x;\n"
+        "    if (y < x) return 0;\n"
+        "    if (y > 100) return 100;\n"
+        "    if (x < 10) return x;\n"
+        "    return y;\n"
+        "}\n"
+        "var i = 0;\n"
+        "var sum = 0;\n"
+        "while (i < %d) {\n"
+        "    sum = sum + step(i);\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "print sum;\n";
+    static char buffer[512];
+    snprintf(buffer, sizeof(buffer), format, count);
+    return buffer;
+}
+
+TEST_SUIT_START(tiers)
+
+    START_TEST(Functions are promoted after enough calls)
+        const char* source = step_source(VM_TIER_UP_CALLS - 1);
+        ObjFunction* script = compile("script", source, OPTIMIZE_TIER_0);
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, script, source), "3664\n"));
+        CHECK_TRUE(find_function(script, "step")->optimized == NULL);
+        vm_destroy(vm);
+
+        source = step_source(VM_TIER_UP_CALLS);
+        script = compile("script", source, OPTIMIZE_TIER_0);
+        vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, script, source), "3764\n"));
+        CHECK_TRUE(find_function(script, "step")->optimized != NULL);
+        vm_destroy(vm);
+    END_TEST
+
+    START_TEST(Promoted functions run superinstructions)
+        const char* source = step_source(200);
+        ObjFunction* script = compile("script", source, OPTIMIZE_TIER_0);
+        ObjFunction* step   = find_function(script, "step");
+        const u8 superinstructions[] = {
+            OP_STORE_LOCAL, OP_ADD_CONSTANT, OP_SUBTRACT_CONSTANT, OP_LESS_CONSTANT,
+            OP_GREATER_CONSTANT, OP_ADD_LOCAL, OP_LESS_LOCAL,
+        };
+
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, script, source), "17364\n"));
+        bool found = step->optimized != NULL;
+        for (int i = 0; found && i < (int) (sizeof(superinstructions) / sizeof(superinstructions[0])); ++i)
+            found = chunk_contains(step->optimized, superinstructions[i]) && !chunk_contains(&step->chunk, superinstructions[i]);
+        CHECK_TRUE(found);
+        vm_destroy(vm);
+
+        CHECK_TRUE(tiered_output_equals(source, "17364\n"));
+    END_TEST
+
+    START_TEST(A frame moves to tier 1 in the middle of its loop)
+        const char* source =
+            "fun spin(n) {\n"
+            "    var i = 0;\n"
+            "    var total = 0;\n"
+            "    while (i < n) {\n"
+            "        var half = i / 2;\n"
+            "        total = total + half;\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    return total;\n"
+            "}\n"
+            "print spin(5000);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_TIER_0);
+        ObjFunction* spin   = find_function(script, "spin");
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, script, source), "6247500\n"));
+        CHECK_TRUE(spin->call_count == 1);
+        CHECK_TRUE(spin->optimized != NULL);
+        vm_destroy(vm);
+
+        CHECK_TRUE(tiered_output_equals(source, "6247500\n"));
+    END_TEST
+
+    START_TEST(Loops just under and over the back edge limit)
+        char source[256];
+        const char* format =
+            "fun spin(n) {\n"
+            "    var i = 0;\n"
+            "    while (i < n) i = i + 1;\n"
+            "    return i;\n"
+            "}\n"
+            "print spin(%d);\n";
+        for (int count = VM_TIER_UP_BACK_EDGES - 1; count <= VM_TIER_UP_BACK_EDGES + 1; ++count) {
+            snprintf(source, sizeof(source), format, count);
+            char expected[32];
+            snprintf(expected, sizeof(expected), "%d\n", count);
+
+            ObjFunction* script = compile("script", source, OPTIMIZE_TIER_0);
+            VM* vm = vm_create(NULL);
+            CHECK_TRUE(output_equals(run_on_vm(vm, script, source), expected));
+            CHECK_TRUE((find_function(script, "spin")->optimized != NULL) == (count >= VM_TIER_UP_BACK_EDGES));
+            vm_destroy(vm);
+        }
+    END_TEST
+
+    START_TEST(Frames in tier 0 move over after a deeper call promotes the function)
+        // The outer frames start in tier 0, and get to their loops after the
+        // inner calls have promoted the function.
+        const char* source =
+            "fun walk(n) {\n"
+            "    if (n > 0) walk(n - 1);\n"
+            "    var i = 0;\n"
+            "    var total = 0;\n"
+            "    while (i < 4) {\n"
+            "        total = total + i;\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    return total;\n"
+            "}\n"
+            "print walk(200);\n";
+
+        ObjFunction* script = compile("script", source, OPTIMIZE_TIER_0);
+        VM* vm = vm_create(NULL);
+        CHECK_TRUE(output_equals(run_on_vm(vm, script, source), "6\n"));
+        CHECK_TRUE(find_function(script, "walk")->optimized != NULL);
+        vm_destroy(vm);
+
+        CHECK_TRUE(tiered_output_equals(source, "6\n"));
+    END_TEST
+
+TEST_SUIT_END